@@ -301,22 +301,25 @@ static void generate_node(StringBuilder *sb, ASTNode *node, int indent) {
             }
             break;
             
-        case AST_VAR_DECL:
+        case AST_VAR_DECL: {
             indent_code(sb, indent);
-            if (node->data_type == TYPE_STRING) {
+            // Untyped declarations take the initializer's type
+            DataType type = node->data_type;
+            if (type == TYPE_UNKNOWN && node->right) type = semantic_infer_type(node->right);
+            if (type == TYPE_STRING) {
                 sb_append(sb, "char *%s", node->value ? node->value : "var");
                 if (node->right) {
                     sb_append(sb, " = sub_strdup(");
                     generate_expression(sb, node->right);
                     sb_append(sb, ")");
                 }
-            } else if (node->data_type == TYPE_BOOL) {
+            } else if (type == TYPE_BOOL) {
                 sb_append(sb, "bool %s", node->value ? node->value : "var");
                 if (node->right) {
                     sb_append(sb, " = ");
                     generate_expression(sb, node->right);
                 }
-            } else if (node->data_type == TYPE_FLOAT) {
+            } else if (type == TYPE_FLOAT) {
                 sb_append(sb, "double %s", node->value ? node->value : "var");
                 if (node->right) {
                     sb_append(sb, " = ");
@@ -331,6 +334,7 @@ static void generate_node(StringBuilder *sb, ASTNode *node, int indent) {
             }
             sb_append(sb, ";\n");
             break;
+        }
             
         case AST_CONST_DECL:
             indent_code(sb, indent);
@@ -149,6 +149,8 @@ static void generate_expr_cpp(StringBuilder *sb, ASTNode *node, CPPCodegenOption
         case AST_LITERAL:
             if (node->data_type == TYPE_STRING && options->use_std_string) {
                 sb_append(sb, "std::string(\"%s\")", node->value ? node->value : "");
+            } else if (node->data_type == TYPE_STRING) {
+                sb_append(sb, "\"%s\"", node->value ? node->value : "");
             } else {
                 sb_append(sb, "%s", node->value ? node->value : "nullptr");
             }
@@ -70,6 +70,17 @@ static void sb_append(StringBuilder *sb, const char *fmt, ...) {
     va_end(args);
 }
 
+/* A literal; string literal text goes between double quotes */
+static void sb_append_literal(StringBuilder *sb, const ASTNode *node, const char *none) {
+    if (!node->value) {
+        sb_append(sb, "%s", none);
+    } else if (node->data_type == TYPE_STRING) {
+        sb_append(sb, "\"%s\"", node->value);
+    } else {
+        sb_append(sb, "%s", node->value);
+    }
+}
+
 static char* sb_to_string(StringBuilder *sb) {
     if (!sb) return NULL;
     char *result = strdup(sb->buffer);
@@ -133,7 +144,7 @@ static void generate_expr_python(StringBuilder *sb, ASTNode *node) {
     
     switch (node->type) {
         case AST_LITERAL:
-            sb_append(sb, "%s", node->value ? node->value : "None");
+            sb_append_literal(sb, node, "None");
             break;
         case AST_IDENTIFIER:
             sb_append(sb, "%s", node->value ? node->value : "var");
@@ -316,7 +327,7 @@ static void generate_expr_js(StringBuilder *sb, ASTNode *node) {
     
     switch (node->type) {
         case AST_LITERAL:
-            sb_append(sb, "%s", node->value ? node->value : "null");
+            sb_append_literal(sb, node, "null");
             break;
         case AST_IDENTIFIER:
             sb_append(sb, "%s", node->value ? node->value : "var");
@@ -503,7 +514,7 @@ static void generate_expr_java(StringBuilder *sb, ASTNode *node) {
     
     switch (node->type) {
         case AST_LITERAL:
-            sb_append(sb, "%s", node->value ? node->value : "null");
+            sb_append_literal(sb, node, "null");
             break;
         case AST_IDENTIFIER:
             sb_append(sb, "%s", node->value ? node->value : "var");
@@ -663,7 +674,7 @@ char* codegen_java(ASTNode *ast, const char *source) {
 static void generate_expr_swift(StringBuilder *sb, ASTNode *node) {
     if (!node) return;
     switch (node->type) {
-        case AST_LITERAL: sb_append(sb, "%s", node->value ? node->value : "nil"); break;
+        case AST_LITERAL: sb_append_literal(sb, node, "nil"); break;
         case AST_IDENTIFIER: sb_append(sb, "%s", node->value ? node->value : "var"); break;
         case AST_BINARY_EXPR:
             sb_append(sb, "("); generate_expr_swift(sb, node->left);
@@ -732,7 +743,7 @@ char* codegen_swift(ASTNode *ast, const char *source) {
 static void generate_expr_kotlin(StringBuilder *sb, ASTNode *node) {
     if (!node) return;
     switch (node->type) {
-        case AST_LITERAL: sb_append(sb, "%s", node->value ? node->value : "null"); break;
+        case AST_LITERAL: sb_append_literal(sb, node, "null"); break;
         case AST_IDENTIFIER: sb_append(sb, "%s", node->value ? node->value : "var"); break;
         case AST_BINARY_EXPR:
             sb_append(sb, "("); generate_expr_kotlin(sb, node->left);
@@ -811,7 +822,7 @@ static void generate_expr_ruby(StringBuilder *sb, ASTNode *node) {
 
     switch (node->type) {
         case AST_LITERAL:
-            sb_append(sb, "%s", node->value ? node->value : "nil");
+            sb_append_literal(sb, node, "nil");
             break;
 
         case AST_IDENTIFIER:
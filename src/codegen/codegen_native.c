@@ -4,11 +4,17 @@
    File: codegen_native.c
    ======================================== */
 
+#define _GNU_SOURCE
 #include "codegen_native.h"
+#include "isel_x64.h"
 #include "windows_compat.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 
 /* Assembly code buffer */
 typedef struct {
@@ -81,160 +87,340 @@ NativeFormat codegen_native_get_host_format(void) {
 #endif
 }
 
-/* x86-64 Register allocation */
-static const char* x86_64_get_reg(int reg_num) {
-    static const char *regs[] = {
-        "rax", "rbx", "rcx", "rdx", "rsi", "rdi", 
-        "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
-    };
-    return regs[reg_num % 14];
+/* ---------- x86-64, Intel syntax ----------
+   Every local and vreg has a stack slot (locals first, then vregs, as
+   in codegen_x64.c). Arithmetic, comparisons, branches and array
+   accesses go through the shared instruction selector (isel_x64.h);
+   calls, division and the remaining opcodes are written out here. */
+
+typedef struct {
+    bool need_fail_runtime;    // Some access jumps to __sub_bounds_fail
+    int string_count;          // .LSTR labels defined so far
+} NativeModule;
+
+typedef struct {
+    AsmBuffer *buf;
+    IRFunction *func;
+    NativeModule *module;
+    bool failed;               // An opcode this backend cannot lower
+} NativeFunction;
+
+static int native_slot_offset(NativeFunction *nf, const IRValue *val) {
+    if (val->kind == IR_VAL_VAR) return (val->data.reg_num + 1) * 8;
+    return (nf->func->local_count + val->data.reg_num + 1) * 8;
+}
+
+static X64Operand native_locate(void *backend, const IRValue *val) {
+    NativeFunction *nf = backend;
+    if (val->kind == IR_VAL_CONST) return x64_opnd_imm(val->data.int_val);
+    return x64_opnd_mem(X64_REG_RBP, -native_slot_offset(nf, val));
+}
+
+static void native_emit(void *backend, const char *line) {
+    asm_buffer_append(((NativeFunction*)backend)->buf, "    %s\n", line);
+}
+
+static void native_load(NativeFunction *nf, const IRValue *val, const char *reg) {
+    if (!val) {
+        asm_buffer_append(nf->buf, "    xor %s, %s\n", reg, reg);
+    } else if (val->kind == IR_VAL_CONST) {
+        asm_buffer_append(nf->buf, "    mov %s, %lld\n", reg, (long long)val->data.int_val);
+    } else {
+        asm_buffer_append(nf->buf, "    mov %s, qword ptr [rbp - %d]\n", reg, native_slot_offset(nf, val));
+    }
+}
+
+static void native_store(NativeFunction *nf, const char *reg, const IRValue *dest) {
+    if (!dest) return;
+    asm_buffer_append(nf->buf, "    mov qword ptr [rbp - %d], %s\n", native_slot_offset(nf, dest), reg);
+}
+
+static void native_load_args(NativeFunction *nf, IRInstruction *instr) {
+    static const char *arg_regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+    for (int k = 0; k < instr->arg_count && k < 6; k++) {
+        native_load(nf, instr->args[k], arg_regs[k]);
+    }
+}
+
+static void native_call_args(NativeFunction *nf, IRInstruction *instr) {
+    native_load_args(nf, instr);
+    asm_buffer_append(nf->buf, "    xor eax, eax\n");
+    if (instr->src1 && instr->src1->data.label) {
+        asm_buffer_append(nf->buf, "    call %s\n", instr->src1->data.label);
+    }
+}
+
+/* Read-only string constant (length, bytes, NUL); returns the label
+   number of its first byte */
+static int native_define_string(NativeFunction *nf, const char *text) {
+    int id = nf->module->string_count++;
+    asm_buffer_append(nf->buf, ".section .rodata\n");
+    asm_buffer_append(nf->buf, ".balign 8\n");
+    asm_buffer_append(nf->buf, "    .quad %zu\n", strlen(text));
+    asm_buffer_append(nf->buf, ".LSTR%d:\n", id);
+    asm_buffer_append(nf->buf, "    .string \"");
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') asm_buffer_append(nf->buf, "\\%c", *c);
+        else if (*c < 32 || *c > 126) asm_buffer_append(nf->buf, "\\%03o", *c);
+        else asm_buffer_append(nf->buf, "%c", *c);
+    }
+    asm_buffer_append(nf->buf, "\"\n.section .text\n");
+    return id;
+}
+
+/* Leave for __sub_bounds_fail unless 0 <= index < length; one unsigned
+   compare covers both ends */
+static void native_emit_index_check(NativeFunction *nf, const char *base, const char *index) {
+    asm_buffer_append(nf->buf, "    cmp %s, qword ptr [%s - 8]\n", index, base);
+    asm_buffer_append(nf->buf, "    jae __sub_bounds_fail\n");
+    nf->module->need_fail_runtime = true;
+}
+
+static void native_emit_const_index_check(NativeFunction *nf, const char *base, int64_t index) {
+    asm_buffer_append(nf->buf, "    cmp qword ptr [%s - 8], %lld\n", base, (long long)index);
+    asm_buffer_append(nf->buf, "    jbe __sub_bounds_fail\n");
+    nf->module->need_fail_runtime = true;
+}
+
+/* Opcodes the selector has no rule for */
+static void native_generate_instruction(NativeFunction *nf, IRInstruction *instr) {
+    AsmBuffer *buf = nf->buf;
+    switch (instr->opcode) {
+        case IR_FUNC_START:
+        case IR_FUNC_END:
+        case IR_ALLOC:
+            break;
+
+        case IR_CONST_INT:
+        case IR_MOVE:
+        case IR_LOAD:
+        case IR_STORE:
+            if (!instr->dest) break;
+            native_load(nf, instr->src1, "rax");
+            native_store(nf, "rax", instr->dest);
+            break;
+
+        case IR_DIV:
+        case IR_MOD:
+            native_load(nf, instr->src2, "rcx");
+            native_load(nf, instr->src1, "rax");
+            asm_buffer_append(buf, "    cqo\n");
+            asm_buffer_append(buf, "    idiv rcx\n");
+            native_store(nf, instr->opcode == IR_DIV ? "rax" : "rdx", instr->dest);
+            break;
+
+        case IR_MULHI:
+            native_load(nf, instr->src2, "rcx");
+            native_load(nf, instr->src1, "rax");
+            asm_buffer_append(buf, "    imul rcx\n");
+            native_store(nf, "rdx", instr->dest);
+            break;
+
+        case IR_SHL:
+        case IR_SHR:
+        case IR_SAR:
+            // Variable shift count in cl
+            native_load(nf, instr->src2, "rcx");
+            native_load(nf, instr->src1, "rax");
+            asm_buffer_append(buf, "    %s rax, cl\n", instr->opcode == IR_SHL ? "shl" :
+                                                       instr->opcode == IR_SHR ? "shr" : "sar");
+            native_store(nf, "rax", instr->dest);
+            break;
+
+        case IR_NOT:
+            native_load(nf, instr->src1, "rax");
+            asm_buffer_append(buf, "    test rax, rax\n");
+            asm_buffer_append(buf, "    sete al\n");
+            asm_buffer_append(buf, "    movzx eax, al\n");
+            native_store(nf, "rax", instr->dest);
+            break;
+
+        case IR_LABEL:
+            if (instr->dest && instr->dest->data.label) {
+                asm_buffer_append(buf, "%s:\n", instr->dest->data.label);
+            }
+            break;
+
+        case IR_JUMP:
+            if (instr->dest && instr->dest->data.label) {
+                asm_buffer_append(buf, "    jmp %s\n", instr->dest->data.label);
+            }
+            break;
+
+        case IR_RETURN:
+            native_load(nf, instr->src1, "rax");
+            asm_buffer_append(buf, "    jmp %s_return\n", nf->func->name);
+            break;
+
+        case IR_CALL:
+            // String and growable-array operations live in codegen_x64.c's runtime
+            if (instr->src1 && instr->src1->data.label && strncmp(instr->src1->data.label, "__sub_", 6) == 0) {
+                asm_buffer_append(buf, "    # unsupported: call %s\n", instr->src1->data.label);
+                nf->failed = true;
+                break;
+            }
+            native_call_args(nf, instr);
+            native_store(nf, "rax", instr->dest);
+            break;
+
+        case IR_TAIL_CALL:
+            // Arguments in registers, release our frame and jump: the
+            // callee returns straight to our caller
+            native_load_args(nf, instr);
+            asm_buffer_append(buf, "    mov rsp, rbp\n");
+            asm_buffer_append(buf, "    pop rbp\n");
+            if (instr->src1 && instr->src1->data.label) {
+                asm_buffer_append(buf, "    jmp %s\n", instr->src1->data.label);
+            }
+            break;
+
+        case IR_PRINT:
+            if (instr->src1 && instr->src1->kind == IR_VAL_CONST && instr->src1->type == IR_TYPE_STRING) {
+                // Text: printf("%.*s\n", length, bytes) with the stored length
+                asm_buffer_append(buf, "    lea rdx, [rip + .LSTR%d]\n",
+                                  native_define_string(nf, instr->src1->data.string_val));
+                asm_buffer_append(buf, "    mov rsi, qword ptr [rdx - 8]\n");
+                asm_buffer_append(buf, "    lea rdi, [rip + .LC1]\n");
+                asm_buffer_append(buf, "    xor eax, eax\n");
+                asm_buffer_append(buf, "    call printf@PLT\n");
+                break;
+            }
+            native_load(nf, instr->src1, "rsi");
+            asm_buffer_append(buf, "    lea rdi, [rip + .LC0]\n");
+            asm_buffer_append(buf, "    xor eax, eax\n");
+            asm_buffer_append(buf, "    call printf@PLT\n");
+            break;
+
+        case IR_ALLOC_ARRAY:
+            // calloc(n + 1, 8): the length word, then the elements
+            native_load(nf, instr->src1, "rdi");
+            asm_buffer_append(buf, "    inc rdi\n");
+            asm_buffer_append(buf, "    mov esi, 8\n");
+            asm_buffer_append(buf, "    call calloc@PLT\n");
+            native_load(nf, instr->src1, "rcx");
+            asm_buffer_append(buf, "    mov qword ptr [rax], rcx\n");
+            asm_buffer_append(buf, "    add rax, 8\n");
+            native_store(nf, "rax", instr->dest);
+            break;
+
+        case IR_LOAD_ELEM:
+            native_load(nf, instr->src1, "rax");
+            if (instr->src2 && instr->src2->kind == IR_VAL_CONST &&
+                instr->src2->data.int_val >= 0 && instr->src2->data.int_val <= INT32_MAX / 8) {
+                if (!instr->in_bounds) native_emit_const_index_check(nf, "rax", instr->src2->data.int_val);
+                asm_buffer_append(buf, "    mov rax, qword ptr [rax + %lld]\n",
+                                  (long long)instr->src2->data.int_val * 8);
+            } else {
+                native_load(nf, instr->src2, "rcx");
+                if (!instr->in_bounds) native_emit_index_check(nf, "rax", "rcx");
+                asm_buffer_append(buf, "    mov rax, qword ptr [rax + rcx*8]\n");
+            }
+            native_store(nf, "rax", instr->dest);
+            break;
+
+        case IR_STORE_ELEM:
+            if (instr->arg_count < 1) break;
+            native_load(nf, instr->args[0], "rdx");
+            native_load(nf, instr->src2, "rcx");
+            native_load(nf, instr->src1, "rax");
+            if (!instr->in_bounds) native_emit_index_check(nf, "rax", "rcx");
+            asm_buffer_append(buf, "    mov qword ptr [rax + rcx*8], rdx\n");
+            break;
+
+        default:
+            asm_buffer_append(buf, "    # unsupported: %s\n", ir_opcode_name(instr->opcode));
+            nf->failed = true;
+            break;
+    }
+}
+
+/* Select `instr` (with `kid` folded in) through the shared rule table */
+static bool native_select(const X64IselTarget *target, IRInstruction *instr, IRInstruction *kid) {
+    // Checked element accesses take the generic path, which emits the check
+    if ((instr->opcode == IR_LOAD_ELEM || instr->opcode == IR_STORE_ELEM) && !instr->in_bounds) return false;
+    return x64_isel_generate(target, instr, kid, X64_REG_RAX, NULL);
 }
 
 /* Generate x86-64 assembly from IR */
-static void codegen_x86_64_function(AsmBuffer *buf, IRFunction *func) {
+static bool codegen_x86_64_function(AsmBuffer *buf, NativeModule *module, IRFunction *func) {
+    static const char *param_regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+    NativeFunction nf = { buf, func, module, false };
+
     // Function prologue
-    asm_buffer_append(buf, "\n; Function: %s\n", func->name);
+    asm_buffer_append(buf, "\n# Function: %s\n", func->name);
     asm_buffer_append(buf, "%s:\n", func->name);
     asm_buffer_append(buf, "    push rbp\n");
     asm_buffer_append(buf, "    mov rbp, rsp\n");
-    
-    // Allocate stack space for locals
-    if (func->local_count > 0) {
-        asm_buffer_append(buf, "    sub rsp, %d\n", func->local_count * 8);
+    int frame = ((func->local_count + func->reg_count) * 8 + 15) & ~15;
+    if (frame > 0) {
+        asm_buffer_append(buf, "    sub rsp, %d\n", frame);
     }
-    
-    // Generate code for each instruction
+    for (int i = 0; i < func->param_count && i < 6; i++) {
+        asm_buffer_append(buf, "    mov qword ptr [rbp - %d], %s\n", (i + 1) * 8, param_regs[i]);
+    }
+
+    // rax, rcx and rdx never hold a value across instructions
+    X64IselTarget target = {
+        X64_SYNTAX_INTEL, &nf, native_locate, native_emit,
+        { X64_REG_RAX, X64_REG_RCX, X64_REG_RDX }, 3
+    };
+    int *use_counts = x64_isel_use_counts(func);
+
     IRInstruction *instr = func->instructions;
     while (instr) {
-        switch (instr->opcode) {
-            case IR_FUNC_START:
-            case IR_FUNC_END:
-                // Markers, no code
-                break;
-                
-            case IR_MOVE:
-                if (instr->src1 && instr->dest) {
-                    if (instr->src1->type == IR_TYPE_INT) {
-                        asm_buffer_append(buf, "    mov %s, %lld\n", 
-                            x86_64_get_reg(instr->dest->data.reg_num),
-                            (long long)instr->src1->data.int_val);
-                    }
-                }
-                break;
-                
-            case IR_ADD:
-                if (instr->src1 && instr->src2 && instr->dest) {
-                    // Load operands into registers
-                    if (instr->src1->type == IR_TYPE_INT) {
-                        asm_buffer_append(buf, "    mov rax, %lld\n", 
-                            (long long)instr->src1->data.int_val);
-                    } else {
-                        asm_buffer_append(buf, "    mov rax, %s\n", 
-                            x86_64_get_reg(instr->src1->data.reg_num));
-                    }
-                    
-                    if (instr->src2->type == IR_TYPE_INT) {
-                        asm_buffer_append(buf, "    add rax, %lld\n", 
-                            (long long)instr->src2->data.int_val);
-                    } else {
-                        asm_buffer_append(buf, "    add rax, %s\n", 
-                            x86_64_get_reg(instr->src2->data.reg_num));
-                    }
-                    
-                    asm_buffer_append(buf, "    mov %s, rax\n", 
-                        x86_64_get_reg(instr->dest->data.reg_num));
-                }
-                break;
-                
-            case IR_SUB:
-                // Similar to ADD but with sub instruction
-                if (instr->src1 && instr->src2 && instr->dest) {
-                    asm_buffer_append(buf, "    mov rax, %s\n", 
-                        x86_64_get_reg(instr->src1->data.reg_num));
-                    asm_buffer_append(buf, "    sub rax, %s\n", 
-                        x86_64_get_reg(instr->src2->data.reg_num));
-                    asm_buffer_append(buf, "    mov %s, rax\n", 
-                        x86_64_get_reg(instr->dest->data.reg_num));
-                }
-                break;
-                
-            case IR_MUL:
-                if (instr->src1 && instr->src2 && instr->dest) {
-                    asm_buffer_append(buf, "    mov rax, %s\n", 
-                        x86_64_get_reg(instr->src1->data.reg_num));
-                    asm_buffer_append(buf, "    imul rax, %s\n", 
-                        x86_64_get_reg(instr->src2->data.reg_num));
-                    asm_buffer_append(buf, "    mov %s, rax\n", 
-                        x86_64_get_reg(instr->dest->data.reg_num));
-                }
-                break;
-                
-            case IR_CALL:
-                // Function call (simplified - assumes C calling convention)
-                if (instr->dest && instr->dest->data.string_val) {
-                    // For now, handle print specially
-                    if (strcmp(instr->dest->data.string_val, "print") == 0 ||
-                        strcmp(instr->dest->data.string_val, "printf") == 0) {
-                        // Call printf from libc
-                        if (instr->src1) {
-                            if (instr->src1->type == IR_TYPE_STRING) {
-                                asm_buffer_append(buf, "    lea rdi, [rel .str%d]\n", 0);
-                            } else {
-                                asm_buffer_append(buf, "    mov rdi, %s\n", 
-                                    x86_64_get_reg(instr->src1->data.reg_num));
-                            }
-                        }
-                        asm_buffer_append(buf, "    call printf\n");
-                    } else {
-                        asm_buffer_append(buf, "    call %s\n", instr->dest->data.string_val);
-                    }
-                }
-                break;
-                
-            case IR_RETURN:
-                if (instr->src1) {
-                    if (instr->src1->type == IR_TYPE_INT) {
-                        asm_buffer_append(buf, "    mov rax, %lld\n", 
-                            (long long)instr->src1->data.int_val);
-                    } else {
-                        asm_buffer_append(buf, "    mov rax, %s\n", 
-                            x86_64_get_reg(instr->src1->data.reg_num));
-                    }
-                }
-                break;
-                
-            case IR_LABEL:
-                if (instr->dest && instr->dest->data.label) {
-                    asm_buffer_append(buf, "%s:\n", instr->dest->data.label);
-                }
-                break;
-                
-            case IR_JUMP:
-                if (instr->src1 && instr->src1->data.label) {
-                    asm_buffer_append(buf, "    jmp %s\n", instr->src1->data.label);
-                }
-                break;
-                
-            case IR_JUMP_IF_NOT:
-                if (instr->src1 && instr->src2) {
-                    asm_buffer_append(buf, "    cmp %s, 0\n", 
-                        x86_64_get_reg(instr->src1->data.reg_num));
-                    asm_buffer_append(buf, "    je %s\n", instr->src2->data.label);
-                }
-                break;
-                
-            default:
-                asm_buffer_append(buf, "    ; TODO: opcode %d\n", instr->opcode);
-                break;
+        IRInstruction *next = instr->next;
+        IRInstruction *root = instr;
+        IRInstruction *kid = NULL;
+        if (x64_isel_foldable(instr, next, use_counts) && x64_isel_absorbs(&target, next, instr)) {
+            root = next;
+            kid = instr;
+        }
+        if (!native_select(&target, root, kid)) {
+            root = instr;
+            kid = NULL;
+            if (!native_select(&target, root, NULL)) {
+                native_generate_instruction(&nf, instr);
+                instr = next;
+                continue;
+            }
+        }
+        if (root->opcode != IR_STORE_ELEM && root->opcode != IR_JUMP_IF && root->opcode != IR_JUMP_IF_NOT) {
+            native_store(&nf, "rax", root->dest);
         }
-        
-        instr = instr->next;
+        instr = root->next;
     }
-    
+    free(use_counts);
+
     // Function epilogue
+    asm_buffer_append(buf, "%s_return:\n", func->name);
     asm_buffer_append(buf, "    mov rsp, rbp\n");
     asm_buffer_append(buf, "    pop rbp\n");
     asm_buffer_append(buf, "    ret\n");
+    return !nf.failed;
+}
+
+/* A failed run-time check writes pending output, then the message (in
+   the VM's wording) on stderr, and exits with status 1 */
+static void codegen_x86_64_fail_runtime(AsmBuffer *buf) {
+    static const char message[] = "Runtime error: array index out of range\\n";
+    asm_buffer_append(buf, "\n# Run-time check failures\n");
+    asm_buffer_append(buf, "__sub_bounds_fail:\n");
+    asm_buffer_append(buf, "    lea rbx, [rip + .Lsub_bounds_msg]\n");
+    asm_buffer_append(buf, "    and rsp, -16\n");
+    asm_buffer_append(buf, "    xor edi, edi\n");
+    asm_buffer_append(buf, "    call fflush@PLT\n");
+    asm_buffer_append(buf, "    mov edi, 2\n");
+    asm_buffer_append(buf, "    lea rsi, [rbx + 8]\n");
+    asm_buffer_append(buf, "    mov rdx, qword ptr [rbx]\n");
+    asm_buffer_append(buf, "    call write@PLT\n");
+    asm_buffer_append(buf, "    mov edi, 1\n");
+    asm_buffer_append(buf, "    call exit@PLT\n");
+    asm_buffer_append(buf, ".section .rodata\n");
+    asm_buffer_append(buf, ".balign 8\n");
+    asm_buffer_append(buf, ".Lsub_bounds_msg:\n");
+    asm_buffer_append(buf, "    .quad %d\n", (int)sizeof(message) - 2);
+    asm_buffer_append(buf, "    .ascii \"%s\"\n", message);
+    asm_buffer_append(buf, ".section .text\n");
 }
 
 /* Generate assembly code */
@@ -245,9 +431,11 @@ char* codegen_native_generate_asm(IRModule *module, NativeTarget target) {
     
     // Assembly header
     switch (target) {
-        case NATIVE_TARGET_X86_64:
-            asm_buffer_append(buf, "; SUB Language - Native x86-64 Assembly\n");
-            asm_buffer_append(buf, "; Generated by SUB Compiler\n\n");
+        case NATIVE_TARGET_X86_64: {
+            bool ok = true;
+            asm_buffer_append(buf, "# SUB Language - Native x86-64 Assembly\n");
+            asm_buffer_append(buf, "# Generated by SUB Compiler\n\n");
+            asm_buffer_append(buf, ".intel_syntax noprefix\n");
             
             // Platform-specific directives
 #ifdef __APPLE__
@@ -263,27 +451,38 @@ char* codegen_native_generate_asm(IRModule *module, NativeTarget target) {
             asm_buffer_append(buf, ".type main, @function\n");
 #endif
             
-            // External declarations
-            asm_buffer_append(buf, ".extern printf\n\n");
-            
             // Generate functions
+            NativeModule native = { false, 0 };
             IRFunction *func = module->functions;
             while (func) {
-                codegen_x86_64_function(buf, func);
+                if (!codegen_x86_64_function(buf, &native, func)) ok = false;
                 func = func->next;
             }
+            if (native.need_fail_runtime) codegen_x86_64_fail_runtime(buf);
             
-            // Data section for strings
+            // Data section: print format and string literals
             asm_buffer_append(buf, "\n.section .rodata\n");
+            asm_buffer_append(buf, ".LC0:\n");
+            asm_buffer_append(buf, "    .asciz \"%%ld\\n\"\n");
+            asm_buffer_append(buf, ".LC1:\n");
+            asm_buffer_append(buf, "    .asciz \"%%.*s\\n\"\n");
             for (int i = 0; i < module->string_count; i++) {
                 asm_buffer_append(buf, ".str%d:\n", i);
                 asm_buffer_append(buf, "    .asciz \"%s\"\n", module->string_literals[i]);
             }
-            
+#if defined(__linux__)
+            asm_buffer_append(buf, ".section .note.GNU-stack,\"\",@progbits\n");
+#endif
+            if (!ok) {
+                fprintf(stderr, "Error: IR uses opcodes the Intel-syntax backend cannot lower\n");
+                free(asm_buffer_to_string(buf));
+                return NULL;
+            }
             break;
+        }
             
         default:
-            asm_buffer_append(buf, "; Unsupported target architecture\n");
+            asm_buffer_append(buf, "# Unsupported target architecture\n");
             break;
     }
     
@@ -308,6 +507,7 @@ bool codegen_native_write_executable(const char *filename, const char *machine_c
     // 2. Create sections (.text, .data, .rodata)
     // 3. Set up relocation tables
     // 4. Link with runtime libraries
+    (void)format;
     
     FILE *f = fopen(filename, "wb");
     if (!f) return false;
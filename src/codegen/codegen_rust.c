@@ -88,7 +88,11 @@ static void generate_expr_rust(StringBuilder *sb, ASTNode *node) {
     
     switch (node->type) {
         case AST_LITERAL:
-            sb_append(sb, "%s", node->value ? node->value : "()");
+            if (node->value && node->data_type == TYPE_STRING) {
+                sb_append(sb, "\"%s\"", node->value);
+            } else {
+                sb_append(sb, "%s", node->value ? node->value : "()");
+            }
             break;
         case AST_IDENTIFIER:
             sb_append(sb, "%s", node->value ? node->value : "var");
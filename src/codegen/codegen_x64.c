@@ -6,10 +6,17 @@
 
 #define _GNU_SOURCE
 #include "codegen_x64.h"
+#include "regalloc_x64.h"
+#include "peephole_x64.h"
+#include "isel_x64.h"
+#include "encode_x64.h"
+#include "ir_profile.h"
 #include "windows_compat.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 /* Register names for AT&T syntax (GCC/Clang) */
 static const char* register_names_64[] = {
@@ -29,6 +36,8 @@ X64Context* x64_context_create(FILE *output) {
     ctx->label_counter = 0;
     ctx->string_counter = 0;
     ctx->stack_offset = 0;
+    ctx->rax_vreg = -1;
+    ctx->frame_base = X64_REG_RBP;
     
     // Mark special registers as in use
     ctx->reg_in_use[X64_REG_RSP] = true;
@@ -38,6 +47,7 @@ X64Context* x64_context_create(FILE *output) {
 }
 
 void x64_context_free(X64Context *ctx) {
+    free(ctx->code);
     free(ctx);
 }
 
@@ -81,67 +91,1249 @@ int x64_generate_label(X64Context *ctx) {
     return ctx->label_counter++;
 }
 
+/* ---------- Machine instruction buffer ----------
+   While a function is generated every line goes to ctx->code, so the
+   peephole pass can rewrite it before it reaches the output file. */
+
+static X64MInstr* x64_code_append(X64Context *ctx, X64MInstrKind kind, const char *op) {
+    if (ctx->code_count == ctx->code_capacity) {
+        ctx->code_capacity = ctx->code_capacity ? ctx->code_capacity * 2 : 256;
+        ctx->code = realloc(ctx->code, sizeof(X64MInstr) * ctx->code_capacity);
+    }
+    X64MInstr *mi = &ctx->code[ctx->code_count++];
+    memset(mi, 0, sizeof(X64MInstr));
+    mi->kind = kind;
+    mi->op = strdup(op);
+    return mi;
+}
+
+static char* x64_trim(char *text) {
+    while (*text == ' ' || *text == '\t') text++;
+    size_t len = strlen(text);
+    while (len > 0 && (text[len - 1] == ' ' || text[len - 1] == '\t' || text[len - 1] == '\n')) {
+        text[--len] = '\0';
+    }
+    return text;
+}
+
+/* "mnemonic a, b(c,d), e": operands split on commas outside parentheses */
+static void x64_code_append_insn(X64Context *ctx, char *text) {
+    text = x64_trim(text);
+    char *rest = text + strcspn(text, " \t");
+    if (*rest) *rest++ = '\0';
+    X64MInstr *mi = x64_code_append(ctx, X64_MI_INSN, text);
+    rest = x64_trim(rest);
+    int depth = 0;
+    char *start = rest;
+    for (char *c = rest; *start; c++) {
+        if (*c == '(') depth++;
+        else if (*c == ')') depth--;
+        else if ((*c == ',' && depth == 0 && mi->operand_count < 3) || *c == '\0') {
+            bool last = *c == '\0';
+            *c = '\0';
+            mi->operands[mi->operand_count++] = strdup(x64_trim(start));
+            if (last) break;
+            start = c + 1;
+        }
+    }
+}
+
+static void x64_code_flush(X64Context *ctx) {
+    if (ctx->object && !ctx->object_error[0]) {
+        x64_encode_function(ctx->object, ctx->code, ctx->code_count, ctx->object_error,
+                            sizeof(ctx->object_error));
+    }
+    for (int i = 0; i < ctx->code_count && !ctx->object; i++) {
+        X64MInstr *mi = &ctx->code[i];
+        if (mi->kind == X64_MI_LABEL) {
+            fprintf(ctx->output, "%s:\n", mi->op);
+        } else if (mi->kind == X64_MI_COMMENT) {
+            fprintf(ctx->output, "    # %s\n", mi->op);
+        } else {
+            fprintf(ctx->output, "    %s", mi->op);
+            for (int k = 0; k < mi->operand_count; k++) {
+                fprintf(ctx->output, "%s%s", k ? ", " : " ", mi->operands[k]);
+            }
+            fprintf(ctx->output, "\n");
+        }
+    }
+    for (int i = 0; i < ctx->code_count; i++) {
+        free(ctx->code[i].op);
+        for (int k = 0; k < ctx->code[i].operand_count; k++) free(ctx->code[i].operands[k]);
+    }
+    if (!ctx->object) fprintf(ctx->output, "\n");
+    ctx->code_count = 0;
+}
+
 /* Emit assembly code */
 void x64_emit(X64Context *ctx, const char *format, ...) {
+    char line[512];
     va_list args;
     va_start(args, format);
-    fprintf(ctx->output, "    ");
-    vfprintf(ctx->output, format, args);
-    fprintf(ctx->output, "\n");
+    vsnprintf(line, sizeof(line), format, args);
     va_end(args);
+    if (ctx->buffering) {
+        x64_code_append_insn(ctx, line);
+    } else {
+        fprintf(ctx->output, "    %s\n", line);
+    }
 }
 
 void x64_emit_comment(X64Context *ctx, const char *comment) {
-    fprintf(ctx->output, "    # %s\n", comment);
+    if (ctx->buffering) x64_code_append(ctx, X64_MI_COMMENT, comment);
+    else fprintf(ctx->output, "    # %s\n", comment);
 }
 
 void x64_emit_label(X64Context *ctx, const char *label) {
-    fprintf(ctx->output, "%s:\n", label);
+    if (ctx->buffering) x64_code_append(ctx, X64_MI_LABEL, label);
+    else fprintf(ctx->output, "%s:\n", label);
 }
 
 /* Generate program prologue */
 static void x64_generate_prologue(X64Context *ctx) {
+    if (ctx->object) {
+        if (!ctx->static_runtime) elf_declare_global(ctx->object, "main");
+        return;
+    }
     fprintf(ctx->output, "# Generated by SUB Native Compiler\n");
     fprintf(ctx->output, "# Architecture: x86-64\n\n");
     
+    fprintf(ctx->output, ".section .data\n");
+    fprintf(ctx->output, ".section .text\n");
+    fprintf(ctx->output, ".global %s\n\n", ctx->static_runtime ? "_start" : "main");
+}
+
+/* ---------- Static runtime ---------- */
+
+/* With --static-runtime the program carries its own entry point and
+   allocator, written against raw Linux syscalls: __sub_calloc bump
+   allocates zeroed memory from mmap'd chunks (nothing is ever freed) and
+   stops with an out-of-memory error when a size overflows or mmap
+   fails, and _start calls main and exits with its result. */
+static const char *const x64_runtime_start[] = {
+    "_start:",
+    "xorl %ebp, %ebp",
+    "call main",
+    "movq %rax, %rdi",
+    "movl $231, %eax",              // exit_group
+    "syscall",
+    NULL
+};
+
+static const char *const x64_runtime_calloc[] = {
+    "__sub_calloc:",
+    "movq %rdi, %rax",
+    "imulq %rsi, %rax",
+    "jo __sub_memory_fail",
+    "movq %rax, %rcx",
+    "shrq $46, %rcx",               // Negative or 64 TiB and up: never mappable
+    "jnz __sub_memory_fail",
+    "addq $15, %rax",
+    "andq $-16, %rax",
+    "movq .Lsub_heap_next(%rip), %rdx",
+    "leaq (%rdx,%rax), %rcx",
+    "cmpq .Lsub_heap_end(%rip), %rcx",
+    "ja .Lsub_calloc_map",
+    "movq %rcx, .Lsub_heap_next(%rip)",
+    "movq %rdx, %rax",
+    "ret",
+    // New chunk: at least 1 MiB, whole pages
+    ".Lsub_calloc_map:",
+    "pushq %rax",
+    "movl $1048576, %esi",
+    "cmpq %rsi, %rax",
+    "jbe .Lsub_calloc_chunk",
+    "movq %rax, %rsi",
+    ".Lsub_calloc_chunk:",
+    "addq $4095, %rsi",
+    "andq $-4096, %rsi",
+    "xorl %edi, %edi",
+    "movl $3, %edx",                // PROT_READ | PROT_WRITE
+    "movl $34, %r10d",              // MAP_PRIVATE | MAP_ANONYMOUS
+    "movq $-1, %r8",
+    "xorl %r9d, %r9d",
+    "movl $9, %eax",                // mmap
+    "syscall",
+    "popq %rcx",
+    "cmpq $-4096, %rax",
+    "ja __sub_memory_fail",
+    "leaq (%rax,%rsi), %rdx",
+    "movq %rdx, .Lsub_heap_end(%rip)",
+    "leaq (%rax,%rcx), %rdx",
+    "movq %rdx, .Lsub_heap_next(%rip)",
+    "ret",
+    NULL
+};
+
+/* __sub_prof_write dumps the profile area (header and counters) to the
+   profile path when an instrumented main returns. It preserves every
+   register so the return value and allocated registers survive. */
+static const char *const x64_runtime_profile[] = {
+    "__sub_prof_write:",
+    "pushq %rax",
+    "pushq %rcx",
+    "pushq %rdx",
+    "pushq %rsi",
+    "pushq %rdi",
+    "pushq %r11",
+    "leaq .Lsub_prof_path(%rip), %rdi",
+    "movl $577, %esi",              // O_WRONLY | O_CREAT | O_TRUNC
+    "movl $420, %edx",              // 0644
+    "movl $2, %eax",                // open
+    "syscall",
+    "testq %rax, %rax",
+    "js .Lsub_prof_done",
+    "movq %rax, %rdi",
+    "leaq .Lsub_prof(%rip), %rsi",
+    "movq .Lsub_prof+16(%rip), %rdx",
+    "leaq 24(,%rdx,8), %rdx",
+    "movl $1, %eax",                // write(fd, area, 24 + 8 * counters)
+    "syscall",
+    "movl $3, %eax",                // close
+    "syscall",
+    ".Lsub_prof_done:",
+    "popq %r11",
+    "popq %rdi",
+    "popq %rsi",
+    "popq %rdx",
+    "popq %rcx",
+    "popq %rax",
+    "ret",
+    NULL
+};
+
+/* ---------- Output runtime ---------- */
+
+/* print() in every mode: text is collected in a 64 KiB buffer (mapped on
+   first use) and written to fd 1 when it fills, when the entry function
+   returns and before a runtime error. When stdout is a terminal, found
+   with TCGETS on the first line, every line is written at once.
+
+   __sub_format_int writes a number's decimal text backwards, two digits
+   per step through a table of the pairs "00".."99", working on the
+   magnitude as unsigned so INT64_MIN needs no special case.
+   __sub_print_str copies a length-prefixed string and its newline. Both
+   print routines may clobber any caller-saved register. __sub_flush
+   preserves every register: it runs on the way out of main. */
+
+/* RDI = value, RSI = end of the text; returns its first byte. Uses no
+   stack and clobbers RDX, RSI, R8, R10 and R11. */
+static const char *const x64_runtime_format_int[] = {
+    "__sub_format_int:",
+    "movq %rdi, %r8",
+    "testq %r8, %r8",
+    "jns .Lsub_format_int_pairs",
+    "negq %r8",
+    ".Lsub_format_int_pairs:",
+    "leaq .Lsub_digit_pairs(%rip), %r11",
+    "movabsq $2951479051793528259, %r10", // 2^66 / 100, rounded up
+    ".Lsub_format_int_pair:",
+    "cmpq $100, %r8",
+    "jb .Lsub_format_int_last",
+    "movq %r8, %rax",
+    "shrq $2, %rax",
+    "mulq %r10",
+    "shrq $2, %rdx",                // quotient
+    "imulq $100, %rdx, %rax",
+    "subq %rax, %r8",               // remainder
+    "movzwl (%r11,%r8,2), %eax",
+    "movq %rdx, %r8",
+    "subq $2, %rsi",
+    "movw %ax, (%rsi)",
+    "jmp .Lsub_format_int_pair",
+    ".Lsub_format_int_last:",
+    "cmpq $10, %r8",
+    "jb .Lsub_format_int_digit",
+    "movzwl (%r11,%r8,2), %eax",
+    "subq $2, %rsi",
+    "movw %ax, (%rsi)",
+    "jmp .Lsub_format_int_sign",
+    ".Lsub_format_int_digit:",
+    "addl $48, %r8d",
+    "decq %rsi",
+    "movb %r8b, (%rsi)",
+    ".Lsub_format_int_sign:",
+    "testq %rdi, %rdi",
+    "jns .Lsub_format_int_done",
+    "decq %rsi",
+    "movb $45, (%rsi)",
+    ".Lsub_format_int_done:",
+    "movq %rsi, %rax",
+    "ret",
+    NULL
+};
+
+static const char *const x64_runtime_print_int[] = {
+    "__sub_print_int:",
+    // Room for the longest number, its sign and the newline
+    "movq .Lsub_out_pos(%rip), %rcx",
+    "addq $32, %rcx",
+    "cmpq .Lsub_out_cap(%rip), %rcx",
+    "jbe .Lsub_print_int_start",
+    "call __sub_out_room",
+    // Text built in the red zone, below the return address of the call
+    ".Lsub_print_int_start:",
+    "leaq -9(%rsp), %rsi",
+    "movb $10, (%rsi)",
+    "call __sub_format_int",
+    "movq %rax, %rsi",
+    // At most 21 bytes: three unconditional 8-byte moves
+    "leaq -8(%rsp), %rdx",
+    "subq %rsi, %rdx",
+    "movq .Lsub_out_pos(%rip), %rcx",
+    "movq .Lsub_out_buf(%rip), %rdi",
+    "addq %rcx, %rdi",
+    "addq %rdx, %rcx",
+    "movq %rcx, .Lsub_out_pos(%rip)",
+    "movq (%rsi), %rax",
+    "movq %rax, (%rdi)",
+    "movq 8(%rsi), %rax",
+    "movq %rax, 8(%rdi)",
+    "movq 16(%rsi), %rax",
+    "movq %rax, 16(%rdi)",
+    "jmp __sub_out_line",
+    NULL
+};
+
+static const char *const x64_runtime_print_str[] = {
+    "__sub_print_str:",
+    "movq -8(%rdi), %rdx",
+    "movq %rdi, %rsi",
+    "movq .Lsub_out_pos(%rip), %rcx",
+    "leaq 1(%rcx,%rdx), %rcx",
+    "cmpq .Lsub_out_cap(%rip), %rcx",
+    "jbe .Lsub_print_str_copy",
+    "call __sub_out_room",
+    // Longer than the whole buffer: write the text directly
+    "leaq 1(%rdx), %rcx",
+    "cmpq .Lsub_out_cap(%rip), %rcx",
+    "jbe .Lsub_print_str_copy",
+    "movl $1, %edi",
+    "movl $1, %eax",                // write(1, text, length)
+    "syscall",
+    "xorl %edx, %edx",
+    ".Lsub_print_str_copy:",
+    "movq .Lsub_out_pos(%rip), %rcx",
+    "movq .Lsub_out_buf(%rip), %rdi",
+    "addq %rcx, %rdi",
+    "leaq 1(%rcx,%rdx), %rcx",
+    "movq %rcx, .Lsub_out_pos(%rip)",
+    "movq %rdx, %rcx",
+    "rep",
+    "movsb",
+    "movb $10, (%rdi)",
+    "jmp __sub_out_line",
+    NULL
+};
+
+/* A line was added: write it out at once on a terminal */
+static const char *const x64_runtime_out_line[] = {
+    "__sub_out_line:",
+    "movq .Lsub_out_mode(%rip), %rax",
+    "cmpq $1, %rax",
+    "je __sub_flush",
+    "testq %rax, %rax",
+    "jne .Lsub_out_line_done",
+    "movl $1, %edi",
+    "movl $21505, %esi",            // TCGETS
+    "leaq -64(%rsp), %rdx",
+    "movl $16, %eax",               // ioctl(1, TCGETS, termios in the red zone)
+    "syscall",
+    "movl $2, %ecx",                // 1: terminal, 2: anything else
+    "testq %rax, %rax",
+    "jne .Lsub_out_line_mode",
+    "movl $1, %ecx",
+    ".Lsub_out_line_mode:",
+    "movq %rcx, .Lsub_out_mode(%rip)",
+    "cmpq $1, %rcx",
+    "je __sub_flush",
+    ".Lsub_out_line_done:",
+    "ret",
+    NULL
+};
+
+/* Empty the buffer, mapping it on first use (falling back to a small
+   static one if mmap fails). Keeps RDI, RSI and RDX. */
+static const char *const x64_runtime_out_room[] = {
+    "__sub_out_room:",
+    "cmpq $0, .Lsub_out_buf(%rip)",
+    "jne __sub_flush",
+    "pushq %rdi",
+    "pushq %rsi",
+    "pushq %rdx",
+    "xorl %edi, %edi",
+    "movl $65536, %esi",
+    "movl $3, %edx",                // PROT_READ | PROT_WRITE
+    "movl $34, %r10d",              // MAP_PRIVATE | MAP_ANONYMOUS
+    "movq $-1, %r8",
+    "xorl %r9d, %r9d",
+    "movl $9, %eax",                // mmap
+    "syscall",
+    "movl $65536, %ecx",
+    "cmpq $-4096, %rax",
+    "jbe .Lsub_out_room_mapped",
+    "leaq .Lsub_out_small(%rip), %rax",
+    "movl $64, %ecx",
+    ".Lsub_out_room_mapped:",
+    "movq %rax, .Lsub_out_buf(%rip)",
+    "movq %rcx, .Lsub_out_cap(%rip)",
+    "popq %rdx",
+    "popq %rsi",
+    "popq %rdi",
+    "ret",
+    NULL
+};
+
+static const char *const x64_runtime_flush[] = {
+    "__sub_flush:",
+    "pushq %rax",
+    "pushq %rcx",
+    "pushq %rdx",
+    "pushq %rsi",
+    "pushq %rdi",
+    "pushq %r11",
+    "movq .Lsub_out_buf(%rip), %rsi",
+    "movq .Lsub_out_pos(%rip), %rdx",
+    ".Lsub_flush_write:",
+    "testq %rdx, %rdx",
+    "jle .Lsub_flush_done",
+    "movl $1, %edi",
+    "movl $1, %eax",                // write(1, buffer, pending)
+    "syscall",
+    "cmpq $-4, %rax",               // EINTR: try again
+    "je .Lsub_flush_write",
+    "testq %rax, %rax",
+    "jle .Lsub_flush_done",
+    "addq %rax, %rsi",
+    "subq %rax, %rdx",
+    "jmp .Lsub_flush_write",
+    ".Lsub_flush_done:",
+    "movq $0, .Lsub_out_pos(%rip)",
+    "popq %r11",
+    "popq %rdi",
+    "popq %rsi",
+    "popq %rdx",
+    "popq %rcx",
+    "popq %rax",
+    "ret",
+    NULL
+};
+
+/* ---------- String and array runtime ---------- */
+
+/* Strings are immutable byte sequences stored after their length (and
+   followed by a NUL), so len() reads them like arrays. Heap arrays keep
+   their capacity before the element count: __sub_array_append adds in
+   place while there is room and otherwise moves the elements to a block
+   of twice the size. Nothing is freed; an old block stays valid for any
+   other reference to it. One-character strings (s[i], str of a digit)
+   come from a static table and are never allocated. All routines follow
+   the System V convention. */
+
+static const char *const x64_runtime_alloc_libc[] = {
+    "__sub_alloc:",
+    "subq $8, %rsp",
+    "call calloc@PLT",
+    "addq $8, %rsp",
+    "testq %rax, %rax",
+    "jz __sub_memory_fail",
+    "ret",
+    NULL
+};
+
+static const char *const x64_runtime_alloc_static[] = {
+    "__sub_alloc:",
+    "jmp __sub_calloc",
+    NULL
+};
+
+/* RDI = length; returns a zeroed string of that length */
+static const char *const x64_runtime_str_new[] = {
+    "__sub_str_new:",
+    "pushq %rdi",
+    "addq $16, %rdi",
+    "shrq $3, %rdi",                // words: length, bytes and the NUL
+    "movl $8, %esi",
+    "call __sub_alloc",
+    "popq %rdi",
+    "movq %rdi, (%rax)",
+    "addq $8, %rax",
+    "ret",
+    NULL
+};
+
+static const char *const x64_runtime_str_concat[] = {
+    "__sub_str_concat:",
+    "movq %rdi, %rax",
+    "cmpq $0, -8(%rsi)",
+    "je .Lsub_str_concat_done",
+    "movq %rsi, %rax",
+    "cmpq $0, -8(%rdi)",
+    "je .Lsub_str_concat_done",
+    "pushq %rbx",
+    "pushq %r12",
+    "pushq %r13",
+    "movq %rdi, %rbx",
+    "movq %rsi, %r12",
+    "movq -8(%rdi), %rdi",
+    "addq -8(%rsi), %rdi",
+    "call __sub_str_new",
+    "movq %rax, %r13",
+    "movq %rax, %rdi",
+    "movq %rbx, %rsi",
+    "movq -8(%rbx), %rcx",
+    "rep",
+    "movsb",
+    "movq %r12, %rsi",
+    "movq -8(%r12), %rcx",
+    "rep",
+    "movsb",
+    "movq %r13, %rax",
+    "popq %r13",
+    "popq %r12",
+    "popq %rbx",
+    ".Lsub_str_concat_done:",
+    "ret",
+    NULL
+};
+
+/* 1 when both strings hold the same bytes, else 0 */
+static const char *const x64_runtime_str_equal[] = {
+    "__sub_str_equal:",
+    "movl $1, %eax",
+    "movq -8(%rdi), %rcx",
+    "cmpq -8(%rsi), %rcx",
+    "jne .Lsub_str_equal_differ",
+    "repe",                         // no bytes: ZF still set by the compare
+    "cmpsb",
+    "jne .Lsub_str_equal_differ",
+    "ret",
+    ".Lsub_str_equal_differ:",
+    "xorl %eax, %eax",
+    "ret",
+    NULL
+};
+
+/* Negative, zero or positive as the first string sorts before, equal to
+   or after the second (bytes unsigned, then the shorter first) */
+static const char *const x64_runtime_str_compare[] = {
+    "__sub_str_compare:",
+    "movq -8(%rdi), %r8",
+    "movq -8(%rsi), %r9",
+    "movq %r8, %rcx",
+    "cmpq %r9, %rcx",
+    "jbe .Lsub_str_compare_bytes",
+    "movq %r9, %rcx",
+    ".Lsub_str_compare_bytes:",
+    "testq %rcx, %rcx",
+    "repe",
+    "cmpsb",
+    "je .Lsub_str_compare_length",
+    "movzbl -1(%rdi), %eax",
+    "movzbl -1(%rsi), %ecx",
+    "subq %rcx, %rax",
+    "ret",
+    ".Lsub_str_compare_length:",
+    "movq %r8, %rax",
+    "subq %r9, %rax",
+    "ret",
+    NULL
+};
+
+/* The one-character string at byte RSI of RDI, checked like an element */
+static const char *const x64_runtime_str_at[] = {
+    "__sub_str_at:",
+    "cmpq -8(%rdi), %rsi",
+    "jae __sub_str_index_fail",
+    "movzbl (%rdi,%rsi), %eax",
+    "shlq $4, %rax",
+    "leaq .Lsub_chars+8(%rip), %rdx",
+    "addq %rdx, %rax",
+    "ret",
+    NULL
+};
+
+static const char *const x64_runtime_str_from_int[] = {
+    "__sub_str_from_int:",
+    "cmpq $10, %rdi",
+    "jae .Lsub_str_from_int_format",
+    "shlq $4, %rdi",
+    "leaq .Lsub_chars+776(%rip), %rax", // "0" is character 48
+    "addq %rdi, %rax",
+    "ret",
+    ".Lsub_str_from_int_format:",
+    "pushq %rbx",
+    "subq $32, %rsp",
+    "leaq 32(%rsp), %rsi",
+    "call __sub_format_int",
+    "movq %rax, %rbx",
+    "leaq 32(%rsp), %rdi",
+    "subq %rax, %rdi",
+    "call __sub_str_new",
+    "movq %rax, %rdi",
+    "movq %rbx, %rsi",
+    "movq -8(%rax), %rcx",
+    "rep",
+    "movsb",
+    "addq $32, %rsp",
+    "popq %rbx",
+    "ret",
+    NULL
+};
+
+static const char *const x64_runtime_array_append[] = {
+    "__sub_array_append:",
+    "movq -8(%rdi), %rcx",
+    "cmpq -16(%rdi), %rcx",
+    "jae .Lsub_array_append_grow",
+    "movq %rsi, (%rdi,%rcx,8)",
+    "incq %rcx",
+    "movq %rcx, -8(%rdi)",
+    "movq %rdi, %rax",
+    "ret",
+    // Full: twice the capacity (at least 4), the new element, then a copy
+    ".Lsub_array_append_grow:",
+    "pushq %rbx",
+    "pushq %r12",
+    "pushq %r13",
+    "movq %rdi, %rbx",
+    "movq %rsi, %r12",
+    "leaq (%rcx,%rcx), %r13",
+    "cmpq $4, %r13",
+    "jae .Lsub_array_append_alloc",
+    "movl $4, %r13d",
+    ".Lsub_array_append_alloc:",
+    "leaq 2(%r13), %rdi",
+    "movl $8, %esi",
+    "call __sub_alloc",
+    "movq %r13, (%rax)",
+    "addq $16, %rax",
+    "movq -8(%rbx), %rcx",
+    "leaq 1(%rcx), %rdx",
+    "movq %rdx, -8(%rax)",
+    "movq %r12, (%rax,%rcx,8)",
+    "movq %rax, %rdi",
+    "movq %rbx, %rsi",
+    "rep",
+    "movsq",
+    "popq %r13",
+    "popq %r12",
+    "popq %rbx",
+    "ret",
+    NULL
+};
+
+/* Every failed run-time check jumps to one of the __sub_*_fail entries,
+   which report the error on stderr and exit with status 1. Buffered
+   output is written first. Messages are stored after their length. */
+static const char *const x64_runtime_fail_entries[] = {
+    "__sub_bounds_fail:",
+    "leaq .Lsub_bounds_msg(%rip), %rbx",
+    "jmp __sub_fail",
+    "__sub_str_index_fail:",
+    "leaq .Lsub_str_index_msg(%rip), %rbx",
+    "jmp __sub_fail",
+    "__sub_size_fail:",
+    "leaq .Lsub_size_msg(%rip), %rbx",
+    "jmp __sub_fail",
+    "__sub_memory_fail:",
+    "leaq .Lsub_memory_msg(%rip), %rbx",
+    "jmp __sub_fail",
+    NULL
+};
+
+static const char *const x64_runtime_fail_entry[] = {
+    "__sub_fail:",
+    NULL
+};
+
+static const char *const x64_runtime_fail_flush[] = {
+    "__sub_fail:",
+    "call __sub_flush",
+    NULL
+};
+
+static const char *const x64_runtime_fail[] = {
+    "movl $2, %edi",
+    "leaq 8(%rbx), %rsi",
+    "movq (%rbx), %rdx",
+    "movl $1, %eax",                // write(2, message, length)
+    "syscall",
+    "movl $1, %edi",
+    "movl $231, %eax",              // exit_group(1)
+    "syscall",
+    NULL
+};
+
+/* Run-time error messages, in the VM's wording */
+static const struct {
+    const char *label;
+    const char *text;
+} x64_fail_messages[] = {
+    { ".Lsub_bounds_msg", "Runtime error: array index out of range" },
+    { ".Lsub_str_index_msg", "Runtime error: string index out of range" },
+    { ".Lsub_size_msg", "Runtime error: negative array size" },
+    { ".Lsub_memory_msg", "Runtime error: out of memory" },
+};
+
+/* Emit one runtime routine (label lines end in ':') */
+static void x64_emit_runtime_routine(X64Context *ctx, const char *const *lines) {
+    ctx->buffering = true;
+    for (const char *const *line = lines; *line; line++) {
+        size_t len = strlen(*line);
+        if ((*line)[len - 1] == ':') {
+            char label[64];
+            snprintf(label, sizeof(label), "%.*s", (int)len - 1, *line);
+            x64_emit_label(ctx, label);
+        } else {
+            x64_emit(ctx, "%s", *line);
+        }
+    }
+    ctx->buffering = false;
+    x64_code_flush(ctx);
+}
+
+static void x64_generate_runtime(X64Context *ctx) {
+    static const char *const *functions[] = { x64_runtime_start, x64_runtime_calloc };
+    for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++) {
+        x64_emit_runtime_routine(ctx, functions[f]);
+    }
+
+    // Allocator state: next free byte and end of the current chunk
+    if (ctx->object) {
+        size_t heap = elf_append(ctx->object, ELF_SEC_DATA, NULL, 16);
+        elf_define_symbol(ctx->object, ".Lsub_heap_next", ELF_SEC_DATA, heap, false);
+        elf_define_symbol(ctx->object, ".Lsub_heap_end", ELF_SEC_DATA, heap + 8, false);
+        return;
+    }
+    fprintf(ctx->output, ".section .data\n");
+    fprintf(ctx->output, ".balign 8\n");
+    fprintf(ctx->output, ".Lsub_heap_next:\n");
+    fprintf(ctx->output, "    .quad 0\n");
+    fprintf(ctx->output, ".Lsub_heap_end:\n");
+    fprintf(ctx->output, "    .quad 0\n");
+    fprintf(ctx->output, ".section .text\n");
+}
+
+/* Quoted assembler text of `length` bytes */
+static void x64_write_ascii(FILE *out, const char *bytes, size_t length) {
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)bytes[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 32 || c > 126) fprintf(out, "\\%03o", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void x64_generate_print_runtime(X64Context *ctx) {
+    static const char *const *functions[] = {
+        x64_runtime_format_int, x64_runtime_print_int, x64_runtime_print_str, x64_runtime_out_line,
+        x64_runtime_out_room, x64_runtime_flush
+    };
+    for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++) {
+        x64_emit_runtime_routine(ctx, functions[f]);
+    }
+
+    // Buffer address, bytes pending, capacity, terminal state, fallback buffer
+    char pairs[200];
+    for (int i = 0; i < 100; i++) {
+        pairs[2 * i] = (char)('0' + i / 10);
+        pairs[2 * i + 1] = (char)('0' + i % 10);
+    }
+    static const char *const state[] = { ".Lsub_out_buf", ".Lsub_out_pos", ".Lsub_out_cap", ".Lsub_out_mode" };
+    if (ctx->object) {
+        elf_align(ctx->object, ELF_SEC_DATA, 8);
+        size_t area = elf_append(ctx->object, ELF_SEC_DATA, NULL, 8 * 4 + 64);
+        for (int i = 0; i < 4; i++) elf_define_symbol(ctx->object, state[i], ELF_SEC_DATA, area + 8 * i, false);
+        elf_define_symbol(ctx->object, ".Lsub_out_small", ELF_SEC_DATA, area + 8 * 4, false);
+        elf_define_symbol(ctx->object, ".Lsub_digit_pairs", ELF_SEC_RODATA,
+                          elf_append(ctx->object, ELF_SEC_RODATA, pairs, sizeof(pairs)), false);
+        return;
+    }
+    fprintf(ctx->output, ".section .data\n");
+    fprintf(ctx->output, ".balign 8\n");
+    for (int i = 0; i < 4; i++) fprintf(ctx->output, "%s:\n    .quad 0\n", state[i]);
+    fprintf(ctx->output, ".Lsub_out_small:\n");
+    fprintf(ctx->output, "    .zero 64\n");
+    fprintf(ctx->output, ".section .rodata\n");
+    fprintf(ctx->output, ".Lsub_digit_pairs:\n");
+    fprintf(ctx->output, "    .ascii ");
+    x64_write_ascii(ctx->output, pairs, sizeof(pairs));
+    fprintf(ctx->output, "\n.section .text\n");
+}
+
+/* Read-only string constant (length, bytes, NUL); returns the label
+   number of its first byte */
+static int x64_define_string(X64Context *ctx, const char *text) {
+    int id = ctx->string_counter++;
+    char label[32];
+    snprintf(label, sizeof(label), ".LSTR%d", id);
+    uint64_t length = strlen(text);
+    if (ctx->object) {
+        elf_align(ctx->object, ELF_SEC_RODATA, 8);
+        elf_append(ctx->object, ELF_SEC_RODATA, &length, sizeof(length));
+        size_t at = elf_append(ctx->object, ELF_SEC_RODATA, text, length + 1);
+        elf_define_symbol(ctx->object, label, ELF_SEC_RODATA, at, false);
+        return id;
+    }
     fprintf(ctx->output, ".section .rodata\n");
-    fprintf(ctx->output, ".LC0:\n");
-    fprintf(ctx->output, "    .string \"%%ld\\n\"\n");
+    fprintf(ctx->output, ".balign 8\n");
+    fprintf(ctx->output, "    .quad %llu\n", (unsigned long long)length);
+    fprintf(ctx->output, "%s:\n", label);
+    fprintf(ctx->output, "    .string ");
+    x64_write_ascii(ctx->output, text, length);
+    fprintf(ctx->output, "\n.section .text\n");
+    return id;
+}
+
+static void x64_generate_string_runtime(X64Context *ctx) {
+    static const char *const *functions[] = {
+        x64_runtime_str_new, x64_runtime_str_concat, x64_runtime_str_equal, x64_runtime_str_compare,
+        x64_runtime_str_at, x64_runtime_str_from_int, x64_runtime_array_append
+    };
+    x64_emit_runtime_routine(ctx, ctx->static_runtime ? x64_runtime_alloc_static : x64_runtime_alloc_libc);
+    for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++) {
+        x64_emit_runtime_routine(ctx, functions[f]);
+    }
+
+    // Every one-character string: length 1, the byte, padding
+    static char chars[256 * 16];
+    for (int c = 0; c < 256; c++) {
+        chars[16 * c] = 1;
+        chars[16 * c + 8] = (char)c;
+    }
+    if (ctx->object) {
+        elf_align(ctx->object, ELF_SEC_RODATA, 16);
+        elf_define_symbol(ctx->object, ".Lsub_chars", ELF_SEC_RODATA,
+                          elf_append(ctx->object, ELF_SEC_RODATA, chars, sizeof(chars)), false);
+        return;
+    }
+    fprintf(ctx->output, ".section .rodata\n");
+    fprintf(ctx->output, ".balign 16\n");
+    fprintf(ctx->output, ".Lsub_chars:\n");
+    for (int c = 0; c < 256; c++) fprintf(ctx->output, "    .quad 1, %d\n", c);
+    fprintf(ctx->output, ".section .text\n");
+}
+
+static void x64_generate_fail_runtime(X64Context *ctx) {
+    x64_emit_runtime_routine(ctx, x64_runtime_fail_entries);
+    x64_emit_runtime_routine(ctx, ctx->print_runtime ? x64_runtime_fail_flush : x64_runtime_fail_entry);
+    x64_emit_runtime_routine(ctx, x64_runtime_fail);
+    size_t count = sizeof(x64_fail_messages) / sizeof(x64_fail_messages[0]);
+    if (!ctx->object) fprintf(ctx->output, ".section .rodata\n");
+    for (size_t m = 0; m < count; m++) {
+        const char *text = x64_fail_messages[m].text;
+        uint64_t length = strlen(text) + 1;
+        if (ctx->object) {
+            elf_align(ctx->object, ELF_SEC_RODATA, 8);
+            size_t message = elf_append(ctx->object, ELF_SEC_RODATA, &length, sizeof(length));
+            elf_append(ctx->object, ELF_SEC_RODATA, text, length - 1);
+            elf_append(ctx->object, ELF_SEC_RODATA, "\n", 1);
+            elf_define_symbol(ctx->object, x64_fail_messages[m].label, ELF_SEC_RODATA, message, false);
+            continue;
+        }
+        fprintf(ctx->output, ".balign 8\n");
+        fprintf(ctx->output, "%s:\n", x64_fail_messages[m].label);
+        fprintf(ctx->output, "    .quad %llu\n", (unsigned long long)length);
+        fprintf(ctx->output, "    .ascii \"%s\\n\"\n", text);
+    }
+    if (!ctx->object) fprintf(ctx->output, ".section .text\n");
+}
+
+/* Profile area of an instrumented module: magic, checksum and counter
+   count (the .subprof header), the counters, then the output path */
+static void x64_generate_profile_runtime(X64Context *ctx, const IRModule *module) {
+    x64_emit_runtime_routine(ctx, x64_runtime_profile);
+    uint64_t header[3] = { IR_PROFILE_MAGIC, module->profile_checksum, (uint64_t)module->profile_counters };
+    const char *path = ctx->profile_path ? ctx->profile_path : "default.subprof";
+    if (ctx->object) {
+        elf_align(ctx->object, ELF_SEC_DATA, 8);
+        size_t area = elf_append(ctx->object, ELF_SEC_DATA, header, sizeof(header));
+        elf_append(ctx->object, ELF_SEC_DATA, NULL, 8 * (size_t)module->profile_counters);
+        elf_define_symbol(ctx->object, ".Lsub_prof", ELF_SEC_DATA, area, false);
+        elf_define_symbol(ctx->object, ".Lsub_prof_counts", ELF_SEC_DATA, area + sizeof(header), false);
+        elf_define_symbol(ctx->object, ".Lsub_prof_path", ELF_SEC_RODATA,
+                          elf_append(ctx->object, ELF_SEC_RODATA, path, strlen(path) + 1), false);
+        return;
+    }
     fprintf(ctx->output, ".section .data\n");
+    fprintf(ctx->output, ".balign 8\n");
+    fprintf(ctx->output, ".Lsub_prof:\n");
+    fprintf(ctx->output, "    .quad %llu, %llu, %llu\n", (unsigned long long)header[0],
+            (unsigned long long)header[1], (unsigned long long)header[2]);
+    fprintf(ctx->output, ".Lsub_prof_counts:\n");
+    fprintf(ctx->output, "    .zero %d\n", 8 * module->profile_counters);
+    fprintf(ctx->output, ".section .rodata\n");
+    fprintf(ctx->output, ".Lsub_prof_path:\n");
+    fprintf(ctx->output, "    .string ");
+    x64_write_ascii(ctx->output, path, strlen(path));
+    fprintf(ctx->output, "\n");
     fprintf(ctx->output, ".section .text\n");
-    fprintf(ctx->output, ".global main\n\n");
+}
+
+/* Stack slot of value v (local i is value i, vreg r follows the
+   locals). Without register allocation the frame below RBP holds one
+   slot per value in that order; with it, the allocator's colored slots
+   (a value it gave no slot is never accessed). */
+static int x64_value_offset(X64Context *ctx, int v) {
+    if (ctx->alloc) {
+        int slot = ctx->alloc->slot[v];
+        return ((slot < 0 ? 0 : slot) + 1) * 8;
+    }
+    return (v + 1) * 8;
+}
+
+/* Stack slot of a local (IR_VAL_VAR) or virtual register (IR_VAL_REG) */
+static int x64_slot_offset(X64Context *ctx, const IRValue *val) {
+    return x64_value_offset(ctx, x64_regalloc_value(ctx->current_func, val));
+}
+
+/* Words of the frame taken by value slots */
+static int x64_value_slots(X64Context *ctx) {
+    if (ctx->alloc) return ctx->alloc->slot_count;
+    return ctx->current_func->local_count + ctx->current_func->reg_count;
+}
+
+/* Memory operand `offset` bytes below the frame top: RBP, or in a leaf
+   function without a frame pointer the stack pointer at entry (the red
+   zone when frame_size is 0) */
+static const char* x64_frame_addr(X64Context *ctx, int offset, char *buf, size_t size) {
+    int disp = ctx->frame_base == X64_REG_RSP ? ctx->frame_size - offset : -offset;
+    snprintf(buf, size, "%d(%%%s)", disp, x64_register_name(ctx->frame_base, true));
+    return buf;
+}
+
+static const char* x64_slot(X64Context *ctx, const IRValue *val, char *buf, size_t size) {
+    return x64_frame_addr(ctx, x64_slot_offset(ctx, val), buf, size);
+}
+
+static bool x64_is_imm32(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static bool x64_is_const(const IRValue *val) {
+    return val && val->kind == IR_VAL_CONST;
+}
+
+/* Register allocated to a local or vreg, X64_REG_COUNT if it lives on the stack */
+static X64Register x64_value_reg(X64Context *ctx, const IRValue *val) {
+    if (!ctx->alloc) return X64_REG_COUNT;
+    int v = x64_regalloc_value(ctx->current_func, val);
+    return v >= 0 ? ctx->alloc->reg[v] : X64_REG_COUNT;
+}
+
+static const char* x64_reg64(X64Register reg) {
+    return x64_register_name(reg, true);
+}
+
+/* Load an operand (constant, vreg or local) into a register */
+static void x64_load(X64Context *ctx, const IRValue *val, X64Register reg) {
+    const char *name = x64_register_name(reg, true);
+    if (!val) {
+        x64_emit(ctx, "xorl %%%s, %%%s", x64_register_name(reg, false), x64_register_name(reg, false));
+    } else if (x64_is_const(val)) {
+        int64_t v = val->data.int_val;
+        if (v == 0) x64_emit(ctx, "xorl %%%s, %%%s", x64_register_name(reg, false), x64_register_name(reg, false));
+        else if (x64_is_imm32(v)) x64_emit(ctx, "movq $%" PRId64 ", %%%s", v, name);
+        else x64_emit(ctx, "movabsq $%" PRId64 ", %%%s", v, name);
+    } else if (val->kind == IR_VAL_REG && val->data.reg_num == ctx->rax_vreg) {
+        if (reg == X64_REG_RAX) return; // Already there
+        x64_emit(ctx, "movq %%rax, %%%s", name);
+    } else if (x64_value_reg(ctx, val) != X64_REG_COUNT) {
+        X64Register home = x64_value_reg(ctx, val);
+        if (home != reg) x64_emit(ctx, "movq %%%s, %%%s", x64_reg64(home), name);
+    } else {
+        char slot[32];
+        x64_emit(ctx, "movq %s, %%%s", x64_slot(ctx, val, slot, sizeof(slot)), name);
+    }
+    if (reg == X64_REG_RAX) ctx->rax_vreg = -1;
+}
+
+/* Register holding `val`: its allocated register, or `scratch` after loading it */
+static X64Register x64_reg_or_load(X64Context *ctx, const IRValue *val, X64Register scratch) {
+    X64Register home = x64_value_reg(ctx, val);
+    if (home != X64_REG_COUNT) return home;
+    x64_load(ctx, val, scratch);
+    return scratch;
+}
+
+/* Store RAX into the destination slot and remember it is mirrored */
+static void x64_store_result(X64Context *ctx, const IRValue *dest) {
+    if (!dest) return;
+    X64Register home = x64_value_reg(ctx, dest);
+    if (home != X64_REG_COUNT) {
+        x64_emit(ctx, "movq %%rax, %%%s", x64_reg64(home));
+    } else {
+        char slot[32];
+        x64_emit(ctx, "movq %%rax, %s", x64_slot(ctx, dest, slot, sizeof(slot)));
+    }
+    ctx->rax_vreg = dest->kind == IR_VAL_REG ? dest->data.reg_num : -1;
+}
+
+/* Register to compute a result in: the destination's own register when
+   it has one, otherwise RAX followed by x64_finish_result */
+static X64Register x64_result_reg(X64Context *ctx, const IRValue *dest) {
+    X64Register home = x64_value_reg(ctx, dest);
+    return home != X64_REG_COUNT ? home : X64_REG_RAX;
+}
+
+static void x64_finish_result(X64Context *ctx, const IRValue *dest, X64Register reg) {
+    if (reg == X64_REG_RAX) x64_store_result(ctx, dest);
+}
+
+/* Leave for __sub_bounds_fail unless 0 <= index < length; one unsigned
+   compare covers both ends */
+static void x64_emit_index_check(X64Context *ctx, X64Register base, X64Register index) {
+    x64_emit(ctx, "cmpq -8(%%%s), %%%s", x64_reg64(base), x64_reg64(index));
+    x64_emit(ctx, "jae __sub_bounds_fail");
+    ctx->need_fail_runtime = true;
+}
+
+static void x64_emit_const_index_check(X64Context *ctx, X64Register base, int64_t index) {
+    x64_emit(ctx, "cmpq $%" PRId64 ", -8(%%%s)", index, x64_reg64(base));
+    x64_emit(ctx, "jbe __sub_bounds_fail");
+    ctx->need_fail_runtime = true;
+}
+
+/* Render a source operand usable as the second operand of an ALU op:
+   $imm32, its register or its stack slot. Wide constants go through %rcx. */
+static const char* x64_operand(X64Context *ctx, const IRValue *val, char *buf, size_t size) {
+    if (x64_is_const(val)) {
+        if (x64_is_imm32(val->data.int_val)) {
+            snprintf(buf, size, "$%" PRId64, val->data.int_val);
+            return buf;
+        }
+        x64_load(ctx, val, X64_REG_RCX);
+        return "%rcx";
+    }
+    if (x64_value_reg(ctx, val) != X64_REG_COUNT) {
+        snprintf(buf, size, "%%%s", x64_reg64(x64_value_reg(ctx, val)));
+        return buf;
+    }
+    if (val->kind == IR_VAL_REG && val->data.reg_num == ctx->rax_vreg) {
+        x64_emit(ctx, "movq %%rax, %%rcx");
+        return "%rcx";
+    }
+    return x64_slot(ctx, val, buf, size);
+}
+
+/* Save slot of a callee-saved register, after the locals and vregs */
+static int x64_callee_save_offset(X64Context *ctx, X64Register reg) {
+    int index = x64_value_slots(ctx);
+    for (int r = 0; r < (int)reg; r++) {
+        if (ctx->alloc->callee_saved_used[r]) index++;
+    }
+    return (index + 1) * 8;
+}
+
+/* Frame arrays (IR_ALLOC_FRAME_ARRAY) sit below the save slots: the
+   array at word offset `offset` of length n spans n + 1 slots with its
+   length word at the lowest address. Returns element 0's offset below RBP. */
+static int x64_frame_array_offset(X64Context *ctx, int64_t offset, int64_t length) {
+    int index = x64_value_slots(ctx) + (int)(offset + length);
+    for (int r = 0; ctx->alloc && r < X64_REG_COUNT; r++) {
+        if (ctx->alloc->callee_saved_used[r]) index++;
+    }
+    return index * 8;
+}
+
+static void x64_restore_callee_saved(X64Context *ctx) {
+    char slot[32];
+    for (int r = 0; ctx->alloc && r < X64_REG_COUNT; r++) {
+        if (ctx->alloc->callee_saved_used[r]) {
+            x64_emit(ctx, "movq %s, %%%s", x64_frame_addr(ctx, x64_callee_save_offset(ctx, r), slot, sizeof(slot)),
+                     x64_reg64(r));
+        }
+    }
+}
+
+static const X64Register x64_arg_regs[] = {
+    X64_REG_RDI, X64_REG_RSI, X64_REG_RDX, X64_REG_RCX, X64_REG_R8, X64_REG_R9
+};
+
+#define X64_ARG_REGS 6
+
+/* Register-to-register moves that happen at once: a destination may be
+   another move's source, so moves are ordered and a cycle is broken
+   through RAX (never an allocated home). */
+static void x64_parallel_move(X64Context *ctx, X64Register *src, X64Register *dst, int pending) {
+    while (pending > 0) {
+        int ready = -1;
+        for (int k = 0; k < pending && ready < 0; k++) {
+            bool blocked = false;
+            for (int j = 0; j < pending; j++) {
+                if (j != k && src[j] == dst[k]) blocked = true;
+            }
+            if (!blocked) ready = k;
+        }
+        if (ready < 0) {
+            x64_emit(ctx, "movq %%%s, %%rax", x64_reg64(src[0]));
+            src[0] = X64_REG_RAX;
+            ctx->rax_vreg = -1;
+            continue;
+        }
+        x64_emit(ctx, "movq %%%s, %%%s", x64_reg64(src[ready]), x64_reg64(dst[ready]));
+        src[ready] = src[pending - 1];
+        dst[ready] = dst[pending - 1];
+        pending--;
+    }
+}
+
+/* Frame offset of incoming stack argument i (i >= 6), above the return
+   address (and the saved RBP) */
+static int x64_stack_param_offset(X64Context *ctx, int i) {
+    return -(ctx->frame_base == X64_REG_RSP ? 8 : 16) - (i - X64_ARG_REGS) * 8;
+}
+
+/* Move incoming arguments to the parameters' homes (parameter i is
+   local i): registers first, since a home may be an argument register,
+   then the System V stack arguments beyond the sixth. */
+static void x64_move_params(X64Context *ctx, IRFunction *func) {
+    X64Register src[X64_ARG_REGS], dst[X64_ARG_REGS];
+    char slot[32], arg[32];
+    int pending = 0;
+    for (int i = 0; i < func->param_count && i < X64_ARG_REGS; i++) {
+        if (ctx->alloc && i < ctx->alloc->value_count && ctx->alloc->start[i] != 0) {
+            continue;   // Overwritten before any read
+        }
+        X64Register home = ctx->alloc && i < ctx->alloc->value_count ? ctx->alloc->reg[i]
+                                                                      : X64_REG_COUNT;
+        if (home == X64_REG_COUNT) {
+            x64_emit(ctx, "movq %%%s, %s", x64_reg64(x64_arg_regs[i]),
+                     x64_frame_addr(ctx, x64_value_offset(ctx, i), slot, sizeof(slot)));
+        } else if (home != x64_arg_regs[i]) {
+            src[pending] = x64_arg_regs[i];
+            dst[pending++] = home;
+        }
+    }
+    x64_parallel_move(ctx, src, dst, pending);
+
+    for (int i = X64_ARG_REGS; i < func->param_count; i++) {
+        if (ctx->alloc && i < ctx->alloc->value_count && ctx->alloc->start[i] != 0) continue;
+        X64Register home = ctx->alloc && i < ctx->alloc->value_count ? ctx->alloc->reg[i]
+                                                                      : X64_REG_COUNT;
+        x64_frame_addr(ctx, x64_stack_param_offset(ctx, i), arg, sizeof(arg));
+        if (home != X64_REG_COUNT) {
+            x64_emit(ctx, "movq %s, %%%s", arg, x64_reg64(home));
+        } else {
+            x64_emit(ctx, "movq %s, %%rax", arg);
+            x64_emit(ctx, "movq %%rax, %s", x64_frame_addr(ctx, x64_value_offset(ctx, i), slot, sizeof(slot)));
+        }
+    }
+
+    // Locals read before any store start out as zero (after the moves
+    // above: they may sit in argument registers). Their slot may have
+    // held another value, or an earlier call's.
+    for (int i = func->param_count; ctx->alloc && i < func->local_count; i++) {
+        if (ctx->alloc->start[i] != 0) continue;
+        if (ctx->alloc->reg[i] != X64_REG_COUNT) {
+            const char *name = x64_register_name(ctx->alloc->reg[i], false);
+            x64_emit(ctx, "xorl %%%s, %%%s", name, name);
+        } else {
+            x64_emit(ctx, "movq $0, %s", x64_frame_addr(ctx, x64_value_offset(ctx, i), slot, sizeof(slot)));
+        }
+    }
+}
+
+/* Evaluate call arguments into place: beyond the sixth pushed right to
+   left (padded to keep RSP 16-byte aligned), then the register ones.
+   Returns the bytes to pop after the call. */
+static int x64_setup_call_args(X64Context *ctx, const IRInstruction *instr) {
+    int stack_args = instr->arg_count > X64_ARG_REGS ? instr->arg_count - X64_ARG_REGS : 0;
+    int pad = (stack_args & 1) * 8;
+    if (pad) x64_emit(ctx, "subq $8, %%rsp");
+    for (int k = instr->arg_count - 1; k >= X64_ARG_REGS; k--) {
+        x64_emit(ctx, "pushq %%%s", x64_reg64(x64_reg_or_load(ctx, instr->args[k], X64_REG_RAX)));
+    }
+
+    // Arguments living in registers are permuted at once (the allocator
+    // may keep a value that dies here in an argument register); the rest
+    // load straight into their register afterwards
+    X64Register src[X64_ARG_REGS], dst[X64_ARG_REGS];
+    int pending = 0;
+    for (int k = 0; k < instr->arg_count && k < X64_ARG_REGS; k++) {
+        X64Register home = x64_value_reg(ctx, instr->args[k]);
+        if (home != X64_REG_COUNT && home != x64_arg_regs[k]) {
+            src[pending] = home;
+            dst[pending++] = x64_arg_regs[k];
+        }
+    }
+    x64_parallel_move(ctx, src, dst, pending);
+    for (int k = 0; k < instr->arg_count && k < X64_ARG_REGS; k++) {
+        if (x64_value_reg(ctx, instr->args[k]) == X64_REG_COUNT) x64_load(ctx, instr->args[k], x64_arg_regs[k]);
+    }
+    return stack_args * 8 + pad;
+}
+
+/* Leaf functions make no calls, so they need no aligned frame and may
+   keep their slots in the red zone below RSP */
+static bool x64_is_leaf(const IRFunction *func) {
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        switch (instr->opcode) {
+            case IR_CALL: case IR_TAIL_CALL: case IR_PRINT: case IR_ALLOC_ARRAY:
+            case IR_PROFILE_WRITE:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+#define X64_RED_ZONE 128
+
+/* Release the frame before returning or tail-calling */
+static void x64_leave_frame(X64Context *ctx) {
+    x64_restore_callee_saved(ctx);
+    if (ctx->frame_base == X64_REG_RBP) {
+        x64_emit(ctx, "movq %%rbp, %%rsp");
+        x64_emit(ctx, "popq %%rbp");
+    } else if (ctx->frame_size > 0) {
+        x64_emit(ctx, "addq $%d, %%rsp", ctx->frame_size);
+    }
 }
 
 /* Generate function prologue */
 static void x64_generate_function_prologue(X64Context *ctx, IRFunction *func) {
     x64_emit_label(ctx, func->name);
     x64_emit_comment(ctx, "Function prologue");
-    x64_emit(ctx, "pushq %%rbp");
-    x64_emit(ctx, "movq %%rsp, %%rbp");
     
-    // Allocate stack space for parameters and locals
-    int total_stack = func->local_count * 8 + func->param_count * 8;
-    if (total_stack > 0) {
-        total_stack = (total_stack + 15) & ~15; // Align to 16 bytes
+    // Stack space for value slots (parameters are locals), saved
+    // callee-saved registers and frame arrays
+    int saved = 0;
+    for (int r = 0; ctx->alloc && r < X64_REG_COUNT; r++) {
+        if (ctx->alloc->callee_saved_used[r]) saved++;
+    }
+    int total_stack = (x64_value_slots(ctx) + saved + func->frame_words) * 8;
+    total_stack = (total_stack + 15) & ~15; // Align to 16 bytes
+    ctx->frame_base = x64_is_leaf(func) ? X64_REG_RSP : X64_REG_RBP;
+    ctx->frame_size = 0;
+    if (ctx->frame_base == X64_REG_RBP) {
+        x64_emit(ctx, "pushq %%rbp");
+        x64_emit(ctx, "movq %%rsp, %%rbp");
+        if (total_stack > 0) x64_emit(ctx, "subq $%d, %%rsp", total_stack);
+    } else if (total_stack > X64_RED_ZONE) {
+        ctx->frame_size = total_stack;
         x64_emit(ctx, "subq $%d, %%rsp", total_stack);
     }
-    
-    // Save parameters to stack (now below the allocated area)
-    for (int i = 0; i < func->param_count; i++) {
-        const char *reg;
-        switch(i) {
-            case 0: reg = "rdi"; break;
-            case 1: reg = "rsi"; break;
-            case 2: reg = "rdx"; break;
-            case 3: reg = "rcx"; break;
-            case 4: reg = "r8"; break;
-            case 5: reg = "r9"; break;
-            default: reg = "rdi"; break;
+    char slot[32];
+    for (int r = 0; ctx->alloc && r < X64_REG_COUNT; r++) {
+        if (ctx->alloc->callee_saved_used[r]) {
+            x64_emit(ctx, "movq %%%s, %s", x64_reg64(r),
+                     x64_frame_addr(ctx, x64_callee_save_offset(ctx, r), slot, sizeof(slot)));
         }
-        // Parameters at: [rbp - (param_index + 1) * 8]
-        int offset = (i + 1) * 8;
-        x64_emit(ctx, "movq %%%s, -%d(%%rbp)", reg, offset);
     }
+    
+    x64_move_params(ctx, func);
+    ctx->rax_vreg = -1;
+}
+
+/* The entry function writes out buffered print() output before it
+   returns (its tail calls become calls, see IR_TAIL_CALL) */
+static bool x64_flushes_output(const X64Context *ctx, const IRFunction *func) {
+    return ctx->print_runtime && strcmp(func->name, "main") == 0;
 }
 
 /* Generate function epilogue */
@@ -153,100 +1345,446 @@ static void x64_generate_function_epilogue(X64Context *ctx, IRFunction *func) {
     snprintf(return_label, sizeof(return_label), "%s_return", func->name);
     x64_emit_label(ctx, return_label);
     
-    x64_emit(ctx, "movq %%rbp, %%rsp");
-    x64_emit(ctx, "popq %%rbp");
-    x64_emit(ctx, "ret\n");
+    x64_leave_frame(ctx);
+    if (x64_flushes_output(ctx, func)) x64_emit(ctx, "call __sub_flush");
+    x64_emit(ctx, "ret");
+}
+
+static const char* x64_setcc(IROpcode op) {
+    switch (op) {
+        case IR_EQ: return "sete";
+        case IR_NE: return "setne";
+        case IR_LT: return "setl";
+        case IR_LE: return "setle";
+        case IR_GT: return "setg";
+        case IR_GE: return "setge";
+        default: return "sete";
+    }
+}
+
+/* a OP b == b OP' a */
+static IROpcode x64_swap_compare(IROpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GT;
+        case IR_LE: return IR_GE;
+        case IR_GT: return IR_LT;
+        case IR_GE: return IR_LE;
+        default: return op;
+    }
+}
+
+/* cmpq of a comparison's operands, with a constant left operand moved to
+   the immediate side. Returns the opcode that holds for the emitted order. */
+static IROpcode x64_emit_compare(X64Context *ctx, const IRInstruction *instr) {
+    char buf[64];
+    const IRValue *lhs = instr->src1;
+    const IRValue *rhs = instr->src2;
+    IROpcode op = instr->opcode;
+    if (x64_is_const(lhs) && !x64_is_const(rhs)) {
+        lhs = instr->src2;
+        rhs = instr->src1;
+        op = x64_swap_compare(op);
+    }
+    const char *operand = x64_operand(ctx, rhs, buf, sizeof(buf));
+    X64Register reg = x64_reg_or_load(ctx, lhs, X64_REG_RAX);
+    x64_emit(ctx, "cmpq %s, %%%s", operand, x64_reg64(reg)); // Compare Left vs Right
+    return op;
+}
+
+/* ---------- Instruction selection hooks ---------- */
+
+/* Selector backend: the context plus a note that heads the first line */
+typedef struct {
+    X64Context *ctx;
+    const char *note;
+} X64IselSink;
+
+/* Where the selector finds a value: an immediate, the allocated
+   register, RAX while it mirrors the vreg, or the stack slot */
+static X64Operand x64_isel_locate(void *backend, const IRValue *val) {
+    X64Context *ctx = ((X64IselSink*)backend)->ctx;
+    if (x64_is_const(val)) return x64_opnd_imm(val->data.int_val);
+    X64Register home = x64_value_reg(ctx, val);
+    if (home != X64_REG_COUNT) return x64_opnd_reg(home);
+    if (val->kind == IR_VAL_REG && val->data.reg_num == ctx->rax_vreg) return x64_opnd_reg(X64_REG_RAX);
+    int offset = x64_slot_offset(ctx, val);
+    return x64_opnd_mem(ctx->frame_base, ctx->frame_base == X64_REG_RSP ? ctx->frame_size - offset : -offset);
+}
+
+static void x64_isel_emit(void *backend, const char *line) {
+    X64IselSink *sink = backend;
+    if (sink->note) {
+        x64_emit_comment(sink->ctx, sink->note);
+        sink->note = NULL;
+    }
+    x64_emit(sink->ctx, "%s", line);
+}
+
+/* Select `instr` (with `kid` folded in) through the rule table */
+static bool x64_select(X64Context *ctx, const X64IselTarget *target, IRInstruction *instr, IRInstruction *kid) {
+    // Checked element accesses take the generic path, which emits the check
+    if ((instr->opcode == IR_LOAD_ELEM || instr->opcode == IR_STORE_ELEM) && !instr->in_bounds) return false;
+    bool value = instr->opcode != IR_STORE_ELEM && instr->opcode != IR_JUMP_IF &&
+                 instr->opcode != IR_JUMP_IF_NOT;
+    X64Register out = value ? x64_result_reg(ctx, instr->dest) : X64_REG_COUNT;
+    bool clobbered[X64_REG_COUNT];
+    char note[96];
+    if (kid) {
+        snprintf(note, sizeof(note), "%s(%s)", ir_opcode_name(instr->opcode), ir_opcode_name(kid->opcode));
+    } else {
+        snprintf(note, sizeof(note), "%s", ir_opcode_name(instr->opcode));
+    }
+    ((X64IselSink*)target->backend)->note = note;
+    bool ok = x64_isel_generate(target, instr, kid, out, clobbered);
+    ((X64IselSink*)target->backend)->note = NULL;
+    if (!ok) return false;
+    if (clobbered[X64_REG_RAX]) ctx->rax_vreg = -1;
+    if (value) x64_finish_result(ctx, instr->dest, out);
+    return true;
+}
+
+/* ---------- SIMD kernels (IR_VECTOR_LOOP) ----------
+   Node n lives in xmm/ymm n; the reduction accumulator in 12, with 13-15
+   as scratch. Element pointers are kept in the remaining caller-saved
+   general purpose registers and the index in %rcx. */
+#define X64_VEC_ACC 12
+#define X64_VEC_MASK 13
+#define X64_VEC_TMP1 14
+#define X64_VEC_TMP2 15
+
+static const X64Register x64_vec_base_regs[] = {
+    X64_REG_RSI, X64_REG_RDI, X64_REG_R8, X64_REG_R9, X64_REG_R10, X64_REG_R11
+};
+
+/* dst = a OP b (SSE forms are destructive: dst is copied from a first) */
+static void x64_vec_binop(X64Context *ctx, bool avx, const char *op, int a, int b, int dst) {
+    if (avx) {
+        x64_emit(ctx, "v%s %%ymm%d, %%ymm%d, %%ymm%d", op, b, a, dst);
+        return;
+    }
+    if (dst != a) x64_emit(ctx, "movdqa %%xmm%d, %%xmm%d", a, dst);
+    x64_emit(ctx, "%s %%xmm%d, %%xmm%d", op, b, dst);
+}
+
+static void x64_vec_shift(X64Context *ctx, bool avx, const char *op, int amount, int a, int dst) {
+    if (avx) {
+        x64_emit(ctx, "v%s $%d, %%ymm%d, %%ymm%d", op, amount, a, dst);
+        return;
+    }
+    if (dst != a) x64_emit(ctx, "movdqa %%xmm%d, %%xmm%d", a, dst);
+    x64_emit(ctx, "%s $%d, %%xmm%d", op, amount, dst);
+}
+
+/* Copy %rax into every lane of register `reg` */
+static void x64_vec_broadcast_rax(X64Context *ctx, bool avx, int reg) {
+    if (avx) {
+        x64_emit(ctx, "vmovq %%rax, %%xmm%d", reg);
+        x64_emit(ctx, "vpbroadcastq %%xmm%d, %%ymm%d", reg, reg);
+    } else {
+        x64_emit(ctx, "movq %%rax, %%xmm%d", reg);
+        x64_emit(ctx, "punpcklqdq %%xmm%d, %%xmm%d", reg, reg);
+    }
+}
+
+/* Power-of-two constant broadcast by a SCALAR node, as a shift count */
+static int x64_vec_pow2_shift(const IRInstruction *instr, const IRVecNode *node) {
+    if (node->kind != IR_VEC_SCALAR || !x64_is_const(instr->args[node->arg])) return -1;
+    int64_t value = instr->args[node->arg]->data.int_val;
+    if (value <= 0 || (value & (value - 1)) != 0) return -1;
+    int shift = 0;
+    while (((int64_t)1 << shift) != value) shift++;
+    return shift;
+}
+
+/* Low 64 bits of lane-wise 64x64 products from 32x32->64 multiplies:
+   lo(a)*lo(b) + ((hi(a)*lo(b) + lo(a)*hi(b)) << 32) */
+static void x64_vec_mul(X64Context *ctx, bool avx, int a, int b, int dst) {
+    x64_vec_shift(ctx, avx, "psrlq", 32, a, X64_VEC_TMP1);
+    x64_vec_binop(ctx, avx, "pmuludq", X64_VEC_TMP1, b, X64_VEC_TMP1);
+    x64_vec_shift(ctx, avx, "psrlq", 32, b, X64_VEC_TMP2);
+    x64_vec_binop(ctx, avx, "pmuludq", X64_VEC_TMP2, a, X64_VEC_TMP2);
+    x64_vec_binop(ctx, avx, "paddq", X64_VEC_TMP1, X64_VEC_TMP2, X64_VEC_TMP1);
+    x64_vec_shift(ctx, avx, "psllq", 32, X64_VEC_TMP1, X64_VEC_TMP1);
+    x64_vec_binop(ctx, avx, "pmuludq", a, b, dst);
+    x64_vec_binop(ctx, avx, "paddq", dst, X64_VEC_TMP1, dst);
+}
+
+/* acc = lane-wise min/max(acc, x) (AVX2 only: needs 64-bit compares) */
+static void x64_vec_select(X64Context *ctx, IROpcode reduce, const char *width, int x, int acc, int mask) {
+    if (reduce == IR_LT) {
+        x64_emit(ctx, "vpcmpgtq %%%s%d, %%%s%d, %%%s%d", width, x, width, acc, width, mask);
+    } else {
+        x64_emit(ctx, "vpcmpgtq %%%s%d, %%%s%d, %%%s%d", width, acc, width, x, width, mask);
+    }
+    x64_emit(ctx, "vblendvpd %%%s%d, %%%s%d, %%%s%d, %%%s%d", width, mask, width, x, width, acc, width, acc);
+}
+
+static void x64_generate_vector_loop(X64Context *ctx, IRInstruction *instr) {
+    const IRVectorKernel *vk = instr->vector;
+    if (!vk || instr->arg_count < 2) return;
+    bool avx = vk->width == 4;
+    const char *vreg = avx ? "ymm" : "xmm";
+    const char *mov = avx ? "vmovdqu" : "movdqu";
+    char buf[64];
+
+    x64_emit_comment(ctx, avx ? "Vector loop (AVX2, 4 x i64)" : "Vector loop (SSE2, 2 x i64)");
+
+    // Element pointers
+    int base_of[64];
+    int base_count = 0;
+    for (int i = 0; i < 64; i++) base_of[i] = -1;
+    for (int n = 0; n < vk->node_count + vk->store_count; n++) {
+        int arg = n < vk->node_count ? (vk->nodes[n].kind == IR_VEC_ELEM ? vk->nodes[n].arg : -1)
+                                     : vk->stores[n - vk->node_count].arg;
+        if (arg < 0 || arg >= 64 || base_of[arg] >= 0 || base_count == 6) continue;
+        base_of[arg] = base_count;
+        x64_load(ctx, instr->args[arg], x64_vec_base_regs[base_count++]);
+    }
+
+    // Broadcast loop invariants once
+    for (int n = 0; n < vk->node_count; n++) {
+        if (vk->nodes[n].kind != IR_VEC_SCALAR) continue;
+        x64_load(ctx, instr->args[vk->nodes[n].arg], X64_REG_RAX);
+        x64_vec_broadcast_rax(ctx, avx, n);
+    }
+    if (vk->reduce == IR_ADD) {
+        x64_vec_binop(ctx, avx, "pxor", X64_VEC_ACC, X64_VEC_ACC, X64_VEC_ACC);
+    } else if (vk->reduce != IR_NOT) {
+        x64_load(ctx, instr->args[vk->reduce_init], X64_REG_RAX);
+        x64_vec_broadcast_rax(ctx, avx, X64_VEC_ACC);
+    }
+
+    x64_load(ctx, instr->args[0], X64_REG_RCX);
+    x64_load(ctx, instr->args[1], X64_REG_RDX);
+    int label = x64_generate_label(ctx);
+    char loop_label[32];
+    snprintf(loop_label, sizeof(loop_label), ".LVEC%d", label);
+    x64_emit_label(ctx, loop_label);
+
+    for (int n = 0; n <= vk->node_count; n++) {
+        for (int s = 0; s < vk->store_count; s++) {
+            const IRVecStore *store = &vk->stores[s];
+            if (store->after != n) continue;
+            x64_emit(ctx, "%s %%%s%d, %d(%%%s,%%rcx,8)", mov, vreg, store->node, store->offset * 8,
+                     x64_register_name(x64_vec_base_regs[base_of[store->arg]], true));
+        }
+        if (n == vk->node_count) break;
+
+        const IRVecNode *node = &vk->nodes[n];
+        switch (node->kind) {
+            case IR_VEC_ELEM:
+                x64_emit(ctx, "%s %d(%%%s,%%rcx,8), %%%s%d", mov, node->offset * 8,
+                         x64_register_name(x64_vec_base_regs[base_of[node->arg]], true), vreg, n);
+                break;
+            case IR_VEC_INDEX:
+                // i + offset + {0, 1, 2, 3}
+                x64_emit(ctx, "leaq %d(%%rcx), %%rax", node->offset);
+                x64_vec_broadcast_rax(ctx, avx, n);
+                if (avx) x64_emit(ctx, "vpaddq .LVIOTA(%%rip), %%ymm%d, %%ymm%d", n, n);
+                else x64_emit(ctx, "paddq .LVIOTA(%%rip), %%xmm%d", n);
+                ctx->need_lane_iota = true;
+                break;
+            case IR_VEC_SCALAR:
+                break;
+            case IR_VEC_OP: {
+                int shift = x64_vec_pow2_shift(instr, &vk->nodes[node->b]);
+                if (node->op == IR_ADD) {
+                    x64_vec_binop(ctx, avx, "paddq", node->a, node->b, n);
+                } else if (node->op == IR_SUB) {
+                    x64_vec_binop(ctx, avx, "psubq", node->a, node->b, n);
+                } else if (node->op == IR_MUL && shift >= 0) {
+                    x64_vec_shift(ctx, avx, "psllq", shift, node->a, n);
+                } else if (node->op == IR_MUL) {
+                    x64_vec_mul(ctx, avx, node->a, node->b, n);
+                } else {
+                    // Shift by an immediate count
+                    int amount = (int)(instr->args[vk->nodes[node->b].arg]->data.int_val & 63);
+                    x64_vec_shift(ctx, avx, node->op == IR_SHL ? "psllq" : "psrlq", amount, node->a, n);
+                }
+                break;
+            }
+        }
+    }
+
+    if (vk->reduce == IR_ADD) {
+        x64_vec_binop(ctx, avx, "paddq", X64_VEC_ACC, vk->reduce_node, X64_VEC_ACC);
+    } else if (vk->reduce != IR_NOT) {
+        x64_vec_select(ctx, vk->reduce, "ymm", vk->reduce_node, X64_VEC_ACC, X64_VEC_MASK);
+    }
+    x64_emit(ctx, "addq $%d, %%rcx", vk->width);
+    x64_emit(ctx, "cmpq %%rdx, %%rcx");
+    x64_emit(ctx, "jl .LVEC%d", label);
+
+    // Horizontal reduction of the accumulator lanes into %rax
+    if (vk->reduce != IR_NOT) {
+        if (avx) {
+            x64_emit(ctx, "vextracti128 $1, %%ymm%d, %%xmm%d", X64_VEC_ACC, X64_VEC_MASK);
+            if (vk->reduce == IR_ADD) {
+                x64_emit(ctx, "vpaddq %%xmm%d, %%xmm%d, %%xmm%d", X64_VEC_MASK, X64_VEC_ACC, X64_VEC_ACC);
+                x64_emit(ctx, "vpshufd $0x4e, %%xmm%d, %%xmm%d", X64_VEC_ACC, X64_VEC_MASK);
+                x64_emit(ctx, "vpaddq %%xmm%d, %%xmm%d, %%xmm%d", X64_VEC_MASK, X64_VEC_ACC, X64_VEC_ACC);
+            } else {
+                x64_vec_select(ctx, vk->reduce, "xmm", X64_VEC_MASK, X64_VEC_ACC, X64_VEC_TMP1);
+                x64_emit(ctx, "vpshufd $0x4e, %%xmm%d, %%xmm%d", X64_VEC_ACC, X64_VEC_MASK);
+                x64_vec_select(ctx, vk->reduce, "xmm", X64_VEC_MASK, X64_VEC_ACC, X64_VEC_TMP1);
+            }
+            x64_emit(ctx, "vmovq %%xmm%d, %%rax", X64_VEC_ACC);
+        } else {
+            x64_emit(ctx, "pshufd $0x4e, %%xmm%d, %%xmm%d", X64_VEC_ACC, X64_VEC_MASK);
+            x64_emit(ctx, "paddq %%xmm%d, %%xmm%d", X64_VEC_MASK, X64_VEC_ACC);
+            x64_emit(ctx, "movq %%xmm%d, %%rax", X64_VEC_ACC);
+        }
+    }
+    if (avx) x64_emit(ctx, "vzeroupper");
+    ctx->rax_vreg = -1;
+
+    if (vk->reduce == IR_ADD && !ir_value_is_const_int(instr->args[vk->reduce_init], 0)) {
+        x64_emit(ctx, "addq %s, %%rax", x64_operand(ctx, instr->args[vk->reduce_init], buf, sizeof(buf)));
+    }
+    if (vk->reduce != IR_NOT) x64_store_result(ctx, instr->dest);
 }
 
 /* Generate instruction */
 void x64_generate_instruction(X64Context *ctx, IRInstruction *instr) {
     if (!instr) return;
+    char buf[64];
     
     switch (instr->opcode) {
         case IR_CONST_INT:
-            if (instr->dest) {
-                x64_emit(ctx, "movq $%ld, %%rax", instr->src1->data.int_val);
+        case IR_MOVE:
+            if (!instr->dest) break;
+            if (x64_value_reg(ctx, instr->dest) != X64_REG_COUNT) {
+                x64_load(ctx, instr->src1, x64_value_reg(ctx, instr->dest));
+            } else if (x64_is_const(instr->src1) && x64_is_imm32(instr->src1->data.int_val)) {
+                x64_emit(ctx, "movq $%" PRId64 ", %s", instr->src1->data.int_val,
+                         x64_slot(ctx, instr->dest, buf, sizeof(buf)));
+            } else {
+                x64_load(ctx, instr->src1, X64_REG_RAX);
+                x64_store_result(ctx, instr->dest);
             }
             break;
-            
-        case IR_PUSH:
-             x64_emit(ctx, "pushq %%rax");
-             break;
 
         case IR_ADD:
-            x64_emit_comment(ctx, "ADD operation");
-            x64_emit(ctx, "popq %%rbx"); // Pop left operand
-            x64_emit(ctx, "addq %%rbx, %%rax");
-            break;
-            
         case IR_SUB:
-            x64_emit_comment(ctx, "SUB operation");
-            x64_emit(ctx, "movq %%rax, %%rbx"); // Right operand -> RBX
-            x64_emit(ctx, "popq %%rax");        // Left operand -> RAX
-            x64_emit(ctx, "subq %%rbx, %%rax"); // Left - Right
+        case IR_AND:
+        case IR_OR: {
+            const char *mnemonic = instr->opcode == IR_ADD ? "addq" :
+                                   instr->opcode == IR_SUB ? "subq" :
+                                   instr->opcode == IR_AND ? "andq" : "orq";
+            x64_emit_comment(ctx, ir_opcode_name(instr->opcode));
+            const IRValue *lhs = instr->src1;
+            const IRValue *rhs = instr->src2;
+            if (instr->opcode != IR_SUB && x64_is_const(lhs) && !x64_is_const(rhs)) {
+                // Commutative: keep the constant as the immediate operand
+                lhs = instr->src2;
+                rhs = instr->src1;
+            }
+            X64Register out = x64_result_reg(ctx, instr->dest);
+            X64Register lhs_reg = x64_value_reg(ctx, lhs);
+            X64Register rhs_reg = x64_value_reg(ctx, rhs);
+            bool rhs_imm = x64_is_const(rhs) && x64_is_imm32(rhs->data.int_val) &&
+                           rhs->data.int_val != INT32_MIN;
+            if (instr->opcode == IR_SUB && x64_is_const(lhs) && lhs->data.int_val == 0) {
+                // 0 - x
+                if (out != X64_REG_RAX && rhs_reg == out) out = X64_REG_RAX;
+                x64_load(ctx, rhs, out);
+                x64_emit(ctx, "negq %%%s", x64_reg64(out));
+            } else if ((instr->opcode == IR_ADD || instr->opcode == IR_SUB) && rhs_imm &&
+                       lhs_reg != X64_REG_COUNT && lhs_reg != out) {
+                // Three-operand add: leaq imm(%src), %dst
+                int64_t disp = instr->opcode == IR_ADD ? rhs->data.int_val : -rhs->data.int_val;
+                x64_emit(ctx, "leaq %" PRId64 "(%%%s), %%%s", disp, x64_reg64(lhs_reg), x64_reg64(out));
+            } else if (instr->opcode == IR_ADD && lhs_reg != X64_REG_COUNT && rhs_reg != X64_REG_COUNT &&
+                       lhs_reg != out && rhs_reg != out) {
+                x64_emit(ctx, "leaq (%%%s,%%%s), %%%s", x64_reg64(lhs_reg), x64_reg64(rhs_reg), x64_reg64(out));
+            } else {
+                // The destination may share a register with an operand it consumes
+                if (out != X64_REG_RAX && rhs_reg == out) out = X64_REG_RAX;
+                const char *operand = x64_operand(ctx, rhs, buf, sizeof(buf));
+                x64_load(ctx, lhs, out);
+                x64_emit(ctx, "%s %s, %%%s", mnemonic, operand, x64_reg64(out));
+            }
+            x64_finish_result(ctx, instr->dest, out);
             break;
+        }
             
-        case IR_MUL:
+        case IR_MUL: {
             x64_emit_comment(ctx, "MUL operation");
-            x64_emit(ctx, "popq %%rbx");
-            x64_emit(ctx, "imulq %%rbx, %%rax");
+            X64Register out = x64_result_reg(ctx, instr->dest);
+            if (out != X64_REG_RAX && x64_value_reg(ctx, instr->src2) == out) out = X64_REG_RAX;
+            const char *dst = x64_reg64(out);
+            if (x64_is_const(instr->src2) && (instr->src2->data.int_val == 3 ||
+                instr->src2->data.int_val == 5 || instr->src2->data.int_val == 9)) {
+                // x * {3,5,9} == x + x * {2,4,8}
+                const char *src = x64_reg64(x64_reg_or_load(ctx, instr->src1, out));
+                x64_emit(ctx, "leaq (%%%s,%%%s,%d), %%%s", src, src, (int)instr->src2->data.int_val - 1, dst);
+            } else if (x64_is_const(instr->src2) && x64_is_imm32(instr->src2->data.int_val)) {
+                const char *src = x64_reg64(x64_reg_or_load(ctx, instr->src1, out));
+                x64_emit(ctx, "imulq $%" PRId64 ", %%%s, %%%s", instr->src2->data.int_val, src, dst);
+            } else {
+                const char *rhs = x64_operand(ctx, instr->src2, buf, sizeof(buf));
+                x64_load(ctx, instr->src1, out);
+                x64_emit(ctx, "imulq %s, %%%s", rhs, dst);
+            }
+            x64_finish_result(ctx, instr->dest, out);
+            break;
+        }
+            
+        case IR_MULHI:
+            x64_emit_comment(ctx, "MULHI operation");
+            x64_load(ctx, instr->src2, X64_REG_RCX);
+            x64_load(ctx, instr->src1, X64_REG_RAX);
+            x64_emit(ctx, "imulq %%rcx");
+            x64_emit(ctx, "movq %%rdx, %%rax");
+            x64_store_result(ctx, instr->dest);
             break;
             
         case IR_DIV:
-            x64_emit_comment(ctx, "DIV operation");
-            x64_emit(ctx, "movq %%rax, %%rbx"); // Right -> RBX (divisor)
-            x64_emit(ctx, "popq %%rax");        // Left -> RAX (dividend)
+        case IR_MOD:
+            x64_emit_comment(ctx, instr->opcode == IR_DIV ? "DIV operation" : "MOD operation");
+            x64_load(ctx, instr->src2, X64_REG_RCX); // Divisor
+            x64_load(ctx, instr->src1, X64_REG_RAX); // Dividend
             x64_emit(ctx, "cqto");
-            x64_emit(ctx, "idivq %%rbx");
+            x64_emit(ctx, "idivq %%rcx");
+            if (instr->opcode == IR_MOD) {
+                x64_emit(ctx, "movq %%rdx, %%rax");
+            }
+            x64_store_result(ctx, instr->dest);
             break;
             
-        case IR_RETURN:
-            if (instr->src1) {
-                if (instr->src1->kind == IR_VAL_CONST) {
-                     x64_emit(ctx, "movq $%ld, %%rax", instr->src1->data.int_val);
-                } else if (instr->src1->kind == IR_VAL_REG) {
-                     // If it's a register, we likely need to map it to RAX.
-                     // But we don't know WHICH physical register the virtual register is in!
-                     // The naive stack-based codegen assumes regs are popped?
-                     // Wait, our IR uses virtual regs.
-                     // IR_ADD pops to RAX.
-                     // If IR_RETURN src is implicit (last result), it's in RAX.
-                     // But if src1 is EXPLICIT register from `ir.c` (reg_count - 1),
-                     // we need to know where `reg_count-1` is.
-                     
-                     // In stack-machine mode (current codegen):
-                     // Operations leave result in RAX (and/or stack).
-                     // If ir.c sets src1 to "last register", it implies "current accumulator".
-                     // So we implicitly satisfy it?
-                     // BUT, if we have `x = 1; return x`:
-                     // LOAD 0 -> RAX=1.
-                     // RETURN (src=reg for x).
-                     // We need to move value of reg x to RAX.
-                     
-                     // How does codegen access generic registers?
-                     // `IR_LOAD` emits `movq -off(%rbp), %rax`.
-                     // Does `IR_RETURN` need to generate a load?
-                     // Yes! If src1 is a register that needs to be returned.
-                     
-                     // But `ir.c` logic for `AST_RETURN_STMT` sets src1 to `func->reg_count - 1`.
-                     // `reg_count-1` is a virtual temporary.
-                     // Where is it stored?
-                     // `IR_ADD` result: `addq %rbx, %rax` -> result in RAX. DOES NOT STORE to stack/reg map.
-                     // Unless there is a store?
-                     // `ir.c` `IR_ADD` dest is `reg_count++`.
-                     // Logic: `bin_op->dest = ir_value_create_reg(...)`.
-                     // But `codegen` ignores `dest` for ADD! It keeps result in RAX.
-                     
-                     // CRITICAL: The codegen assumes RAX holds the result of the last operation.
-                     // If `IR_RETURN` is generating `mov...` it clobbers RAX!
-                     // If src1 is a CONST, `mov $val, %rax` is correct.
-                     // If src1 is a REG, checking if it is the "current" reg (implicit in RAX).
-                     // If `ir.c` guarantees src1 is the result of the previous instruction...
-                     // Then it's already in RAX.
-                     // So we do NOTHING.
-                }
+        case IR_SHL:
+        case IR_SHR:
+        case IR_SAR: {
+            const char *mnemonic = instr->opcode == IR_SHL ? "shlq" :
+                                   instr->opcode == IR_SHR ? "shrq" : "sarq";
+            x64_emit_comment(ctx, ir_opcode_name(instr->opcode));
+            if (x64_is_const(instr->src2)) {
+                X64Register out = x64_result_reg(ctx, instr->dest);
+                x64_load(ctx, instr->src1, out);
+                x64_emit(ctx, "%s $%d, %%%s", mnemonic, (int)(instr->src2->data.int_val & 63), x64_reg64(out));
+                x64_finish_result(ctx, instr->dest, out);
+                break;
+            } else {
+                x64_load(ctx, instr->src2, X64_REG_RCX);
+                x64_load(ctx, instr->src1, X64_REG_RAX);
+                x64_emit(ctx, "%s %%cl, %%rax", mnemonic);
             }
-            x64_emit(ctx, "jmp %s_return", instr->comment ? instr->comment : "main");
+            x64_store_result(ctx, instr->dest);
+            break;
+        }
+            
+        case IR_NOT: {
+            const char *src = x64_reg64(x64_reg_or_load(ctx, instr->src1, X64_REG_RAX));
+            x64_emit(ctx, "testq %%%s, %%%s", src, src);
+            x64_emit(ctx, "sete %%al");
+            x64_emit(ctx, "movzbq %%al, %%rax");
+            x64_store_result(ctx, instr->dest);
+            break;
+        }
+            
+        case IR_RETURN:
+            x64_load(ctx, instr->src1, X64_REG_RAX);
+            x64_emit(ctx, "jmp %s_return", ctx->current_func ? ctx->current_func->name : "main");
             break;
 
         case IR_ALLOC:
@@ -255,68 +1793,76 @@ void x64_generate_instruction(X64Context *ctx, IRInstruction *instr) {
             
         case IR_STORE:
             x64_emit_comment(ctx, "Store variable");
-            // dest is the variable register (index), src implicitly in RAX from previous expr
-            // Stack offset = (reg_num + 1) * 8
-            if (instr->dest) {
-                int offset = (instr->dest->data.reg_num + 1) * 8;
-                x64_emit(ctx, "movq %%rax, -%d(%%rbp)", offset);
+            if (instr->dest && x64_value_reg(ctx, instr->dest) != X64_REG_COUNT) {
+                x64_load(ctx, instr->src1, x64_value_reg(ctx, instr->dest));
+            } else if (instr->dest && x64_value_reg(ctx, instr->src1) != X64_REG_COUNT) {
+                x64_emit(ctx, "movq %%%s, %s", x64_reg64(x64_value_reg(ctx, instr->src1)),
+                         x64_slot(ctx, instr->dest, buf, sizeof(buf)));
+            } else if (instr->dest) {
+                if (x64_is_const(instr->src1) && x64_is_imm32(instr->src1->data.int_val)) {
+                    x64_emit(ctx, "movq $%" PRId64 ", %s", instr->src1->data.int_val,
+                             x64_slot(ctx, instr->dest, buf, sizeof(buf)));
+                } else {
+                    x64_load(ctx, instr->src1, X64_REG_RAX);
+                    x64_emit(ctx, "movq %%rax, %s", x64_slot(ctx, instr->dest, buf, sizeof(buf)));
+                    if (instr->src1 && instr->src1->kind == IR_VAL_REG) ctx->rax_vreg = instr->src1->data.reg_num;
+                }
             }
             break;
             
         case IR_LOAD:
             x64_emit_comment(ctx, "Load variable");
-            // src1 is the variable register
-            if (instr->src1) {
-                int offset = (instr->src1->data.reg_num + 1) * 8;
-                x64_emit(ctx, "movq -%d(%%rbp), %%rax", offset);
+            if (instr->src1 && instr->dest) {
+                X64Register out = x64_result_reg(ctx, instr->dest);
+                x64_load(ctx, instr->src1, out);
+                x64_finish_result(ctx, instr->dest, out);
             }
             break;
             
         case IR_PRINT:
-            x64_emit_comment(ctx, "Print integer");
-            // Assuming the value to print is in RAX (from previous instruction)
-            x64_emit(ctx, "movq %%rax, %%rsi"); // 2nd argument: value to print
-            x64_emit(ctx, "leaq .LC0(%%rip), %%rdi"); // 1st argument: format string
-            x64_emit(ctx, "xorq %%rax, %%rax"); // Clear RAX (no vector args)
-            x64_emit(ctx, "call printf@PLT");
+            if (instr->src1 && instr->src1->kind == IR_VAL_CONST && instr->src1->type == IR_TYPE_STRING) {
+                x64_emit_comment(ctx, "Print text");
+                x64_emit(ctx, "leaq .LSTR%d(%%rip), %%rdi", x64_define_string(ctx, instr->src1->data.string_val));
+                x64_emit(ctx, "call __sub_print_str");
+            } else {
+                x64_emit_comment(ctx, "Print integer");
+                x64_load(ctx, instr->src1, X64_REG_RDI);
+                x64_emit(ctx, "call __sub_print_int");
+            }
+            ctx->rax_vreg = -1;
             break;
             
         case IR_JUMP_IF_NOT:
-            x64_emit_comment(ctx, "Jump if false (0)");
-            x64_emit(ctx, "cmpq $0, %%rax");
+        case IR_JUMP_IF: {
+            x64_emit_comment(ctx, instr->opcode == IR_JUMP_IF_NOT ? "Jump if false (0)" : "Jump if true");
+            const char *cond = x64_reg64(x64_reg_or_load(ctx, instr->src1, X64_REG_RAX));
+            x64_emit(ctx, "testq %%%s, %%%s", cond, cond);
             if (instr->dest && instr->dest->data.label) {
-                x64_emit(ctx, "je %s", instr->dest->data.label);
+                x64_emit(ctx, "%s %s", instr->opcode == IR_JUMP_IF_NOT ? "je" : "jne",
+                         instr->dest->data.label);
             }
             break;
+        }
 
         case IR_EQ:
         case IR_NE:
         case IR_LT:
         case IR_LE:
         case IR_GT:
-        case IR_GE:
+        case IR_GE: {
             x64_emit_comment(ctx, "Comparison");
-            x64_emit(ctx, "movq %%rax, %%rbx"); // Right -> RBX
-            x64_emit(ctx, "popq %%rax");        // Left -> RAX
-            x64_emit(ctx, "cmpq %%rbx, %%rax"); // Compare Left (RAX) vs Right (RBX)
+            IROpcode op = x64_emit_compare(ctx, instr);
             x64_emit(ctx, "movq $0, %%rax");    // Default false
-            const char *set_instr = "sete"; // Default EQ
-            switch(instr->opcode) {
-                case IR_EQ: set_instr = "sete"; break;
-                case IR_NE: set_instr = "setne"; break;
-                case IR_LT: set_instr = "setl"; break;
-                case IR_LE: set_instr = "setle"; break;
-                case IR_GT: set_instr = "setg"; break;
-                case IR_GE: set_instr = "setge"; break;
-                default: break;
-            }
-            x64_emit(ctx, "%s %%al", set_instr);
+            x64_emit(ctx, "%s %%al", x64_setcc(op));
+            x64_store_result(ctx, instr->dest);
             break;
+        }
             
         case IR_LABEL:
             if (instr->dest && instr->dest->data.label) {
                 x64_emit_label(ctx, instr->dest->data.label);
             }
+            ctx->rax_vreg = -1;
             break;
             
         case IR_JUMP:
@@ -325,55 +1871,139 @@ void x64_generate_instruction(X64Context *ctx, IRInstruction *instr) {
             }
             break;
             
-        case IR_CALL:
+        case IR_CALL: {
+            // SUB functions are not variadic: no AL vector count
             x64_emit_comment(ctx, "Function call");
-            
-            int arg_count = 0;
-            if (instr->src1 && instr->src1->type == IR_TYPE_INT) {
-                arg_count = (int)instr->src1->data.int_val;
+            int pop = x64_setup_call_args(ctx, instr);
+            if (instr->src1 && instr->src1->data.label) {
+                x64_emit(ctx, "call %s", instr->src1->data.label);
             }
-            
-            // Arguments were pushed in order: arg0, arg1, ... argN
-            // Stack top is argN.
-            // ABI expects: RDI, RSI, RDX, RCX, R8, R9.
-            // We must POP in REVERSE ABI order: R9, R8, RCX, RDX, RSI, RDI.
-            
-            // Handle up to 6 arguments for now
-            // Note: We only pop if count >= N, but we must do it in specific order.
-            // Actually, we simply pop 'arg_count' times.
-            // If count is 1: Stack: [arg0]. Pop -> RDI.
-            // If count is 2: Stack: [arg0, arg1]. Pop -> RSI, Pop -> RDI.
-            // Wait, PUSH order in ir.c loop:
-            // for i=0..count: push child[i]. 
-            // So stack is: arg0 (bottom), arg1, arg2 (top).
-            // POP gives arg2 (RDX).
-            // POP gives arg1 (RSI).
-            // POP gives arg0 (RDI).
-            // So we just need to determine WHICH register correspond to the CURRENT pop.
-            // loop k from count-1 down to 0:
-            //   reg = abi[k]
-            //   pop reg
-            
-            const char *abi_regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
-            for (int k = arg_count - 1; k >= 0; k--) {
-                if (k < 6) {
-                    x64_emit(ctx, "popq %%%s", abi_regs[k]);
-                } else {
-                    // TODO: Stack arguments for > 6 args
-                     x64_emit_comment(ctx, "Arg > 6 ignored for now");
-                     x64_emit(ctx, "addq $8, %%rsp"); // wrapper pop
-                }
+            if (pop) x64_emit(ctx, "addq $%d, %%rsp", pop);
+            ctx->rax_vreg = -1;
+            x64_store_result(ctx, instr->dest);
+            break;
+        }
+        
+        case IR_TAIL_CALL: {
+            // Arguments in registers (at most six, see ir_tailcall.c),
+            // release our frame, and let the callee return straight to
+            // our caller
+            if (x64_flushes_output(ctx, ctx->current_func)) {
+                x64_emit_comment(ctx, "Call and return (output is flushed on the way out)");
+                int pop = x64_setup_call_args(ctx, instr);
+                x64_emit(ctx, "call %s", instr->src1->data.label);
+                if (pop) x64_emit(ctx, "addq $%d, %%rsp", pop);
+                x64_emit(ctx, "jmp %s_return", ctx->current_func->name);
+                ctx->rax_vreg = -1;
+                break;
             }
-            
-            // Align stack if needed (System V requires 16-byte alignment before call)
-            // Current simplistic approach aligns in prologue.
-            
-            x64_emit(ctx, "xorq %%rax, %%rax"); // Variadic args (AL=0)
-            if (instr->dest && instr->dest->data.label) {
-                x64_emit(ctx, "call %s", instr->dest->data.label);
+            x64_emit_comment(ctx, "Tail call");
+            x64_setup_call_args(ctx, instr);
+            x64_leave_frame(ctx);
+            if (instr->src1 && instr->src1->data.label) {
+                x64_emit(ctx, "jmp %s", instr->src1->data.label);
             }
+            ctx->rax_vreg = -1;
             break;
+        }
             
+        case IR_ALLOC_ARRAY:
+            // calloc(n + 2, 8): capacity and length words, then the elements
+            x64_emit_comment(ctx, "Allocate array");
+            x64_load(ctx, instr->src1, X64_REG_RDI);
+            if (!(instr->src1->kind == IR_VAL_CONST && instr->src1->data.int_val >= 0)) {
+                x64_emit(ctx, "testq %%rdi, %%rdi");
+                x64_emit(ctx, "js __sub_size_fail");
+                ctx->need_fail_runtime = true;
+            }
+            x64_emit(ctx, "addq $2, %%rdi");
+            x64_emit(ctx, "movl $8, %%esi");
+            x64_emit(ctx, "call %s", ctx->static_runtime ? "__sub_calloc" : "calloc@PLT");
+            ctx->rax_vreg = -1;
+            if (!ctx->static_runtime) {
+                x64_emit(ctx, "testq %%rax, %%rax");
+                x64_emit(ctx, "jz __sub_memory_fail");
+                ctx->need_fail_runtime = true;
+            }
+            x64_load(ctx, instr->src1, X64_REG_RCX);
+            x64_emit(ctx, "movq %%rcx, (%%rax)");
+            x64_emit(ctx, "movq %%rcx, 8(%%rax)");
+            x64_emit(ctx, "addq $16, %%rax");
+            x64_store_result(ctx, instr->dest);
+            break;
+
+        case IR_CONST_STRING: {
+            X64Register out = x64_result_reg(ctx, instr->dest);
+            x64_emit(ctx, "leaq .LSTR%d(%%rip), %%%s", x64_define_string(ctx, instr->src1->data.string_val),
+                     x64_reg64(out));
+            x64_finish_result(ctx, instr->dest, out);
+            break;
+        }
+
+        case IR_ALLOC_FRAME_ARRAY: {
+            // Fresh zeroed array in this function's frame
+            x64_emit_comment(ctx, "Frame array");
+            int64_t length = instr->src1->data.int_val;
+            int elements = x64_frame_array_offset(ctx, instr->src2->data.int_val, length);
+            x64_emit(ctx, "movq $%" PRId64 ", %s", length, x64_frame_addr(ctx, elements + 8, buf, sizeof(buf)));
+            for (int64_t i = 0; i < length; i++) {
+                x64_emit(ctx, "movq $0, %s", x64_frame_addr(ctx, elements - (int)(i * 8), buf, sizeof(buf)));
+            }
+            X64Register out = x64_result_reg(ctx, instr->dest);
+            x64_emit(ctx, "leaq %s, %%%s", x64_frame_addr(ctx, elements, buf, sizeof(buf)), x64_reg64(out));
+            x64_finish_result(ctx, instr->dest, out);
+            break;
+        }
+
+        case IR_ARRAY_LEN: {
+            X64Register out = x64_result_reg(ctx, instr->dest);
+            X64Register base = x64_reg_or_load(ctx, instr->src1, X64_REG_RAX);
+            x64_emit(ctx, "movq -8(%%%s), %%%s", x64_reg64(base), x64_reg64(out));
+            x64_finish_result(ctx, instr->dest, out);
+            break;
+        }
+
+        case IR_LOAD_ELEM: {
+            x64_emit_comment(ctx, "Load element");
+            X64Register out = x64_result_reg(ctx, instr->dest);
+            if (x64_is_const(instr->src2) && x64_is_imm32(instr->src2->data.int_val * 8)) {
+                X64Register base = x64_reg_or_load(ctx, instr->src1, X64_REG_RAX);
+                if (!instr->in_bounds) x64_emit_const_index_check(ctx, base, instr->src2->data.int_val);
+                x64_emit(ctx, "movq %" PRId64 "(%%%s), %%%s", instr->src2->data.int_val * 8,
+                         x64_reg64(base), x64_reg64(out));
+            } else {
+                X64Register index = x64_reg_or_load(ctx, instr->src2, X64_REG_RCX);
+                X64Register base = x64_reg_or_load(ctx, instr->src1, X64_REG_RAX);
+                if (!instr->in_bounds) x64_emit_index_check(ctx, base, index);
+                x64_emit(ctx, "movq (%%%s,%%%s,8), %%%s", x64_reg64(base), x64_reg64(index), x64_reg64(out));
+            }
+            x64_finish_result(ctx, instr->dest, out);
+            break;
+        }
+
+        case IR_STORE_ELEM: {
+            x64_emit_comment(ctx, "Store element");
+            if (instr->arg_count < 1) break;
+            X64Register value = x64_reg_or_load(ctx, instr->args[0], X64_REG_RDX);
+            X64Register index = x64_reg_or_load(ctx, instr->src2, X64_REG_RCX);
+            X64Register base = x64_reg_or_load(ctx, instr->src1, X64_REG_RAX);
+            if (!instr->in_bounds) x64_emit_index_check(ctx, base, index);
+            x64_emit(ctx, "movq %%%s, (%%%s,%%%s,8)", x64_reg64(value), x64_reg64(base), x64_reg64(index));
+            break;
+        }
+
+        case IR_VECTOR_LOOP:
+            x64_generate_vector_loop(ctx, instr);
+            break;
+
+        case IR_PROFILE_COUNT:
+            x64_emit(ctx, "incq .Lsub_prof_counts+%lld(%%rip)", (long long)instr->src1->data.int_val * 8);
+            break;
+
+        case IR_PROFILE_WRITE:
+            x64_emit(ctx, "call __sub_prof_write");
+            break;
+
         default:
             x64_emit_comment(ctx, "Unimplemented opcode");
             break;
@@ -384,16 +2014,49 @@ void x64_generate_instruction(X64Context *ctx, IRInstruction *instr) {
 void x64_generate_function(X64Context *ctx, IRFunction *func) {
     if (!func) return;
     
+    ctx->current_func = func;
+    ctx->buffering = true;
+    ctx->alloc = ctx->use_regalloc ? x64_regalloc_function(func) : NULL;
     x64_generate_function_prologue(ctx, func);
+    if (ctx->alloc) {
+        char note[96];
+        snprintf(note, sizeof(note), "Linear scan: %d values in registers, %d on the stack",
+                 ctx->alloc->assigned, ctx->alloc->spilled);
+        x64_emit_comment(ctx, note);
+    }
     
-    // Generate instructions
+    X64IselSink sink = { ctx, NULL };
+    X64IselTarget target = {
+        X64_SYNTAX_ATT, &sink, x64_isel_locate, x64_isel_emit,
+        { X64_REG_RAX, X64_REG_RCX, X64_REG_RDX }, 3
+    };
+    int *use_counts = x64_isel_use_counts(func);
+
+    // Generate instructions; a single-use result computed right before
+    // its user is folded into the user's tree when that is cheaper
     IRInstruction *instr = func->instructions;
     while (instr) {
-        x64_generate_instruction(ctx, instr);
-        instr = instr->next;
+        IRInstruction *next = instr->next;
+        if (x64_isel_foldable(instr, next, use_counts) && x64_isel_absorbs(&target, next, instr)) {
+            if (x64_select(ctx, &target, next, instr)) {
+                instr = next->next;
+                continue;
+            }
+        }
+        if (!x64_select(ctx, &target, instr, NULL)) {
+            x64_generate_instruction(ctx, instr);
+        }
+        instr = next;
     }
+    free(use_counts);
     
     x64_generate_function_epilogue(ctx, func);
+    x64_regalloc_free(ctx->alloc);
+    ctx->alloc = NULL;
+
+    x64_peephole_function(ctx);
+    x64_code_flush(ctx);
+    ctx->buffering = false;
 }
 
 /* Generate complete program */
@@ -401,6 +2064,20 @@ void x64_generate_program(X64Context *ctx, IRModule *module) {
     if (!module) return;
     
     x64_generate_prologue(ctx);
+    for (IRFunction *f = module->functions; f; f = f->next) {
+        for (IRInstruction *instr = f->instructions; instr; instr = instr->next) {
+            if (instr->opcode == IR_PRINT) ctx->print_runtime = true;
+            if (instr->opcode == IR_CONST_STRING ||
+                ((instr->opcode == IR_CALL || instr->opcode == IR_TAIL_CALL) && instr->src1 &&
+                 instr->src1->data.label && strncmp(instr->src1->data.label, "__sub_", 6) == 0)) {
+                ctx->string_runtime = true;
+            }
+        }
+    }
+    // String routines print, convert numbers and check indexes
+    if (ctx->string_runtime) ctx->print_runtime = ctx->need_fail_runtime = true;
+    // __sub_calloc reports allocation failures
+    if (ctx->static_runtime) ctx->need_fail_runtime = true;
     
     // Generate all functions
     IRFunction *func = module->functions;
@@ -408,6 +2085,28 @@ void x64_generate_program(X64Context *ctx, IRModule *module) {
         x64_generate_function(ctx, func);
         func = func->next;
     }
+    if (ctx->static_runtime) x64_generate_runtime(ctx);
+    if (ctx->print_runtime) x64_generate_print_runtime(ctx);
+    if (ctx->string_runtime) x64_generate_string_runtime(ctx);
+    if (ctx->need_fail_runtime) x64_generate_fail_runtime(ctx);
+    if (module->profile_counters > 0) x64_generate_profile_runtime(ctx, module);
+    
+    if (ctx->object) {
+        if (ctx->need_lane_iota) {
+            static const int64_t lanes[4] = { 0, 1, 2, 3 };
+            elf_align(ctx->object, ELF_SEC_RODATA, 32);
+            elf_define_symbol(ctx->object, ".LVIOTA", ELF_SEC_RODATA,
+                              elf_append(ctx->object, ELF_SEC_RODATA, lanes, sizeof(lanes)), false);
+        }
+        return;
+    }
+
+    if (ctx->need_lane_iota) {
+        fprintf(ctx->output, "\n.section .rodata\n");
+        fprintf(ctx->output, ".balign 32\n");
+        fprintf(ctx->output, ".LVIOTA:\n");
+        fprintf(ctx->output, "    .quad 0, 1, 2, 3\n");
+    }
     
     // Add exit code
     fprintf(ctx->output, "\n# Exit\n");
@@ -31,6 +31,33 @@ typedef enum {
     X64_REG_COUNT
 } X64Register;
 
+/* One line of a function body, buffered for the peephole pass */
+typedef enum {
+    X64_MI_INSN,
+    X64_MI_LABEL,
+    X64_MI_COMMENT
+} X64MInstrKind;
+
+typedef struct {
+    X64MInstrKind kind;
+    char *op;                  // Mnemonic, label name or comment text
+    char *operands[4];         // AT&T order: destination last
+    int operand_count;
+} X64MInstr;
+
+/* Peephole rewrites, counted per rule */
+typedef enum {
+    X64_PEEP_SELF_MOVE,        // movq %r, %r
+    X64_PEEP_MOVE_BACK,        // movq a, b; movq b, a
+    X64_PEEP_STORE_RELOAD,     // movq %r, mem; movq mem, %s
+    X64_PEEP_PUSH_POP,         // pushq a; popq b
+    X64_PEEP_JUMP_NEXT,        // jmp to the following label
+    X64_PEEP_UNREACHABLE,      // code between a jmp/ret and the next label
+    X64_PEEP_SETCC_ZERO,       // movq $0, %rax before setcc
+    X64_PEEP_FLAG_RETEST,      // testq of a setcc result before je/jne
+    X64_PEEP_RULE_COUNT
+} X64PeepholeRule;
+
 /* Code generation context */
 typedef struct {
     FILE *output;              // Output file
@@ -39,6 +66,25 @@ typedef struct {
     int stack_offset;          // Current stack offset
     bool reg_in_use[X64_REG_COUNT]; // Register allocation tracker
     IRFunction *current_func;   // Current function being generated
+    int rax_vreg;               // Virtual register currently mirrored in RAX (-1 if none)
+    X64Register frame_base;     // RBP, or RSP in a leaf function without a frame pointer
+    int frame_size;             // RSP-based frames: bytes reserved below the return address
+    bool need_lane_iota;        // Emit the {0, 1, 2, 3} lane index constant
+    bool need_fail_runtime;     // Some check can fail at run time: emit the __sub_*_fail entries
+    bool print_runtime;         // The module prints: emit the buffered output runtime
+    bool string_runtime;        // The module uses strings or append: emit their runtime
+    bool use_regalloc;          // Keep locals and vregs in registers (-O1 and above)
+    struct X64RegAlloc *alloc;  // Current function's assignment (NULL: all on the stack)
+    X64MInstr *code;            // Current function body, emitted after the peephole pass
+    int code_count;
+    int code_capacity;
+    bool buffering;             // Inside a function: x64_emit* append to `code`
+    int peephole_level;         // 0 off, 1 local cleanups, 2 also flag reuse (-O2 and above)
+    int peephole_counts[X64_PEEP_RULE_COUNT];
+    struct ElfObject *object;   // Integrated assembler: encode into this object instead of writing text
+    char object_error[160];     // First instruction the encoder rejected (empty if none)
+    bool static_runtime;        // Call the built-in syscall runtime instead of libc, enter at _start
+    const char *profile_path;   // --profile-generate: where the instrumented program writes its counts
 } X64Context;
 
 /* Main code generation functions */
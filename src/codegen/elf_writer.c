@@ -0,0 +1,486 @@
+/* ========================================
+   SUB Language - ELF64 Object Writer
+   Implementation
+   File: elf_writer.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "elf_writer.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+/* ELF constants (spelled out here so the writer builds without <elf.h>) */
+#define ELF_ET_REL        1
+#define ELF_ET_EXEC       2
+#define ELF_EM_X86_64     62
+#define ELF_SHT_PROGBITS  1
+#define ELF_SHT_SYMTAB    2
+#define ELF_SHT_STRTAB    3
+#define ELF_SHT_RELA      4
+#define ELF_SHF_WRITE     0x1
+#define ELF_SHF_ALLOC     0x2
+#define ELF_SHF_EXECINSTR 0x4
+#define ELF_SHF_INFO_LINK 0x40
+#define ELF_STB_LOCAL     0
+#define ELF_STB_GLOBAL    1
+#define ELF_STT_NOTYPE    0
+#define ELF_STT_FUNC      2
+#define ELF_STT_SECTION   3
+#define ELF_PT_LOAD       1
+#define ELF_PT_GNU_STACK  0x6474e551
+#define ELF_PF_X          0x1
+#define ELF_PF_W          0x2
+#define ELF_PF_R          0x4
+
+#define ELF_HEADER_SIZE   64
+#define ELF_SHDR_SIZE     64
+#define ELF_SYM_SIZE      24
+#define ELF_RELA_SIZE     24
+#define ELF_PHDR_SIZE     56
+
+#define ELF_EXEC_BASE     0x400000
+#define ELF_PAGE_SIZE     0x1000
+
+static const char *elf_section_names[ELF_SEC_COUNT] = { ".text", ".rodata", ".data" };
+
+ElfObject* elf_object_create(void) {
+    ElfObject *obj = calloc(1, sizeof(ElfObject));
+    obj->sections[ELF_SEC_TEXT].align = 16;
+    obj->sections[ELF_SEC_RODATA].align = 8;
+    obj->sections[ELF_SEC_DATA].align = 8;
+    return obj;
+}
+
+void elf_object_free(ElfObject *obj) {
+    if (!obj) return;
+    for (int s = 0; s < ELF_SEC_COUNT; s++) free(obj->sections[s].data);
+    for (int i = 0; i < obj->symbol_count; i++) free(obj->symbols[i].name);
+    for (int i = 0; i < obj->reloc_count; i++) free(obj->relocs[i].symbol);
+    for (int i = 0; i < obj->global_count; i++) free(obj->globals[i]);
+    free(obj->symbols);
+    free(obj->relocs);
+    free(obj->globals);
+    free(obj);
+}
+
+size_t elf_append(ElfObject *obj, ElfSectionId section, const void *data, size_t size) {
+    ElfSection *sec = &obj->sections[section];
+    if (size == 0) return sec->size;
+    if (sec->size + size > sec->capacity) {
+        sec->capacity = sec->capacity ? sec->capacity * 2 : 4096;
+        while (sec->size + size > sec->capacity) sec->capacity *= 2;
+        sec->data = realloc(sec->data, sec->capacity);
+    }
+    size_t offset = sec->size;
+    if (data) memcpy(sec->data + offset, data, size);
+    else memset(sec->data + offset, 0, size);
+    sec->size += size;
+    return offset;
+}
+
+void elf_align(ElfObject *obj, ElfSectionId section, int align) {
+    ElfSection *sec = &obj->sections[section];
+    if (align > sec->align) sec->align = align;
+    size_t pad = (align - sec->size % align) % align;
+    if (pad == 0) return;
+    // Code is padded with nops, data with zeros
+    size_t offset = elf_append(obj, section, NULL, pad);
+    if (section == ELF_SEC_TEXT) memset(sec->data + offset, 0x90, pad);
+}
+
+void elf_declare_global(ElfObject *obj, const char *name) {
+    obj->globals = realloc(obj->globals, sizeof(char*) * (obj->global_count + 1));
+    obj->globals[obj->global_count++] = strdup(name);
+}
+
+static bool elf_is_global(const ElfObject *obj, const char *name) {
+    for (int i = 0; i < obj->global_count; i++) {
+        if (strcmp(obj->globals[i], name) == 0) return true;
+    }
+    return false;
+}
+
+ElfSymbol* elf_find_symbol(ElfObject *obj, const char *name) {
+    for (int i = 0; i < obj->symbol_count; i++) {
+        if (strcmp(obj->symbols[i].name, name) == 0) return &obj->symbols[i];
+    }
+    return NULL;
+}
+
+bool elf_define_symbol(ElfObject *obj, const char *name, ElfSectionId section, size_t offset, bool function) {
+    if (elf_find_symbol(obj, name)) {
+        fprintf(stderr, "Error: symbol '%s' is already defined\n", name);
+        return false;
+    }
+    if (obj->symbol_count == obj->symbol_capacity) {
+        obj->symbol_capacity = obj->symbol_capacity ? obj->symbol_capacity * 2 : 64;
+        obj->symbols = realloc(obj->symbols, sizeof(ElfSymbol) * obj->symbol_capacity);
+    }
+    ElfSymbol *sym = &obj->symbols[obj->symbol_count++];
+    sym->name = strdup(name);
+    sym->section = section;
+    sym->offset = offset;
+    sym->size = 0;
+    sym->function = function;
+    return true;
+}
+
+void elf_add_reloc(ElfObject *obj, ElfSectionId section, size_t offset, const char *symbol,
+                   int type, int64_t addend) {
+    if (obj->reloc_count == obj->reloc_capacity) {
+        obj->reloc_capacity = obj->reloc_capacity ? obj->reloc_capacity * 2 : 64;
+        obj->relocs = realloc(obj->relocs, sizeof(ElfReloc) * obj->reloc_capacity);
+    }
+    ElfReloc *rel = &obj->relocs[obj->reloc_count++];
+    rel->section = section;
+    rel->offset = offset;
+    rel->symbol = strdup(symbol);
+    rel->type = type;
+    rel->addend = addend;
+}
+
+/* ---------- File image ---------- */
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} ElfBuffer;
+
+static void elf_put(ElfBuffer *buf, const void *data, size_t size) {
+    if (buf->size + size > buf->capacity) {
+        buf->capacity = buf->capacity ? buf->capacity * 2 : 4096;
+        while (buf->size + size > buf->capacity) buf->capacity *= 2;
+        buf->data = realloc(buf->data, buf->capacity);
+    }
+    if (data) memcpy(buf->data + buf->size, data, size);
+    else memset(buf->data + buf->size, 0, size);
+    buf->size += size;
+}
+
+/* Little-endian integer of `bytes` bytes */
+static void elf_put_int(ElfBuffer *buf, uint64_t value, int bytes) {
+    uint8_t le[8];
+    for (int i = 0; i < bytes; i++) le[i] = (uint8_t)(value >> (8 * i));
+    elf_put(buf, le, bytes);
+}
+
+static void elf_pad(ElfBuffer *buf, size_t align) {
+    while (buf->size % align) elf_put(buf, NULL, 1);
+}
+
+static uint32_t elf_add_string(ElfBuffer *strtab, const char *s) {
+    uint32_t offset = (uint32_t)strtab->size;
+    elf_put(strtab, s, strlen(s) + 1);
+    return offset;
+}
+
+static void elf_put_symbol(ElfBuffer *symtab, uint32_t name, int bind, int type, uint16_t shndx,
+                           uint64_t value, uint64_t size) {
+    elf_put_int(symtab, name, 4);
+    elf_put_int(symtab, (uint64_t)((bind << 4) | type), 1);
+    elf_put_int(symtab, 0, 1);
+    elf_put_int(symtab, shndx, 2);
+    elf_put_int(symtab, value, 8);
+    elf_put_int(symtab, size, 8);
+}
+
+/* ELF header over the first ELF_HEADER_SIZE bytes of `file` */
+static void elf_put_header(ElfBuffer *file, int type, uint64_t entry, uint64_t phoff, uint64_t phnum,
+                           uint64_t shoff, uint64_t shnum, uint64_t shstrndx) {
+    ElfBuffer header = { 0 };
+    static const uint8_t ident[16] = { 0x7f, 'E', 'L', 'F', 2, 1, 1, 0 };  // 64-bit, LE, v1, SysV
+    elf_put(&header, ident, sizeof(ident));
+    elf_put_int(&header, (uint64_t)type, 2);
+    elf_put_int(&header, ELF_EM_X86_64, 2);
+    elf_put_int(&header, 1, 4);                // e_version
+    elf_put_int(&header, entry, 8);
+    elf_put_int(&header, phoff, 8);
+    elf_put_int(&header, shoff, 8);
+    elf_put_int(&header, 0, 4);                // e_flags
+    elf_put_int(&header, ELF_HEADER_SIZE, 2);
+    elf_put_int(&header, phnum ? ELF_PHDR_SIZE : 0, 2);
+    elf_put_int(&header, phnum, 2);
+    elf_put_int(&header, shnum ? ELF_SHDR_SIZE : 0, 2);
+    elf_put_int(&header, shnum, 2);
+    elf_put_int(&header, shstrndx, 2);
+    memcpy(file->data, header.data, ELF_HEADER_SIZE);
+    free(header.data);
+}
+
+static bool elf_write_file(const ElfBuffer *file, const char *path, bool executable) {
+    bool ok = false;
+    FILE *out = fopen(path, "wb");
+    if (out) {
+        ok = fwrite(file->data, 1, file->size, out) == file->size;
+        ok = fclose(out) == 0 && ok;
+    }
+#ifndef _WIN32
+    if (ok && executable) ok = chmod(path, 0755) == 0;
+#endif
+    if (!ok) fprintf(stderr, "Error: cannot write %s '%s'\n", executable ? "executable" : "object file", path);
+    return ok;
+}
+
+typedef struct {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t align;
+    uint64_t entsize;
+} ElfShdr;
+
+/* Section header indexes */
+enum {
+    ELF_IDX_NULL,
+    ELF_IDX_TEXT,
+    ELF_IDX_RODATA,
+    ELF_IDX_DATA,
+    ELF_IDX_NOTE,
+    ELF_IDX_SYMTAB,
+    ELF_IDX_STRTAB,
+    ELF_IDX_SHSTRTAB,
+    ELF_IDX_RELA            // One per section with relocations
+};
+
+static int elf_symbol_index(char **names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+bool elf_object_write(ElfObject *obj, const char *path) {
+    ElfBuffer strtab = { 0 }, symtab = { 0 };
+    ElfBuffer rela[ELF_SEC_COUNT] = { { 0 } };
+    elf_put(&strtab, "", 1);
+
+    // Locals: null, section symbols, then named locals; globals last
+    elf_put_symbol(&symtab, 0, ELF_STB_LOCAL, ELF_STT_NOTYPE, 0, 0, 0);
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        elf_put_symbol(&symtab, 0, ELF_STB_LOCAL, ELF_STT_SECTION, (uint16_t)(ELF_IDX_TEXT + s), 0, 0);
+    }
+    int symbol_total = 1 + ELF_SEC_COUNT;
+    for (int i = 0; i < obj->symbol_count; i++) {
+        ElfSymbol *sym = &obj->symbols[i];
+        if (strncmp(sym->name, ".L", 2) == 0 || elf_is_global(obj, sym->name)) continue;
+        elf_put_symbol(&symtab, elf_add_string(&strtab, sym->name), ELF_STB_LOCAL,
+                       sym->function ? ELF_STT_FUNC : ELF_STT_NOTYPE,
+                       (uint16_t)(ELF_IDX_TEXT + sym->section), sym->offset, sym->size);
+        symbol_total++;
+    }
+    int first_global = symbol_total;
+
+    // Globals: defined ones, then every undefined name referenced
+    char **global_names = malloc(sizeof(char*) * (obj->symbol_count + obj->reloc_count + 1));
+    int global_count = 0;
+    for (int i = 0; i < obj->symbol_count; i++) {
+        ElfSymbol *sym = &obj->symbols[i];
+        if (!elf_is_global(obj, sym->name)) continue;
+        elf_put_symbol(&symtab, elf_add_string(&strtab, sym->name), ELF_STB_GLOBAL,
+                       sym->function ? ELF_STT_FUNC : ELF_STT_NOTYPE,
+                       (uint16_t)(ELF_IDX_TEXT + sym->section), sym->offset, sym->size);
+        global_names[global_count++] = sym->name;
+    }
+    for (int i = 0; i < obj->reloc_count; i++) {
+        const char *name = obj->relocs[i].symbol;
+        if (elf_find_symbol(obj, name) || elf_symbol_index(global_names, global_count, name) >= 0) continue;
+        if (strncmp(name, ".L", 2) == 0) {
+            fprintf(stderr, "Error: undefined local label '%s'\n", name);
+            free(global_names);
+            free(strtab.data);
+            free(symtab.data);
+            return false;
+        }
+        elf_put_symbol(&symtab, elf_add_string(&strtab, name), ELF_STB_GLOBAL, ELF_STT_NOTYPE, 0, 0, 0);
+        global_names[global_count++] = obj->relocs[i].symbol;
+    }
+
+    // Relocations: same-section local references are resolved in place
+    for (int i = 0; i < obj->reloc_count; i++) {
+        ElfReloc *rel = &obj->relocs[i];
+        ElfSymbol *sym = elf_find_symbol(obj, rel->symbol);
+        bool global = elf_is_global(obj, rel->symbol);
+        uint64_t index;
+        int64_t addend = rel->addend;
+        int type = rel->type;
+        if (sym && !global && sym->section == rel->section) {
+            int32_t value = (int32_t)((int64_t)sym->offset + addend - (int64_t)rel->offset);
+            uint8_t *field = obj->sections[rel->section].data + rel->offset;
+            for (int b = 0; b < 4; b++) field[b] = (uint8_t)((uint32_t)value >> (8 * b));
+            continue;
+        }
+        if (sym && !global) {
+            index = 1 + sym->section;
+            addend += (int64_t)sym->offset;
+            type = ELF_R_X86_64_PC32;
+        } else {
+            index = (uint64_t)(first_global + elf_symbol_index(global_names, global_count, rel->symbol));
+        }
+        elf_put_int(&rela[rel->section], rel->offset, 8);
+        elf_put_int(&rela[rel->section], (index << 32) | (uint32_t)type, 8);
+        elf_put_int(&rela[rel->section], (uint64_t)addend, 8);
+    }
+    free(global_names);
+
+    // Section contents follow the ELF header
+    ElfShdr shdr[ELF_IDX_RELA + ELF_SEC_COUNT];
+    memset(shdr, 0, sizeof(shdr));
+    ElfBuffer shstrtab = { 0 };
+    elf_put(&shstrtab, "", 1);
+    ElfBuffer file = { 0 };
+    elf_put(&file, NULL, ELF_HEADER_SIZE);
+
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        ElfSection *sec = &obj->sections[s];
+        ElfShdr *sh = &shdr[ELF_IDX_TEXT + s];
+        elf_pad(&file, (size_t)sec->align);
+        sh->name = elf_add_string(&shstrtab, elf_section_names[s]);
+        sh->type = ELF_SHT_PROGBITS;
+        sh->flags = ELF_SHF_ALLOC | (s == ELF_SEC_TEXT ? ELF_SHF_EXECINSTR : 0) |
+                    (s == ELF_SEC_DATA ? ELF_SHF_WRITE : 0);
+        sh->offset = file.size;
+        sh->size = sec->size;
+        sh->align = (uint64_t)sec->align;
+        elf_put(&file, sec->data, sec->size);
+    }
+
+    // Empty .note.GNU-stack: the stack is not executable
+    shdr[ELF_IDX_NOTE].name = elf_add_string(&shstrtab, ".note.GNU-stack");
+    shdr[ELF_IDX_NOTE].type = ELF_SHT_PROGBITS;
+    shdr[ELF_IDX_NOTE].offset = file.size;
+    shdr[ELF_IDX_NOTE].align = 1;
+
+    elf_pad(&file, 8);
+    shdr[ELF_IDX_SYMTAB] = (ElfShdr){ elf_add_string(&shstrtab, ".symtab"), ELF_SHT_SYMTAB, 0, file.size,
+                                      symtab.size, ELF_IDX_STRTAB, (uint32_t)first_global, 8, ELF_SYM_SIZE };
+    elf_put(&file, symtab.data, symtab.size);
+    shdr[ELF_IDX_STRTAB] = (ElfShdr){ elf_add_string(&shstrtab, ".strtab"), ELF_SHT_STRTAB, 0, file.size,
+                                      strtab.size, 0, 0, 1, 0 };
+    elf_put(&file, strtab.data, strtab.size);
+
+    int shnum = ELF_IDX_RELA;
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        if (rela[s].size == 0) continue;
+        char name[32];
+        snprintf(name, sizeof(name), ".rela%s", elf_section_names[s]);
+        elf_pad(&file, 8);
+        shdr[shnum++] = (ElfShdr){ elf_add_string(&shstrtab, name), ELF_SHT_RELA, ELF_SHF_INFO_LINK, file.size,
+                                   rela[s].size, ELF_IDX_SYMTAB, (uint32_t)(ELF_IDX_TEXT + s), 8, ELF_RELA_SIZE };
+        elf_put(&file, rela[s].data, rela[s].size);
+        free(rela[s].data);
+    }
+
+    shdr[ELF_IDX_SHSTRTAB].name = elf_add_string(&shstrtab, ".shstrtab");
+    shdr[ELF_IDX_SHSTRTAB].type = ELF_SHT_STRTAB;
+    shdr[ELF_IDX_SHSTRTAB].offset = file.size;
+    shdr[ELF_IDX_SHSTRTAB].size = shstrtab.size;
+    shdr[ELF_IDX_SHSTRTAB].align = 1;
+    elf_put(&file, shstrtab.data, shstrtab.size);
+
+    elf_pad(&file, 8);
+    uint64_t shoff = file.size;
+    for (int i = 0; i < shnum; i++) {
+        elf_put_int(&file, shdr[i].name, 4);
+        elf_put_int(&file, shdr[i].type, 4);
+        elf_put_int(&file, shdr[i].flags, 8);
+        elf_put_int(&file, 0, 8);              // sh_addr
+        elf_put_int(&file, shdr[i].offset, 8);
+        elf_put_int(&file, shdr[i].size, 8);
+        elf_put_int(&file, shdr[i].link, 4);
+        elf_put_int(&file, shdr[i].info, 4);
+        elf_put_int(&file, shdr[i].align, 8);
+        elf_put_int(&file, shdr[i].entsize, 8);
+    }
+
+    elf_put_header(&file, ELF_ET_REL, 0, 0, 0, shoff, (uint64_t)shnum, ELF_IDX_SHSTRTAB);
+    bool ok = elf_write_file(&file, path, false);
+
+    free(file.data);
+    free(shstrtab.data);
+    free(strtab.data);
+    free(symtab.data);
+    return ok;
+}
+
+/* ---------- Static executable ---------- */
+
+bool elf_executable_write(ElfObject *obj, const char *path, const char *entry) {
+    // Sections follow the headers back to back in the file; each gets its
+    // own pages in memory, at an address congruent to its file offset
+    uint64_t vaddr[ELF_SEC_COUNT] = { 0 };
+    uint64_t offset[ELF_SEC_COUNT] = { 0 };
+    int phnum = 1;                             // PT_GNU_STACK
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        if (s == ELF_SEC_TEXT || obj->sections[s].size) phnum++;
+    }
+    uint64_t file_end = ELF_HEADER_SIZE + (uint64_t)phnum * ELF_PHDR_SIZE;
+    uint64_t next_page = ELF_EXEC_BASE;
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        uint64_t align = (uint64_t)obj->sections[s].align;
+        offset[s] = (file_end + align - 1) / align * align;
+        vaddr[s] = next_page + offset[s] % ELF_PAGE_SIZE;
+        file_end = offset[s] + obj->sections[s].size;
+        next_page = (vaddr[s] + obj->sections[s].size + ELF_PAGE_SIZE - 1) / ELF_PAGE_SIZE * ELF_PAGE_SIZE;
+    }
+
+    // Every reference is resolved here; there is no dynamic linker
+    for (int i = 0; i < obj->reloc_count; i++) {
+        ElfReloc *rel = &obj->relocs[i];
+        ElfSymbol *sym = elf_find_symbol(obj, rel->symbol);
+        if (!sym) {
+            fprintf(stderr, "Error: undefined symbol '%s' in static executable\n", rel->symbol);
+            return false;
+        }
+        int64_t value = (int64_t)(vaddr[sym->section] + sym->offset) + rel->addend -
+                        (int64_t)(vaddr[rel->section] + rel->offset);
+        if (value < INT32_MIN || value > INT32_MAX) {
+            fprintf(stderr, "Error: reference to '%s' out of range\n", rel->symbol);
+            return false;
+        }
+        uint8_t *field = obj->sections[rel->section].data + rel->offset;
+        for (int b = 0; b < 4; b++) field[b] = (uint8_t)((uint32_t)value >> (8 * b));
+    }
+    ElfSymbol *start = elf_find_symbol(obj, entry);
+    if (!start || start->section != ELF_SEC_TEXT) {
+        fprintf(stderr, "Error: entry point '%s' is not defined\n", entry);
+        return false;
+    }
+
+    ElfBuffer file = { 0 };
+    elf_put(&file, NULL, ELF_HEADER_SIZE);
+    static const int flags[ELF_SEC_COUNT] = { ELF_PF_R | ELF_PF_X, ELF_PF_R, ELF_PF_R | ELF_PF_W };
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        if (s != ELF_SEC_TEXT && obj->sections[s].size == 0) continue;
+        elf_put_int(&file, ELF_PT_LOAD, 4);
+        elf_put_int(&file, (uint64_t)flags[s], 4);
+        elf_put_int(&file, offset[s], 8);
+        elf_put_int(&file, vaddr[s], 8);       // p_vaddr
+        elf_put_int(&file, vaddr[s], 8);       // p_paddr
+        elf_put_int(&file, obj->sections[s].size, 8);
+        elf_put_int(&file, obj->sections[s].size, 8);
+        elf_put_int(&file, ELF_PAGE_SIZE, 8);
+    }
+    elf_put_int(&file, ELF_PT_GNU_STACK, 4);
+    elf_put_int(&file, ELF_PF_R | ELF_PF_W, 4);
+    elf_put(&file, NULL, 6 * 8);
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        while (file.size < offset[s]) elf_put(&file, NULL, 1);
+        elf_put(&file, obj->sections[s].data, obj->sections[s].size);
+    }
+
+    elf_put_header(&file, ELF_ET_EXEC, vaddr[ELF_SEC_TEXT] + start->offset, ELF_HEADER_SIZE,
+                   (uint64_t)phnum, 0, 0, 0);
+    bool ok = elf_write_file(&file, path, true);
+    free(file.data);
+    return ok;
+}
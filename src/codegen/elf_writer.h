@@ -0,0 +1,94 @@
+/* ========================================
+   SUB Language - ELF64 Object Writer
+   Relocatable x86-64 object files without an assembler
+   File: elf_writer.h
+   ======================================== */
+
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * An object is built up section by section: bytes are appended, symbols
+ * are defined at section offsets and references to symbols are recorded
+ * by name. elf_object_write resolves what it can: a PC-relative
+ * reference to a symbol in the same section is patched in place, a
+ * reference to a local symbol in another section becomes a relocation
+ * against that section, and anything undefined becomes a relocation
+ * against an undefined global (printf, calloc, ...).
+ *
+ * Labels starting with ".L" never reach the symbol table, as with GNU as.
+ */
+
+typedef enum {
+    ELF_SEC_TEXT,
+    ELF_SEC_RODATA,
+    ELF_SEC_DATA,
+    ELF_SEC_COUNT
+} ElfSectionId;
+
+/* x86-64 relocation types used by the backend */
+#define ELF_R_X86_64_PC32  2
+#define ELF_R_X86_64_PLT32 4
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int align;
+} ElfSection;
+
+typedef struct {
+    char *name;
+    ElfSectionId section;
+    size_t offset;
+    size_t size;
+    bool function;
+} ElfSymbol;
+
+typedef struct {
+    ElfSectionId section;      // Section holding the 32-bit field
+    size_t offset;             // Field offset
+    char *symbol;
+    int type;                  // ELF_R_X86_64_*
+    int64_t addend;
+} ElfReloc;
+
+typedef struct ElfObject {
+    ElfSection sections[ELF_SEC_COUNT];
+    ElfSymbol *symbols;        // Defined symbols
+    int symbol_count;
+    int symbol_capacity;
+    ElfReloc *relocs;
+    int reloc_count;
+    int reloc_capacity;
+    char **globals;            // Names given global binding (.global)
+    int global_count;
+} ElfObject;
+
+ElfObject* elf_object_create(void);
+void elf_object_free(ElfObject *obj);
+
+/* Append bytes; returns their offset */
+size_t elf_append(ElfObject *obj, ElfSectionId section, const void *data, size_t size);
+void elf_align(ElfObject *obj, ElfSectionId section, int align);
+
+void elf_declare_global(ElfObject *obj, const char *name);
+bool elf_define_symbol(ElfObject *obj, const char *name, ElfSectionId section, size_t offset, bool function);
+ElfSymbol* elf_find_symbol(ElfObject *obj, const char *name);
+
+/* Reference `symbol` + addend from the 32-bit field at section:offset */
+void elf_add_reloc(ElfObject *obj, ElfSectionId section, size_t offset, const char *symbol,
+                   int type, int64_t addend);
+
+/* Resolve references and write the ET_REL file */
+bool elf_object_write(ElfObject *obj, const char *path);
+
+/* Link the object on its own into a static ET_EXEC starting at `entry`:
+   every referenced symbol must be defined. Patches obj's sections. */
+bool elf_executable_write(ElfObject *obj, const char *path, const char *entry);
+
+#endif /* ELF_WRITER_H */
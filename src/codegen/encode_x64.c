@@ -0,0 +1,695 @@
+/* ========================================
+   SUB Language - x86-64 Machine Code Encoder
+   Implementation
+   File: encode_x64.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "encode_x64.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+
+/* ---------- Operands ---------- */
+
+typedef enum {
+    ENC_GPR,
+    ENC_XMM,                   // xmm (128) or ymm (256)
+    ENC_IMM,
+    ENC_MEM,
+    ENC_SYM                    // Branch or call target
+} EncOperandKind;
+
+#define ENC_NONE (-1)
+#define ENC_RIP  16
+
+typedef struct {
+    EncOperandKind kind;
+    int reg;                   // GPR / XMM number
+    int bits;                  // GPR: 8, 32, 64; XMM: 128, 256
+    bool rex_byte;             // spl, bpl, sil, dil: only reachable with REX
+    int64_t value;             // IMM value, MEM displacement
+    int base;                  // MEM: ENC_NONE, ENC_RIP or a GPR
+    int index;                 // MEM: ENC_NONE or a GPR
+    int scale;
+    char sym[96];              // SYM target, or MEM displacement symbol
+} EncOperand;
+
+static const char *enc_gpr64[] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static const char *enc_gpr32[] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+static const char *enc_gpr16[] = {
+    "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+    "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"
+};
+static const char *enc_gpr8[] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+static bool enc_parse_reg(const char *name, EncOperand *op) {
+    for (int r = 0; r < 16; r++) {
+        int bits = strcmp(name, enc_gpr64[r]) == 0 ? 64 : strcmp(name, enc_gpr32[r]) == 0 ? 32 :
+                   strcmp(name, enc_gpr16[r]) == 0 ? 16 : strcmp(name, enc_gpr8[r]) == 0 ? 8 : 0;
+        if (bits) {
+            op->kind = ENC_GPR;
+            op->reg = r;
+            op->bits = bits;
+            op->rex_byte = bits == 8 && r >= 4 && r < 8;
+            return true;
+        }
+    }
+    if ((strncmp(name, "xmm", 3) == 0 || strncmp(name, "ymm", 3) == 0) && name[3]) {
+        char *end;
+        long r = strtol(name + 3, &end, 10);
+        if (*end || r < 0 || r > 15) return false;
+        op->kind = ENC_XMM;
+        op->reg = (int)r;
+        op->bits = name[0] == 'y' ? 256 : 128;
+        return true;
+    }
+    return false;
+}
+
+static bool enc_parse_int(const char *text, int64_t *value) {
+    if (!*text) return false;
+    char *end;
+    long long v = strtoll(text, &end, 0);
+    if (*end) return false;
+    *value = v;
+    return true;
+}
+
+/* %reg, $imm, disp(base,index,scale), sym[+offset](%rip) or a label */
+static bool enc_parse_operand(const char *text, EncOperand *op) {
+    memset(op, 0, sizeof(EncOperand));
+    op->base = op->index = ENC_NONE;
+    op->scale = 1;
+    if (text[0] == '%') return enc_parse_reg(text + 1, op);
+    if (text[0] == '$') {
+        op->kind = ENC_IMM;
+        return enc_parse_int(text + 1, &op->value);
+    }
+
+    const char *paren = strchr(text, '(');
+    if (!paren) {
+        op->kind = ENC_SYM;
+        snprintf(op->sym, sizeof(op->sym), "%.*s", (int)strcspn(text, "@"), text);
+        return true;
+    }
+
+    op->kind = ENC_MEM;
+    char disp[96];
+    snprintf(disp, sizeof(disp), "%.*s", (int)(paren - text), text);
+    if (disp[0] && !enc_parse_int(disp, &op->value)) {
+        // sym or sym+offset
+        char *plus = strchr(disp, '+');
+        if (plus) {
+            *plus = '\0';
+            if (!enc_parse_int(plus + 1, &op->value)) return false;
+        }
+        snprintf(op->sym, sizeof(op->sym), "%s", disp);
+    }
+
+    // Inside the parentheses: base, index, scale (any may be empty)
+    char inner[64];
+    const char *close = strchr(paren, ')');
+    if (!close || close[1]) return false;
+    snprintf(inner, sizeof(inner), "%.*s", (int)(close - paren - 1), paren + 1);
+    char *parts[3] = { inner, NULL, NULL };
+    for (int k = 1; k < 3; k++) {
+        parts[k] = parts[k - 1] ? strchr(parts[k - 1], ',') : NULL;
+        if (parts[k]) *parts[k]++ = '\0';
+    }
+    EncOperand reg;
+    if (parts[0][0]) {
+        if (strcmp(parts[0], "%rip") == 0) op->base = ENC_RIP;
+        else if (parts[0][0] == '%' && enc_parse_reg(parts[0] + 1, &reg) && reg.kind == ENC_GPR && reg.bits == 64) op->base = reg.reg;
+        else return false;
+    }
+    if (parts[1] && parts[1][0]) {
+        if (parts[1][0] != '%' || !enc_parse_reg(parts[1] + 1, &reg) || reg.kind != ENC_GPR ||
+            reg.bits != 64 || reg.reg == 4) {
+            return false;
+        }
+        op->index = reg.reg;
+    }
+    if (parts[2] && parts[2][0]) {
+        int64_t scale;
+        if (!enc_parse_int(parts[2], &scale) || (scale != 1 && scale != 2 && scale != 4 && scale != 8)) return false;
+        op->scale = (int)scale;
+    }
+    if (op->sym[0] && op->base != ENC_RIP) return false;   // Only RIP-relative symbols
+    return op->value >= INT32_MIN && op->value <= INT32_MAX;
+}
+
+/* ---------- Instruction bytes ---------- */
+
+typedef enum {
+    ENC_BR_NONE,
+    ENC_BR_JMP,
+    ENC_BR_JCC,
+    ENC_BR_CALL
+} EncBranch;
+
+typedef struct {
+    uint8_t bytes[16];
+    int len;
+    // RIP-relative field
+    int reloc_at;              // Offset of the 32-bit field, -1 if none
+    char reloc_sym[96];
+    int64_t reloc_disp;
+    // Branches and calls
+    EncBranch branch;
+    int cc;
+    char target[96];
+    int target_insn;           // Label's index in the buffer, -1 outside the function
+    bool wide;
+    int offset;                // Layout
+} EncInsn;
+
+static void enc_byte(EncInsn *e, int b) {
+    if (e->len < (int)sizeof(e->bytes)) e->bytes[e->len] = (uint8_t)b;
+    e->len++;
+}
+
+static void enc_int(EncInsn *e, int64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) enc_byte(e, (int)((uint64_t)v >> (8 * i)) & 0xff);
+}
+
+static bool enc_fits8(int64_t v) { return v >= -128 && v <= 127; }
+static bool enc_fits32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+/* Register number in the ModRM.rm / SIB.base position */
+static int enc_rm_ext(const EncOperand *rm) {
+    if (rm->kind == ENC_MEM) return rm->base >= 0 && rm->base < 16 ? rm->base >> 3 : 0;
+    return rm->reg >> 3;
+}
+
+static int enc_index_ext(const EncOperand *rm) {
+    return rm->kind == ENC_MEM && rm->index >= 0 ? rm->index >> 3 : 0;
+}
+
+static void enc_modrm(EncInsn *e, int reg, const EncOperand *rm) {
+    reg &= 7;
+    if (rm->kind != ENC_MEM) {
+        enc_byte(e, 0xC0 | reg << 3 | (rm->reg & 7));
+        return;
+    }
+    if (rm->base == ENC_RIP) {
+        enc_byte(e, 0x05 | reg << 3);
+        e->reloc_at = e->len;
+        snprintf(e->reloc_sym, sizeof(e->reloc_sym), "%s", rm->sym);
+        e->reloc_disp = rm->value;
+        enc_int(e, 0, 4);
+        return;
+    }
+    int scale_bits = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+    int index = rm->index >= 0 ? rm->index & 7 : 4;
+    if (rm->base == ENC_NONE) {
+        // disp32 with no base: SIB base 101, mod 00
+        enc_byte(e, 0x04 | reg << 3);
+        enc_byte(e, scale_bits << 6 | index << 3 | 5);
+        enc_int(e, rm->value, 4);
+        return;
+    }
+    int mod = rm->value == 0 && (rm->base & 7) != 5 ? 0 : enc_fits8(rm->value) ? 1 : 2;
+    if (rm->index >= 0 || (rm->base & 7) == 4) {
+        enc_byte(e, mod << 6 | reg << 3 | 4);
+        enc_byte(e, scale_bits << 6 | index << 3 | (rm->base & 7));
+    } else {
+        enc_byte(e, mod << 6 | reg << 3 | (rm->base & 7));
+    }
+    if (mod == 1) enc_int(e, rm->value, 1);
+    if (mod == 2) enc_int(e, rm->value, 4);
+}
+
+/* [prefix] [REX] opcode ModRM: `reg` is a register number or /digit */
+static void enc_op(EncInsn *e, int prefix, bool w, const char *opcode, int reg, bool reg_byte,
+                   const EncOperand *rm) {
+    if (prefix) enc_byte(e, prefix);
+    int rex = (w ? 8 : 0) | (reg >> 3) << 2 | enc_index_ext(rm) << 1 | enc_rm_ext(rm);
+    if (rex || reg_byte || (rm->kind == ENC_GPR && rm->rex_byte)) enc_byte(e, 0x40 | rex);
+    for (const char *c = opcode; *c; c++) enc_byte(e, (uint8_t)*c);
+    enc_modrm(e, reg, rm);
+}
+
+/* VEX prefix (2-byte form when possible) + opcode + ModRM */
+static void enc_vex(EncInsn *e, int pp, int map, bool w, bool l, int vvvv, int opcode, int reg,
+                    const EncOperand *rm) {
+    int r = !(reg >> 3), x = !enc_index_ext(rm), b = !enc_rm_ext(rm);
+    int tail = (~vvvv & 15) << 3 | (l ? 4 : 0) | pp;
+    if (map == 1 && !w && x && b) {
+        enc_byte(e, 0xC5);
+        enc_byte(e, r << 7 | tail);
+    } else {
+        enc_byte(e, 0xC4);
+        enc_byte(e, r << 7 | x << 6 | b << 5 | map);
+        enc_byte(e, (w ? 0x80 : 0) | tail);
+    }
+    enc_byte(e, opcode);
+    enc_modrm(e, reg, rm);
+}
+
+/* ---------- Mnemonics ---------- */
+
+static const struct { const char *name; int cc; } enc_cc_names[] = {
+    { "o", 0 }, { "no", 1 }, { "b", 2 }, { "c", 2 }, { "nae", 2 }, { "ae", 3 }, { "nb", 3 }, { "nc", 3 },
+    { "e", 4 }, { "z", 4 }, { "ne", 5 }, { "nz", 5 }, { "be", 6 }, { "na", 6 }, { "a", 7 }, { "nbe", 7 },
+    { "s", 8 }, { "ns", 9 }, { "p", 10 }, { "pe", 10 }, { "np", 11 }, { "po", 11 },
+    { "l", 12 }, { "nge", 12 }, { "ge", 13 }, { "nl", 13 }, { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 }
+};
+
+static int enc_cc(const char *suffix) {
+    for (size_t i = 0; i < sizeof(enc_cc_names) / sizeof(enc_cc_names[0]); i++) {
+        if (strcmp(suffix, enc_cc_names[i].name) == 0) return enc_cc_names[i].cc;
+    }
+    return -1;
+}
+
+/* Operand size from an AT&T suffix: 64 for base+"q", 32 for base+"l", else 0 */
+static int enc_sized(const char *mnemonic, const char *base) {
+    size_t n = strlen(base);
+    if (strncmp(mnemonic, base, n) != 0 || strlen(mnemonic) != n + 1) return 0;
+    return mnemonic[n] == 'q' ? 64 : mnemonic[n] == 'l' ? 32 : 0;
+}
+
+static const struct { const char *name; int digit; } enc_alu[] = {
+    { "add", 0 }, { "or", 1 }, { "and", 4 }, { "sub", 5 }, { "xor", 6 }, { "cmp", 7 }
+};
+
+static const struct { const char *name; const char *opcode; int digit; } enc_unary[] = {
+    { "not", "\xF7", 2 }, { "neg", "\xF7", 3 }, { "mul", "\xF7", 4 }, { "div", "\xF7", 6 },
+    { "idiv", "\xF7", 7 }, { "inc", "\xFF", 0 }, { "dec", "\xFF", 1 }
+};
+
+static const struct { const char *name; int digit; } enc_shifts[] = {
+    { "rol", 0 }, { "ror", 1 }, { "shl", 4 }, { "sal", 4 }, { "shr", 5 }, { "sar", 7 }
+};
+
+/* SSE2 reg, r/m forms (66 0F op) and their VEX three-operand twins */
+static const struct { const char *name; int map; int opcode; } enc_sse[] = {
+    { "paddq", 1, 0xD4 }, { "psubq", 1, 0xFB }, { "pmuludq", 1, 0xF4 }, { "pxor", 1, 0xEF },
+    { "pand", 1, 0xDB }, { "por", 1, 0xEB }, { "punpcklqdq", 1, 0x6C }, { "pcmpeqq", 2, 0x29 },
+    { "pcmpgtq", 2, 0x37 }
+};
+
+static bool enc_fail(char *error, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error, size, format, args);
+    va_end(args);
+    return false;
+}
+
+static bool enc_is(const EncOperand *op, EncOperandKind kind) {
+    return op->kind == kind;
+}
+
+static bool enc_is_rm(const EncOperand *op) {
+    return op->kind == ENC_GPR || op->kind == ENC_MEM;
+}
+
+static bool enc_is_xmm_rm(const EncOperand *op) {
+    return op->kind == ENC_XMM || op->kind == ENC_MEM;
+}
+
+/* Encode one instruction; branches only record their target */
+static bool enc_insn(EncInsn *e, const X64MInstr *mi, char *error, size_t error_size) {
+    const char *m = mi->op;
+    int n = mi->operand_count;
+    EncOperand ops[4];
+    for (int i = 0; i < n; i++) {
+        if (!enc_parse_operand(mi->operands[i], &ops[i])) {
+            return enc_fail(error, error_size, "operand '%s' of %s", mi->operands[i], m);
+        }
+    }
+    const EncOperand *src = n > 0 ? &ops[0] : NULL;
+    const EncOperand *dst = n > 1 ? &ops[n - 1] : src;
+    int bits;
+
+    // No operands
+    if (n == 0) {
+        if (strcmp(m, "ret") == 0) enc_byte(e, 0xC3);
+        else if (strcmp(m, "cqto") == 0) enc_int(e, 0x9948, 2);
+        else if (strcmp(m, "cltq") == 0) enc_int(e, 0x9848, 2);
+        else if (strcmp(m, "leave") == 0) enc_byte(e, 0xC9);
+        else if (strcmp(m, "nop") == 0) enc_byte(e, 0x90);
+        else if (strcmp(m, "syscall") == 0) enc_int(e, 0x050F, 2);
+        else if (strcmp(m, "rep") == 0 || strcmp(m, "repe") == 0) enc_byte(e, 0xF3);
+        else if (strcmp(m, "movsb") == 0) enc_byte(e, 0xA4);
+        else if (strcmp(m, "movsq") == 0) enc_int(e, 0xA548, 2);
+        else if (strcmp(m, "cmpsb") == 0) enc_byte(e, 0xA6);
+        else if (strcmp(m, "vzeroupper") == 0) enc_int(e, 0x77F8C5, 3);
+        else return enc_fail(error, error_size, "instruction '%s'", m);
+        return true;
+    }
+
+    // Branches and calls
+    if (n == 1 && enc_is(src, ENC_SYM)) {
+        if (strcmp(m, "jmp") == 0) e->branch = ENC_BR_JMP;
+        else if (strcmp(m, "call") == 0) e->branch = ENC_BR_CALL;
+        else if (m[0] == 'j' && (e->cc = enc_cc(m + 1)) >= 0) e->branch = ENC_BR_JCC;
+        else return enc_fail(error, error_size, "instruction '%s %s'", m, mi->operands[0]);
+        snprintf(e->target, sizeof(e->target), "%s", src->sym);
+        return true;
+    }
+
+    // Integer ALU
+    for (size_t k = 0; k < sizeof(enc_alu) / sizeof(enc_alu[0]); k++) {
+        if (!(bits = enc_sized(m, enc_alu[k].name)) || n != 2) continue;
+        bool w = bits == 64;
+        char op[2] = { 0, 0 };
+        if (enc_is(src, ENC_IMM) && enc_is_rm(dst)) {
+            if (!enc_fits32(src->value)) break;
+            bool short_imm = enc_fits8(src->value);
+            enc_op(e, 0, w, short_imm ? "\x83" : "\x81", enc_alu[k].digit, false, dst);
+            enc_int(e, src->value, short_imm ? 1 : 4);
+            return true;
+        }
+        if (enc_is(src, ENC_GPR) && enc_is_rm(dst)) {
+            op[0] = (char)(enc_alu[k].digit * 8 + 1);
+            enc_op(e, 0, w, op, src->reg, false, dst);
+            return true;
+        }
+        if (enc_is(src, ENC_MEM) && enc_is(dst, ENC_GPR)) {
+            op[0] = (char)(enc_alu[k].digit * 8 + 3);
+            enc_op(e, 0, w, op, dst->reg, false, src);
+            return true;
+        }
+        break;
+    }
+
+    // Moves
+    if ((bits = enc_sized(m, "mov")) && n == 2) {
+        bool w = bits == 64;
+        if (enc_is(src, ENC_IMM) && enc_is(dst, ENC_GPR) && !w) {
+            if (dst->reg >= 8) enc_byte(e, 0x41);
+            enc_byte(e, 0xB8 + (dst->reg & 7));
+            enc_int(e, src->value, 4);
+            return true;
+        }
+        if (enc_is(src, ENC_IMM) && enc_is_rm(dst) && enc_fits32(src->value)) {
+            enc_op(e, 0, w, "\xC7", 0, false, dst);
+            enc_int(e, src->value, 4);
+            return true;
+        }
+        if (enc_is(src, ENC_GPR) && enc_is_rm(dst)) {
+            enc_op(e, 0, w, "\x89", src->reg, false, dst);
+            return true;
+        }
+        if (enc_is(src, ENC_MEM) && enc_is(dst, ENC_GPR)) {
+            enc_op(e, 0, w, "\x8B", dst->reg, false, src);
+            return true;
+        }
+        if (w && enc_is(src, ENC_GPR) && enc_is(dst, ENC_XMM)) {
+            enc_op(e, 0x66, true, "\x0F\x6E", dst->reg, false, src);
+            return true;
+        }
+        if (w && enc_is(src, ENC_XMM) && enc_is(dst, ENC_GPR)) {
+            enc_op(e, 0x66, true, "\x0F\x7E", src->reg, false, dst);
+            return true;
+        }
+    }
+    if (strcmp(m, "movb") == 0 && n == 2 && enc_is(dst, ENC_MEM)) {
+        if (enc_is(src, ENC_IMM)) {
+            enc_op(e, 0, false, "\xC6", 0, false, dst);
+            enc_int(e, src->value, 1);
+            return true;
+        }
+        if (enc_is(src, ENC_GPR) && src->bits == 8) {
+            enc_op(e, 0, false, "\x88", src->reg, src->rex_byte, dst);
+            return true;
+        }
+    }
+    if (strcmp(m, "movabsq") == 0 && n == 2 && enc_is(src, ENC_IMM) && enc_is(dst, ENC_GPR)) {
+        enc_byte(e, 0x48 | (dst->reg >> 3));
+        enc_byte(e, 0xB8 + (dst->reg & 7));
+        enc_int(e, src->value, 8);
+        return true;
+    }
+    if ((strcmp(m, "movzbq") == 0 || strcmp(m, "movzbl") == 0) && n == 2 &&
+        enc_is_rm(src) && enc_is(dst, ENC_GPR)) {
+        enc_op(e, 0, m[5] == 'q', "\x0F\xB6", dst->reg, false, src);
+        return true;
+    }
+    if (strcmp(m, "movzwl") == 0 && n == 2 && enc_is(src, ENC_MEM) && enc_is(dst, ENC_GPR)) {
+        enc_op(e, 0, false, "\x0F\xB7", dst->reg, false, src);
+        return true;
+    }
+    if (strcmp(m, "movw") == 0 && n == 2 && enc_is(src, ENC_GPR) && src->bits == 16 && enc_is(dst, ENC_MEM)) {
+        enc_op(e, 0x66, false, "\x89", src->reg, false, dst);
+        return true;
+    }
+    if (strcmp(m, "leaq") == 0 && n == 2 && enc_is(src, ENC_MEM) && enc_is(dst, ENC_GPR)) {
+        enc_op(e, 0, true, "\x8D", dst->reg, false, src);
+        return true;
+    }
+    if ((bits = enc_sized(m, "test")) && n == 2 && enc_is(src, ENC_GPR) && enc_is_rm(dst)) {
+        enc_op(e, 0, bits == 64, "\x85", src->reg, false, dst);
+        return true;
+    }
+    if (strcmp(m, "imulq") == 0) {
+        if (n == 1 && enc_is_rm(src)) {
+            enc_op(e, 0, true, "\xF7", 5, false, src);
+            return true;
+        }
+        if (n == 2 && enc_is_rm(src) && enc_is(dst, ENC_GPR)) {
+            enc_op(e, 0, true, "\x0F\xAF", dst->reg, false, src);
+            return true;
+        }
+        // imulq $imm, %reg is shorthand for imulq $imm, %reg, %reg
+        const EncOperand *factor = n == 3 ? &ops[1] : dst;
+        if ((n == 3 || n == 2) && enc_is(src, ENC_IMM) && enc_fits32(src->value) && enc_is_rm(factor) && enc_is(dst, ENC_GPR)) {
+            bool short_imm = enc_fits8(src->value);
+            enc_op(e, 0, true, short_imm ? "\x6B" : "\x69", dst->reg, false, factor);
+            enc_int(e, src->value, short_imm ? 1 : 4);
+            return true;
+        }
+    }
+    for (size_t k = 0; k < sizeof(enc_unary) / sizeof(enc_unary[0]); k++) {
+        if ((bits = enc_sized(m, enc_unary[k].name)) && n == 1 && enc_is_rm(src)) {
+            enc_op(e, 0, bits == 64, enc_unary[k].opcode, enc_unary[k].digit, false, src);
+            return true;
+        }
+    }
+    for (size_t k = 0; k < sizeof(enc_shifts) / sizeof(enc_shifts[0]); k++) {
+        if (!(bits = enc_sized(m, enc_shifts[k].name)) || n != 2 || !enc_is_rm(dst)) continue;
+        bool w = bits == 64;
+        if (enc_is(src, ENC_IMM) && src->value == 1) {
+            enc_op(e, 0, w, "\xD1", enc_shifts[k].digit, false, dst);
+        } else if (enc_is(src, ENC_IMM) && src->value >= 0 && src->value < 256) {
+            enc_op(e, 0, w, "\xC1", enc_shifts[k].digit, false, dst);
+            enc_int(e, src->value, 1);
+        } else if (enc_is(src, ENC_GPR) && src->reg == 1 && src->bits == 8) {
+            enc_op(e, 0, w, "\xD3", enc_shifts[k].digit, false, dst);
+        } else {
+            break;
+        }
+        return true;
+    }
+    if ((strcmp(m, "pushq") == 0 || strcmp(m, "popq") == 0) && n == 1 && enc_is(src, ENC_GPR)) {
+        if (src->reg >= 8) enc_byte(e, 0x41);
+        enc_byte(e, (m[1] == 'u' ? 0x50 : 0x58) + (src->reg & 7));
+        return true;
+    }
+    if (strncmp(m, "set", 3) == 0 && enc_cc(m + 3) >= 0 && n == 1 && enc_is_rm(src)) {
+        char op[3] = { 0x0F, (char)(0x90 + enc_cc(m + 3)), 0 };
+        enc_op(e, 0, false, op, 0, false, src);
+        return true;
+    }
+
+    // SSE2
+    for (size_t k = 0; k < sizeof(enc_sse) / sizeof(enc_sse[0]); k++) {
+        if (strcmp(m, enc_sse[k].name) == 0 && n == 2 && enc_is_xmm_rm(src) && enc_is(dst, ENC_XMM)) {
+            char op[4] = { 0x0F, enc_sse[k].map == 2 ? 0x38 : (char)enc_sse[k].opcode, (char)enc_sse[k].opcode, 0 };
+            if (enc_sse[k].map == 1) op[2] = 0;
+            enc_op(e, 0x66, false, op, dst->reg, false, src);
+            return true;
+        }
+        if (m[0] == 'v' && strcmp(m + 1, enc_sse[k].name) == 0 && n == 3 && enc_is_xmm_rm(src) &&
+            enc_is(&ops[1], ENC_XMM) && enc_is(dst, ENC_XMM)) {
+            enc_vex(e, 1, enc_sse[k].map, false, dst->bits == 256, ops[1].reg, enc_sse[k].opcode, dst->reg, src);
+            return true;
+        }
+    }
+    if ((strcmp(m, "movdqa") == 0 || strcmp(m, "movdqu") == 0 ||
+         strcmp(m, "vmovdqa") == 0 || strcmp(m, "vmovdqu") == 0) && n == 2) {
+        bool vex = m[0] == 'v';
+        bool aligned = m[vex ? 6 : 5] == 'a';
+        bool store = !enc_is(dst, ENC_XMM);
+        const EncOperand *reg = store ? src : dst;
+        const EncOperand *rm = store ? dst : src;
+        if (!enc_is(reg, ENC_XMM) || !enc_is_xmm_rm(rm)) {
+            return enc_fail(error, error_size, "operands of %s", m);
+        }
+        if (vex) {
+            enc_vex(e, aligned ? 1 : 2, 1, false, reg->bits == 256, 0, store ? 0x7F : 0x6F, reg->reg, rm);
+        } else {
+            enc_op(e, aligned ? 0x66 : 0xF3, false, store ? "\x0F\x7F" : "\x0F\x6F", reg->reg, false, rm);
+        }
+        return true;
+    }
+    if ((strcmp(m, "psllq") == 0 || strcmp(m, "psrlq") == 0) && n == 2 && enc_is(src, ENC_IMM) &&
+        enc_is(dst, ENC_XMM)) {
+        enc_op(e, 0x66, false, "\x0F\x73", m[2] == 'l' ? 6 : 2, false, dst);
+        enc_int(e, src->value, 1);
+        return true;
+    }
+    if ((strcmp(m, "vpsllq") == 0 || strcmp(m, "vpsrlq") == 0) && n == 3 && enc_is(src, ENC_IMM) &&
+        enc_is(&ops[1], ENC_XMM) && enc_is(dst, ENC_XMM)) {
+        enc_vex(e, 1, 1, false, dst->bits == 256, dst->reg, 0x73, m[3] == 'l' ? 6 : 2, &ops[1]);
+        enc_int(e, src->value, 1);
+        return true;
+    }
+    if (strcmp(m, "pshufd") == 0 && n == 3 && enc_is(src, ENC_IMM) && enc_is_xmm_rm(&ops[1]) && enc_is(dst, ENC_XMM)) {
+        enc_op(e, 0x66, false, "\x0F\x70", dst->reg, false, &ops[1]);
+        enc_int(e, src->value, 1);
+        return true;
+    }
+    if (strcmp(m, "vpshufd") == 0 && n == 3 && enc_is(src, ENC_IMM) && enc_is_xmm_rm(&ops[1]) && enc_is(dst, ENC_XMM)) {
+        enc_vex(e, 1, 1, false, dst->bits == 256, 0, 0x70, dst->reg, &ops[1]);
+        enc_int(e, src->value, 1);
+        return true;
+    }
+    if (strcmp(m, "vpbroadcastq") == 0 && n == 2 && enc_is_xmm_rm(src) && enc_is(dst, ENC_XMM)) {
+        enc_vex(e, 1, 2, false, dst->bits == 256, 0, 0x59, dst->reg, src);
+        return true;
+    }
+    if (strcmp(m, "vmovq") == 0 && n == 2 && enc_is(src, ENC_GPR) && enc_is(dst, ENC_XMM)) {
+        enc_vex(e, 1, 1, true, false, 0, 0x6E, dst->reg, src);
+        return true;
+    }
+    if (strcmp(m, "vmovq") == 0 && n == 2 && enc_is(src, ENC_XMM) && enc_is(dst, ENC_GPR)) {
+        enc_vex(e, 1, 1, true, false, 0, 0x7E, src->reg, dst);
+        return true;
+    }
+    if (strcmp(m, "vextracti128") == 0 && n == 3 && enc_is(src, ENC_IMM) && enc_is(&ops[1], ENC_XMM) &&
+        enc_is_xmm_rm(dst)) {
+        enc_vex(e, 1, 3, false, true, 0, 0x39, ops[1].reg, dst);
+        enc_int(e, src->value, 1);
+        return true;
+    }
+    if (strcmp(m, "vblendvpd") == 0 && n == 4 && enc_is(src, ENC_XMM) && enc_is_xmm_rm(&ops[1]) &&
+        enc_is(&ops[2], ENC_XMM) && enc_is(dst, ENC_XMM)) {
+        enc_vex(e, 1, 3, false, dst->bits == 256, ops[2].reg, 0x4B, dst->reg, &ops[1]);
+        enc_byte(e, src->reg << 4);
+        return true;
+    }
+
+    return enc_fail(error, error_size, "instruction '%s' with %d operand%s", m, n, n == 1 ? "" : "s");
+}
+
+/* ---------- Functions ---------- */
+
+static int enc_branch_size(const EncInsn *e) {
+    switch (e->branch) {
+        case ENC_BR_JMP: return e->wide ? 5 : 2;
+        case ENC_BR_JCC: return e->wide ? 6 : 2;
+        case ENC_BR_CALL: return 5;
+        default: return e->len;
+    }
+}
+
+bool x64_encode_function(ElfObject *obj, const X64MInstr *code, int count, char *error, size_t error_size) {
+    EncInsn *enc = calloc(count > 0 ? count : 1, sizeof(EncInsn));
+    for (int i = 0; i < count; i++) {
+        enc[i].reloc_at = -1;
+        enc[i].target_insn = -1;
+        if (code[i].kind == X64_MI_INSN && !enc_insn(&enc[i], &code[i], error, error_size)) {
+            free(enc);
+            return false;
+        }
+        if (enc[i].len > 15) {
+            free(enc);
+            return enc_fail(error, error_size, "instruction '%s' is too long", code[i].op);
+        }
+    }
+
+    // Branch targets inside the function; calls always go through a
+    // relocation (printf) or are resolved by the object writer
+    for (int i = 0; i < count; i++) {
+        if (enc[i].branch == ENC_BR_NONE) continue;
+        for (int j = 0; j < count && enc[i].branch != ENC_BR_CALL; j++) {
+            if (code[j].kind == X64_MI_LABEL && strcmp(code[j].op, enc[i].target) == 0) {
+                enc[i].target_insn = j;
+                break;
+            }
+        }
+        if (enc[i].target_insn < 0) enc[i].wide = true;
+    }
+
+    // Branch relaxation: grow short jumps whose displacement does not fit
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        int offset = 0;
+        for (int i = 0; i < count; i++) {
+            enc[i].offset = offset;
+            offset += enc_branch_size(&enc[i]);
+        }
+        for (int i = 0; i < count; i++) {
+            if (enc[i].branch == ENC_BR_NONE || enc[i].wide) continue;
+            int64_t disp = enc[enc[i].target_insn].offset - (enc[i].offset + enc_branch_size(&enc[i]));
+            if (!enc_fits8(disp)) {
+                enc[i].wide = true;
+                changed = true;
+            }
+        }
+    }
+
+    elf_align(obj, ELF_SEC_TEXT, 16);
+    size_t base = obj->sections[ELF_SEC_TEXT].size;
+    /* The first label names the function; relocations against new symbols
+       may grow the symbol table, so it is looked up again at the end */
+    const char *function = NULL;
+    for (int i = 0; i < count; i++) {
+        EncInsn *e = &enc[i];
+        size_t at = base + (size_t)e->offset;
+        if (code[i].kind == X64_MI_LABEL) {
+            if (!elf_define_symbol(obj, code[i].op, ELF_SEC_TEXT, at, function == NULL)) {
+                free(enc);
+                return enc_fail(error, error_size, "duplicate label '%s'", code[i].op);
+            }
+            if (!function) function = code[i].op;
+            continue;
+        }
+        if (e->branch != ENC_BR_NONE) {
+            EncInsn b = { .len = 0 };
+            int size = enc_branch_size(e);
+            if (e->branch == ENC_BR_CALL) enc_byte(&b, 0xE8);
+            else if (e->branch == ENC_BR_JMP) enc_byte(&b, e->wide ? 0xE9 : 0xEB);
+            else if (e->wide) enc_int(&b, 0x800F | (e->cc << 8), 2);
+            else enc_byte(&b, 0x70 + e->cc);
+            if (e->target_insn >= 0) {
+                enc_int(&b, enc[e->target_insn].offset - (e->offset + size), size - b.len);
+            } else {
+                elf_add_reloc(obj, ELF_SEC_TEXT, at + b.len, e->target, ELF_R_X86_64_PLT32, -4);
+                enc_int(&b, 0, 4);
+            }
+            elf_append(obj, ELF_SEC_TEXT, b.bytes, b.len);
+            continue;
+        }
+        if (e->reloc_at >= 0) {
+            if (!e->reloc_sym[0]) {
+                free(enc);
+                return enc_fail(error, error_size, "RIP-relative operand without a symbol in '%s'", code[i].op);
+            }
+            elf_add_reloc(obj, ELF_SEC_TEXT, at + e->reloc_at, e->reloc_sym, ELF_R_X86_64_PC32,
+                          e->reloc_disp - (e->len - e->reloc_at));
+        }
+        elf_append(obj, ELF_SEC_TEXT, e->bytes, e->len);
+    }
+    ElfSymbol *symbol = function ? elf_find_symbol(obj, function) : NULL;
+    if (symbol) symbol->size = obj->sections[ELF_SEC_TEXT].size - symbol->offset;
+    free(enc);
+    return true;
+}
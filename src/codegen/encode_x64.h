@@ -0,0 +1,28 @@
+/* ========================================
+   SUB Language - x86-64 Machine Code Encoder
+   Buffered AT&T instructions to bytes, without an assembler
+   File: encode_x64.h
+   ======================================== */
+
+#ifndef ENCODE_X64_H
+#define ENCODE_X64_H
+
+#include "codegen_x64.h"
+#include "elf_writer.h"
+
+/*
+ * Encodes a generated function (ctx->code after the peephole pass) into
+ * obj's .text. Covers what the backend emits: 64/32/8-bit integer
+ * instructions, SSE2 and AVX2 (VEX) vector instructions, and branches,
+ * which start short and are widened until every displacement fits.
+ *
+ * Labels become symbols at their offsets (the first one is the function
+ * itself); calls, jumps out of the function and RIP-relative data
+ * references become relocations resolved by elf_object_write.
+ *
+ * Returns false and describes the first unsupported instruction in
+ * `error` when something cannot be encoded.
+ */
+bool x64_encode_function(ElfObject *obj, const X64MInstr *code, int count, char *error, size_t error_size);
+
+#endif /* ENCODE_X64_H */
@@ -0,0 +1,761 @@
+/* ========================================
+   SUB Language - x86-64 Instruction Selector
+   Implementation
+   File: isel_x64.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "isel_x64.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+
+/* ---------- Operands and rendering ---------- */
+
+static const char* isel_reg8_names[] = {
+    "al", "bl", "cl", "dl", "sil", "dil", "bpl", "spl",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+X64Operand x64_opnd_reg(X64Register reg) {
+    X64Operand op = { X64_OPND_REG, reg, X64_REG_COUNT, 1, 64, 0, NULL };
+    return op;
+}
+
+X64Operand x64_opnd_imm(int64_t value) {
+    X64Operand op = { X64_OPND_IMM, X64_REG_COUNT, X64_REG_COUNT, 1, 64, value, NULL };
+    return op;
+}
+
+X64Operand x64_opnd_mem(X64Register base, int64_t disp) {
+    X64Operand op = { X64_OPND_MEM, base, X64_REG_COUNT, 1, 64, disp, NULL };
+    return op;
+}
+
+X64Operand x64_opnd_label(const char *label) {
+    X64Operand op = { X64_OPND_LABEL, X64_REG_COUNT, X64_REG_COUNT, 1, 64, 0, label };
+    return op;
+}
+
+static const char* isel_reg_name(X64Register reg, int bits) {
+    if (reg >= X64_REG_COUNT) return "INVALID";
+    return bits == 8 ? isel_reg8_names[reg] : x64_register_name(reg, bits == 64);
+}
+
+static void isel_render_operand(X64Syntax syntax, char *buf, size_t size, const X64Operand *op, bool ptr) {
+    bool att = syntax == X64_SYNTAX_ATT;
+    switch (op->kind) {
+        case X64_OPND_REG:
+            snprintf(buf, size, "%s%s", att ? "%" : "", isel_reg_name(op->reg, op->bits));
+            break;
+        case X64_OPND_IMM:
+            snprintf(buf, size, "%s%" PRId64, att ? "$" : "", op->value);
+            break;
+        case X64_OPND_LABEL:
+            snprintf(buf, size, "%s", op->label);
+            break;
+        case X64_OPND_MEM: {
+            bool base = op->reg != X64_REG_COUNT;
+            bool index = op->index != X64_REG_COUNT;
+            int n = 0;
+            if (att) {
+                if (op->value != 0 || (!base && !index)) n += snprintf(buf, size, "%" PRId64, op->value);
+                if (base || index) {
+                    n += snprintf(buf + n, size - n, "(%s%s", base ? "%" : "", base ? isel_reg_name(op->reg, 64) : "");
+                    if (index) n += snprintf(buf + n, size - n, ",%%%s", isel_reg_name(op->index, 64));
+                    if (index && op->scale != 1) n += snprintf(buf + n, size - n, ",%d", op->scale);
+                    snprintf(buf + n, size - n, ")");
+                }
+            } else {
+                n += snprintf(buf, size, "%s[", ptr ? "qword ptr " : "");
+                if (base) n += snprintf(buf + n, size - n, "%s", isel_reg_name(op->reg, 64));
+                if (index) {
+                    n += snprintf(buf + n, size - n, "%s%s", base ? " + " : "", isel_reg_name(op->index, 64));
+                    if (op->scale != 1) n += snprintf(buf + n, size - n, "*%d", op->scale);
+                }
+                if (!base && !index) n += snprintf(buf + n, size - n, "%" PRId64, op->value);
+                else if (op->value > 0) n += snprintf(buf + n, size - n, " + %" PRId64, op->value);
+                else if (op->value < 0) n += snprintf(buf + n, size - n, " - %" PRIu64, (uint64_t)0 - (uint64_t)op->value);
+                snprintf(buf + n, size - n, "]");
+            }
+            break;
+        }
+        case X64_OPND_NONE:
+            buf[0] = '\0';
+            break;
+    }
+}
+
+void x64_render(X64Syntax syntax, char *buf, size_t size, const char *mnemonic, bool sized,
+                const X64Operand *ops, int count) {
+    bool att = syntax == X64_SYNTAX_ATT;
+    // Intel needs an explicit size only when no register operand implies it
+    bool ptr = !att && sized && strcmp(mnemonic, "lea") != 0;
+    for (int i = 0; i < count && ptr; i++) {
+        if (ops[i].kind == X64_OPND_REG) ptr = false;
+    }
+    int n = snprintf(buf, size, "%s%s", mnemonic, att && sized ? "q" : "");
+    for (int i = 0; i < count && n >= 0 && (size_t)n < size; i++) {
+        char text[96];
+        isel_render_operand(syntax, text, sizeof(text), &ops[att ? i : count - 1 - i], ptr);
+        n += snprintf(buf + n, size - n, "%s%s", i ? ", " : " ", text);
+    }
+}
+
+/* ---------- Rule table ---------- */
+
+typedef enum {
+    ISEL_REG,                  // Value in a general purpose register
+    ISEL_IMM,                  // Sign-extended 32-bit immediate
+    ISEL_MEM,                  // Value in a stack slot
+    ISEL_ADDR,                 // base + index * scale + disp, for lea
+    ISEL_INDEX,                // index * scale
+    ISEL_ELEM,                 // Array element offset: index * 8 + disp
+    ISEL_CC,                   // Flags of a comparison
+    ISEL_STMT,                 // No value
+    ISEL_NT_COUNT
+} IselNT;
+
+/* Leaf classes and chain rules share the pattern field with IR opcodes */
+#define ISEL_LEAF_IMM   (-1)   // Constant that fits an imm32
+#define ISEL_LEAF_WIDE  (-2)   // Any other constant
+#define ISEL_LEAF_REG   (-3)   // Value in a register
+#define ISEL_LEAF_MEM   (-4)   // Value in a stack slot
+#define ISEL_CHAIN      (-5)   // One nonterminal from another
+
+typedef enum {
+    P_NONE,
+    P_SHIFT,                   // count in 0..63
+    P_SCALE_SHL,               // shift by 1..3: an index scale
+    P_SCALE_MUL,               // multiply by 2, 4 or 8
+    P_LEA_MUL,                 // multiply by 3, 5 or 9: base + base * {2,4,8}
+    P_NEG,                     // immediate can be negated
+    P_ELEM,                    // immediate * 8 fits a displacement
+    P_ELEM_NEG                 // -immediate * 8 fits a displacement
+} IselPred;
+
+typedef enum {
+    A_LEAF,                    // The leaf operand itself
+    A_STEPS,                   // Emit `steps`, result in D
+    A_TWO_ADDR,                // steps[0] is "mov K0, D", dropped when K0 is D
+    A_CC,                      // Emit `steps`; result is the condition
+    A_ADDR_DISP,               // K0 + K1
+    A_ADDR_NEG_DISP,           // K0 - K1
+    A_ADDR_INDEX,              // K0 + K1, K1 a register or an INDEX
+    A_ADDR_INDEX_REV,          // K1 + K0, K0 an INDEX
+    A_ADDR_SCALED,             // K0 + K0 * (K1 - 1)
+    A_INDEX_SHL,               // K0 << K1
+    A_INDEX_MUL,               // K0 * K1
+    A_ELEM_INDEX,              // Element K0
+    A_ELEM_DISP,               // Constant element K0
+    A_ELEM_INDEX_DISP,         // Element K0 + K1
+    A_ELEM_INDEX_NEG           // Element K0 - K1
+} IselAction;
+
+/* Template operands */
+typedef enum {
+    O_NONE,
+    O_D,                       // Result register
+    O_D8,                      // Its low byte
+    O_K0, O_K1, O_K2,          // Operands of the matched children
+    O_ZERO,                    // $0
+    O_ELEM,                    // Array element: K0 + ELEM(K1)
+    O_LEN,                     // Array length word: -8(K0)
+    O_LABEL                    // Branch target
+} IselOpd;
+
+typedef struct {
+    const char *mnemonic;      // '?' = condition of K0, '!' = its negation
+    bool sized;
+    IselOpd ops[3];            // AT&T order
+} IselStep;
+
+typedef struct {
+    IselNT lhs;
+    int pattern;               // IROpcode, leaf class or ISEL_CHAIN
+    IselNT kids[3];
+    int kid_count;
+    IselPred pred;
+    int cost;                  // Instructions emitted
+    IselAction action;
+    IselStep steps[2];
+} IselRule;
+
+#define STEP(m, sized, a, b, c) { m, sized, { a, b, c } }
+#define NOSTEPS { STEP(NULL, false, O_NONE, O_NONE, O_NONE) }
+
+/* dst = a OP b for every operand form of b */
+#define ISEL_ALU(op, m)                                                                      \
+    { ISEL_REG, op, { ISEL_REG, ISEL_IMM }, 2, P_NONE, 2, A_TWO_ADDR,                         \
+      { STEP("mov", true, O_K0, O_D, O_NONE), STEP(m, true, O_K1, O_D, O_NONE) } },          \
+    { ISEL_REG, op, { ISEL_REG, ISEL_REG }, 2, P_NONE, 2, A_TWO_ADDR,                         \
+      { STEP("mov", true, O_K0, O_D, O_NONE), STEP(m, true, O_K1, O_D, O_NONE) } },          \
+    { ISEL_REG, op, { ISEL_REG, ISEL_MEM }, 2, P_NONE, 2, A_TWO_ADDR,                         \
+      { STEP("mov", true, O_K0, O_D, O_NONE), STEP(m, true, O_K1, O_D, O_NONE) } }
+
+#define ISEL_SHIFT(op, m)                                                                    \
+    { ISEL_REG, op, { ISEL_REG, ISEL_IMM }, 2, P_SHIFT, 2, A_TWO_ADDR,                        \
+      { STEP("mov", true, O_K0, O_D, O_NONE), STEP(m, true, O_K1, O_D, O_NONE) } }
+
+#define ISEL_CMP(op)                                                                         \
+    { ISEL_CC, op, { ISEL_REG, ISEL_IMM }, 2, P_NONE, 1, A_CC, { STEP("cmp", true, O_K1, O_K0, O_NONE) } }, \
+    { ISEL_CC, op, { ISEL_REG, ISEL_REG }, 2, P_NONE, 1, A_CC, { STEP("cmp", true, O_K1, O_K0, O_NONE) } }, \
+    { ISEL_CC, op, { ISEL_REG, ISEL_MEM }, 2, P_NONE, 1, A_CC, { STEP("cmp", true, O_K1, O_K0, O_NONE) } }, \
+    { ISEL_CC, op, { ISEL_MEM, ISEL_IMM }, 2, P_NONE, 1, A_CC, { STEP("cmp", true, O_K1, O_K0, O_NONE) } }, \
+    { ISEL_CC, op, { ISEL_MEM, ISEL_REG }, 2, P_NONE, 1, A_CC, { STEP("cmp", true, O_K1, O_K0, O_NONE) } }
+
+static const IselRule isel_rules[] = {
+    /* Leaves */
+    { ISEL_REG,  ISEL_LEAF_REG,  { 0 }, 0, P_NONE, 0, A_LEAF, NOSTEPS },
+    { ISEL_IMM,  ISEL_LEAF_IMM,  { 0 }, 0, P_NONE, 0, A_LEAF, NOSTEPS },
+    { ISEL_MEM,  ISEL_LEAF_MEM,  { 0 }, 0, P_NONE, 0, A_LEAF, NOSTEPS },
+    { ISEL_REG,  ISEL_LEAF_WIDE, { 0 }, 0, P_NONE, 1, A_STEPS, { STEP("movabs", true, O_K0, O_D, O_NONE) } },
+
+    /* Chain rules */
+    { ISEL_REG,  ISEL_CHAIN, { ISEL_MEM },  1, P_NONE, 1, A_STEPS, { STEP("mov", true, O_K0, O_D, O_NONE) } },
+    { ISEL_REG,  ISEL_CHAIN, { ISEL_IMM },  1, P_NONE, 1, A_STEPS, { STEP("mov", true, O_K0, O_D, O_NONE) } },
+    { ISEL_REG,  ISEL_CHAIN, { ISEL_ADDR }, 1, P_NONE, 1, A_STEPS, { STEP("lea", true, O_K0, O_D, O_NONE) } },
+    { ISEL_REG,  ISEL_CHAIN, { ISEL_CC },   1, P_NONE, 2, A_STEPS,
+      { STEP("mov", true, O_ZERO, O_D, O_NONE), STEP("set?", false, O_D8, O_NONE, O_NONE) } },
+    { ISEL_ELEM, ISEL_CHAIN, { ISEL_REG },  1, P_NONE, 0, A_ELEM_INDEX, NOSTEPS },
+    { ISEL_ELEM, ISEL_CHAIN, { ISEL_IMM },  1, P_ELEM, 0, A_ELEM_DISP, NOSTEPS },
+
+    /* Arithmetic */
+    ISEL_ALU(IR_ADD, "add"),
+    ISEL_ALU(IR_SUB, "sub"),
+    ISEL_ALU(IR_AND, "and"),
+    ISEL_ALU(IR_OR, "or"),
+    ISEL_ALU(IR_MUL, "imul"),
+    { ISEL_REG, IR_MUL, { ISEL_REG, ISEL_IMM }, 2, P_NONE, 1, A_STEPS, { STEP("imul", true, O_K1, O_K0, O_D) } },
+    ISEL_SHIFT(IR_SHL, "shl"),
+    ISEL_SHIFT(IR_SHR, "shr"),
+    ISEL_SHIFT(IR_SAR, "sar"),
+
+    /* Addressing arithmetic (reached through REG <- ADDR: lea) */
+    { ISEL_ADDR,  IR_ADD, { ISEL_REG, ISEL_IMM },   2, P_NONE,      0, A_ADDR_DISP, NOSTEPS },
+    { ISEL_ADDR,  IR_SUB, { ISEL_REG, ISEL_IMM },   2, P_NEG,       0, A_ADDR_NEG_DISP, NOSTEPS },
+    { ISEL_ADDR,  IR_ADD, { ISEL_REG, ISEL_REG },   2, P_NONE,      0, A_ADDR_INDEX, NOSTEPS },
+    { ISEL_ADDR,  IR_ADD, { ISEL_REG, ISEL_INDEX }, 2, P_NONE,      0, A_ADDR_INDEX, NOSTEPS },
+    { ISEL_ADDR,  IR_ADD, { ISEL_INDEX, ISEL_REG }, 2, P_NONE,      0, A_ADDR_INDEX_REV, NOSTEPS },
+    { ISEL_ADDR,  IR_MUL, { ISEL_REG, ISEL_IMM },   2, P_LEA_MUL,   0, A_ADDR_SCALED, NOSTEPS },
+    { ISEL_INDEX, IR_SHL, { ISEL_REG, ISEL_IMM },   2, P_SCALE_SHL, 0, A_INDEX_SHL, NOSTEPS },
+    { ISEL_INDEX, IR_MUL, { ISEL_REG, ISEL_IMM },   2, P_SCALE_MUL, 0, A_INDEX_MUL, NOSTEPS },
+
+    /* Arrays */
+    { ISEL_ELEM, IR_ADD, { ISEL_REG, ISEL_IMM }, 2, P_ELEM,     0, A_ELEM_INDEX_DISP, NOSTEPS },
+    { ISEL_ELEM, IR_SUB, { ISEL_REG, ISEL_IMM }, 2, P_ELEM_NEG, 0, A_ELEM_INDEX_NEG, NOSTEPS },
+    { ISEL_REG,  IR_LOAD_ELEM,  { ISEL_REG, ISEL_ELEM }, 2, P_NONE, 1, A_STEPS,
+      { STEP("mov", true, O_ELEM, O_D, O_NONE) } },
+    { ISEL_STMT, IR_STORE_ELEM, { ISEL_REG, ISEL_ELEM, ISEL_REG }, 3, P_NONE, 1, A_STEPS,
+      { STEP("mov", true, O_K2, O_ELEM, O_NONE) } },
+    { ISEL_STMT, IR_STORE_ELEM, { ISEL_REG, ISEL_ELEM, ISEL_IMM }, 3, P_NONE, 1, A_STEPS,
+      { STEP("mov", true, O_K2, O_ELEM, O_NONE) } },
+    { ISEL_REG,  IR_ARRAY_LEN,  { ISEL_REG }, 1, P_NONE, 1, A_STEPS, { STEP("mov", true, O_LEN, O_D, O_NONE) } },
+
+    /* Comparisons and branches */
+    ISEL_CMP(IR_EQ), ISEL_CMP(IR_NE), ISEL_CMP(IR_LT),
+    ISEL_CMP(IR_LE), ISEL_CMP(IR_GT), ISEL_CMP(IR_GE),
+    { ISEL_STMT, IR_JUMP_IF,     { ISEL_CC },  1, P_NONE, 1, A_STEPS, { STEP("j?", false, O_LABEL, O_NONE, O_NONE) } },
+    { ISEL_STMT, IR_JUMP_IF_NOT, { ISEL_CC },  1, P_NONE, 1, A_STEPS, { STEP("j!", false, O_LABEL, O_NONE, O_NONE) } },
+    { ISEL_STMT, IR_JUMP_IF,     { ISEL_REG }, 1, P_NONE, 2, A_STEPS,
+      { STEP("test", true, O_K0, O_K0, O_NONE), STEP("jne", false, O_LABEL, O_NONE, O_NONE) } },
+    { ISEL_STMT, IR_JUMP_IF_NOT, { ISEL_REG }, 1, P_NONE, 2, A_STEPS,
+      { STEP("test", true, O_K0, O_K0, O_NONE), STEP("je", false, O_LABEL, O_NONE, O_NONE) } },
+    { ISEL_STMT, IR_JUMP_IF,     { ISEL_MEM }, 1, P_NONE, 2, A_STEPS,
+      { STEP("cmp", true, O_ZERO, O_K0, O_NONE), STEP("jne", false, O_LABEL, O_NONE, O_NONE) } },
+    { ISEL_STMT, IR_JUMP_IF_NOT, { ISEL_MEM }, 1, P_NONE, 2, A_STEPS,
+      { STEP("cmp", true, O_ZERO, O_K0, O_NONE), STEP("je", false, O_LABEL, O_NONE, O_NONE) } },
+};
+
+#define ISEL_RULE_COUNT ((int)(sizeof(isel_rules) / sizeof(isel_rules[0])))
+
+/* ---------- Trees ---------- */
+
+#define ISEL_INF (INT_MAX / 4)
+#define ISEL_MAX_NODES 16
+#define ISEL_MAX_LINES 16
+
+typedef struct IselNode {
+    int pattern;               // IROpcode or leaf class
+    const IRInstruction *instr;
+    IROpcode cond;             // Comparisons: the condition after operand swaps
+    X64Operand loc;            // Leaves: where the value lives
+    struct IselNode *kids[3];
+    int kid_count;
+    int cost[ISEL_NT_COUNT];
+    const IselRule *rule[ISEL_NT_COUNT];
+} IselNode;
+
+typedef struct {
+    const X64IselTarget *target;
+    const IRInstruction *root_instr;
+    X64Register out;           // Result register of the root (X64_REG_COUNT while costing)
+    IselNode nodes[ISEL_MAX_NODES];
+    int node_count;
+    uint32_t refs;             // Registers read by leaves
+    uint32_t taken;            // Registers written so far
+    bool failed;
+    char lines[ISEL_MAX_LINES][128];
+    int line_count;
+} IselState;
+
+static bool isel_is_compare(int op) {
+    return op == IR_EQ || op == IR_NE || op == IR_LT || op == IR_LE || op == IR_GT || op == IR_GE;
+}
+
+static bool isel_is_commutative(int op) {
+    return op == IR_ADD || op == IR_AND || op == IR_OR || op == IR_MUL;
+}
+
+/* Instructions with rules, and those that may be folded into a parent */
+static bool isel_is_root(int op) {
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_MUL:
+        case IR_SHL: case IR_SHR: case IR_SAR:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_LOAD_ELEM: case IR_STORE_ELEM: case IR_ARRAY_LEN:
+        case IR_JUMP_IF: case IR_JUMP_IF_NOT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isel_is_pure(int op) {
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_AND: case IR_OR: case IR_MUL:
+        case IR_SHL: case IR_SHR: case IR_SAR:
+            return true;
+        default:
+            return isel_is_compare(op);
+    }
+}
+
+static IROpcode isel_swap_compare(IROpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GT;
+        case IR_LE: return IR_GE;
+        case IR_GT: return IR_LT;
+        case IR_GE: return IR_LE;
+        default: return op;
+    }
+}
+
+static const char* isel_cc_name(IROpcode op, bool negate) {
+    switch (op) {
+        case IR_EQ: return negate ? "ne" : "e";
+        case IR_NE: return negate ? "e" : "ne";
+        case IR_LT: return negate ? "ge" : "l";
+        case IR_LE: return negate ? "g" : "le";
+        case IR_GT: return negate ? "le" : "g";
+        case IR_GE: return negate ? "l" : "ge";
+        default: return negate ? "ne" : "e";
+    }
+}
+
+static uint32_t isel_opnd_regs(const X64Operand *op) {
+    uint32_t mask = 0;
+    if ((op->kind == X64_OPND_REG || op->kind == X64_OPND_MEM) && op->reg < X64_REG_COUNT) mask |= 1u << op->reg;
+    if (op->kind == X64_OPND_MEM && op->index < X64_REG_COUNT) mask |= 1u << op->index;
+    return mask;
+}
+
+static uint32_t isel_tree_regs(const IselNode *n) {
+    if (n->pattern < 0) return isel_opnd_regs(&n->loc);
+    uint32_t mask = 0;
+    for (int i = 0; i < n->kid_count; i++) mask |= isel_tree_regs(n->kids[i]);
+    return mask;
+}
+
+static IselNode* isel_new_node(IselState *s) {
+    if (s->node_count == ISEL_MAX_NODES) {
+        s->failed = true;
+        s->node_count = 0;
+    }
+    IselNode *n = &s->nodes[s->node_count++];
+    memset(n, 0, sizeof(IselNode));
+    return n;
+}
+
+static IselNode* isel_leaf(IselState *s, const IRValue *val) {
+    IselNode *n = isel_new_node(s);
+    n->loc = s->target->locate(s->target->backend, val);
+    switch (n->loc.kind) {
+        case X64_OPND_IMM:
+            n->pattern = n->loc.value >= INT32_MIN && n->loc.value <= INT32_MAX ? ISEL_LEAF_IMM : ISEL_LEAF_WIDE;
+            break;
+        case X64_OPND_REG: n->pattern = ISEL_LEAF_REG; break;
+        case X64_OPND_MEM: n->pattern = ISEL_LEAF_MEM; break;
+        default: s->failed = true; n->pattern = ISEL_LEAF_MEM; break;
+    }
+    s->refs |= isel_opnd_regs(&n->loc);
+    return n;
+}
+
+static bool isel_is_const_leaf(const IselNode *n) {
+    return n->pattern == ISEL_LEAF_IMM || n->pattern == ISEL_LEAF_WIDE;
+}
+
+/* Tree for `instr`; an operand defined by `kid` becomes a subtree */
+static IselNode* isel_build(IselState *s, const IRInstruction *instr, const IRInstruction *kid) {
+    IselNode *n = isel_new_node(s);
+    n->pattern = instr->opcode;
+    n->instr = instr;
+    n->cond = instr->opcode;
+    const IRValue *vals[3] = { instr->src1, instr->src2, instr->arg_count > 0 ? instr->args[0] : NULL };
+    switch (instr->opcode) {
+        case IR_STORE_ELEM: n->kid_count = 3; break;
+        case IR_ARRAY_LEN: case IR_JUMP_IF: case IR_JUMP_IF_NOT: n->kid_count = 1; break;
+        default: n->kid_count = 2; break;
+    }
+    for (int i = 0; i < n->kid_count; i++) {
+        const IRValue *val = vals[i];
+        if (!val) {
+            s->failed = true;
+            return n;
+        }
+        if (kid && val->kind == IR_VAL_REG && kid->dest && val->data.reg_num == kid->dest->data.reg_num) {
+            n->kids[i] = isel_build(s, kid, NULL);
+        } else {
+            n->kids[i] = isel_leaf(s, val);
+        }
+    }
+    // Constants go to the immediate side
+    if (n->kid_count == 2 && isel_is_const_leaf(n->kids[0]) && !isel_is_const_leaf(n->kids[1]) &&
+        (isel_is_commutative(n->pattern) || isel_is_compare(n->pattern))) {
+        IselNode *tmp = n->kids[0];
+        n->kids[0] = n->kids[1];
+        n->kids[1] = tmp;
+        n->cond = isel_swap_compare(n->cond);
+    }
+    return n;
+}
+
+/* ---------- Labeling ---------- */
+
+static bool isel_pred_ok(const IselRule *r, const IselNode *n) {
+    if (r->pred == P_NONE) return true;
+    const IselNode *leaf = r->pattern == ISEL_CHAIN ? n : n->kids[1];
+    if (leaf->pattern != ISEL_LEAF_IMM) return false;
+    int64_t v = leaf->loc.value;
+    switch (r->pred) {
+        case P_SHIFT: return v >= 0 && v <= 63;
+        case P_SCALE_SHL: return v >= 1 && v <= 3;
+        case P_SCALE_MUL: return v == 2 || v == 4 || v == 8;
+        case P_LEA_MUL: return v == 3 || v == 5 || v == 9;
+        case P_NEG: return v != INT32_MIN;
+        case P_ELEM: return v >= INT32_MIN / 8 && v <= INT32_MAX / 8;
+        case P_ELEM_NEG: return v > INT32_MIN / 8 && v <= INT32_MAX / 8;
+        default: return true;
+    }
+}
+
+static void isel_label(IselState *s, IselNode *n) {
+    for (int i = 0; i < n->kid_count; i++) isel_label(s, n->kids[i]);
+    for (int nt = 0; nt < ISEL_NT_COUNT; nt++) {
+        n->cost[nt] = ISEL_INF;
+        n->rule[nt] = NULL;
+    }
+
+    for (int k = 0; k < ISEL_RULE_COUNT; k++) {
+        const IselRule *r = &isel_rules[k];
+        if (r->pattern == ISEL_CHAIN || r->pattern != n->pattern || r->kid_count != n->kid_count) continue;
+        int cost = r->cost;
+        for (int i = 0; i < r->kid_count && cost < ISEL_INF; i++) {
+            cost += n->kids[i]->cost[r->kids[i]];
+        }
+        if (cost >= ISEL_INF || !isel_pred_ok(r, n)) continue;
+        // The leading move of a two-address form disappears when the
+        // first operand is computed into the result register or already
+        // sits there
+        if (r->action == A_TWO_ADDR &&
+            (n->kids[0]->pattern != ISEL_LEAF_REG ||
+             (n->instr == s->root_instr && s->out != X64_REG_COUNT &&
+              (n->kids[0]->loc.reg == s->out ||
+               (isel_is_commutative(n->pattern) && n->kids[1]->pattern == ISEL_LEAF_REG &&
+                n->kids[1]->loc.reg == s->out))))) {
+            cost--;
+        }
+        if (cost < n->cost[r->lhs]) {
+            n->cost[r->lhs] = cost;
+            n->rule[r->lhs] = r;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < ISEL_RULE_COUNT; k++) {
+            const IselRule *r = &isel_rules[k];
+            if (r->pattern != ISEL_CHAIN || n->cost[r->kids[0]] >= ISEL_INF || !isel_pred_ok(r, n)) continue;
+            int cost = n->cost[r->kids[0]] + r->cost;
+            if (cost < n->cost[r->lhs]) {
+                n->cost[r->lhs] = cost;
+                n->rule[r->lhs] = r;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* ---------- Reduction ---------- */
+
+static X64Register isel_take(IselState *s, X64Register want) {
+    if (want != X64_REG_COUNT) {
+        s->taken |= 1u << want;
+        return want;
+    }
+    for (int i = 0; i < s->target->scratch_count; i++) {
+        X64Register r = s->target->scratch[i];
+        uint32_t bit = 1u << r;
+        if (!((s->refs | s->taken) & bit) && r != s->out) {
+            s->taken |= bit;
+            return r;
+        }
+    }
+    s->failed = true;
+    return X64_REG_RAX;
+}
+
+static void isel_line(IselState *s, const char *mnemonic, bool sized, const X64Operand *ops, int count) {
+    if (s->line_count == ISEL_MAX_LINES) {
+        s->failed = true;
+        return;
+    }
+    x64_render(s->target->syntax, s->lines[s->line_count++], sizeof(s->lines[0]), mnemonic, sized, ops, count);
+}
+
+static void isel_emit_step(IselState *s, const IselStep *step, X64Register d, const X64Operand *k) {
+    char mnemonic[16];
+    const char *q = strpbrk(step->mnemonic, "?!");
+    if (q) {
+        snprintf(mnemonic, sizeof(mnemonic), "%.*s%s", (int)(q - step->mnemonic), step->mnemonic,
+                 isel_cc_name((IROpcode)k[0].value, *q == '!'));
+    } else {
+        snprintf(mnemonic, sizeof(mnemonic), "%s", step->mnemonic);
+    }
+
+    X64Operand ops[3];
+    int count = 0;
+    for (int i = 0; i < 3 && step->ops[i] != O_NONE; i++) {
+        X64Operand *op = &ops[count++];
+        switch (step->ops[i]) {
+            case O_D: *op = x64_opnd_reg(d); break;
+            case O_D8: *op = x64_opnd_reg(d); op->bits = 8; break;
+            case O_K0: *op = k[0]; break;
+            case O_K1: *op = k[1]; break;
+            case O_K2: *op = k[2]; break;
+            case O_ZERO: *op = x64_opnd_imm(0); break;
+            case O_ELEM:
+                *op = k[1];
+                op->reg = k[0].reg;
+                break;
+            case O_LEN: *op = x64_opnd_mem(k[0].reg, -8); break;
+            case O_LABEL: *op = x64_opnd_label(s->root_instr->dest->data.label); break;
+            case O_NONE: break;
+        }
+    }
+    isel_line(s, mnemonic, step->sized, ops, count);
+}
+
+static void isel_emit_steps(IselState *s, const IselRule *r, X64Register d, const X64Operand *k, int first) {
+    for (int i = first; i < 2 && r->steps[i].mnemonic; i++) {
+        isel_emit_step(s, &r->steps[i], d, k);
+    }
+}
+
+static X64Operand isel_index(X64Register index, int scale, int64_t disp) {
+    X64Operand op = x64_opnd_mem(X64_REG_COUNT, disp);
+    op.index = index;
+    op.scale = scale;
+    return op;
+}
+
+static X64Operand isel_reduce(IselState *s, IselNode *n, IselNT nt, X64Register want) {
+    const IselRule *r = n->rule[nt];
+    X64Operand k[3] = { x64_opnd_imm(0), x64_opnd_imm(0), x64_opnd_imm(0) };
+    if (!r) {
+        s->failed = true;
+        return k[0];
+    }
+
+    if (r->pattern == ISEL_CHAIN) {
+        k[0] = isel_reduce(s, n, r->kids[0], X64_REG_COUNT);
+    } else if (r->pattern < 0) {
+        k[0] = n->loc;
+    } else {
+        for (int i = 0; i < r->kid_count; i++) {
+            // Load the first operand of a two-address form straight into
+            // the result register unless a later operand still reads it
+            X64Register kid_want = X64_REG_COUNT;
+            if (i == 0 && r->action == A_TWO_ADDR && want != X64_REG_COUNT) {
+                uint32_t later = 0;
+                for (int j = 1; j < r->kid_count; j++) later |= isel_tree_regs(n->kids[j]);
+                if (!(later & (1u << want))) kid_want = want;
+            }
+            k[i] = isel_reduce(s, n->kids[i], r->kids[i], kid_want);
+        }
+    }
+
+    X64Operand result = x64_opnd_imm(0);
+    switch (r->action) {
+        case A_LEAF:
+            return k[0];
+
+        case A_STEPS: {
+            X64Register d = r->lhs == ISEL_REG ? isel_take(s, want) : X64_REG_COUNT;
+            isel_emit_steps(s, r, d, k, 0);
+            return d != X64_REG_COUNT ? x64_opnd_reg(d) : result;
+        }
+
+        case A_TWO_ADDR: {
+            // A first operand computed into a fresh register is updated in place
+            bool fresh = k[0].kind == X64_OPND_REG && n->kids[0]->rule[r->kids[0]]->action != A_LEAF;
+            X64Register d = want == X64_REG_COUNT && fresh ? k[0].reg : isel_take(s, want);
+            bool in_place = k[0].kind == X64_OPND_REG && k[0].reg == d;
+            if (!in_place && (isel_opnd_regs(&k[1]) & (1u << d))) {
+                if (isel_is_commutative(n->pattern) && !(isel_opnd_regs(&k[0]) & (1u << d))) {
+                    X64Operand tmp = k[0];
+                    k[0] = k[1];
+                    k[1] = tmp;
+                    in_place = k[0].kind == X64_OPND_REG && k[0].reg == d;
+                } else {
+                    // The result register is still an input: compute aside
+                    X64Register t = isel_take(s, X64_REG_COUNT);
+                    isel_emit_steps(s, r, t, k, 0);
+                    X64Operand mov[2] = { x64_opnd_reg(t), x64_opnd_reg(d) };
+                    isel_line(s, "mov", true, mov, 2);
+                    return x64_opnd_reg(d);
+                }
+            }
+            isel_emit_steps(s, r, d, k, in_place ? 1 : 0);
+            return x64_opnd_reg(d);
+        }
+
+        case A_CC:
+            isel_emit_steps(s, r, X64_REG_COUNT, k, 0);
+            result.kind = X64_OPND_NONE;
+            result.value = n->cond;
+            return result;
+
+        case A_ADDR_DISP:      return x64_opnd_mem(k[0].reg, k[1].value);
+        case A_ADDR_NEG_DISP:  return x64_opnd_mem(k[0].reg, -k[1].value);
+        case A_ADDR_INDEX:
+            result = x64_opnd_mem(k[0].reg, 0);
+            result.index = k[1].kind == X64_OPND_REG ? k[1].reg : k[1].index;
+            result.scale = k[1].kind == X64_OPND_REG ? 1 : k[1].scale;
+            return result;
+        case A_ADDR_INDEX_REV:
+            result = x64_opnd_mem(k[1].reg, 0);
+            result.index = k[0].index;
+            result.scale = k[0].scale;
+            return result;
+        case A_ADDR_SCALED:
+            result = x64_opnd_mem(k[0].reg, 0);
+            result.index = k[0].reg;
+            result.scale = (int)k[1].value - 1;
+            return result;
+        case A_INDEX_SHL:      return isel_index(k[0].reg, 1 << k[1].value, 0);
+        case A_INDEX_MUL:      return isel_index(k[0].reg, (int)k[1].value, 0);
+        case A_ELEM_INDEX:     return isel_index(k[0].reg, 8, 0);
+        case A_ELEM_DISP:      return isel_index(X64_REG_COUNT, 8, k[0].value * 8);
+        case A_ELEM_INDEX_DISP: return isel_index(k[0].reg, 8, k[1].value * 8);
+        case A_ELEM_INDEX_NEG: return isel_index(k[0].reg, 8, -k[1].value * 8);
+    }
+    return result;
+}
+
+/* ---------- Entry points ---------- */
+
+static IselNT isel_goal(const IRInstruction *instr) {
+    switch (instr->opcode) {
+        case IR_STORE_ELEM: case IR_JUMP_IF: case IR_JUMP_IF_NOT: return ISEL_STMT;
+        default: return ISEL_REG;
+    }
+}
+
+static bool isel_shape_ok(const IRInstruction *instr) {
+    if (!isel_is_root(instr->opcode)) return false;
+    if (instr->opcode == IR_JUMP_IF || instr->opcode == IR_JUMP_IF_NOT) {
+        return instr->dest && instr->dest->kind == IR_VAL_LABEL && instr->dest->data.label;
+    }
+    if (instr->opcode == IR_STORE_ELEM) return instr->arg_count >= 1;
+    return instr->dest != NULL;
+}
+
+/* Label the tree of `root` (+ `kid`); returns the cost of its goal */
+static int isel_cost(IselState *s, const X64IselTarget *target, const IRInstruction *root,
+                     const IRInstruction *kid, X64Register out, IselNode **tree) {
+    memset(s, 0, sizeof(IselState));
+    s->target = target;
+    s->root_instr = root;
+    s->out = out;
+    IselNode *n = isel_build(s, root, kid);
+    if (s->failed) return ISEL_INF;
+    isel_label(s, n);
+    if (tree) *tree = n;
+    return n->cost[isel_goal(root)];
+}
+
+int* x64_isel_use_counts(const IRFunction *func) {
+    int *counts = calloc(func->reg_count > 0 ? func->reg_count : 1, sizeof(int));
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        const IRValue *ops[2] = { instr->src1, instr->src2 };
+        for (int i = 0; i < 2 + instr->arg_count; i++) {
+            const IRValue *val = i < 2 ? ops[i] : instr->args[i - 2];
+            if (val && val->kind == IR_VAL_REG && val->data.reg_num >= 0 && val->data.reg_num < func->reg_count) {
+                counts[val->data.reg_num]++;
+            }
+        }
+    }
+    return counts;
+}
+
+bool x64_isel_foldable(const IRInstruction *kid, const IRInstruction *root, const int *use_counts) {
+    if (!kid || !root || kid->next != root || !isel_is_pure(kid->opcode) || !isel_shape_ok(root) ||
+        !kid->dest || kid->dest->kind != IR_VAL_REG || use_counts[kid->dest->data.reg_num] != 1) {
+        return false;
+    }
+    const IRValue *vals[3] = { root->src1, root->src2, root->arg_count > 0 ? root->args[0] : NULL };
+    for (int i = 0; i < 3; i++) {
+        if (vals[i] && vals[i]->kind == IR_VAL_REG && vals[i]->data.reg_num == kid->dest->data.reg_num) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool x64_isel_absorbs(const X64IselTarget *target, const IRInstruction *root, const IRInstruction *kid) {
+    IselState *s = malloc(sizeof(IselState));
+    int folded = isel_cost(s, target, root, kid, X64_REG_COUNT, NULL);
+    int alone = isel_cost(s, target, kid, NULL, X64_REG_COUNT, NULL);
+    if (alone < ISEL_INF) alone += isel_cost(s, target, root, NULL, X64_REG_COUNT, NULL);
+    free(s);
+    return folded < ISEL_INF && folded < alone;
+}
+
+bool x64_isel_generate(const X64IselTarget *target, const IRInstruction *root, const IRInstruction *kid,
+                       X64Register out, bool clobbered[X64_REG_COUNT]) {
+    if (!isel_shape_ok(root)) return false;
+    IselState *s = malloc(sizeof(IselState));
+    IselNode *tree = NULL;
+    IselNT goal = isel_goal(root);
+    if (isel_cost(s, target, root, kid, goal == ISEL_REG ? out : X64_REG_COUNT, &tree) >= ISEL_INF) {
+        free(s);
+        return false;
+    }
+    X64Operand result = isel_reduce(s, tree, goal, goal == ISEL_REG ? out : X64_REG_COUNT);
+    if (!s->failed && goal == ISEL_REG && (result.kind != X64_OPND_REG || result.reg != out)) {
+        X64Operand mov[2] = { result, x64_opnd_reg(out) };
+        isel_line(s, "mov", true, mov, 2);
+    }
+    bool ok = !s->failed;
+    if (ok) {
+        for (int i = 0; i < s->line_count; i++) target->emit(target->backend, s->lines[i]);
+        for (int r = 0; clobbered && r < X64_REG_COUNT; r++) clobbered[r] = (s->taken >> r) & 1;
+    }
+    free(s);
+    return ok;
+}
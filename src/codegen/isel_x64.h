@@ -0,0 +1,83 @@
+/* ========================================
+   SUB Language - x86-64 Instruction Selector
+   Table-driven tree-pattern matching shared by the x86-64 backends
+   File: isel_x64.h
+   ======================================== */
+
+#ifndef ISEL_X64_H
+#define ISEL_X64_H
+
+#include "codegen_x64.h"
+#include <stdint.h>
+
+/*
+ * BURS-style selection: an IR instruction, optionally with the instruction
+ * right before it folded in as a subtree, is labeled bottom-up with the
+ * cheapest rule for every nonterminal (register, immediate, memory,
+ * address, scaled index, array element, condition, statement) and then
+ * reduced top-down into instructions. Costs, patterns and instruction
+ * templates all live in the rule table in isel_x64.c.
+ *
+ * Backends describe where values live (X64IselTarget.locate) and receive
+ * rendered lines (X64IselTarget.emit) in AT&T or Intel syntax.
+ */
+
+typedef enum {
+    X64_SYNTAX_ATT,            // GNU as default: movq $1, %rax
+    X64_SYNTAX_INTEL           // .intel_syntax noprefix: mov rax, 1
+} X64Syntax;
+
+typedef enum {
+    X64_OPND_NONE,
+    X64_OPND_REG,
+    X64_OPND_IMM,
+    X64_OPND_MEM,
+    X64_OPND_LABEL
+} X64OperandKind;
+
+typedef struct {
+    X64OperandKind kind;
+    X64Register reg;           // REG, or MEM base (X64_REG_COUNT: none)
+    X64Register index;         // MEM index (X64_REG_COUNT: none)
+    int scale;                 // MEM index scale
+    int bits;                  // REG width: 64, 32 or 8
+    int64_t value;             // IMM value or MEM displacement
+    const char *label;         // LABEL
+} X64Operand;
+
+X64Operand x64_opnd_reg(X64Register reg);
+X64Operand x64_opnd_imm(int64_t value);
+X64Operand x64_opnd_mem(X64Register base, int64_t disp);
+X64Operand x64_opnd_label(const char *label);
+
+/* Render one instruction. Operands are in AT&T order (sources first);
+   `sized` marks a 64-bit operation (q suffix / qword ptr). */
+void x64_render(X64Syntax syntax, char *buf, size_t size, const char *mnemonic, bool sized,
+                const X64Operand *ops, int count);
+
+/* Backend hooks */
+typedef struct {
+    X64Syntax syntax;
+    void *backend;
+    X64Operand (*locate)(void *backend, const IRValue *val);   // Register, stack slot or immediate
+    void (*emit)(void *backend, const char *line);
+    X64Register scratch[4];    // Registers that hold no value between instructions
+    int scratch_count;
+} X64IselTarget;
+
+/* Uses of every virtual register in `func` (caller frees) */
+int* x64_isel_use_counts(const IRFunction *func);
+
+/* Can `kid` (whose result only `root` reads) be evaluated as part of
+   root's tree? x64_isel_absorbs then says whether that is cheaper. */
+bool x64_isel_foldable(const IRInstruction *kid, const IRInstruction *root, const int *use_counts);
+bool x64_isel_absorbs(const X64IselTarget *target, const IRInstruction *root, const IRInstruction *kid);
+
+/* Select and emit `root` (with `kid` folded in, or NULL). Value-producing
+   instructions leave their result in `out`. Returns false, emitting
+   nothing, when no rule covers the tree. `clobbered` (may be NULL)
+   receives every register written. */
+bool x64_isel_generate(const X64IselTarget *target, const IRInstruction *root, const IRInstruction *kid,
+                       X64Register out, bool clobbered[X64_REG_COUNT]);
+
+#endif /* ISEL_X64_H */
@@ -0,0 +1,331 @@
+/* ========================================
+   SUB Language - x86-64 In-Memory JIT
+   Implementation
+   File: jit_x64.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "jit_x64.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define JIT_PAGE_SIZE 4096
+#define JIT_STUB_SIZE 16       // jmp *0(%rip); .quad target; 2 bytes of int3
+
+static const char jit_magic[8] = "SUBJIT1";
+
+typedef struct {
+    char *name;
+    size_t offset;             // From the start of the image (.text is first)
+    size_t size;
+} JitSymbol;
+
+struct X64JitImage {
+    uint8_t *base;
+    size_t size;               // Whole mapping, page aligned
+    size_t offset[ELF_SEC_COUNT];
+    size_t length[ELF_SEC_COUNT];
+    size_t stub_offset;        // Stubs for external calls, inside .text
+    char **externs;
+    int extern_count;
+    JitSymbol *symbols;        // Functions only
+    int symbol_count;
+};
+
+/* Host functions the generated code calls by name */
+static const struct { const char *name; void *address; } jit_runtime[] = {
+    { "calloc", (void*)calloc },
+};
+
+static void *jit_runtime_address(const char *name) {
+    for (size_t i = 0; i < sizeof(jit_runtime) / sizeof(jit_runtime[0]); i++) {
+        if (strcmp(jit_runtime[i].name, name) == 0) return jit_runtime[i].address;
+    }
+    return NULL;
+}
+
+static size_t jit_page_round(size_t size) {
+    return (size + JIT_PAGE_SIZE - 1) / JIT_PAGE_SIZE * JIT_PAGE_SIZE;
+}
+
+static bool jit_fail(char *error, size_t size, const char *message, const char *detail) {
+    snprintf(error, size, "%s%s%s%s", message, detail ? " '" : "", detail ? detail : "", detail ? "'" : "");
+    return false;
+}
+
+/* Section offsets and the mapping size from the section lengths */
+static void jit_layout(X64JitImage *image) {
+    image->offset[ELF_SEC_TEXT] = 0;
+    image->offset[ELF_SEC_RODATA] = jit_page_round(image->length[ELF_SEC_TEXT]);
+    image->offset[ELF_SEC_DATA] = image->offset[ELF_SEC_RODATA] + jit_page_round(image->length[ELF_SEC_RODATA]);
+    image->size = image->offset[ELF_SEC_DATA] + jit_page_round(image->length[ELF_SEC_DATA]);
+}
+
+void x64_jit_free(X64JitImage *image) {
+    if (!image) return;
+#ifndef _WIN32
+    if (image->base) munmap(image->base, image->size);
+#endif
+    for (int i = 0; i < image->extern_count; i++) free(image->externs[i]);
+    for (int i = 0; i < image->symbol_count; i++) free(image->symbols[i].name);
+    free(image->externs);
+    free(image->symbols);
+    free(image);
+}
+
+#ifndef _WIN32
+
+static bool jit_map(X64JitImage *image, char *error, size_t error_size) {
+    void *base = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return jit_fail(error, error_size, "cannot map JIT memory", NULL);
+    image->base = base;
+    return true;
+}
+
+/* Point the stubs at this process's libc, then drop write access to code
+   and constants */
+static bool jit_finish(X64JitImage *image, char *error, size_t error_size) {
+    for (int i = 0; i < image->extern_count; i++) {
+        void *target = jit_runtime_address(image->externs[i]);
+        if (!target) return jit_fail(error, error_size, "undefined symbol", image->externs[i]);
+        uint8_t *stub = image->base + image->stub_offset + (size_t)i * JIT_STUB_SIZE;
+        static const uint8_t jump[6] = { 0xFF, 0x25, 0, 0, 0, 0 };
+        uint64_t address = (uint64_t)(uintptr_t)target;
+        memcpy(stub, jump, sizeof(jump));
+        for (int b = 0; b < 8; b++) stub[6 + b] = (uint8_t)(address >> (8 * b));
+        stub[14] = stub[15] = 0xCC;
+    }
+    size_t text = jit_page_round(image->length[ELF_SEC_TEXT]);
+    size_t rodata = jit_page_round(image->length[ELF_SEC_RODATA]);
+    if (mprotect(image->base, text, PROT_READ | PROT_EXEC) != 0 ||
+        (rodata && mprotect(image->base + image->offset[ELF_SEC_RODATA], rodata, PROT_READ) != 0)) {
+        return jit_fail(error, error_size, "cannot protect JIT memory", NULL);
+    }
+    return true;
+}
+
+static int jit_extern_index(const X64JitImage *image, const char *name) {
+    for (int i = 0; i < image->extern_count; i++) {
+        if (strcmp(image->externs[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+X64JitImage* x64_jit_link(ElfObject *obj, char *error, size_t error_size) {
+    X64JitImage *image = calloc(1, sizeof(X64JitImage));
+
+    // Every referenced name without a definition gets a stub
+    for (int i = 0; i < obj->reloc_count; i++) {
+        const char *name = obj->relocs[i].symbol;
+        if (elf_find_symbol(obj, name) || jit_extern_index(image, name) >= 0) continue;
+        if (strncmp(name, ".L", 2) == 0) {
+            jit_fail(error, error_size, "undefined local label", name);
+            x64_jit_free(image);
+            return NULL;
+        }
+        image->externs = realloc(image->externs, sizeof(char*) * (image->extern_count + 1));
+        image->externs[image->extern_count++] = strdup(name);
+    }
+
+    size_t text_size = obj->sections[ELF_SEC_TEXT].size;
+    image->stub_offset = (text_size + JIT_STUB_SIZE - 1) / JIT_STUB_SIZE * JIT_STUB_SIZE;
+    image->length[ELF_SEC_TEXT] = image->stub_offset + (size_t)image->extern_count * JIT_STUB_SIZE;
+    image->length[ELF_SEC_RODATA] = obj->sections[ELF_SEC_RODATA].size;
+    image->length[ELF_SEC_DATA] = obj->sections[ELF_SEC_DATA].size;
+    jit_layout(image);
+    if (!jit_map(image, error, error_size)) {
+        x64_jit_free(image);
+        return NULL;
+    }
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        if (obj->sections[s].size) memcpy(image->base + image->offset[s], obj->sections[s].data, obj->sections[s].size);
+    }
+    memset(image->base + text_size, 0xCC, image->stub_offset - text_size);
+
+    // All references are PC-relative and stay inside the mapping
+    for (int i = 0; i < obj->reloc_count; i++) {
+        ElfReloc *rel = &obj->relocs[i];
+        ElfSymbol *sym = elf_find_symbol(obj, rel->symbol);
+        size_t target = sym ? image->offset[sym->section] + sym->offset
+                            : image->stub_offset + (size_t)jit_extern_index(image, rel->symbol) * JIT_STUB_SIZE;
+        size_t place = image->offset[rel->section] + rel->offset;
+        int32_t value = (int32_t)((int64_t)target + rel->addend - (int64_t)place);
+        for (int b = 0; b < 4; b++) image->base[place + b] = (uint8_t)((uint32_t)value >> (8 * b));
+    }
+
+    for (int i = 0; i < obj->symbol_count; i++) {
+        ElfSymbol *sym = &obj->symbols[i];
+        if (!sym->function) continue;
+        image->symbols = realloc(image->symbols, sizeof(JitSymbol) * (image->symbol_count + 1));
+        image->symbols[image->symbol_count++] = (JitSymbol){ strdup(sym->name), sym->offset, sym->size };
+    }
+
+    if (!jit_finish(image, error, error_size)) {
+        x64_jit_free(image);
+        return NULL;
+    }
+    return image;
+}
+
+/* ---------- Cache files ---------- */
+
+/* Host byte order: images only ever run on the machine that built them */
+static void jit_put_u64(FILE *out, uint64_t value) {
+    fwrite(&value, sizeof(value), 1, out);
+}
+
+static void jit_put_string(FILE *out, const char *s) {
+    jit_put_u64(out, strlen(s));
+    fwrite(s, 1, strlen(s), out);
+}
+
+bool x64_jit_save(const X64JitImage *image, const char *path) {
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *out = fopen(temp, "wb");
+    if (!out) return false;
+    fwrite(jit_magic, 1, sizeof(jit_magic), out);
+    for (int s = 0; s < ELF_SEC_COUNT; s++) jit_put_u64(out, image->length[s]);
+    jit_put_u64(out, image->stub_offset);
+    jit_put_u64(out, (uint64_t)image->extern_count);
+    for (int i = 0; i < image->extern_count; i++) jit_put_string(out, image->externs[i]);
+    jit_put_u64(out, (uint64_t)image->symbol_count);
+    for (int i = 0; i < image->symbol_count; i++) {
+        jit_put_string(out, image->symbols[i].name);
+        jit_put_u64(out, image->symbols[i].offset);
+        jit_put_u64(out, image->symbols[i].size);
+    }
+    for (int s = 0; s < ELF_SEC_COUNT; s++) {
+        fwrite(image->base + image->offset[s], 1, image->length[s], out);
+    }
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    // Concurrent runs may race to fill the same entry; rename keeps it whole
+    if (ok) ok = rename(temp, path) == 0;
+    if (!ok) remove(temp);
+    return ok;
+}
+
+static bool jit_get_u64(FILE *in, uint64_t *value) {
+    return fread(value, sizeof(*value), 1, in) == 1;
+}
+
+static char *jit_get_string(FILE *in) {
+    uint64_t length;
+    if (!jit_get_u64(in, &length) || length > 4096) return NULL;
+    char *s = malloc(length + 1);
+    if (fread(s, 1, length, in) != length) {
+        free(s);
+        return NULL;
+    }
+    s[length] = '\0';
+    return s;
+}
+
+X64JitImage* x64_jit_load(const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (!in) return NULL;
+    X64JitImage *image = calloc(1, sizeof(X64JitImage));
+    char magic[sizeof(jit_magic)];
+    uint64_t value;
+    bool ok = fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, jit_magic, sizeof(magic)) == 0;
+    for (int s = 0; ok && s < ELF_SEC_COUNT; s++) {
+        ok = jit_get_u64(in, &value) && value < ((uint64_t)1 << 32);
+        image->length[s] = (size_t)value;
+    }
+    ok = ok && jit_get_u64(in, &value) && value <= image->length[ELF_SEC_TEXT];
+    image->stub_offset = (size_t)value;
+    ok = ok && jit_get_u64(in, &value) && value < 1024;
+    int extern_count = ok ? (int)value : 0;
+    image->externs = calloc((size_t)extern_count + 1, sizeof(char*));
+    for (int i = 0; ok && i < extern_count; i++) {
+        ok = (image->externs[i] = jit_get_string(in)) != NULL;
+        image->extern_count = i + 1;
+    }
+    ok = ok && image->stub_offset + (size_t)extern_count * JIT_STUB_SIZE <= image->length[ELF_SEC_TEXT];
+    ok = ok && jit_get_u64(in, &value) && value < ((uint64_t)1 << 20);
+    int symbol_count = ok ? (int)value : 0;
+    image->symbols = calloc((size_t)symbol_count + 1, sizeof(JitSymbol));
+    for (int i = 0; ok && i < symbol_count; i++) {
+        JitSymbol *sym = &image->symbols[i];
+        uint64_t offset = 0, size = 0;
+        ok = (sym->name = jit_get_string(in)) != NULL && jit_get_u64(in, &offset) && jit_get_u64(in, &size) &&
+             offset + size <= image->length[ELF_SEC_TEXT];
+        sym->offset = (size_t)offset;
+        sym->size = (size_t)size;
+        image->symbol_count = i + 1;
+    }
+
+    char error[128];
+    if (ok) {
+        jit_layout(image);
+        ok = jit_map(image, error, sizeof(error));
+    }
+    for (int s = 0; ok && s < ELF_SEC_COUNT; s++) {
+        ok = fread(image->base + image->offset[s], 1, image->length[s], in) == image->length[s];
+    }
+    ok = ok && fgetc(in) == EOF && jit_finish(image, error, sizeof(error));
+    fclose(in);
+    if (!ok) {
+        x64_jit_free(image);
+        return NULL;
+    }
+    return image;
+}
+
+bool x64_jit_write_perf_map(const X64JitImage *image) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+    FILE *out = fopen(path, "a");
+    if (!out) return false;
+    for (int i = 0; i < image->symbol_count; i++) {
+        const JitSymbol *sym = &image->symbols[i];
+        fprintf(out, "%lx %zx %s\n", (unsigned long)(uintptr_t)(image->base + sym->offset), sym->size, sym->name);
+    }
+    return fclose(out) == 0;
+}
+
+#else /* _WIN32 */
+
+X64JitImage* x64_jit_link(ElfObject *obj, char *error, size_t error_size) {
+    (void)obj;
+    jit_fail(error, error_size, "in-memory execution needs POSIX mmap", NULL);
+    return NULL;
+}
+
+bool x64_jit_save(const X64JitImage *image, const char *path) {
+    (void)image;
+    (void)path;
+    return false;
+}
+
+X64JitImage* x64_jit_load(const char *path) {
+    (void)path;
+    return NULL;
+}
+
+bool x64_jit_write_perf_map(const X64JitImage *image) {
+    (void)image;
+    return false;
+}
+
+#endif /* _WIN32 */
+
+bool x64_jit_call(const X64JitImage *image, const char *name, int64_t *result) {
+    for (int i = 0; i < image->symbol_count; i++) {
+        if (strcmp(image->symbols[i].name, name) != 0) continue;
+        int64_t (*function)(void);
+        void *address = image->base + image->symbols[i].offset;
+        memcpy(&function, &address, sizeof(function));
+        *result = function();
+        return true;
+    }
+    return false;
+}
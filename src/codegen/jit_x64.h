@@ -0,0 +1,44 @@
+/* ========================================
+   SUB Language - x86-64 In-Memory JIT
+   Links an encoded module into executable memory and runs it
+   File: jit_x64.h
+   ======================================== */
+
+#ifndef JIT_X64_H
+#define JIT_X64_H
+
+#include "elf_writer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * An image is the module's .text, .rodata and .data laid out on their
+ * own pages of one mapping, with every internal reference resolved.
+ * Calls to libc (printf, calloc) go through absolute-jump stubs at the
+ * end of .text, so the image itself is position independent: only the
+ * stub slots are filled in when it is mapped. That is what makes images
+ * cacheable across runs despite ASLR.
+ *
+ * Pages are mapped read-write while the image is built, then .text is
+ * switched to read-execute and .rodata to read-only.
+ */
+typedef struct X64JitImage X64JitImage;
+
+/* Link the object into memory; NULL with a message in `error` on failure */
+X64JitImage* x64_jit_link(ElfObject *obj, char *error, size_t error_size);
+
+/* Image cache: save writes atomically (temp file + rename), load
+   returns NULL when the file is missing or not a usable image */
+bool x64_jit_save(const X64JitImage *image, const char *path);
+X64JitImage* x64_jit_load(const char *path);
+
+/* Call a defined function with no arguments */
+bool x64_jit_call(const X64JitImage *image, const char *name, int64_t *result);
+
+/* /tmp/perf-<pid>.map entries for the image's functions */
+bool x64_jit_write_perf_map(const X64JitImage *image);
+
+void x64_jit_free(X64JitImage *image);
+
+#endif /* JIT_X64_H */
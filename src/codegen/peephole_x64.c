@@ -0,0 +1,368 @@
+/* ========================================
+   SUB Language - x86-64 Peephole Optimizer
+   Implementation
+   File: peephole_x64.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "peephole_x64.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* peephole_rule_names[X64_PEEP_RULE_COUNT] = {
+    "self-move", "move-back", "store-reload", "push-pop",
+    "jump-next", "unreachable", "setcc-zero", "flag-retest"
+};
+
+const char* x64_peephole_rule_name(X64PeepholeRule rule) {
+    return rule < X64_PEEP_RULE_COUNT ? peephole_rule_names[rule] : "unknown";
+}
+
+/* ---------- Machine instruction helpers ---------- */
+
+static bool mi_live(const X64MInstr *mi) {
+    return mi->op != NULL;
+}
+
+static void mi_kill(X64MInstr *mi) {
+    free(mi->op);
+    for (int i = 0; i < mi->operand_count; i++) free(mi->operands[i]);
+    mi->op = NULL;
+    mi->operand_count = 0;
+}
+
+/* Replace `mi` with a new instruction; the operands may point into `mi` itself */
+static void mi_set(X64MInstr *mi, const char *op, int count, const char *a, const char *b) {
+    char *na = a ? strdup(a) : NULL;
+    char *nb = b ? strdup(b) : NULL;
+    mi_kill(mi);
+    mi->kind = X64_MI_INSN;
+    mi->op = strdup(op);
+    mi->operand_count = count;
+    mi->operands[0] = na;
+    mi->operands[1] = nb;
+}
+
+static bool mi_is(const X64MInstr *mi, const char *op, int operands) {
+    return mi_live(mi) && mi->kind == X64_MI_INSN && strcmp(mi->op, op) == 0 &&
+           mi->operand_count == operands;
+}
+
+static bool mi_is_jump(const X64MInstr *mi) {
+    return mi_live(mi) && mi->kind == X64_MI_INSN && mi->op[0] == 'j' && mi->operand_count == 1;
+}
+
+static bool op_is_reg(const char *operand) {
+    return operand[0] == '%';
+}
+
+static bool op_is_mem(const char *operand) {
+    return strchr(operand, '(') != NULL;
+}
+
+/* Next live entry after `i` that is not a comment (labels included), or -1 */
+static int peep_next(X64Context *ctx, int i) {
+    for (int k = i + 1; k < ctx->code_count; k++) {
+        if (mi_live(&ctx->code[k]) && ctx->code[k].kind != X64_MI_COMMENT) return k;
+    }
+    return -1;
+}
+
+static int peep_prev(X64Context *ctx, int i) {
+    for (int k = i - 1; k >= 0; k--) {
+        if (mi_live(&ctx->code[k]) && ctx->code[k].kind != X64_MI_COMMENT) return k;
+    }
+    return -1;
+}
+
+static int peep_next_insn(X64Context *ctx, int i) {
+    int k = peep_next(ctx, i);
+    return k >= 0 && ctx->code[k].kind == X64_MI_INSN ? k : -1;
+}
+
+static int peep_prev_insn(X64Context *ctx, int i) {
+    int k = peep_prev(ctx, i);
+    return k >= 0 && ctx->code[k].kind == X64_MI_INSN ? k : -1;
+}
+
+static void peep_count(X64Context *ctx, X64PeepholeRule rule, bool *changed) {
+    ctx->peephole_counts[rule]++;
+    *changed = true;
+}
+
+/* Does any operand of `mi` name the accumulator? */
+static bool mi_mentions_rax(const X64MInstr *mi) {
+    for (int i = 0; i < mi->operand_count; i++) {
+        const char *o = mi->operands[i];
+        if (strstr(o, "%rax") || strstr(o, "%eax") || strstr(o, "%al")) return true;
+    }
+    return false;
+}
+
+/* Condition code of a setCC / jCC mnemonic and its negation */
+static const char* peep_negate_cc(const char *cc) {
+    static const char *pairs[][2] = {
+        { "e", "ne" }, { "l", "ge" }, { "le", "g" }, { "b", "ae" }, { "be", "a" }
+    };
+    for (int i = 0; i < 5; i++) {
+        if (strcmp(cc, pairs[i][0]) == 0) return pairs[i][1];
+        if (strcmp(cc, pairs[i][1]) == 0) return pairs[i][0];
+    }
+    return NULL;
+}
+
+/* ---------- Level 1 rules ---------- */
+
+/* movq %r, %r */
+static bool peep_self_move(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *mi = &ctx->code[i];
+    if (!mi_is(mi, "movq", 2) || !op_is_reg(mi->operands[0]) ||
+        strcmp(mi->operands[0], mi->operands[1]) != 0) {
+        return false;
+    }
+    mi_kill(mi);
+    peep_count(ctx, X64_PEEP_SELF_MOVE, changed);
+    return true;
+}
+
+/* movq a, %b; movq %b, a: the second move changes nothing unless the
+   first overwrote a base register of `a` */
+static bool peep_move_back(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *a = &ctx->code[i];
+    int j = peep_next_insn(ctx, i);
+    if (j < 0 || !mi_is(a, "movq", 2) || !mi_is(&ctx->code[j], "movq", 2)) return false;
+    X64MInstr *b = &ctx->code[j];
+    if (!op_is_reg(a->operands[1]) || strcmp(a->operands[0], b->operands[1]) != 0 ||
+        strcmp(a->operands[1], b->operands[0]) != 0) {
+        return false;
+    }
+    if (!op_is_reg(a->operands[0]) && !op_is_mem(a->operands[0])) return false;
+    if (op_is_mem(a->operands[0]) && strstr(a->operands[0], a->operands[1])) return false;
+    mi_kill(b);
+    peep_count(ctx, X64_PEEP_MOVE_BACK, changed);
+    return true;
+}
+
+/* movq %r, mem; movq mem, %s -> movq %r, mem; movq %r, %s */
+static bool peep_store_reload(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *st = &ctx->code[i];
+    int j = peep_next_insn(ctx, i);
+    if (j < 0 || !mi_is(st, "movq", 2) || !mi_is(&ctx->code[j], "movq", 2)) return false;
+    X64MInstr *ld = &ctx->code[j];
+    if (!op_is_reg(st->operands[0]) || !op_is_mem(st->operands[1]) ||
+        strcmp(st->operands[1], ld->operands[0]) != 0 || !op_is_reg(ld->operands[1])) {
+        return false;
+    }
+    if (strcmp(st->operands[0], ld->operands[1]) == 0) {
+        mi_kill(ld);
+    } else {
+        mi_set(ld, "movq", 2, st->operands[0], ld->operands[1]);
+    }
+    peep_count(ctx, X64_PEEP_STORE_RELOAD, changed);
+    return true;
+}
+
+/* pushq a; popq b -> movq a, b */
+static bool peep_push_pop(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *push = &ctx->code[i];
+    int j = peep_next_insn(ctx, i);
+    if (j < 0 || !mi_is(push, "pushq", 1) || !mi_is(&ctx->code[j], "popq", 1)) return false;
+    X64MInstr *pop = &ctx->code[j];
+    if (op_is_mem(push->operands[0]) && op_is_mem(pop->operands[0])) return false;
+    if (strcmp(push->operands[0], pop->operands[0]) == 0) {
+        mi_kill(push);
+    } else {
+        mi_set(push, "movq", 2, push->operands[0], pop->operands[0]);
+    }
+    mi_kill(pop);
+    peep_count(ctx, X64_PEEP_PUSH_POP, changed);
+    return true;
+}
+
+/* jmp/jcc L where L labels the next instruction */
+static bool peep_jump_next(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *jump = &ctx->code[i];
+    if (!mi_is_jump(jump)) return false;
+    for (int k = peep_next(ctx, i); k >= 0 && ctx->code[k].kind == X64_MI_LABEL; k = peep_next(ctx, k)) {
+        if (strcmp(ctx->code[k].op, jump->operands[0]) == 0) {
+            mi_kill(jump);
+            peep_count(ctx, X64_PEEP_JUMP_NEXT, changed);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Instructions after an unconditional jmp or ret, up to the next label */
+static bool peep_unreachable(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *mi = &ctx->code[i];
+    if (!mi_is(mi, "jmp", 1) && !mi_is(mi, "ret", 0)) return false;
+    bool removed = false;
+    for (int k = peep_next(ctx, i); k >= 0 && ctx->code[k].kind == X64_MI_INSN; k = peep_next(ctx, k)) {
+        mi_kill(&ctx->code[k]);
+        peep_count(ctx, X64_PEEP_UNREACHABLE, changed);
+        removed = true;
+    }
+    return removed;
+}
+
+/* ---------- Level 2 rules ---------- */
+
+/* cmp; movq $0, %rax; setcc %al. Zero RAX before the compare when the
+   compare does not read it, otherwise zero-extend after the setcc. */
+static bool peep_setcc_zero(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *zero = &ctx->code[i];
+    if (!mi_is(zero, "movq", 2) || strcmp(zero->operands[0], "$0") != 0 ||
+        strcmp(zero->operands[1], "%rax") != 0) {
+        return false;
+    }
+    int j = peep_next_insn(ctx, i);
+    if (j < 0 || strncmp(ctx->code[j].op, "set", 3) != 0 || ctx->code[j].operand_count != 1 ||
+        strcmp(ctx->code[j].operands[0], "%al") != 0) {
+        return false;
+    }
+    int p = peep_prev_insn(ctx, i);
+    X64MInstr *cmp = p >= 0 ? &ctx->code[p] : NULL;
+    if (cmp && (mi_is(cmp, "cmpq", 2) || mi_is(cmp, "testq", 2)) && !mi_mentions_rax(cmp)) {
+        // Slide the compare into the movq's place and zero in front of it
+        X64MInstr moved = *cmp;
+        *cmp = *zero;
+        *zero = moved;
+        mi_set(cmp, "xorl", 2, "%eax", "%eax");
+    } else {
+        X64MInstr set = ctx->code[j];
+        ctx->code[j] = *zero;
+        *zero = set;
+        mi_set(&ctx->code[j], "movzbl", 2, "%al", "%eax");
+    }
+    peep_count(ctx, X64_PEEP_SETCC_ZERO, changed);
+    return true;
+}
+
+/* Is RAX known to be zero apart from %al at the setcc at `i`? */
+static bool peep_setcc_extended(X64Context *ctx, int i, int *after) {
+    *after = i;
+    int p = peep_prev_insn(ctx, i);
+    if (p >= 0 && mi_is(&ctx->code[p], "movq", 2) && strcmp(ctx->code[p].operands[0], "$0") == 0 &&
+        strcmp(ctx->code[p].operands[1], "%rax") == 0) {
+        return true;
+    }
+    if (p >= 0 && (mi_is(&ctx->code[p], "cmpq", 2) || mi_is(&ctx->code[p], "testq", 2))) {
+        int z = peep_prev_insn(ctx, p);
+        if (z >= 0 && mi_is(&ctx->code[z], "xorl", 2) && strcmp(ctx->code[z].operands[0], "%eax") == 0 &&
+            strcmp(ctx->code[z].operands[1], "%eax") == 0) {
+            return true;
+        }
+    }
+    int n = peep_next_insn(ctx, i);
+    if (n >= 0 && ((mi_is(&ctx->code[n], "movzbl", 2) && strcmp(ctx->code[n].operands[1], "%eax") == 0) ||
+                   (mi_is(&ctx->code[n], "movzbq", 2) && strcmp(ctx->code[n].operands[1], "%rax") == 0)) &&
+        strcmp(ctx->code[n].operands[0], "%al") == 0) {
+        *after = n;
+        return true;
+    }
+    return false;
+}
+
+#define PEEP_MAX_HOLDERS 8
+
+static int peep_find(const char **set, int count, const char *operand) {
+    for (int k = 0; k < count; k++) {
+        if (strcmp(set[k], operand) == 0) return k;
+    }
+    return -1;
+}
+
+/* setcc %al ... (moves of the result) ... testq X, X; je/jne L, where X
+   still holds the setcc result: the flags of the original compare decide */
+static bool peep_flag_retest(X64Context *ctx, int i, bool *changed) {
+    X64MInstr *set = &ctx->code[i];
+    if (!mi_live(set) || set->kind != X64_MI_INSN || strncmp(set->op, "set", 3) != 0 ||
+        set->operand_count != 1 || strcmp(set->operands[0], "%al") != 0) {
+        return false;
+    }
+    const char *cc = set->op + 3;
+    if (!peep_negate_cc(cc)) return false;
+    int k;
+    if (!peep_setcc_extended(ctx, i, &k)) return false;
+
+    // Locations holding the boolean; plain moves leave the flags alone
+    const char *holders[PEEP_MAX_HOLDERS];
+    int count = 0;
+    holders[count++] = "%rax";
+    for (k = peep_next_insn(ctx, k); k >= 0; k = peep_next_insn(ctx, k)) {
+        X64MInstr *mi = &ctx->code[k];
+        bool retest = (mi_is(mi, "cmpq", 2) && strcmp(mi->operands[0], "$0") == 0) ||
+                      (mi_is(mi, "testq", 2) && strcmp(mi->operands[0], mi->operands[1]) == 0);
+        if (retest && peep_find(holders, count, mi->operands[1]) >= 0) {
+            int j = peep_next_insn(ctx, k);
+            if (j < 0) return false;
+            X64MInstr *branch = &ctx->code[j];
+            bool on_false = mi_is(branch, "je", 1);
+            if (!on_false && !mi_is(branch, "jne", 1)) return false;
+            char jcc[8];
+            snprintf(jcc, sizeof(jcc), "j%s", on_false ? peep_negate_cc(cc) : cc);
+            mi_set(branch, jcc, 1, branch->operands[0], NULL);
+            mi_kill(mi);
+            peep_count(ctx, X64_PEEP_FLAG_RETEST, changed);
+            return true;
+        }
+        if (!mi_is(mi, "movq", 2)) return false;
+        const char *src = mi->operands[0];
+        const char *dst = mi->operands[1];
+        bool copies = peep_find(holders, count, src) >= 0;
+        // The destination, and memory addressed through it, stop holding the value
+        for (int h = count - 1; h >= 0; h--) {
+            if (strcmp(holders[h], dst) == 0 || (op_is_reg(dst) && op_is_mem(holders[h]) &&
+                                                 strstr(holders[h], dst))) {
+                holders[h] = holders[--count];
+            }
+        }
+        if (copies && count < PEEP_MAX_HOLDERS) holders[count++] = dst;
+        if (count == 0) return false;
+    }
+    return false;
+}
+
+/* ---------- Driver ---------- */
+
+static void peep_compact(X64Context *ctx) {
+    int out = 0;
+    for (int i = 0; i < ctx->code_count; i++) {
+        if (mi_live(&ctx->code[i])) ctx->code[out++] = ctx->code[i];
+    }
+    ctx->code_count = out;
+}
+
+void x64_peephole_function(X64Context *ctx) {
+    if (ctx->peephole_level <= 0) return;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < ctx->code_count; i++) {
+            if (!mi_live(&ctx->code[i]) || ctx->code[i].kind != X64_MI_INSN) continue;
+            if (peep_self_move(ctx, i, &changed)) continue;
+            if (peep_push_pop(ctx, i, &changed)) continue;
+            if (peep_move_back(ctx, i, &changed)) continue;
+            if (peep_store_reload(ctx, i, &changed)) continue;
+            if (peep_jump_next(ctx, i, &changed)) continue;
+            if (peep_unreachable(ctx, i, &changed)) continue;
+            if (ctx->peephole_level >= 2) {
+                if (peep_setcc_zero(ctx, i, &changed)) continue;
+                peep_flag_retest(ctx, i, &changed);
+            }
+        }
+        peep_compact(ctx);
+    }
+}
+
+void x64_peephole_print_stats(const X64Context *ctx, FILE *out) {
+    int total = 0;
+    fprintf(out, "===== Peephole rewrites (level %d) =====\n", ctx->peephole_level);
+    for (int r = 0; r < X64_PEEP_RULE_COUNT; r++) {
+        fprintf(out, "  %-14s %6d\n", x64_peephole_rule_name(r), ctx->peephole_counts[r]);
+        total += ctx->peephole_counts[r];
+    }
+    fprintf(out, "  %-14s %6d\n", "total", total);
+}
@@ -0,0 +1,31 @@
+/* ========================================
+   SUB Language - x86-64 Peephole Optimizer
+   Window-based rewrites over a buffered function body
+   File: peephole_x64.h
+   ======================================== */
+
+#ifndef PEEPHOLE_X64_H
+#define PEEPHOLE_X64_H
+
+#include "codegen_x64.h"
+
+/*
+ * Runs on ctx->code after a function has been generated and before it
+ * is written out. Windows look at neighbouring instructions, skipping
+ * comments; a label always ends a window since control can enter there.
+ * Rules are applied until nothing changes, and every rewrite is counted
+ * in ctx->peephole_counts.
+ *
+ * Level 1 removes redundant moves, store/reload pairs, push/pop pairs,
+ * jumps to the next instruction and unreachable code. Level 2 also
+ * rewrites setcc sequences and folds re-tests of a setcc result into
+ * the conditional jump.
+ */
+void x64_peephole_function(X64Context *ctx);
+
+const char* x64_peephole_rule_name(X64PeepholeRule rule);
+
+/* Per-rule rewrite counts for the whole program (--peephole-stats) */
+void x64_peephole_print_stats(const X64Context *ctx, FILE *out);
+
+#endif /* PEEPHOLE_X64_H */
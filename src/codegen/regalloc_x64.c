@@ -0,0 +1,328 @@
+/* ========================================
+   SUB Language - x86-64 Register Allocator
+   Implementation
+   File: regalloc_x64.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "regalloc_x64.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/* Caller-saved registers are preferred for short intervals; callee-saved
+   ones survive calls but cost a save/restore in the prologue/epilogue */
+static const X64Register ra_caller_saved[] = {
+    X64_REG_RSI, X64_REG_RDI, X64_REG_R8, X64_REG_R9, X64_REG_R10, X64_REG_R11
+};
+static const X64Register ra_callee_saved[] = {
+    X64_REG_RBX, X64_REG_R12, X64_REG_R13, X64_REG_R14, X64_REG_R15
+};
+#define RA_CALLER_COUNT 6
+#define RA_CALLEE_COUNT 5
+
+int x64_regalloc_value(const IRFunction *func, const IRValue *val) {
+    if (!val) return -1;
+    if (val->kind == IR_VAL_VAR) return val->data.reg_num;
+    if (val->kind == IR_VAL_REG) return func->local_count + val->data.reg_num;
+    return -1;
+}
+
+bool x64_regalloc_clobbers(const IRInstruction *instr) {
+    switch (instr->opcode) {
+        case IR_CALL: case IR_TAIL_CALL: case IR_PRINT:
+        case IR_ALLOC_ARRAY: case IR_VECTOR_LOOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* ---------- Liveness ---------- */
+
+typedef struct {
+    int words;
+    uint64_t *bits;           // block_count rows of `words` words
+} BitRows;
+
+static uint64_t* ra_row(BitRows *rows, int i) {
+    return rows->bits + (size_t)i * rows->words;
+}
+
+static void ra_rows_init(BitRows *rows, int count, int values) {
+    rows->words = (values + 63) / 64;
+    if (rows->words == 0) rows->words = 1;
+    rows->bits = calloc((size_t)count * rows->words, sizeof(uint64_t));
+}
+
+static bool ra_test(const uint64_t *row, int v) {
+    return (row[v >> 6] >> (v & 63)) & 1;
+}
+
+static void ra_set(uint64_t *row, int v) {
+    row[v >> 6] |= (uint64_t)1 << (v & 63);
+}
+
+/* Run `body` with v bound to each value `instr` reads */
+#define RA_FOR_EACH_USE(func, instr, v, body) do {                              \
+    const IRValue *ra_ops_[2] = { (instr)->src1, (instr)->src2 };               \
+    for (int ra_i_ = 0; ra_i_ < 2 + (instr)->arg_count; ra_i_++) {              \
+        const IRValue *ra_val_ = ra_i_ < 2 ? ra_ops_[ra_i_] : (instr)->args[ra_i_ - 2]; \
+        int v = x64_regalloc_value(func, ra_val_);                              \
+        if (v >= 0) { body; }                                                   \
+    }                                                                           \
+} while (0)
+
+/* Value written by `instr`, or -1 */
+static int ra_def(const IRFunction *func, const IRInstruction *instr) {
+    if (!instr->dest) return -1;
+    if (instr->dest->kind == IR_VAL_REG) return x64_regalloc_value(func, instr->dest);
+    if (instr->dest->kind == IR_VAL_VAR && instr->opcode == IR_STORE) {
+        return x64_regalloc_value(func, instr->dest);
+    }
+    return -1;
+}
+
+static void ra_extend(X64RegAlloc *ra, int v, int pos) {
+    if (v < 0 || v >= ra->value_count) return;
+    if (pos < ra->start[v]) ra->start[v] = pos;
+    if (pos > ra->end[v]) ra->end[v] = pos;
+}
+
+/* Live intervals: instruction k reads at 2k and writes at 2k + 1 */
+static void ra_build_intervals(X64RegAlloc *ra, IRFunction *func, bool *crosses) {
+    IRCFG *cfg = ir_cfg_build(func);
+    int n = cfg->block_count;
+    int values = ra->value_count;
+    BitRows use, def, live_in, live_out;
+    ra_rows_init(&use, n, values);
+    ra_rows_init(&def, n, values);
+    ra_rows_init(&live_in, n, values);
+    ra_rows_init(&live_out, n, values);
+    int *block_start = malloc(sizeof(int) * (n ? n : 1));
+    int *block_end = malloc(sizeof(int) * (n ? n : 1));
+
+    // Local use/def sets and block positions
+    int pos = 0;
+    for (int b = 0; b < n; b++) {
+        IRBlock *blk = &cfg->blocks[b];
+        uint64_t *u = ra_row(&use, b);
+        uint64_t *d = ra_row(&def, b);
+        block_start[b] = pos;
+        for (IRInstruction *instr = blk->first; ; instr = instr->next) {
+            RA_FOR_EACH_USE(func, instr, v, if (!ra_test(d, v)) ra_set(u, v));
+            int w = ra_def(func, instr);
+            if (w >= 0) ra_set(d, w);
+            pos += 2;
+            if (instr == blk->last) break;
+        }
+        block_end[b] = pos - 1;
+    }
+
+    // Backward dataflow to a fixed point
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = n - 1; b >= 0; b--) {
+            IRBlock *blk = &cfg->blocks[b];
+            uint64_t *out = ra_row(&live_out, b);
+            uint64_t *in = ra_row(&live_in, b);
+            for (int s = 0; s < blk->succ_count; s++) {
+                uint64_t *succ_in = ra_row(&live_in, blk->succs[s]);
+                for (int w = 0; w < live_out.words; w++) out[w] |= succ_in[w];
+            }
+            uint64_t *u = ra_row(&use, b);
+            uint64_t *d = ra_row(&def, b);
+            for (int w = 0; w < live_in.words; w++) {
+                uint64_t next = u[w] | (out[w] & ~d[w]);
+                if (next != in[w]) {
+                    in[w] = next;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Hull of every live point
+    pos = 0;
+    for (int b = 0; b < n; b++) {
+        IRBlock *blk = &cfg->blocks[b];
+        uint64_t *in = ra_row(&live_in, b);
+        uint64_t *out = ra_row(&live_out, b);
+        for (int v = 0; v < values; v++) {
+            if (ra_test(in, v)) ra_extend(ra, v, block_start[b]);
+            if (ra_test(out, v)) ra_extend(ra, v, block_end[b]);
+        }
+        for (IRInstruction *instr = blk->first; ; instr = instr->next) {
+            RA_FOR_EACH_USE(func, instr, v, ra_extend(ra, v, pos));
+            ra_extend(ra, ra_def(func, instr), pos + 1);
+            pos += 2;
+            if (instr == blk->last) break;
+        }
+    }
+
+    // Values live across a clobbering instruction. Calls and prints read
+    // all their operands before clobbering anything (arguments move into
+    // place at once), so operands dying there may stay caller-saved;
+    // array allocation and vector loops read theirs again afterwards.
+    pos = 0;
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next, pos += 2) {
+        if (!x64_regalloc_clobbers(instr)) continue;
+        bool reads_first = instr->opcode == IR_CALL || instr->opcode == IR_TAIL_CALL || instr->opcode == IR_PRINT;
+        for (int v = 0; v < values; v++) {
+            if (ra->start[v] <= pos && (ra->end[v] > pos || (!reads_first && ra->end[v] == pos))) crosses[v] = true;
+        }
+    }
+
+    free(block_start);
+    free(block_end);
+    free(use.bits);
+    free(def.bits);
+    free(live_in.bits);
+    free(live_out.bits);
+    ir_cfg_free(cfg);
+}
+
+/* ---------- Linear scan ---------- */
+
+static X64RegAlloc *ra_sort_ctx;
+
+static int ra_by_start(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    if (ra_sort_ctx->start[x] != ra_sort_ctx->start[y]) {
+        return ra_sort_ctx->start[x] < ra_sort_ctx->start[y] ? -1 : 1;
+    }
+    return x - y;
+}
+
+static bool ra_is_callee_saved(X64Register reg) {
+    for (int i = 0; i < RA_CALLEE_COUNT; i++) {
+        if (ra_callee_saved[i] == reg) return true;
+    }
+    return false;
+}
+
+/* Interval coloring of the values left on the stack: in order of start,
+   each takes the lowest slot whose previous holder has ended */
+static void ra_color_slots(X64RegAlloc *ra) {
+    int values = ra->value_count;
+    int alloc_n = values ? values : 1;
+    ra->slot = malloc(sizeof(int) * alloc_n);
+    int *order = malloc(sizeof(int) * alloc_n);
+    int *holder = malloc(sizeof(int) * alloc_n);   // Slot -> value, -1 when free
+    int count = 0;
+    for (int v = 0; v < values; v++) {
+        ra->slot[v] = -1;
+        if (ra->end[v] >= 0 && ra->reg[v] == X64_REG_COUNT) order[count++] = v;
+    }
+    ra_sort_ctx = ra;
+    qsort(order, count, sizeof(int), ra_by_start);
+
+    ra->slot_count = 0;
+    for (int i = 0; i < count; i++) {
+        int v = order[i];
+        int chosen = -1;
+        for (int s = 0; s < ra->slot_count && chosen < 0; s++) {
+            if (holder[s] < 0 || ra->end[holder[s]] < ra->start[v]) chosen = s;
+        }
+        if (chosen < 0) chosen = ra->slot_count++;
+        holder[chosen] = v;
+        ra->slot[v] = chosen;
+    }
+    free(order);
+    free(holder);
+}
+
+X64RegAlloc* x64_regalloc_function(IRFunction *func) {
+    X64RegAlloc *ra = calloc(1, sizeof(X64RegAlloc));
+    int values = func->local_count + func->reg_count;
+    ra->value_count = values;
+    int alloc_n = values ? values : 1;
+    ra->reg = malloc(sizeof(X64Register) * alloc_n);
+    ra->start = malloc(sizeof(int) * alloc_n);
+    ra->end = malloc(sizeof(int) * alloc_n);
+    for (int v = 0; v < values; v++) {
+        ra->reg[v] = X64_REG_COUNT;
+        ra->start[v] = INT_MAX;
+        ra->end[v] = -1;
+    }
+    bool *crosses = calloc(alloc_n, sizeof(bool));
+    ra_build_intervals(ra, func, crosses);
+
+    int *order = malloc(sizeof(int) * alloc_n);
+    int count = 0;
+    for (int v = 0; v < values; v++) {
+        if (ra->end[v] >= 0) order[count++] = v;
+    }
+    ra_sort_ctx = ra;
+    qsort(order, count, sizeof(int), ra_by_start);
+
+    // Active intervals, one per register holding a value
+    int holder[X64_REG_COUNT];
+    for (int r = 0; r < X64_REG_COUNT; r++) holder[r] = -1;
+
+    for (int i = 0; i < count; i++) {
+        int v = order[i];
+
+        // Expire intervals that ended before this one starts
+        for (int r = 0; r < X64_REG_COUNT; r++) {
+            if (holder[r] >= 0 && ra->end[holder[r]] < ra->start[v]) holder[r] = -1;
+        }
+
+        X64Register chosen = X64_REG_COUNT;
+        if (!crosses[v]) {
+            for (int k = 0; k < RA_CALLER_COUNT && chosen == X64_REG_COUNT; k++) {
+                if (holder[ra_caller_saved[k]] < 0) chosen = ra_caller_saved[k];
+            }
+        }
+        for (int k = 0; k < RA_CALLEE_COUNT && chosen == X64_REG_COUNT; k++) {
+            if (holder[ra_callee_saved[k]] < 0) chosen = ra_callee_saved[k];
+        }
+
+        if (chosen == X64_REG_COUNT) {
+            // Spill whichever usable interval ends last
+            X64Register victim = X64_REG_COUNT;
+            for (int r = 0; r < X64_REG_COUNT; r++) {
+                if (holder[r] < 0 || (crosses[v] && !ra_is_callee_saved(r))) continue;
+                if (victim == X64_REG_COUNT || ra->end[holder[r]] > ra->end[holder[victim]]) {
+                    victim = r;
+                }
+            }
+            if (victim != X64_REG_COUNT && ra->end[holder[victim]] > ra->end[v]) {
+                ra->reg[holder[victim]] = X64_REG_COUNT;
+                chosen = victim;
+            }
+        }
+
+        if (chosen != X64_REG_COUNT) {
+            ra->reg[v] = chosen;
+            holder[chosen] = v;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        X64Register r = ra->reg[order[i]];
+        if (r == X64_REG_COUNT) {
+            ra->spilled++;
+        } else {
+            ra->assigned++;
+            if (ra_is_callee_saved(r)) ra->callee_saved_used[r] = true;
+        }
+    }
+
+    free(order);
+    free(crosses);
+    ra_color_slots(ra);
+    return ra;
+}
+
+void x64_regalloc_free(X64RegAlloc *ra) {
+    if (!ra) return;
+    free(ra->reg);
+    free(ra->start);
+    free(ra->end);
+    free(ra->slot);
+    free(ra);
+}
@@ -0,0 +1,48 @@
+/* ========================================
+   SUB Language - x86-64 Register Allocator
+   Linear scan over live intervals of IR locals and virtual registers
+   File: regalloc_x64.h
+   ======================================== */
+
+#ifndef REGALLOC_X64_H
+#define REGALLOC_X64_H
+
+#include "codegen_x64.h"
+
+/*
+ * Values are numbered like their stack slots: local i is value i,
+ * virtual register r is value local_count + r. Each value gets one
+ * interval (the hull of every point where it is live) and either a
+ * register for that whole interval or its stack slot.
+ *
+ * RAX, RCX and RDX stay free as scratch for the instruction emitters.
+ * Values live across a call (or any instruction that clobbers the
+ * argument registers) only get callee-saved registers; call arguments
+ * that die at the call may use any.
+ *
+ * Values left on the stack share slots: slots are colored like
+ * registers, so two values get the same slot only when their intervals
+ * do not overlap. Values that are never read or written get none.
+ */
+typedef struct X64RegAlloc {
+    int value_count;
+    X64Register *reg;          // Assigned register, X64_REG_COUNT if on the stack
+    int *start;                // Interval bounds in instruction positions (2 per instruction)
+    int *end;
+    int *slot;                 // Stack slot index (from 0) for values on the stack, -1 otherwise
+    int slot_count;
+    bool callee_saved_used[X64_REG_COUNT];
+    int assigned;              // Values given a register
+    int spilled;               // Live values left on the stack
+} X64RegAlloc;
+
+X64RegAlloc* x64_regalloc_function(IRFunction *func);
+void x64_regalloc_free(X64RegAlloc *ra);
+
+/* Value number of an IR_VAL_VAR / IR_VAL_REG operand (-1 otherwise) */
+int x64_regalloc_value(const IRFunction *func, const IRValue *val);
+
+/* Does `instr` clobber the caller-saved registers handed out by the allocator? */
+bool x64_regalloc_clobbers(const IRInstruction *instr);
+
+#endif /* REGALLOC_X64_H */
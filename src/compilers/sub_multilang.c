@@ -158,6 +158,8 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     printf("      ✓ Passed\n");
+    int folded = optimizer_evaluate_pure_calls(ast);
+    if (folded > 0) printf("      ✓ Evaluated %d pure call%s at compile time\n", folded, folded == 1 ? "" : "s");
     
     // Phase 5: Code Generation - NOW PASSES SOURCE FOR EMBEDDED CODE
     printf("[5/5] ⚙️  Code generation (%s)...\n", info->name);
@@ -169,7 +169,10 @@ int main(int argc, char *argv[]) {
         printf("      💡 Optimizing (level %d)...\n", opt_level);
     }
     if (opt_level > 0) {
-        ir_optimize(ir);
+        IROptions ir_opts;
+        ir_options_init(&ir_opts, opt_level);
+        ir_opts.vector_width = 0;   // SIMD kernels are lowered by codegen_x64 only
+        ir_optimize_with_options(ir, &ir_opts);
     }
     
     // Phase 6: Native Code Generation
@@ -7,7 +7,12 @@
 #define _GNU_SOURCE
 #include "sub_compiler.h"
 #include "ir.h"
+#include "ir_pass.h"
+#include "ir_profile.h"
 #include "codegen_x64.h"
+#include "peephole_x64.h"
+#include "elf_writer.h"
+#include "jit_x64.h"
 #include "windows_compat.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -56,8 +61,230 @@ static int execute_command(const char *cmd) {
     return system(cmd);
 }
 
+/* Driver settings: the IR pipeline plus backend choices */
+typedef struct {
+    IROptions ir;
+    int regalloc;             // Linear-scan register allocation: 1 on, 0 off, -1 from -O level
+    int peephole;             // Peephole level 0..2, -1 from -O level
+    bool peephole_stats;      // Report rewrites per peephole rule
+    bool integrated_as;       // Encode the object in-process instead of running as
+    bool static_runtime;      // Static executable with the built-in runtime, no libc
+    bool run;                 // JIT into memory and run instead of writing a file
+    const char *jit_cache;    // Directory of cached JIT images (NULL: no cache)
+    bool perf_map;            // Write /tmp/perf-<pid>.map for the JIT'd functions
+    const char *profile_generate; // Instrument; the program writes block counts here
+    const char *profile_use;  // Optimize with the counts recorded in this .subprof
+} NativeOptions;
+
+/* Backend context with the -O level defaults applied */
+static X64Context* native_context(FILE *output, const NativeOptions *native) {
+    X64Context *ctx = x64_context_create(output);
+    int level = native->ir.level;
+    ctx->use_regalloc = native->regalloc >= 0 ? native->regalloc != 0 : level >= 1;
+    ctx->peephole_level = native->peephole >= 0 ? native->peephole : (level < 2 ? level : 2);
+    ctx->static_runtime = native->static_runtime;
+    ctx->profile_path = native->profile_generate;
+    return ctx;
+}
+
+/* Encode the module straight into an ELF object (with --static-runtime, a
+   finished executable); false when the encoder meets something it does not
+   support and the caller should assemble */
+static bool write_object_integrated(IRModule *module, const char *path, const NativeOptions *native) {
+    X64Context *ctx = native_context(NULL, native);
+    ctx->object = elf_object_create();
+    x64_generate_program(ctx, module);
+    bool ok = !ctx->object_error[0];
+    if (!ok) {
+        fprintf(stderr, "Warning: integrated assembler: %s; using the system assembler\n",
+                ctx->object_error);
+    } else if (native->static_runtime ? !elf_executable_write(ctx->object, path, "_start")
+                                      : !elf_object_write(ctx->object, path)) {
+        ok = false;
+    } else if (native->peephole_stats) {
+        x64_peephole_print_stats(ctx, stderr);
+    }
+    elf_object_free(ctx->object);
+    x64_context_free(ctx);
+    return ok;
+}
+
+/* Phases 6-7 through the system toolchain: write <output>.s, assemble and link */
+static int assemble_and_link(IRModule *module, const char *output_file, const NativeOptions *native) {
+    printf("[6/7] ⚙️  Generating x86-64 assembly...\n");
+    char cmd[512];
+    char asm_file[256];
+    snprintf(asm_file, sizeof(asm_file), "%s.s", output_file);
+    
+    FILE *asm_output = fopen(asm_file, "w");
+    if (!asm_output) {
+        fprintf(stderr, "      ✗ Cannot create assembly file\n");
+        return 1;
+    }
+    
+    X64Context *ctx = native_context(asm_output, native);
+    x64_generate_program(ctx, module);
+    if (native->peephole_stats) x64_peephole_print_stats(ctx, stderr);
+    x64_context_free(ctx);
+    fclose(asm_output);
+    printf("      ✓ Assembly written to %s\n", asm_file);
+    
+    // Phase 7: Assemble and Link
+    printf("[7/7] 🔗 Assembling and linking...\n");
+    
+#ifdef _WIN32
+    // Windows: Use MSVC assembler (ml64) and linker
+    char obj_file[256];
+    snprintf(obj_file, sizeof(obj_file), "%s.obj", output_file);
+    snprintf(cmd, sizeof(cmd), "ml64 /c /Fo%s %s", obj_file, asm_file);
+    if (execute_command(cmd) != 0) {
+        fprintf(stderr, "      ✗ Assembly failed\n");
+        return 1;
+    }
+    
+    snprintf(cmd, sizeof(cmd), "link /OUT:%s.exe %s", output_file, obj_file);
+    if (execute_command(cmd) != 0) {
+        fprintf(stderr, "      ✗ Linking failed\n");
+        return 1;
+    }
+    printf("      ✓ Executable: %s.exe\n", output_file);
+#else
+    // Linux/macOS: Use GCC
+    snprintf(cmd, sizeof(cmd), "gcc%s -o %s %s", native->static_runtime ? " -static -nostdlib" : "",
+             output_file, asm_file);
+    if (execute_command(cmd) != 0) {
+        fprintf(stderr, "      ✗ Compilation failed\n");
+        return 1;
+    }
+    printf("      ✓ Executable: %s\n", output_file);
+#endif
+    return 0;
+}
+
+/* Phases 6-7 with the integrated assembler: write <output>.o and link it;
+   -1 when the encoder hit something unsupported and the caller should assemble */
+static int encode_and_link(IRModule *module, const char *output_file, const NativeOptions *native) {
+    printf("[6/7] ⚙️  Encoding x86-64 machine code...\n");
+    if (native->static_runtime) {
+        // Nothing left to link: the writer lays out the executable itself
+        if (!write_object_integrated(module, output_file, native)) return -1;
+        printf("[7/7] 🔗 Static executable: %s (no linker)\n", output_file);
+        return 0;
+    }
+    char obj_file[256];
+    snprintf(obj_file, sizeof(obj_file), "%s.o", output_file);
+    if (!write_object_integrated(module, obj_file, native)) return -1;
+    printf("      ✓ Object written to %s\n", obj_file);
+    
+    printf("[7/7] 🔗 Linking...\n");
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "gcc -o %s %s", output_file, obj_file);
+    if (execute_command(cmd) != 0) {
+        fprintf(stderr, "      ✗ Linking failed\n");
+        return 1;
+    }
+    printf("      ✓ Executable: %s\n", output_file);
+    return 0;
+}
+
+/* FNV-1a over the source and every option that changes the generated
+   code; the build stamp retires entries from older compilers */
+static uint64_t jit_cache_key(const char *source, const NativeOptions *native) {
+    char settings[512];
+    snprintf(settings, sizeof(settings), "%s %s|%d|%d|%d|%s|%d|%d", __DATE__, __TIME__, native->ir.level,
+             native->ir.inline_threshold, native->ir.vector_width, native->ir.passes ? native->ir.passes : "",
+             native->regalloc, native->peephole);
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char *parts[] = { settings, source }, **p = parts; p < parts + 2; p++) {
+        for (const unsigned char *c = (const unsigned char *)*p; *c; c++) {
+            hash = (hash ^ *c) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* mkdir -p */
+static bool make_directories(const char *path) {
+    char partial[4096];
+    snprintf(partial, sizeof(partial), "%s", path);
+    for (char *c = partial + 1; ; c++) {
+        if (*c != '/' && *c != '\0') continue;
+        char saved = *c;
+        *c = '\0';
+        struct stat st;
+        if (stat(partial, &st) != 0 && mkdir(partial, 0755) != 0) return false;
+        if (saved == '\0') return true;
+        *c = saved;
+    }
+}
+
+/* --run: compile quietly, JIT into memory and call main in this process.
+   Returns main's result as the exit status. */
+static int run_in_process(const char *input_file, const NativeOptions *native) {
+    char *source = read_file_native(input_file);
+    if (!source) return 1;
+
+    char cache_file[4096] = "";
+    X64JitImage *image = NULL;
+    if (native->jit_cache && make_directories(native->jit_cache)) {
+        snprintf(cache_file, sizeof(cache_file), "%s/%016llx.subjit", native->jit_cache,
+                 (unsigned long long)jit_cache_key(source, native));
+        image = x64_jit_load(cache_file);
+    }
+
+    if (!image) {
+        int token_count;
+        Token *tokens = lexer_tokenize(source, &token_count);
+        ASTNode *ast = parser_parse(tokens, token_count);
+        IRModule *ir_module = NULL;
+        // Like sub_native, skip the strict type checker: it only reports,
+        // and its progress lines would mix with the program's stdout
+        if (!semantic_analyze(ast)) {
+            fprintf(stderr, "Error: %s failed semantic analysis\n", input_file);
+        } else if (!(ir_module = ir_generate_from_ast(ast)) || !ir_optimize_with_options(ir_module, &native->ir)) {
+            fprintf(stderr, "Error: IR generation failed for %s\n", input_file);
+        } else {
+            X64Context *ctx = native_context(NULL, native);
+            ctx->object = elf_object_create();
+            x64_generate_program(ctx, ir_module);
+            char error[160];
+            snprintf(error, sizeof(error), "%s", ctx->object_error);
+            if (!error[0]) image = x64_jit_link(ctx->object, error, sizeof(error));
+            if (!image) fprintf(stderr, "Error: JIT: %s\n", error);
+            if (native->peephole_stats) x64_peephole_print_stats(ctx, stderr);
+            elf_object_free(ctx->object);
+            x64_context_free(ctx);
+        }
+        lexer_free_tokens(tokens, token_count);
+        parser_free_ast(ast);
+        if (ir_module) ir_module_free(ir_module);
+        // Saved before running: .data must hold its initial contents
+        if (image && cache_file[0] && !x64_jit_save(image, cache_file)) {
+            fprintf(stderr, "Warning: cannot write JIT cache entry %s\n", cache_file);
+        }
+    }
+    free(source);
+    if (!image) return 1;
+
+    if (native->perf_map && !x64_jit_write_perf_map(image)) {
+        fprintf(stderr, "Warning: cannot write /tmp/perf-%ld.map\n", (long)getpid());
+    }
+    // Generated code writes straight to fd 1
+    fflush(stdout);
+    int64_t result = 0;
+    if (!x64_jit_call(image, "main", &result)) {
+        fprintf(stderr, "Error: %s has no main\n", input_file);
+        result = 1;
+    }
+    fflush(stdout);
+    x64_jit_free(image);
+    return (int)result;
+}
+
 /* Main native compilation function */
-int compile_to_native(const char *input_file, const char *output_file) {
+int compile_to_native(const char *input_file, const char *output_file, const NativeOptions *native) {
+    const IROptions *opts = &native->ir;
     printf("\n╔═══════════════════════════════════════════╗\n");
     printf("║  SUB Native Compiler (x86-64)            ║\n");
     printf("╚═══════════════════════════════════════════╝\n\n");
@@ -105,66 +332,40 @@ int compile_to_native(const char *input_file, const char *output_file) {
         fprintf(stderr, "      ✗ IR generation failed\n");
         return 1;
     }
+    // Profile counters are numbered on the IR as generated
+    if (native->profile_generate) {
+        ir_profile_instrument(ir_module);
+        printf("      ✓ Instrumented %d blocks (profile: %s)\n", ir_module->profile_counters,
+               native->profile_generate);
+    } else if (native->profile_use && !ir_profile_apply(ir_module, native->profile_use)) {
+        ir_module_free(ir_module);
+        return 1;
+    }
     // Debug: Print IR
     ir_print(ir_module);
     printf("      ✓ IR generated\n");
     
     // Phase 5.5: IR Optimization
     printf("[5.5/7] ⚡ Optimizing IR...\n");
-    ir_optimize(ir_module);
-    printf("      ✓ IR optimized\n");
+    if (!ir_optimize_with_options(ir_module, opts)) {
+        fprintf(stderr, "      ✗ IR optimization failed\n");
+        ir_module_free(ir_module);
+        return 1;
+    }
+    if (opts->passes) printf("      ✓ IR optimized (--passes=%s)\n", opts->passes);
+    else printf("      ✓ IR optimized (-O%d)\n", opts->level);
     
     // Debug: Print optimized IR
     printf("\n      === Optimized IR ===\n");
     ir_print(ir_module);
     
-    // Phase 6: x86-64 Code Generation
-    printf("[6/7] ⚙️  Generating x86-64 assembly...\n");
-    char asm_file[256];
-    snprintf(asm_file, sizeof(asm_file), "%s.s", output_file);
-    
-    FILE *asm_output = fopen(asm_file, "w");
-    if (!asm_output) {
-        fprintf(stderr, "      ✗ Cannot create assembly file\n");
-        return 1;
-    }
-    
-    X64Context *ctx = x64_context_create(asm_output);
-    x64_generate_program(ctx, ir_module);
-    x64_context_free(ctx);
-    fclose(asm_output);
-    printf("      ✓ Assembly written to %s\n", asm_file);
-    
-    // Phase 7: Assemble and Link
-    printf("[7/7] 🔗 Assembling and linking...\n");
-    
-    char cmd[512];
-    
-#ifdef _WIN32
-    // Windows: Use MSVC assembler (ml64) and linker
-    char obj_file[256];
-    snprintf(obj_file, sizeof(obj_file), "%s.obj", output_file);
-    snprintf(cmd, sizeof(cmd), "ml64 /c /Fo%s %s", obj_file, asm_file);
-    if (execute_command(cmd) != 0) {
-        fprintf(stderr, "      ✗ Assembly failed\n");
-        return 1;
-    }
-    
-    snprintf(cmd, sizeof(cmd), "link /OUT:%s.exe %s", output_file, obj_file);
-    if (execute_command(cmd) != 0) {
-        fprintf(stderr, "      ✗ Linking failed\n");
-        return 1;
-    }
-    printf("      ✓ Executable: %s.exe\n", output_file);
-#else
-    // Linux/macOS: Use GCC
-    snprintf(cmd, sizeof(cmd), "gcc -o %s %s", output_file, asm_file);
-    if (execute_command(cmd) != 0) {
-        fprintf(stderr, "      ✗ Compilation failed\n");
-        return 1;
-    }
-    printf("      ✓ Executable: %s\n", output_file);
+    // Phases 6-7: x86-64 code, object file and executable
+    int status = -1;
+#ifdef __linux__
+    if (native->integrated_as) status = encode_and_link(ir_module, output_file, native);
 #endif
+    if (status < 0) status = assemble_and_link(ir_module, output_file, native);
+    if (status != 0) return 1;
     
     // Success!
     printf("\n✅ Native compilation successful!\n");
@@ -186,19 +387,163 @@ int compile_to_native(const char *input_file, const char *output_file) {
     return 0;
 }
 
+/* 64-bit integer lanes the build machine can vectorize with */
+static int host_vector_width(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return 4;
+#endif
+    return 2;
+}
+
+/* Print usage */
+static void print_usage(const char *prog) {
+    printf("SUB Native Compiler v1.0.0\n");
+    printf("Usage: %s [options] <input.sb> [output]\n\n", prog);
+    printf("Options:\n");
+    printf("  -O0 .. -O3               Optimization level (default: -O2)\n");
+    printf("  --inline-threshold=N     Inlining budget in IR instructions\n");
+    printf("  --march=native|x86-64    Vectorize for this CPU (AVX2 if present) or SSE2\n");
+    printf("  --no-vectorize           Disable the loop vectorizer\n");
+    printf("  --passes=a,b,...         Run these IR passes instead of the -O pipeline\n");
+    printf("  --time-passes            Report time and instruction delta per pass\n");
+    printf("  --verify-ir              Check IR invariants after every pass\n");
+    printf("  --no-regalloc            Keep every local and temporary on the stack\n");
+    printf("  --no-peephole            Emit instructions without peephole rewriting\n");
+    printf("  --peephole-stats         Report peephole rewrites per rule\n");
+    printf("  --no-integrated-as       Write assembly and run the system assembler\n");
+    printf("  --static-runtime         Static executable with a built-in syscall runtime (Linux)\n");
+    printf("  --run                    Compile into memory and run now (no files, no gcc)\n");
+    printf("  --jit-cache[=DIR]        With --run, reuse machine code cached by source hash\n");
+    printf("                           (default DIR: $XDG_CACHE_HOME/subc or ~/.cache/subc)\n");
+    printf("  --perf-map               With --run, write /tmp/perf-<pid>.map for perf\n");
+    printf("  --profile-generate[=FILE] Count block executions; main's return writes FILE\n");
+    printf("                           (default FILE: <output>.subprof)\n");
+    printf("  --profile-use=FILE       Lay out and inline using a recorded profile\n\n");
+    printf("IR passes:\n");
+    ir_pass_print_registry(stdout);
+    printf("\n");
+    printf("Examples:\n");
+    printf("  %s program.sb              # Output: program\n", prog);
+    printf("  %s program.sb myapp        # Output: myapp\n", prog);
+    printf("  %s -O3 program.sb myapp    # Aggressive optimization\n", prog);
+    printf("  %s --passes=simplify,inline,verify --time-passes program.sb\n", prog);
+    printf("  %s --run --jit-cache script.sb   # Run in-process\n", prog);
+    printf("  %s --profile-generate app.sb app && ./app && %s --profile-use=app.subprof app.sb app\n\n",
+           prog, prog);
+}
+
 /* Main entry point */
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("SUB Native Compiler v1.0.0\n");
-        printf("Usage: %s <input.sb> [output]\n\n", argv[0]);
-        printf("Examples:\n");
-        printf("  %s program.sb              # Output: program\n", argv[0]);
-        printf("  %s program.sb myapp        # Output: myapp\n\n", argv[0]);
-        return 1;
+    const char *input_file = NULL;
+    const char *output_file = "program";
+    int positional = 0;
+    NativeOptions native = { .regalloc = -1, .peephole = -1, .integrated_as = true };
+    char default_cache_dir[4096];
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home && cache_home[0]) snprintf(default_cache_dir, sizeof(default_cache_dir), "%s/subc", cache_home);
+    else snprintf(default_cache_dir, sizeof(default_cache_dir), "%s/.cache/subc", getenv("HOME") ? getenv("HOME") : ".");
+    IROptions *opts = &native.ir;
+    ir_options_init(opts, 2);
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "-O", 2) == 0) {
+            if (arg[2] < '0' || arg[2] > '3' || arg[3] != '\0') {
+                fprintf(stderr, "Error: Invalid optimization level '%s' (use -O0 .. -O3)\n", arg);
+                return 1;
+            }
+            opts->level = arg[2] - '0';
+        } else if (strncmp(arg, "--inline-threshold=", 19) == 0) {
+            char *end;
+            long value = strtol(arg + 19, &end, 10);
+            if (*end != '\0' || end == arg + 19 || value < 0) {
+                fprintf(stderr, "Error: Invalid inline threshold '%s'\n", arg + 19);
+                return 1;
+            }
+            opts->inline_threshold = (int)value;
+        } else if (strcmp(arg, "--march=native") == 0) {
+            opts->vector_width = host_vector_width();
+        } else if (strcmp(arg, "--march=x86-64") == 0) {
+            opts->vector_width = 2;
+        } else if (strcmp(arg, "--no-vectorize") == 0) {
+            opts->vector_width = 0;
+        } else if (strncmp(arg, "--passes=", 9) == 0) {
+            opts->passes = arg + 9;
+        } else if (strcmp(arg, "--time-passes") == 0) {
+            opts->time_passes = true;
+        } else if (strcmp(arg, "--verify-ir") == 0) {
+            opts->verify = true;
+        } else if (strcmp(arg, "--no-regalloc") == 0) {
+            native.regalloc = 0;
+        } else if (strcmp(arg, "--no-peephole") == 0) {
+            native.peephole = 0;
+        } else if (strcmp(arg, "--peephole-stats") == 0) {
+            native.peephole_stats = true;
+        } else if (strcmp(arg, "--no-integrated-as") == 0) {
+            native.integrated_as = false;
+        } else if (strcmp(arg, "--static-runtime") == 0) {
+            native.static_runtime = true;
+        } else if (strcmp(arg, "--run") == 0) {
+            native.run = true;
+        } else if (strcmp(arg, "--jit-cache") == 0) {
+            native.jit_cache = default_cache_dir;
+        } else if (strncmp(arg, "--jit-cache=", 12) == 0) {
+            native.jit_cache = arg + 12;
+        } else if (strcmp(arg, "--perf-map") == 0) {
+            native.perf_map = true;
+        } else if (strcmp(arg, "--profile-generate") == 0) {
+            native.profile_generate = "";
+        } else if (strncmp(arg, "--profile-generate=", 19) == 0 && arg[19]) {
+            native.profile_generate = arg + 19;
+        } else if (strncmp(arg, "--profile-use=", 14) == 0 && arg[14]) {
+            native.profile_use = arg + 14;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            fprintf(stderr, "Error: Unknown option '%s'\n", arg);
+            print_usage(argv[0]);
+            return 1;
+        } else if (positional == 0) {
+            input_file = arg;
+            positional++;
+        } else if (positional == 1) {
+            output_file = arg;
+            positional++;
+        } else {
+            fprintf(stderr, "Error: Unexpected argument '%s'\n", arg);
+            return 1;
+        }
     }
     
-    const char *input_file = argv[1];
-    const char *output_file = argc > 2 ? argv[2] : "program";
+    if (!input_file) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (native.profile_generate && native.profile_use) {
+        fprintf(stderr, "Error: --profile-generate and --profile-use cannot be combined\n");
+        return 1;
+    }
+    if (native.run) {
+        if (native.profile_generate || native.profile_use) {
+            fprintf(stderr, "Error: profiles are recorded and used by compiled executables, not with --run\n");
+            return 1;
+        }
+        if (native.static_runtime) {
+            fprintf(stderr, "Error: --run calls into this process's libc; it cannot be combined with --static-runtime\n");
+            return 1;
+        }
+        return run_in_process(input_file, &native);
+    }
+#ifndef __linux__
+    if (native.static_runtime) {
+        fprintf(stderr, "Error: --static-runtime uses Linux system calls and is only available on Linux\n");
+        return 1;
+    }
+#endif
+    char default_profile[4096];
+    if (native.profile_generate && !native.profile_generate[0]) {
+        snprintf(default_profile, sizeof(default_profile), "%s.subprof", output_file);
+        native.profile_generate = default_profile;
+    }
     
-    return compile_to_native(input_file, output_file);
+    return compile_to_native(input_file, output_file, &native);
 }
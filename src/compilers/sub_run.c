@@ -0,0 +1,138 @@
+/* ========================================
+   SUB Language - Bytecode Runner
+   `sub run`: compiles SUB to register bytecode and interprets it
+   File: sub_run.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "sub_compiler.h"
+#include "ir.h"
+#include "ir_pass.h"
+#include "vm.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char* read_source(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *content = malloc(size + 1);
+    if (!content) {
+        fclose(file);
+        return NULL;
+    }
+    size_t read = fread(content, 1, size, file);
+    content[read] = '\0';
+    fclose(file);
+    return content;
+}
+
+/* Front end and IR pipeline; NULL after an error message */
+static IRModule* build_module(const char *input_file, const IROptions *opts) {
+    char *source = read_source(input_file);
+    if (!source) return NULL;
+
+    int token_count;
+    Token *tokens = lexer_tokenize(source, &token_count);
+    ASTNode *ast = parser_parse(tokens, token_count);
+    IRModule *module = NULL;
+    // The strict type checker only reports, on stdout: skip it so the
+    // program's output stays clean
+    if (!ast || !semantic_analyze(ast)) {
+        fprintf(stderr, "Error: %s failed semantic analysis\n", input_file);
+    } else if (!(module = ir_generate_from_ast(ast)) || !ir_optimize_with_options(module, opts)) {
+        fprintf(stderr, "Error: IR generation failed for %s\n", input_file);
+        if (module) ir_module_free(module);
+        module = NULL;
+    }
+    lexer_free_tokens(tokens, token_count);
+    if (ast) parser_free_ast(ast);
+    free(source);
+    return module;
+}
+
+static void print_usage(const char *prog) {
+    printf("SUB Bytecode Runner v1.0.0\n");
+    printf("Usage: %s run [options] <input.sb>\n\n", prog);
+    printf("Options:\n");
+    printf("  -O0 .. -O3               IR optimization level (default: -O2)\n");
+    printf("  --inline-threshold=N     Inlining budget in IR instructions\n");
+    printf("  --passes=a,b,...         Run these IR passes instead of the -O pipeline\n");
+    printf("  --dump-bytecode          Print the bytecode listing to stderr before running\n\n");
+    printf("The exit status is main's return value (1 on errors).\n\n");
+    printf("Examples:\n");
+    printf("  %s run program.sb\n", prog);
+    printf("  %s run -O3 --dump-bytecode program.sb\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || strcmp(argv[1], "run") != 0) {
+        print_usage(argv[0]);
+        return argc < 2 || strcmp(argv[1], "--help") == 0 ? 0 : 1;
+    }
+
+    const char *input_file = NULL;
+    bool dump = false;
+    IROptions opts;
+    ir_options_init(&opts, 2);
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strncmp(arg, "-O", 2) == 0) {
+            if (arg[2] < '0' || arg[2] > '3' || arg[3] != '\0') {
+                fprintf(stderr, "Error: Invalid optimization level '%s' (use -O0 .. -O3)\n", arg);
+                return 1;
+            }
+            opts.level = arg[2] - '0';
+        } else if (strncmp(arg, "--inline-threshold=", 19) == 0) {
+            char *end;
+            long value = strtol(arg + 19, &end, 10);
+            if (*end != '\0' || end == arg + 19 || value < 0) {
+                fprintf(stderr, "Error: Invalid inline threshold '%s'\n", arg + 19);
+                return 1;
+            }
+            opts.inline_threshold = (int)value;
+        } else if (strncmp(arg, "--passes=", 9) == 0) {
+            opts.passes = arg + 9;
+        } else if (strcmp(arg, "--dump-bytecode") == 0) {
+            dump = true;
+        } else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "Error: Unknown option '%s'\n", arg);
+            return 1;
+        } else if (!input_file) {
+            input_file = arg;
+        } else {
+            fprintf(stderr, "Error: Unexpected argument '%s'\n", arg);
+            return 1;
+        }
+    }
+    if (!input_file) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    // Vector loops are a native-backend construct: the interpreter gains
+    // nothing from them
+    opts.vector_width = 0;
+
+    IRModule *module = build_module(input_file, &opts);
+    if (!module) return 1;
+    VMProgram *program = vm_compile(module);
+    ir_module_free(module);
+    if (!program) return 1;
+    if (dump) vm_dump(program, stderr);
+
+    bool ok = false;
+    int64_t result = vm_run(program, &ok);
+    fflush(stdout);
+    vm_program_free(program);
+    return ok ? (int)result : 1;
+}
@@ -38,6 +38,12 @@ Token* lexer_tokenize(const char *source, int *token_count) {
     const char *ptr = source;
     
     while (*ptr) {
+        // Expand token array if needed (every branch below adds at most one)
+        if (count + 1 >= capacity) {
+            capacity *= 2;
+            tokens = realloc(tokens, sizeof(Token) * capacity);
+        }
+        
         // Skip whitespace (except newlines)
         if (*ptr == ' ' || *ptr == '\t' || *ptr == '\r') {
             ptr++;
@@ -68,7 +74,9 @@ Token* lexer_tokenize(const char *source, int *token_count) {
             continue;
         }
         
-        // Handle string literals
+        // Handle string literals: the token holds the text between the
+        // quotes with its escapes, in the form a double-quoted literal
+        // needs (single-quoted text escapes '"' and drops "\'")
         if (*ptr == '"' || *ptr == '\'') {
             char quote = *ptr;
             ptr++;
@@ -76,13 +84,24 @@ Token* lexer_tokenize(const char *source, int *token_count) {
             const char *start = ptr;
             
             while (*ptr && *ptr != quote) {
-                if (*ptr == '\\') ptr++; // Skip escaped characters
+                if (*ptr == '\\' && *(ptr + 1)) ptr++; // Skip escaped characters
                 ptr++;
                 column++;
             }
             
-            char *str_value = strndup(start, ptr - start);
-            tokens[count++] = create_token(TOKEN_STRING, str_value, line, column);
+            char *str_value = malloc(2 * (size_t)(ptr - start) + 1);
+            size_t n = 0;
+            for (const char *c = start; c < ptr; c++) {
+                if (*c == '\\' && c + 1 < ptr) {
+                    if (c[1] != '\'' || quote != '\'') str_value[n++] = '\\';
+                    str_value[n++] = *++c;
+                } else {
+                    if (*c == '"') str_value[n++] = '\\';
+                    str_value[n++] = *c;
+                }
+            }
+            str_value[n] = '\0';
+            tokens[count++] = create_token(TOKEN_STRING_LITERAL, str_value, line, column);
             free(str_value);
             
             if (*ptr) {
@@ -119,6 +138,7 @@ Token* lexer_tokenize(const char *source, int *token_count) {
             // Check for keywords
             TokenType type = TOKEN_IDENTIFIER;
             if (strcmp(identifier, "var") == 0) type = TOKEN_VAR;
+            else if (strcmp(identifier, "const") == 0) type = TOKEN_CONST;
             else if (strcmp(identifier, "function") == 0) type = TOKEN_FUNCTION;
             else if (strcmp(identifier, "if") == 0) type = TOKEN_IF;
             else if (strcmp(identifier, "elif") == 0) type = TOKEN_ELIF;
@@ -130,6 +150,8 @@ Token* lexer_tokenize(const char *source, int *token_count) {
             else if (strcmp(identifier, "embed") == 0) type = TOKEN_EMBED;
             else if (strcmp(identifier, "endembed") == 0) type = TOKEN_ENDEMBED;
             else if (strcmp(identifier, "ui") == 0) type = TOKEN_UI;
+            else if (strcmp(identifier, "true") == 0) type = TOKEN_TRUE;
+            else if (strcmp(identifier, "false") == 0) type = TOKEN_FALSE;
             
             tokens[count++] = create_token(type, identifier, line, column);
             free(identifier);
@@ -142,12 +164,16 @@ Token* lexer_tokenize(const char *source, int *token_count) {
             case ')': tokens[count++] = create_token(TOKEN_RPAREN, ")", line, column); break;
             case '{': tokens[count++] = create_token(TOKEN_LBRACE, "{", line, column); break;
             case '}': tokens[count++] = create_token(TOKEN_RBRACE, "}", line, column); break;
+            case '[': tokens[count++] = create_token(TOKEN_LBRACKET, "[", line, column); break;
+            case ']': tokens[count++] = create_token(TOKEN_RBRACKET, "]", line, column); break;
             case '.': tokens[count++] = create_token(TOKEN_DOT, ".", line, column); break;
             case ',': tokens[count++] = create_token(TOKEN_COMMA, ",", line, column); break;
+            case ':': tokens[count++] = create_token(TOKEN_COLON, ":", line, column); break;
             case '+':
             case '-':
             case '*':
             case '/':
+            case '%':
             case '=':
             case '<':
             case '>':
@@ -168,12 +194,6 @@ Token* lexer_tokenize(const char *source, int *token_count) {
         
         ptr++;
         column++;
-        
-        // Expand token array if needed
-        if (count >= capacity) {
-            capacity *= 2;
-            tokens = realloc(tokens, sizeof(Token) * capacity);
-        }
     }
     
     tokens[count++] = create_token(TOKEN_EOF, NULL, line, column);
@@ -0,0 +1,434 @@
+/* ========================================
+   SUB Language AST Optimizer
+   Compile-time evaluation of pure calls for the transpiler backends
+   File: optimizer.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "sub_compiler.h"
+#include "windows_compat.h"
+#include <stdint.h>
+
+/*
+ * The transpilers print the AST in another language, so a call is only
+ * replaced when every target would compute the same value: integers
+ * that stay within 32 bits (Rust and Java ints), no division (a float
+ * in Python and JavaScript), no modulo of negative numbers, and a
+ * result that is not a boolean (True/true/1 differ). A function is
+ * pure when it uses only its parameters, locals and program consts and
+ * calls only pure functions; anything else leaves the call in place.
+ */
+
+#define EVAL_CALL_FUEL    1000000    // AST nodes one folded call may visit
+#define EVAL_PROGRAM_FUEL 10000000   // AST nodes for the whole program
+#define EVAL_MAX_DEPTH    200        // Nested calls inside one evaluation
+
+typedef struct {
+    int64_t value;
+    bool is_bool;
+} EvalValue;
+
+typedef struct {
+    const char *name;
+    EvalValue value;
+} EvalBinding;
+
+typedef struct {
+    EvalBinding *vars;
+    int count;
+} EvalEnv;
+
+typedef struct {
+    ASTNode *program;          // Top-level statements
+    ASTNode **funcs;
+    int func_count;
+    bool *pure;
+    int64_t fuel;
+    int64_t program_fuel;
+    int depth;
+} Evaluator;
+
+typedef enum { FLOW_NEXT, FLOW_RETURN, FLOW_FAIL } EvalFlow;
+
+static int find_function(const Evaluator *ev, const char *name) {
+    if (!name) return -1;
+    for (int i = 0; i < ev->func_count; i++) {
+        if (ev->funcs[i]->value && strcmp(ev->funcs[i]->value, name) == 0) return i;
+    }
+    return -1;
+}
+
+/* ---------- Purity ---------- */
+
+static bool syntax_allowed(const Evaluator *ev, const ASTNode *node) {
+    for (; node; node = node->next) {
+        switch (node->type) {
+            case AST_LITERAL:
+                if (node->data_type == TYPE_STRING) return false;
+                break;
+            case AST_CALL_EXPR:
+                if (find_function(ev, node->value) < 0) return false;
+                break;
+            case AST_FOR_STMT:
+                if (node->child_count < 1 || !node->children[0] || node->children[0]->type != AST_RANGE_EXPR) {
+                    return false;
+                }
+                break;
+            case AST_BLOCK: case AST_VAR_DECL: case AST_CONST_DECL: case AST_IF_STMT:
+            case AST_WHILE_STMT: case AST_RETURN_STMT: case AST_BINARY_EXPR:
+            case AST_IDENTIFIER: case AST_RANGE_EXPR:
+                break;
+            default:
+                return false;
+        }
+        if (!syntax_allowed(ev, node->left) || !syntax_allowed(ev, node->right) ||
+            !syntax_allowed(ev, node->condition) || !syntax_allowed(ev, node->body)) {
+            return false;
+        }
+        // A for loop's second child is its unroll hint
+        int children = node->type == AST_FOR_STMT ? 1 : node->child_count;
+        for (int i = 0; i < children; i++) {
+            if (!syntax_allowed(ev, node->children[i])) return false;
+        }
+    }
+    return true;
+}
+
+static bool calls_impure(const Evaluator *ev, const ASTNode *node) {
+    for (; node; node = node->next) {
+        if (node->type == AST_CALL_EXPR) {
+            int callee = find_function(ev, node->value);
+            if (callee < 0 || !ev->pure[callee]) return true;
+        }
+        if (calls_impure(ev, node->left) || calls_impure(ev, node->right) ||
+            calls_impure(ev, node->condition) || calls_impure(ev, node->body)) {
+            return true;
+        }
+        for (int i = 0; i < node->child_count; i++) {
+            if (calls_impure(ev, node->children[i])) return true;
+        }
+    }
+    return false;
+}
+
+static void find_pure_functions(Evaluator *ev) {
+    for (int i = 0; i < ev->func_count; i++) ev->pure[i] = syntax_allowed(ev, ev->funcs[i]->body);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < ev->func_count; i++) {
+            if (ev->pure[i] && calls_impure(ev, ev->funcs[i]->body)) {
+                ev->pure[i] = false;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* ---------- Evaluation ---------- */
+
+static EvalBinding* env_lookup(EvalEnv *env, const char *name) {
+    if (!name) return NULL;
+    for (int i = env->count - 1; i >= 0; i--) {
+        if (strcmp(env->vars[i].name, name) == 0) return &env->vars[i];
+    }
+    return NULL;
+}
+
+static void env_bind(EvalEnv *env, const char *name, EvalValue value) {
+    EvalBinding *existing = env_lookup(env, name);
+    if (existing) {
+        existing->value = value;
+        return;
+    }
+    env->vars = realloc(env->vars, sizeof(EvalBinding) * (env->count + 1));
+    env->vars[env->count].name = name;
+    env->vars[env->count].value = value;
+    env->count++;
+}
+
+static bool fits_all_targets(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static bool eval_expr(Evaluator *ev, EvalEnv *env, ASTNode *node, EvalValue *out);
+static bool eval_call(Evaluator *ev, int callee, const EvalValue *args, EvalValue *out);
+
+/* Program const `name`, evaluated without any locals in scope */
+static bool eval_global_const(Evaluator *ev, const char *name, EvalValue *out) {
+    for (ASTNode *stmt = ev->program; stmt; stmt = stmt->next) {
+        if (stmt->type == AST_CONST_DECL && stmt->value && name && strcmp(stmt->value, name) == 0 && stmt->right) {
+            EvalEnv empty = { NULL, 0 };
+            if (++ev->depth > EVAL_MAX_DEPTH) return false;
+            bool ok = syntax_allowed(ev, stmt->right) && eval_expr(ev, &empty, stmt->right, out);
+            ev->depth--;
+            return ok;
+        }
+    }
+    return false;
+}
+
+static bool eval_binary(Evaluator *ev, EvalEnv *env, ASTNode *node, EvalValue *out) {
+    const char *op = node->value;
+    if (!op) return false;
+    if (strcmp(op, "=") == 0) {
+        // Only locals and parameters may be assigned
+        EvalBinding *target = node->left && node->left->type == AST_IDENTIFIER ? env_lookup(env, node->left->value) : NULL;
+        if (!target || !eval_expr(ev, env, node->right, out)) return false;
+        target = env_lookup(env, node->left->value);
+        target->value = *out;
+        return true;
+    }
+
+    EvalValue a, b;
+    if (!eval_expr(ev, env, node->left, &a)) return false;
+    out->is_bool = true;
+    if (strcmp(op, "&&") == 0 || strcmp(op, "||") == 0) {
+        bool and = op[0] == '&';
+        if ((a.value != 0) != and) {
+            out->value = !and;
+            return true;
+        }
+        if (!eval_expr(ev, env, node->right, &b)) return false;
+        out->value = b.value != 0;
+        return true;
+    }
+    if (!eval_expr(ev, env, node->right, &b)) return false;
+
+    if (strcmp(op, "==") == 0) out->value = a.value == b.value;
+    else if (strcmp(op, "!=") == 0) out->value = a.value != b.value;
+    else if (strcmp(op, "<") == 0) out->value = a.value < b.value;
+    else if (strcmp(op, "<=") == 0) out->value = a.value <= b.value;
+    else if (strcmp(op, ">") == 0) out->value = a.value > b.value;
+    else if (strcmp(op, ">=") == 0) out->value = a.value >= b.value;
+    else {
+        if (a.is_bool || b.is_bool) return false;
+        out->is_bool = false;
+        if (strcmp(op, "+") == 0) out->value = a.value + b.value;
+        else if (strcmp(op, "-") == 0) out->value = a.value - b.value;
+        else if (strcmp(op, "*") == 0) out->value = a.value * b.value;
+        else if (strcmp(op, "%") == 0 && a.value >= 0 && b.value > 0) out->value = a.value % b.value;
+        else return false;
+        // Operands fit in 32 bits, so the 64-bit result is exact
+        return fits_all_targets(out->value);
+    }
+    return true;
+}
+
+static bool eval_expr(Evaluator *ev, EvalEnv *env, ASTNode *node, EvalValue *out) {
+    if (!node || --ev->fuel < 0) return false;
+    switch (node->type) {
+        case AST_LITERAL: {
+            if (!node->value) return false;
+            if (node->data_type == TYPE_BOOL) {
+                out->value = strcmp(node->value, "true") == 0;
+                out->is_bool = true;
+                return true;
+            }
+            char *end;
+            long long value = strtoll(node->value, &end, 10);
+            if (end == node->value || *end != '\0' || !fits_all_targets(value)) return false;
+            out->value = value;
+            out->is_bool = false;
+            return true;
+        }
+
+        case AST_IDENTIFIER: {
+            EvalBinding *var = env_lookup(env, node->value);
+            if (var) {
+                *out = var->value;
+                return true;
+            }
+            return eval_global_const(ev, node->value, out);
+        }
+
+        case AST_BINARY_EXPR:
+            return eval_binary(ev, env, node, out);
+
+        case AST_CALL_EXPR: {
+            int callee = find_function(ev, node->value);
+            if (callee < 0 || !ev->pure[callee] || node->child_count != ev->funcs[callee]->child_count) return false;
+            EvalValue *args = malloc(sizeof(EvalValue) * (node->child_count > 0 ? node->child_count : 1));
+            bool ok = true;
+            for (int i = 0; i < node->child_count && ok; i++) ok = eval_expr(ev, env, node->children[i], &args[i]);
+            ok = ok && eval_call(ev, callee, args, out);
+            free(args);
+            return ok;
+        }
+
+        default:
+            return false;
+    }
+}
+
+static EvalFlow exec_stmt(Evaluator *ev, EvalEnv *env, ASTNode *node, EvalValue *ret);
+
+static EvalFlow exec_block(Evaluator *ev, EvalEnv *env, ASTNode *block, EvalValue *ret) {
+    if (!block) return FLOW_NEXT;
+    ASTNode *stmt = block->type == AST_BLOCK ? block->body : block;
+    for (; stmt; stmt = stmt->next) {
+        EvalFlow flow = exec_stmt(ev, env, stmt, ret);
+        if (flow != FLOW_NEXT) return flow;
+        if (block->type != AST_BLOCK) break;
+    }
+    return FLOW_NEXT;
+}
+
+static EvalFlow exec_stmt(Evaluator *ev, EvalEnv *env, ASTNode *node, EvalValue *ret) {
+    if (--ev->fuel < 0) return FLOW_FAIL;
+    EvalValue value;
+    switch (node->type) {
+        case AST_VAR_DECL:
+        case AST_CONST_DECL:
+            if (!node->value || !node->right || !eval_expr(ev, env, node->right, &value)) return FLOW_FAIL;
+            env_bind(env, node->value, value);
+            return FLOW_NEXT;
+
+        case AST_IF_STMT:
+            if (!eval_expr(ev, env, node->condition, &value)) return FLOW_FAIL;
+            return exec_block(ev, env, value.value ? node->body : node->right, ret);
+
+        case AST_WHILE_STMT:
+            while (true) {
+                if (!eval_expr(ev, env, node->condition, &value)) return FLOW_FAIL;
+                if (!value.value) return FLOW_NEXT;
+                EvalFlow flow = exec_block(ev, env, node->body, ret);
+                if (flow != FLOW_NEXT) return flow;
+            }
+
+        case AST_FOR_STMT: {
+            ASTNode *range = node->children[0];
+            EvalValue start = { 0, false }, end;
+            if (!node->value || (range->right && !eval_expr(ev, env, range->left, &start)) ||
+                !eval_expr(ev, env, range->right ? range->right : range->left, &end) ||
+                start.is_bool || end.is_bool) {
+                return FLOW_FAIL;
+            }
+            for (int64_t i = start.value; i < end.value; i++) {
+                EvalValue counter = { i, false };
+                env_bind(env, node->value, counter);
+                EvalFlow flow = exec_block(ev, env, node->body, ret);
+                if (flow != FLOW_NEXT) return flow;
+                // Targets disagree on assignments to the loop variable
+                EvalBinding *var = env_lookup(env, node->value);
+                if (var->value.value != i || var->value.is_bool) return FLOW_FAIL;
+            }
+            return FLOW_NEXT;
+        }
+
+        case AST_RETURN_STMT:
+            // A bare return is None in Python and 0 natively
+            if (!node->left || !eval_expr(ev, env, node->left, ret)) return FLOW_FAIL;
+            return FLOW_RETURN;
+
+        case AST_BLOCK:
+            return exec_block(ev, env, node, ret);
+
+        case AST_BINARY_EXPR:
+        case AST_CALL_EXPR:
+        case AST_IDENTIFIER:
+        case AST_LITERAL:
+            return eval_expr(ev, env, node, &value) ? FLOW_NEXT : FLOW_FAIL;
+
+        default:
+            return FLOW_FAIL;
+    }
+}
+
+static bool eval_call(Evaluator *ev, int callee, const EvalValue *args, EvalValue *out) {
+    if (++ev->depth > EVAL_MAX_DEPTH) {
+        ev->depth--;
+        return false;
+    }
+    ASTNode *func = ev->funcs[callee];
+    EvalEnv env = { NULL, 0 };
+    for (int i = 0; i < func->child_count; i++) {
+        if (!func->children[i] || !func->children[i]->value) {
+            free(env.vars);
+            ev->depth--;
+            return false;
+        }
+        env_bind(&env, func->children[i]->value, args[i]);
+    }
+    // Falling off the end returns None in Python: not folded
+    bool ok = exec_block(ev, &env, func->body, out) == FLOW_RETURN;
+    free(env.vars);
+    ev->depth--;
+    return ok;
+}
+
+/* ---------- Rewriting ---------- */
+
+/* Names at a call site may be locals shadowing a program const */
+static bool mentions_name(const ASTNode *node) {
+    if (!node) return false;
+    if (node->type == AST_IDENTIFIER) return true;
+    if (mentions_name(node->left) || mentions_name(node->right)) return true;
+    for (int i = 0; i < node->child_count; i++) {
+        if (mentions_name(node->children[i])) return true;
+    }
+    return false;
+}
+
+/* Evaluate `node` (a call with literal arguments) on a fresh fuel budget */
+static bool evaluate_call_site(Evaluator *ev, ASTNode *node, EvalValue *out) {
+    int callee = find_function(ev, node->value);
+    if (callee < 0 || !ev->pure[callee] || ev->program_fuel <= 0) return false;
+    for (int i = 0; i < node->child_count; i++) {
+        if (mentions_name(node->children[i])) return false;
+    }
+    ev->fuel = ev->program_fuel < EVAL_CALL_FUEL ? ev->program_fuel : EVAL_CALL_FUEL;
+    int64_t start = ev->fuel;
+    EvalEnv empty = { NULL, 0 };
+    ev->depth = 0;
+    bool ok = eval_expr(ev, &empty, node, out) && !out->is_bool;
+    ev->program_fuel -= start - (ev->fuel > 0 ? ev->fuel : 0);
+    return ok;
+}
+
+static int fold_calls(Evaluator *ev, ASTNode *node) {
+    int folded = 0;
+    for (; node; node = node->next) {
+        folded += fold_calls(ev, node->left) + fold_calls(ev, node->right) +
+                  fold_calls(ev, node->condition) + fold_calls(ev, node->body);
+        for (int i = 0; i < node->child_count; i++) folded += fold_calls(ev, node->children[i]);
+
+        EvalValue result;
+        if (node->type == AST_CALL_EXPR && evaluate_call_site(ev, node, &result)) {
+            char text[32];
+            snprintf(text, sizeof(text), "%lld", (long long)result.value);
+            for (int i = 0; i < node->child_count; i++) parser_free_ast(node->children[i]);
+            free(node->children);
+            node->children = NULL;
+            node->child_count = 0;
+            free(node->value);
+            node->value = strdup(text);
+            node->type = AST_LITERAL;
+            node->data_type = TYPE_INT;
+            folded++;
+        }
+    }
+    return folded;
+}
+
+int optimizer_evaluate_pure_calls(ASTNode *ast) {
+    if (!ast || ast->type != AST_PROGRAM) return 0;
+
+    Evaluator ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.program = ast->left;
+    for (ASTNode *stmt = ast->left; stmt; stmt = stmt->next) {
+        if (stmt->type != AST_FUNCTION_DECL || !stmt->value) continue;
+        ev.funcs = realloc(ev.funcs, sizeof(ASTNode*) * (ev.func_count + 1));
+        ev.funcs[ev.func_count++] = stmt;
+    }
+    if (ev.func_count == 0) return 0;
+    ev.pure = malloc(sizeof(bool) * ev.func_count);
+    ev.program_fuel = EVAL_PROGRAM_FUEL;
+    find_pure_functions(&ev);
+
+    int folded = fold_calls(&ev, ast->left);
+    free(ev.pure);
+    free(ev.funcs);
+    return folded;
+}
@@ -95,6 +95,19 @@ static void skip_newlines(ParserState *state) {
     }
 }
 
+/* Parse trailing `[index]` suffixes: a[i][j] -> ((a[i])[j]) */
+static ASTNode* parse_index_suffix(ParserState *state, ASTNode *base) {
+    while (base && match(state, TOKEN_LBRACKET)) {
+        advance(state);
+        ASTNode *access = create_node(AST_ARRAY_ACCESS, NULL);
+        access->left = base;
+        access->right = parse_expression(state);
+        expect(state, TOKEN_RBRACKET);
+        base = access;
+    }
+    return base;
+}
+
 /* Parse primary expression (literals, identifiers, parenthesized expressions) */
 static ASTNode* parse_primary(ParserState *state) {
     Token *tok = current_token(state);
@@ -158,13 +171,29 @@ static ASTNode* parse_primary(ParserState *state) {
             
             expect(state, TOKEN_RPAREN);
             free(name);
-            return call;
+            return parse_index_suffix(state, call);
         }
         
         // Just an identifier
         ASTNode *node = create_node(AST_IDENTIFIER, name);
         free(name);
-        return node;
+        return parse_index_suffix(state, node);
+    }
+    
+    // Array literal: [e1, e2, ...]
+    if (match(state, TOKEN_LBRACKET)) {
+        advance(state);
+        ASTNode *array = create_node(AST_ARRAY_LITERAL, NULL);
+        while (!match(state, TOKEN_RBRACKET) && !match(state, TOKEN_EOF)) {
+            ASTNode *elem = parse_expression(state);
+            if (!elem) break;
+            array->children = realloc(array->children, sizeof(ASTNode*) * (array->child_count + 1));
+            array->children[array->child_count++] = elem;
+            if (!match(state, TOKEN_COMMA)) break;
+            advance(state);
+        }
+        expect(state, TOKEN_RBRACKET);
+        return parse_index_suffix(state, array);
     }
     
     // Parenthesized expression
@@ -172,7 +201,7 @@ static ASTNode* parse_primary(ParserState *state) {
         advance(state);
         ASTNode *expr = parse_expression(state);
         expect(state, TOKEN_RPAREN);
-        return expr;
+        return parse_index_suffix(state, expr);
     }
     
     return NULL;
@@ -188,7 +217,7 @@ static int get_operator_precedence(const char *op) {
     if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0 || 
         strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0) return 4;
     if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0) return 5;
-    if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0) return 6;
+    if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0 || strcmp(op, "%") == 0) return 6;
     return -1;
 }
 
@@ -329,6 +358,9 @@ static ASTNode* parse_if(ParserState *state) {
         advance(state);
         skip_newlines(state);
         if_node->right = parse_block(state);
+        if (match(state, TOKEN_RBRACE)) {
+            advance(state);
+        }
     }
     
     if (match(state, TOKEN_END)) {
@@ -375,9 +407,24 @@ static ASTNode* parse_for(ParserState *state) {
         expect(state, TOKEN_RPAREN);
         
         // Store range node as first child
-        for_node->children = malloc(sizeof(ASTNode*));
+        for_node->children = malloc(sizeof(ASTNode*) * 2);
         for_node->children[0] = range_node;
         for_node->child_count = 1;
+        
+        // Optional unroll hint: for i in range(16) unroll(4) { ... }
+        // kept as a literal second child (unroll(1) disables unrolling)
+        tok = current_token(state);
+        if (tok && tok->type == TOKEN_IDENTIFIER && strcmp(tok->value, "unroll") == 0) {
+            advance(state);
+            expect(state, TOKEN_LPAREN);
+            Token *factor = current_token(state);
+            if (factor && factor->type == TOKEN_NUMBER) {
+                for_node->children[1] = create_node(AST_LITERAL, factor->value);
+                for_node->child_count = 2;
+                advance(state);
+            }
+            expect(state, TOKEN_RPAREN);
+        }
     } else {
         // Iterating over collection or variable
         ASTNode *collection = parse_expression(state);
@@ -449,11 +496,15 @@ static ASTNode* parse_function(ParserState *state) {
                     // Optional type annotation: param: type
                     if (match(state, TOKEN_COLON)) {
                         advance(state);
+                        Token *type_token = current_token(state);
+                        const char *type = type_token && type_token->value ? type_token->value : "";
                         if (match(state, TOKEN_INT) || match(state, TOKEN_FLOAT) || 
-                            match(state, TOKEN_STRING) || match(state, TOKEN_BOOL)) {
-                            // TODO: Store type in param->data_type
-                            advance(state);
-                        } else if (match(state, TOKEN_IDENTIFIER)) {
+                            match(state, TOKEN_STRING) || match(state, TOKEN_BOOL) ||
+                            match(state, TOKEN_IDENTIFIER)) {
+                            if (strcmp(type, "int") == 0) param->data_type = TYPE_INT;
+                            else if (strcmp(type, "float") == 0) param->data_type = TYPE_FLOAT;
+                            else if (strcmp(type, "string") == 0) param->data_type = TYPE_STRING;
+                            else if (strcmp(type, "bool") == 0) param->data_type = TYPE_BOOL;
                             advance(state);
                         }
                     }
@@ -521,8 +572,8 @@ static ASTNode* parse_statement(ParserState *state) {
         ASTNode *const_decl = create_node(AST_CONST_DECL, NULL);
         
         if (match(state, TOKEN_IDENTIFIER)) {
+            tok = current_token(state); // Refresh token
             const_decl->value = strdup(tok->value);
-            tok = current_token(state);
             advance(state);
             
             if (match(state, TOKEN_OPERATOR)) {
@@ -130,10 +130,7 @@ static DataType check_expression_type(ASTNode *node, LocalSymbolTable *table) {
                 return TYPE_UNKNOWN;
             }
             
-            if (node->value[0] == '"' || node->value[0] == '\'') {
-                node->data_type = TYPE_STRING;
-                return TYPE_STRING;
-            }
+            if (node->data_type == TYPE_STRING) return TYPE_STRING;   // Set by the parser
             
             if (strcmp(node->value, "true") == 0 || strcmp(node->value, "false") == 0) {
                 node->data_type = TYPE_BOOL;
@@ -661,6 +658,7 @@ static int analyze_node(ASTNode *node, LocalSymbolTable *table) {
     
     switch (node->type) {
         case AST_VAR_DECL:
+        case AST_CONST_DECL:
             if (node->value) {
                 if (lookup_symbol(table, node->value)) {
                     fprintf(stderr, "Semantic error: Variable '%s' already declared\n", node->value);
@@ -703,6 +701,68 @@ static int analyze_node(ASTNode *node, LocalSymbolTable *table) {
     return 1;
 }
 
+// ========================================
+// Const Assignment Check
+// ========================================
+
+// Declaration of `name` in a function body or the program's statements
+// (nested functions excepted); NULL if there is none
+static ASTNode* find_declaration(ASTNode *node, const char *name) {
+    for (; node; node = node->next) {
+        if (node->type == AST_FUNCTION_DECL) continue;
+        if ((node->type == AST_VAR_DECL || node->type == AST_CONST_DECL) &&
+            node->value && strcmp(node->value, name) == 0) {
+            return node;
+        }
+        ASTNode *found = NULL;
+        if (!found && node->left) found = find_declaration(node->left, name);
+        if (!found && node->right) found = find_declaration(node->right, name);
+        if (!found && node->body) found = find_declaration(node->body, name);
+        for (int i = 0; !found && i < node->child_count; i++) {
+            found = find_declaration(node->children[i], name);
+        }
+        if (found) return found;
+    }
+    return NULL;
+}
+
+static bool declares_parameter(ASTNode *function, const char *name) {
+    for (int i = 0; function && i < function->child_count; i++) {
+        ASTNode *param = function->children[i];
+        if (param && param->value && strcmp(param->value, name) == 0) return true;
+    }
+    return false;
+}
+
+// Every `name = value` must target a variable: a name that the enclosing
+// function does not declare itself refers to the program's declaration
+static int check_const_assignments(ASTNode *node, ASTNode *program, ASTNode *function) {
+    for (; node; node = node->next) {
+        if (node->type == AST_FUNCTION_DECL) {
+            if (!check_const_assignments(node->body, program, node)) return 0;
+            continue;
+        }
+        if (node->type == AST_BINARY_EXPR && node->value && strcmp(node->value, "=") == 0 &&
+            node->left && node->left->type == AST_IDENTIFIER && node->left->value) {
+            const char *name = node->left->value;
+            ASTNode *decl = function ? find_declaration(function->body, name) : NULL;
+            if (!decl && !declares_parameter(function, name)) decl = find_declaration(program->left, name);
+            if (decl && decl->type == AST_CONST_DECL) {
+                fprintf(stderr, "Semantic error: Cannot assign to const '%s'\n", name);
+                return 0;
+            }
+        }
+        if (node->left && !check_const_assignments(node->left, program, function)) return 0;
+        if (node->right && !check_const_assignments(node->right, program, function)) return 0;
+        if (node->body && !check_const_assignments(node->body, program, function)) return 0;
+        if (node->condition && !check_const_assignments(node->condition, program, function)) return 0;
+        for (int i = 0; i < node->child_count; i++) {
+            if (!check_const_assignments(node->children[i], program, function)) return 0;
+        }
+    }
+    return 1;
+}
+
 // ========================================
 // Main Entry Points
 // ========================================
@@ -716,6 +776,9 @@ int semantic_analyze(ASTNode *ast) {
     LocalSymbolTable *table = create_symbol_table();
     int result = analyze_node(ast, table);
     free_symbol_table(table);
+    if (result && ast->type == AST_PROGRAM) {
+        result = check_const_assignments(ast->left, ast, NULL);
+    }
     
     return result;
 }
@@ -150,6 +150,8 @@ TypeInfo* type_infer_from_node(ASTNode *node) {
     
     switch (node->type) {
         case AST_LITERAL:
+            // String literal text has no quotes; the parser marks it
+            if (node->data_type == TYPE_STRING) return type_info_create(SUB_TYPE_STRING);
             return type_info_create(type_infer_from_literal(node->value));
             
         case AST_IDENTIFIER:
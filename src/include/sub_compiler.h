@@ -310,7 +310,9 @@ void optimize_c_output(ASTNode *node);
 void optimizer_optimize(ASTNode *ast, int level);
 void optimizer_constant_folding(ASTNode *ast);
 void optimizer_dead_code_elimination(ASTNode *ast);
-void optimizer_inline_expansion(ASTNode *ast);
+// Replace calls to pure functions with constant arguments by their value; returns the count
+int optimizer_evaluate_pure_calls(ASTNode *ast);
+// Function inlining runs on the IR (ir_inline_module in ir_opt.h)
 
 // Utility Functions
 char* read_file(const char *filename);
@@ -7,6 +7,7 @@
 #define _GNU_SOURCE
 #include "ir.h"
 #include "sub_compiler.h"
+#include "ir_pass.h"
 #include "windows_compat.h"
 #include <stdlib.h>
 #include <string.h>
@@ -28,20 +29,7 @@ void ir_module_free(IRModule *module) {
     IRFunction *func = module->functions;
     while (func) {
         IRFunction *next = func->next;
-        
-        // Free instructions
-        IRInstruction *instr = func->instructions;
-        while (instr) {
-            IRInstruction *next_instr = instr->next;
-            if (instr->dest) free(instr->dest);
-            if (instr->src1) free(instr->src1);
-            if (instr->src2) free(instr->src2);
-            free(instr);
-            instr = next_instr;
-        }
-        
-        free(func->name);
-        free(func);
+        ir_function_free(func);
         func = next;
     }
     
@@ -64,9 +52,28 @@ IRFunction* ir_function_create(const char *name, IRType return_type) {
     func->instructions = NULL;
     func->local_count = 0;
     func->reg_count = 0;
+    func->frame_words = 0;
+    func->profile_entry = -1;
     return func;
 }
 
+/* Free a function unlinked from its module */
+void ir_function_free(IRFunction *func) {
+    if (!func) return;
+    IRInstruction *instr = func->instructions;
+    while (instr) {
+        IRInstruction *next = instr->next;
+        ir_instruction_free(instr);
+        instr = next;
+    }
+    for (int i = 0; i < func->param_count && func->params; i++) {
+        ir_value_free(func->params[i]);
+    }
+    free(func->params);
+    free(func->name);
+    free(func);
+}
+
 /* Add parameter to function */
 void ir_function_add_param(IRFunction *func, IRValue *param) {
     func->params = realloc(func->params, sizeof(IRValue*) * (func->param_count + 1));
@@ -86,13 +93,86 @@ void ir_function_add_instruction(IRFunction *func, IRInstruction *instr) {
     }
 }
 
+/* Insert instruction after `after` (NULL inserts at the head) */
+void ir_function_insert_after(IRFunction *func, IRInstruction *after, IRInstruction *instr) {
+    if (!after) {
+        instr->next = func->instructions;
+        func->instructions = instr;
+    } else {
+        instr->next = after->next;
+        after->next = instr;
+    }
+}
+
+/* Unlink and free `instr`, whose predecessor is `prev` (NULL if head) */
+void ir_function_remove_after(IRFunction *func, IRInstruction *prev, IRInstruction *instr) {
+    if (prev) prev->next = instr->next;
+    else func->instructions = instr->next;
+    instr->next = NULL;
+    ir_instruction_free(instr);
+}
+
+/* Allocate a fresh virtual register */
+int ir_function_new_reg(IRFunction *func) {
+    return func->reg_count++;
+}
+
+/* Allocate a fresh stack local (the ALLOC marker is inserted at the head) */
+int ir_function_new_local(IRFunction *func, const char *name) {
+    int slot = func->local_count++;
+    IRInstruction *alloc = ir_instruction_create(IR_ALLOC);
+    alloc->dest = ir_value_create_var(slot, name);
+    ir_function_insert_after(func, NULL, alloc);
+    return slot;
+}
+
 /* Create IR instruction */
 IRInstruction* ir_instruction_create(IROpcode opcode) {
     IRInstruction *instr = calloc(1, sizeof(IRInstruction));
     instr->opcode = opcode;
+    instr->profile_count = -1;
     return instr;
 }
 
+/* Append a call argument */
+void ir_instruction_add_arg(IRInstruction *instr, IRValue *arg) {
+    instr->args = realloc(instr->args, sizeof(IRValue*) * (instr->arg_count + 1));
+    instr->args[instr->arg_count++] = arg;
+}
+
+/* Free an instruction and the values it owns */
+void ir_instruction_free(IRInstruction *instr) {
+    if (!instr) return;
+    ir_value_free(instr->dest);
+    ir_value_free(instr->src1);
+    ir_value_free(instr->src2);
+    for (int i = 0; i < instr->arg_count; i++) {
+        ir_value_free(instr->args[i]);
+    }
+    free(instr->args);
+    free(instr->comment);
+    ir_vector_kernel_free(instr->vector);
+    free(instr);
+}
+
+IRVectorKernel* ir_vector_kernel_clone(const IRVectorKernel *kernel) {
+    if (!kernel) return NULL;
+    IRVectorKernel *copy = malloc(sizeof(IRVectorKernel));
+    *copy = *kernel;
+    copy->nodes = malloc(sizeof(IRVecNode) * (kernel->node_count ? kernel->node_count : 1));
+    memcpy(copy->nodes, kernel->nodes, sizeof(IRVecNode) * kernel->node_count);
+    copy->stores = malloc(sizeof(IRVecStore) * (kernel->store_count ? kernel->store_count : 1));
+    memcpy(copy->stores, kernel->stores, sizeof(IRVecStore) * kernel->store_count);
+    return copy;
+}
+
+void ir_vector_kernel_free(IRVectorKernel *kernel) {
+    if (!kernel) return;
+    free(kernel->nodes);
+    free(kernel->stores);
+    free(kernel);
+}
+
 /* Create IR values */
 IRValue* ir_value_create_int(int64_t value) {
     IRValue *val = calloc(1, sizeof(IRValue));
@@ -126,6 +206,15 @@ IRValue* ir_value_create_reg(int reg_num, IRType type) {
     return val;
 }
 
+IRValue* ir_value_create_var(int slot, const char *name) {
+    IRValue *val = calloc(1, sizeof(IRValue));
+    val->type = IR_TYPE_INT;
+    val->kind = IR_VAL_VAR;
+    val->data.reg_num = slot;
+    val->name = name ? strdup(name) : NULL;
+    return val;
+}
+
 IRValue* ir_value_create_label(const char *label) {
     IRValue *val = calloc(1, sizeof(IRValue));
     val->type = IR_TYPE_LABEL; // Keep type label for safety
@@ -134,8 +223,539 @@ IRValue* ir_value_create_label(const char *label) {
     return val;
 }
 
+/* Create a label unique across the module (e.g. "L_ELSE_3") */
+IRValue* ir_value_create_unique_label(const char *prefix) {
+    static int label_counter = 0;
+    char label[64];
+    snprintf(label, sizeof(label), "%s_%d", prefix, label_counter++);
+    return ir_value_create_label(label);
+}
+
+/* Deep copy (instructions own their operands) */
+IRValue* ir_value_clone(const IRValue *val) {
+    if (!val) return NULL;
+    IRValue *copy = malloc(sizeof(IRValue));
+    *copy = *val;
+    if (val->kind == IR_VAL_LABEL && val->data.label) {
+        copy->data.label = strdup(val->data.label);
+    } else if (val->kind == IR_VAL_CONST && val->type == IR_TYPE_STRING && val->data.string_val) {
+        copy->data.string_val = strdup(val->data.string_val);
+    }
+    copy->name = val->name ? strdup(val->name) : NULL;
+    return copy;
+}
+
+void ir_value_free(IRValue *val) {
+    if (!val) return;
+    if (val->kind == IR_VAL_LABEL) {
+        free(val->data.label);
+    } else if (val->kind == IR_VAL_CONST && val->type == IR_TYPE_STRING) {
+        free(val->data.string_val);
+    }
+    free(val->name);
+    free(val);
+}
+
+bool ir_value_is_const_int(const IRValue *val, int64_t value) {
+    return val && val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING &&
+           val->type != IR_TYPE_FLOAT && val->data.int_val == value;
+}
+
+/* Opcode helpers */
+const char* ir_opcode_name(IROpcode opcode) {
+    switch (opcode) {
+        case IR_ADD: return "ADD";
+        case IR_SUB: return "SUB";
+        case IR_MUL: return "MUL";
+        case IR_DIV: return "DIV";
+        case IR_MOD: return "MOD";
+        case IR_SHL: return "SHL";
+        case IR_SHR: return "SHR";
+        case IR_SAR: return "SAR";
+        case IR_MULHI: return "MULHI";
+        case IR_EQ: return "EQ";
+        case IR_NE: return "NE";
+        case IR_LT: return "LT";
+        case IR_LE: return "LE";
+        case IR_GT: return "GT";
+        case IR_GE: return "GE";
+        case IR_AND: return "AND";
+        case IR_OR: return "OR";
+        case IR_NOT: return "NOT";
+        case IR_LOAD: return "LOAD";
+        case IR_STORE: return "STORE";
+        case IR_ALLOC: return "ALLOC";
+        case IR_ALLOC_ARRAY: return "ALLOC_ARRAY";
+        case IR_ALLOC_FRAME_ARRAY: return "ALLOC_FRAME_ARRAY";
+        case IR_LOAD_ELEM: return "LOAD_ELEM";
+        case IR_STORE_ELEM: return "STORE_ELEM";
+        case IR_ARRAY_LEN: return "ARRAY_LEN";
+        case IR_LABEL: return "LABEL";
+        case IR_JUMP: return "JUMP";
+        case IR_JUMP_IF: return "JUMP_IF";
+        case IR_JUMP_IF_NOT: return "JUMP_IF_NOT";
+        case IR_CALL: return "CALL";
+        case IR_TAIL_CALL: return "TAIL_CALL";
+        case IR_VECTOR_LOOP: return "VECTOR_LOOP";
+        case IR_RETURN: return "RETURN";
+        case IR_CONST_INT: return "CONST_INT";
+        case IR_CONST_FLOAT: return "CONST_FLOAT";
+        case IR_CONST_STRING: return "CONST_STRING";
+        case IR_MOVE: return "MOVE";
+        case IR_FUNC_START: return "FUNC_START";
+        case IR_FUNC_END: return "FUNC_END";
+        case IR_PARAM: return "PARAM";
+        case IR_PRINT: return "PRINT";
+        case IR_INPUT: return "INPUT";
+        case IR_CAST: return "CAST";
+        case IR_PUSH: return "PUSH";
+        case IR_POP: return "POP";
+        case IR_PROFILE_COUNT: return "PROFILE_COUNT";
+        case IR_PROFILE_WRITE: return "PROFILE_WRITE";
+        case IR_PHI: return "PHI";
+        case IR_NEW: return "NEW";
+        case IR_GET_FIELD: return "GET_FIELD";
+        case IR_SET_FIELD: return "SET_FIELD";
+        case IR_CLASS_DEF: return "CLASS_DEF";
+    }
+    return "UNKNOWN";
+}
+
+bool ir_opcode_is_binary(IROpcode opcode) {
+    switch (opcode) {
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+        case IR_SHL: case IR_SHR: case IR_SAR: case IR_MULHI:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Instructions that must be kept even when their result is unused */
+bool ir_opcode_has_side_effects(IROpcode opcode) {
+    switch (opcode) {
+        case IR_STORE: case IR_STORE_ELEM: case IR_SET_FIELD:
+        case IR_ALLOC: case IR_ALLOC_ARRAY: case IR_ALLOC_FRAME_ARRAY:
+        case IR_LABEL: case IR_JUMP: case IR_JUMP_IF: case IR_JUMP_IF_NOT:
+        case IR_CALL: case IR_TAIL_CALL: case IR_RETURN: case IR_PRINT: case IR_INPUT:
+        case IR_VECTOR_LOOP:
+        case IR_FUNC_START: case IR_FUNC_END: case IR_PARAM:
+        case IR_PUSH: case IR_POP: case IR_CLASS_DEF:
+        case IR_PROFILE_COUNT: case IR_PROFILE_WRITE:
+            return true;
+        default:
+            return false;
+    }
+}
+
 /* Convert AST to IR */
 static void ir_generate_from_ast_node(IRFunction *func, ASTNode *node);
+static IRValue* ir_generate_expr(IRFunction *func, ASTNode *node);
+
+/* Append `opcode` with the given operands (ownership is taken) */
+static IRInstruction* ir_emit(IRFunction *func, IROpcode opcode, IRValue *dest,
+                              IRValue *src1, IRValue *src2) {
+    IRInstruction *instr = ir_instruction_create(opcode);
+    instr->dest = dest;
+    instr->src1 = src1;
+    instr->src2 = src2;
+    ir_function_add_instruction(func, instr);
+    return instr;
+}
+
+/* Find the stack slot of a named local (linear scan of ALLOC markers) */
+static int ir_lookup_local(IRFunction *func, const char *name) {
+    if (!name) return -1;
+    for (IRInstruction *scan = func->instructions; scan; scan = scan->next) {
+        if (scan->opcode == IR_ALLOC && scan->dest && 
+            scan->dest->name && strcmp(scan->dest->name, name) == 0) {
+            return scan->dest->data.reg_num;
+        }
+    }
+    return -1;
+}
+
+/* Top-level statements while the module is generated: functions see the
+   program's integer `const` declarations as compile-time values */
+static ASTNode *ir_top_level = NULL;
+
+static bool ir_eval_global_const(IRFunction *func, const char *name, int64_t *out, int depth);
+
+/* Fold a constant expression (integer literals, program consts, + - * / %
+   and comparisons); false when it is not a compile-time integer */
+static bool ir_eval_const_expr(IRFunction *func, ASTNode *node, int64_t *out, int depth) {
+    if (!node || depth > 32) return false;
+    if (node->type == AST_LITERAL && node->value) {
+        if (strcmp(node->value, "true") == 0 || strcmp(node->value, "false") == 0) {
+            *out = node->value[0] == 't';
+            return true;
+        }
+        const char *p = node->value;
+        if (*p == '-') p++;
+        if (*p < '0' || *p > '9') return false;
+        *out = atoll(node->value);
+        return true;
+    }
+    if (node->type == AST_IDENTIFIER) return ir_eval_global_const(func, node->value, out, depth + 1);
+    if (node->type != AST_BINARY_EXPR || !node->value) return false;
+    int64_t a, b;
+    if (!ir_eval_const_expr(func, node->left, &a, depth + 1) ||
+        !ir_eval_const_expr(func, node->right, &b, depth + 1)) {
+        return false;
+    }
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    const char *op = node->value;
+    if (strcmp(op, "+") == 0) *out = (int64_t)(ua + ub);
+    else if (strcmp(op, "-") == 0) *out = (int64_t)(ua - ub);
+    else if (strcmp(op, "*") == 0) *out = (int64_t)(ua * ub);
+    else if (strcmp(op, "/") == 0 || strcmp(op, "%") == 0) {
+        if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+        *out = op[0] == '/' ? a / b : a % b;
+    }
+    else if (strcmp(op, "==") == 0) *out = a == b;
+    else if (strcmp(op, "!=") == 0) *out = a != b;
+    else if (strcmp(op, "<") == 0) *out = a < b;
+    else if (strcmp(op, "<=") == 0) *out = a <= b;
+    else if (strcmp(op, ">") == 0) *out = a > b;
+    else if (strcmp(op, ">=") == 0) *out = a >= b;
+    else return false;
+    return true;
+}
+
+/* Declaration of program const `name` unless a local of `func` shadows
+   it (main's locals are the program's own declarations) */
+static ASTNode *ir_find_global_const(IRFunction *func, const char *name) {
+    if (!name) return NULL;
+    if (func && strcmp(func->name, "main") != 0 && ir_lookup_local(func, name) != -1) return NULL;
+    for (ASTNode *stmt = ir_top_level; stmt; stmt = stmt->next) {
+        if (stmt->type == AST_CONST_DECL && stmt->value && strcmp(stmt->value, name) == 0) return stmt;
+    }
+    return NULL;
+}
+
+static bool ir_eval_global_const(IRFunction *func, const char *name, int64_t *out, int depth) {
+    ASTNode *decl = ir_find_global_const(func, name);
+    return decl && ir_eval_const_expr(func, decl->right, out, depth);
+}
+
+/* An initializer that evaluates to the same value wherever it is lowered:
+   literals and program consts under operators */
+static bool ir_is_pure_const_expr(IRFunction *func, ASTNode *node, int depth) {
+    if (!node || depth > 32) return false;
+    switch (node->type) {
+        case AST_LITERAL:
+            return true;
+        case AST_IDENTIFIER: {
+            ASTNode *decl = ir_find_global_const(func, node->value);
+            return decl && ir_is_pure_const_expr(func, decl->right, depth + 1);
+        }
+        case AST_BINARY_EXPR:
+            return node->value && strcmp(node->value, "=") != 0 &&
+                   ir_is_pure_const_expr(func, node->left, depth + 1) &&
+                   ir_is_pure_const_expr(func, node->right, depth + 1);
+        case AST_UNARY_EXPR:
+            return ir_is_pure_const_expr(func, node->left, depth + 1);
+        default:
+            return false;
+    }
+}
+
+/* Set when a function reads a program const it cannot recompute */
+static bool ir_generation_failed = false;
+
+/* ---------- Value kinds ---------- */
+
+/* Strings and arrays of strings go through the runtime's string
+   routines; everything else is a 64-bit integer (arrays included). A
+   local's kind joins those of everything assigned to it. A function is
+   generated once per combination of argument kinds its calls pass (a
+   `name: string` annotation makes that parameter a string), so a call
+   has the kind of what its own copy of the function returns. */
+typedef enum { IR_KIND_INT, IR_KIND_STRING, IR_KIND_STRINGS } IRKind;
+
+typedef struct {
+    const char *function;      // "main" for the top-level statements
+    const ASTNode *decl;       // Its declaration (NULL for main)
+    IRKind *params;            // Argument kinds this copy is generated for
+    const char **names;
+    IRKind *kinds;
+    int count, capacity;
+    IRKind returns;
+} IRKindScope;
+
+static IRKindScope **ir_scopes = NULL;
+static int ir_scope_count = 0, ir_scope_capacity = 0;
+
+static IRKindScope* ir_scope_find(const char *function) {
+    for (int i = 0; i < ir_scope_count; i++) {
+        if (function && strcmp(ir_scopes[i]->function, function) == 0) return ir_scopes[i];
+    }
+    return NULL;
+}
+
+static IRKind ir_kind_lookup(const IRKindScope *scope, const char *name) {
+    for (int i = 0; scope && name && i < scope->count; i++) {
+        if (strcmp(scope->names[i], name) == 0) return scope->kinds[i];
+    }
+    return IR_KIND_INT;
+}
+
+static bool ir_kind_declared(const IRKindScope *scope, const char *name) {
+    for (int i = 0; name && i < scope->count; i++) {
+        if (strcmp(scope->names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+/* Widen `name` to at least `kind`; true if that changed anything */
+static bool ir_kind_join(IRKindScope *scope, const char *name, IRKind kind) {
+    if (!name) return false;
+    for (int i = 0; i < scope->count; i++) {
+        if (strcmp(scope->names[i], name) != 0) continue;
+        if (kind <= scope->kinds[i]) return false;
+        scope->kinds[i] = kind;
+        return true;
+    }
+    if (scope->count == scope->capacity) {
+        scope->capacity = scope->capacity ? scope->capacity * 2 : 16;
+        scope->names = realloc(scope->names, sizeof(char*) * scope->capacity);
+        scope->kinds = realloc(scope->kinds, sizeof(IRKind) * scope->capacity);
+    }
+    scope->names[scope->count] = name;
+    scope->kinds[scope->count++] = kind;
+    return kind != IR_KIND_INT;
+}
+
+/* New scope for `function`; a declaration's parameters take `params` */
+static IRKindScope* ir_scope_add(const char *function, const ASTNode *decl, const IRKind *params) {
+    if (ir_scope_count == ir_scope_capacity) {
+        ir_scope_capacity = ir_scope_capacity ? ir_scope_capacity * 2 : 16;
+        ir_scopes = realloc(ir_scopes, sizeof(IRKindScope*) * ir_scope_capacity);
+    }
+    IRKindScope *scope = calloc(1, sizeof(IRKindScope));
+    scope->function = strdup(function);
+    scope->decl = decl;
+    if (decl && decl->child_count > 0) {
+        scope->params = malloc(sizeof(IRKind) * decl->child_count);
+        memcpy(scope->params, params, sizeof(IRKind) * decl->child_count);
+    }
+    for (int i = 0; decl && i < decl->child_count; i++) {
+        const ASTNode *param = decl->children[i];
+        if (param && param->value) ir_kind_join(scope, param->value, params[i]);
+    }
+    ir_scopes[ir_scope_count++] = scope;
+    return scope;
+}
+
+static bool ir_is_string_literal(const ASTNode *node) {
+    return node && node->type == AST_LITERAL && node->value && node->data_type == TYPE_STRING;
+}
+
+static bool ir_is_call_to(const ASTNode *node, const char *name, int args) {
+    return node && node->type == AST_CALL_EXPR && node->value && strcmp(node->value, name) == 0 &&
+           node->child_count == args;
+}
+
+static IRKind ir_kind_of(const IRKindScope *scope, const ASTNode *node);
+
+/* Argument kinds of a call to `decl`: what the call passes, or a string
+   for a parameter annotated as one */
+static void ir_call_kinds(const IRKindScope *scope, const ASTNode *call, const ASTNode *decl, IRKind *out) {
+    for (int i = 0; i < decl->child_count; i++) {
+        const ASTNode *param = decl->children[i];
+        out[i] = param && param->data_type == TYPE_STRING ? IR_KIND_STRING
+                 : i < call->child_count ? ir_kind_of(scope, call->children[i]) : IR_KIND_INT;
+    }
+}
+
+/* Scope of the copy of the function a call from `scope` runs; NULL for
+   calls to built-ins and to functions whose copy is not known yet */
+static IRKindScope* ir_scope_of_call(const IRKindScope *scope, const ASTNode *call) {
+    IRKindScope *callee = ir_scope_find(call->value);
+    if (!callee || !callee->decl) return NULL;
+    const ASTNode *decl = callee->decl;
+    if (decl->child_count == 0) return callee;
+    IRKind *kinds = malloc(sizeof(IRKind) * decl->child_count);
+    ir_call_kinds(scope, call, decl, kinds);
+    IRKindScope *found = NULL;
+    for (int i = 0; i < ir_scope_count && !found; i++) {
+        if (ir_scopes[i]->decl == decl &&
+            memcmp(ir_scopes[i]->params, kinds, sizeof(IRKind) * decl->child_count) == 0) {
+            found = ir_scopes[i];
+        }
+    }
+    free(kinds);
+    return found;
+}
+
+static IRKind ir_kind_of(const IRKindScope *scope, const ASTNode *node) {
+    if (!node) return IR_KIND_INT;
+    switch (node->type) {
+        case AST_LITERAL:
+            return ir_is_string_literal(node) ? IR_KIND_STRING : IR_KIND_INT;
+        case AST_IDENTIFIER:
+            // A function reads a program const it does not shadow as main does
+            if (scope && scope != ir_scopes[0] && !ir_kind_declared(scope, node->value) &&
+                ir_find_global_const(NULL, node->value)) {
+                return ir_kind_lookup(ir_scopes[0], node->value);
+            }
+            return ir_kind_lookup(scope, node->value);
+        case AST_BINARY_EXPR:
+            if (node->value && strcmp(node->value, "=") == 0) return ir_kind_of(scope, node->right);
+            if (node->value && strcmp(node->value, "+") == 0 &&
+                (ir_kind_of(scope, node->left) == IR_KIND_STRING || ir_kind_of(scope, node->right) == IR_KIND_STRING)) {
+                return IR_KIND_STRING;
+            }
+            return IR_KIND_INT;
+        case AST_ARRAY_LITERAL:
+            for (int i = 0; i < node->child_count; i++) {
+                if (ir_kind_of(scope, node->children[i]) == IR_KIND_STRING) return IR_KIND_STRINGS;
+            }
+            return IR_KIND_INT;
+        case AST_ARRAY_ACCESS:
+            return ir_kind_of(scope, node->left) == IR_KIND_INT ? IR_KIND_INT : IR_KIND_STRING;
+        case AST_CALL_EXPR: {
+            if (ir_is_call_to(node, "str", 1)) return IR_KIND_STRING;
+            if (ir_is_call_to(node, "append", 2)) {
+                IRKind array = ir_kind_of(scope, node->children[0]);
+                return array == IR_KIND_STRINGS || ir_kind_of(scope, node->children[1]) == IR_KIND_STRING
+                       ? IR_KIND_STRINGS : array;
+            }
+            IRKindScope *callee = ir_scope_of_call(scope, node);
+            return callee ? callee->returns : IR_KIND_INT;
+        }
+        default:
+            return IR_KIND_INT;
+    }
+}
+
+static bool ir_infer_node(IRKindScope *scope, const ASTNode *node);
+
+static bool ir_infer_list(IRKindScope *scope, const ASTNode *node) {
+    bool changed = false;
+    for (; node; node = node->next) changed |= ir_infer_node(scope, node);
+    return changed;
+}
+
+/* One pass of kind inference over a statement or expression (nested
+   function declarations excepted); true if a kind widened or a call
+   needs a new copy of its function */
+static bool ir_infer_node(IRKindScope *scope, const ASTNode *node) {
+    if (node->type == AST_FUNCTION_DECL) return false;
+    bool changed = false;
+    if (node->type == AST_VAR_DECL || node->type == AST_CONST_DECL) {
+        const ASTNode *init = node->child_count > 0 ? node->children[0] : node->right;
+        changed |= ir_kind_join(scope, node->value, ir_kind_of(scope, init));
+    } else if (node->type == AST_BINARY_EXPR && node->value && strcmp(node->value, "=") == 0 &&
+               node->left && node->left->type == AST_IDENTIFIER) {
+        changed |= ir_kind_join(scope, node->left->value, ir_kind_of(scope, node->right));
+    } else if (ir_is_call_to(node, "append", 2) && node->children[0]->type == AST_IDENTIFIER) {
+        changed |= ir_kind_join(scope, node->children[0]->value, ir_kind_of(scope, node));
+    } else if (node->type == AST_CALL_EXPR) {
+        IRKindScope *callee = ir_scope_find(node->value);
+        if (callee && callee->decl && !ir_scope_of_call(scope, node)) {
+            // First call with these argument kinds: a copy named name.kindN
+            IRKind *kinds = malloc(sizeof(IRKind) * callee->decl->child_count);
+            ir_call_kinds(scope, node, callee->decl, kinds);
+            int copies = 0;
+            for (int i = 0; i < ir_scope_count; i++) copies += ir_scopes[i]->decl == callee->decl;
+            char name[256];
+            snprintf(name, sizeof(name), "%s.kind%d", callee->function, copies);
+            ir_scope_add(name, callee->decl, kinds);
+            free(kinds);
+            changed = true;
+        }
+    } else if (node->type == AST_RETURN_STMT) {
+        const ASTNode *expr = node->left ? node->left : (node->child_count > 0 ? node->children[0] : NULL);
+        IRKind kind = ir_kind_of(scope, expr);
+        if (kind > scope->returns) {
+            scope->returns = kind;
+            changed = true;
+        }
+    }
+    changed |= ir_infer_list(scope, node->left);
+    changed |= ir_infer_list(scope, node->right);
+    changed |= ir_infer_list(scope, node->condition);
+    changed |= ir_infer_list(scope, node->body);
+    for (int i = 0; i < node->child_count; i++) {
+        if (node->children[i]) changed |= ir_infer_list(scope, node->children[i]);
+    }
+    return changed;
+}
+
+/* Kinds of every function copy's locals, widened until nothing changes.
+   Each declared function starts with one copy under its own name for
+   integer arguments (strings where annotated). */
+static void ir_infer_program_kinds(ASTNode *root) {
+    ir_scope_add("main", NULL, NULL);
+    for (ASTNode *stmt = root->left; stmt; stmt = stmt->next) {
+        if (stmt->type != AST_FUNCTION_DECL || !stmt->value) continue;
+        IRKind *kinds = calloc(stmt->child_count + 1, sizeof(IRKind));
+        for (int i = 0; i < stmt->child_count; i++) {
+            ASTNode *param = stmt->children[i];
+            kinds[i] = param && param->data_type == TYPE_STRING ? IR_KIND_STRING : IR_KIND_INT;
+        }
+        ir_scope_add(stmt->value, stmt, kinds);
+        free(kinds);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (ASTNode *stmt = root->left; stmt; stmt = stmt->next) {
+            if (stmt->type != AST_FUNCTION_DECL) changed |= ir_infer_node(ir_scopes[0], stmt);
+        }
+        for (int i = 1; i < ir_scope_count; i++) {
+            changed |= ir_infer_list(ir_scopes[i], ir_scopes[i]->decl->body);
+        }
+    }
+}
+
+static void ir_free_program_kinds(void) {
+    for (int i = 0; i < ir_scope_count; i++) {
+        free((char*)ir_scopes[i]->function);
+        free(ir_scopes[i]->params);
+        free(ir_scopes[i]->names);
+        free(ir_scopes[i]->kinds);
+        free(ir_scopes[i]);
+    }
+    free(ir_scopes);
+    ir_scopes = NULL;
+    ir_scope_count = ir_scope_capacity = 0;
+}
+
+static IRKind ir_expr_kind(IRFunction *func, const ASTNode *node) {
+    return ir_kind_of(ir_scope_find(func->name), node);
+}
+
+/* Function `name` from declaration `decl`, appended to the module */
+static void ir_generate_function(IRModule *module, const char *name, ASTNode *decl) {
+    IRFunction *func = ir_function_create(name, IR_TYPE_INT); // TODO: return type
+
+    // Add to module linked list
+    IRFunction *last = module->functions;
+    while (last->next) last = last->next;
+    last->next = func;
+
+    // Parameters occupy the first locals (local i <- argument i)
+    for (int i = 0; decl->children && i < decl->child_count; i++) {
+        ASTNode *param = decl->children[i];
+        if (param && param->value) {
+            IRInstruction *alloc = ir_instruction_create(IR_ALLOC);
+            alloc->dest = ir_value_create_var(func->local_count++, param->value);
+            ir_function_add_instruction(func, alloc);
+            ir_function_add_param(func, ir_value_create_var(alloc->dest->data.reg_num, param->value));
+        }
+    }
+
+    if (decl->body) {
+        ir_generate_from_ast_node(func, decl->body);
+    }
+
+    // Falling off the end returns 0
+    ir_emit(func, IR_RETURN, NULL, ir_value_create_int(0), NULL);
+}
 
 IRModule* ir_generate_from_ast(void *ast_root) {
     if (!ast_root) return NULL;
@@ -150,47 +770,35 @@ IRModule* ir_generate_from_ast(void *ast_root) {
     ASTNode *root = (ASTNode*)ast_root;
     
     if (root->type == AST_PROGRAM) {
+        ir_top_level = root->left;
+        ir_infer_program_kinds(root);
         // Iterate over all top-level statements
         ASTNode *stmt = root->left;
         while (stmt) {
              if (stmt->type == AST_FUNCTION_DECL) {
-                 if (stmt->value) {
-                     // Create new function
-                     IRFunction *func = ir_function_create(stmt->value, IR_TYPE_INT); // TODO: return type
-                     
-                     // Add to module linked list
-                     IRFunction *last = module->functions;
-                     while (last->next) last = last->next;
-                     last->next = func;
-                     
-                     // Generate body
-                     if (stmt->children && stmt->child_count > 0) {
-                        for (int i = 0; i < stmt->child_count; i++) {
-                            ASTNode *param = stmt->children[i];
-                            if (param && param->value) {
-                                // Allocate stack slot for parameter (local 0 matches param 0)
-                                IRInstruction *alloc = ir_instruction_create(IR_ALLOC);
-                                alloc->dest = ir_value_create_reg(func->local_count++, IR_TYPE_INT);
-                                alloc->dest->name = strdup(param->value);
-                                ir_function_add_instruction(func, alloc);
-                                func->param_count++;
-                            }
-                        }
-                     }
-
-                     if (stmt->body) {
-                         ir_generate_from_ast_node(func, stmt->body);
-                     }
-                 }
+                 if (stmt->value) ir_generate_function(module, stmt->value, stmt);
              } else {
                  // Regular statement -> add to main
                  ir_generate_from_ast_node(main_func, stmt);
              }
              stmt = stmt->next;
         }
+        // Copies of functions for the other argument kinds their calls pass
+        for (int i = 1; i < ir_scope_count; i++) {
+            if (strcmp(ir_scopes[i]->function, ir_scopes[i]->decl->value) != 0) {
+                ir_generate_function(module, ir_scopes[i]->function, (ASTNode*)ir_scopes[i]->decl);
+            }
+        }
+        ir_top_level = NULL;
+        ir_free_program_kinds();
     } else {
         ir_generate_from_ast_node(main_func, root);
     }
+    if (ir_generation_failed) {
+        ir_generation_failed = false;
+        ir_module_free(module);
+        return NULL;
+    }
     
     // Add return 0 to main if not present
     IRInstruction *ret_instr = ir_instruction_create(IR_RETURN);
@@ -201,25 +809,310 @@ IRModule* ir_generate_from_ast(void *ast_root) {
     return module;
 }
 
+/* Map a binary operator token to its IR opcode */
+static IROpcode ir_binary_opcode(const char *op) {
+    if (!op) return IR_ADD;
+    if (strcmp(op, "+") == 0) return IR_ADD;
+    if (strcmp(op, "-") == 0) return IR_SUB;
+    if (strcmp(op, "*") == 0) return IR_MUL;
+    if (strcmp(op, "/") == 0) return IR_DIV;
+    if (strcmp(op, "%") == 0) return IR_MOD;
+    if (strcmp(op, ">") == 0) return IR_GT;
+    if (strcmp(op, "<") == 0) return IR_LT;
+    if (strcmp(op, ">=") == 0) return IR_GE;
+    if (strcmp(op, "<=") == 0) return IR_LE;
+    if (strcmp(op, "==") == 0) return IR_EQ;
+    if (strcmp(op, "!=") == 0) return IR_NE;
+    if (strcmp(op, "&&") == 0) return IR_AND;
+    if (strcmp(op, "||") == 0) return IR_OR;
+    return IR_ADD;
+}
+
+/* Text of a literal print() argument as a string constant: a string
+   literal with its escapes decoded, or a float in the shortest form that
+   reads back as the same double. NULL for anything else. */
+static IRValue* ir_print_literal(const ASTNode *node) {
+    if (!node || node->type != AST_LITERAL || !node->value) return NULL;
+    const char *value = node->value;
+    size_t length = strlen(value);
+    if (ir_is_string_literal(node)) {
+        char *text = malloc(length + 1);
+        size_t n = 0;
+        for (size_t i = 0; i < length; i++) {
+            char c = value[i];
+            if (c == '\\' && i + 1 < length) {
+                c = value[++i];
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+                else if (c == 'r') c = '\r';
+            }
+            text[n++] = c;
+        }
+        text[n] = '\0';
+        IRValue *string = ir_value_create_string(text);
+        free(text);
+        return string;
+    }
+    if (!strchr(value, '.') || value[0] < '0' || value[0] > '9') return NULL;
+    double number = strtod(value, NULL);
+    char text[40];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(text, sizeof(text), "%.*g", precision, number);
+        if (strtod(text, NULL) == number) break;
+    }
+    if (!strpbrk(text, ".en")) strcat(text, ".0");
+    return ir_value_create_string(text);
+}
+
+/* dest = runtime routine `name` applied to `a` and `b` (if any): a call
+   to a `__sub_` label, which native code and the VM provide */
+static IRValue* ir_emit_runtime_call(IRFunction *func, const char *name, IRValue *a, IRValue *b) {
+    IRInstruction *call = ir_instruction_create(IR_CALL);
+    ir_instruction_add_arg(call, a);
+    if (b) ir_instruction_add_arg(call, b);
+    call->dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+    call->src1 = ir_value_create_label(name);
+    ir_function_add_instruction(func, call);
+    return ir_value_clone(call->dest);
+}
+
+/* A string operand: integers are converted to their decimal text */
+static IRValue* ir_generate_string(IRFunction *func, ASTNode *node) {
+    IRValue *value = ir_generate_expr(func, node);
+    if (ir_expr_kind(func, node) == IR_KIND_STRING) return value;
+    return ir_emit_runtime_call(func, "__sub_str_from_int", value, NULL);
+}
+
+/* Value of `node` stored where a `kind` is expected (a string's text for
+   an integer in a string's place) */
+static IRValue* ir_generate_as(IRFunction *func, ASTNode *node, IRKind kind) {
+    return kind == IR_KIND_STRING ? ir_generate_string(func, node) : ir_generate_expr(func, node);
+}
+
+static IRKind ir_element_kind(IRFunction *func, const ASTNode *array) {
+    return ir_expr_kind(func, array) == IR_KIND_STRINGS ? IR_KIND_STRING : IR_KIND_INT;
+}
+
+static void ir_emit_print(IRFunction *func, ASTNode *arg) {
+    IRValue *text = ir_print_literal(arg);
+    if (!text && ir_expr_kind(func, arg) == IR_KIND_STRING) {
+        ir_value_free(ir_emit_runtime_call(func, "__sub_print_str", ir_generate_expr(func, arg), NULL));
+        return;
+    }
+    ir_emit(func, IR_PRINT, NULL, text ? text : ir_generate_expr(func, arg), NULL);
+}
+
+/* `+` and comparisons with a string operand: concatenation and
+   lexicographic byte order; NULL for anything else */
+static IRValue* ir_generate_string_binary(IRFunction *func, ASTNode *node) {
+    const char *op = node->value;
+    if (ir_expr_kind(func, node->left) != IR_KIND_STRING && ir_expr_kind(func, node->right) != IR_KIND_STRING) {
+        return NULL;
+    }
+    IROpcode compare = ir_binary_opcode(op);
+    bool concat = strcmp(op, "+") == 0;
+    if (!concat && (compare < IR_EQ || compare > IR_GE)) return NULL;
+
+    IRValue *lhs = ir_generate_string(func, node->left);
+    IRValue *rhs = ir_generate_string(func, node->right);
+    if (concat) return ir_emit_runtime_call(func, "__sub_str_concat", lhs, rhs);
+    bool equality = compare == IR_EQ || compare == IR_NE;
+    IRValue *order = ir_emit_runtime_call(func, equality ? "__sub_str_equal" : "__sub_str_compare", lhs, rhs);
+    if (compare == IR_EQ) return order;
+    // equal: 1 when equal, so != is == 0; compare: <0, 0, >0 against 0
+    IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+    ir_emit(func, compare == IR_NE ? IR_EQ : compare, dest, order, ir_value_create_int(0));
+    return ir_value_clone(dest);
+}
+
+/* Generate IR for an expression; returns a value owned by the caller
+   (a fresh register reference or a constant) */
+static IRValue* ir_generate_expr(IRFunction *func, ASTNode *node) {
+    if (!node) return ir_value_create_int(0);
+    
+    switch (node->type) {
+        case AST_LITERAL: {
+            if (ir_is_string_literal(node)) {
+                IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_STRING);
+                ir_emit(func, IR_CONST_STRING, dest, ir_print_literal(node), NULL);
+                return ir_value_clone(dest);
+            }
+            // Load constant
+            int64_t value = 0;
+            if (node->value) {
+                if (strcmp(node->value, "true") == 0) value = 1;
+                else if (strcmp(node->value, "false") == 0) value = 0;
+                else value = atoll(node->value);
+            }
+            IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_CONST_INT, dest, ir_value_create_int(value), NULL);
+            return ir_value_clone(dest);
+        }
+        
+        case AST_IDENTIFIER: {
+            int slot = ir_lookup_local(func, node->value);
+            int64_t value;
+            if (slot == -1 && ir_eval_global_const(func, node->value, &value, 0)) {
+                IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+                ir_emit(func, IR_CONST_INT, dest, ir_value_create_int(value), NULL);
+                return ir_value_clone(dest);
+            }
+            // Other program consts: recompute the initializer when that
+            // gives main's value, since functions cannot reach main's locals
+            ASTNode *decl = slot == -1 ? ir_find_global_const(func, node->value) : NULL;
+            if (decl && ir_is_pure_const_expr(func, decl->right, 0)) {
+                return ir_generate_expr(func, decl->right);
+            }
+            if (decl) {
+                fprintf(stderr, "Error: Function %s reads const %s, whose value is only known at run time\n",
+                        func->name, node->value);
+                ir_generation_failed = true;
+                return ir_value_create_int(0);
+            }
+            if (slot == -1) {
+                fprintf(stderr, "Warning: Undefined variable %s in IR generation\n", node->value);
+                return ir_value_create_int(0);
+            }
+            IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_LOAD, dest, ir_value_create_var(slot, node->value), NULL);
+            return ir_value_clone(dest);
+        }
+        
+        case AST_BINARY_EXPR: {
+            // Check for assignment (=)
+            if (node->value && strcmp(node->value, "=") == 0) {
+                // Left side must be identifier
+                if (node->left && node->left->type == AST_IDENTIFIER && node->left->value) {
+                    int slot = ir_lookup_local(func, node->left->value);
+                    if (slot != -1) {
+                        IRValue *value = ir_generate_as(func, node->right, ir_expr_kind(func, node->left));
+                        IRValue *result = ir_value_clone(value);
+                        ir_emit(func, IR_STORE, ir_value_create_var(slot, node->left->value), value, NULL);
+                        return result;
+                    }
+                    fprintf(stderr, "Warning: Assignment to undefined variable %s\n", node->left->value);
+                }
+                if (node->left && node->left->type == AST_ARRAY_ACCESS &&
+                    ir_expr_kind(func, node->left->left) == IR_KIND_STRING) {
+                    fprintf(stderr, "Warning: Strings are immutable; assignment to a character ignored\n");
+                    return ir_value_create_int(0);
+                }
+                if (node->left && node->left->type == AST_ARRAY_ACCESS) {
+                    // a[i] = v: array and index are evaluated before the value
+                    IRValue *array = ir_generate_expr(func, node->left->left);
+                    IRValue *index = ir_generate_expr(func, node->left->right);
+                    IRValue *value = ir_generate_as(func, node->right, ir_element_kind(func, node->left->left));
+                    IRValue *result = ir_value_clone(value);
+                    IRInstruction *store = ir_emit(func, IR_STORE_ELEM, NULL, array, index);
+                    ir_instruction_add_arg(store, value);
+                    return result;
+                }
+                return ir_value_create_int(0);
+            }
+            
+            IRValue *string = node->value ? ir_generate_string_binary(func, node) : NULL;
+            if (string) return string;
+            IRValue *lhs = ir_generate_expr(func, node->left);
+            IRValue *rhs = ir_generate_expr(func, node->right);
+            IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, ir_binary_opcode(node->value), dest, lhs, rhs);
+            return ir_value_clone(dest);
+        }
+        
+        case AST_ARRAY_LITERAL: {
+            // Fresh array, then each element stored in order
+            IRValue *array = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_POINTER);
+            ir_emit(func, IR_ALLOC_ARRAY, array, ir_value_create_int(node->child_count), NULL);
+            for (int i = 0; i < node->child_count; i++) {
+                IRValue *elem = ir_generate_as(func, node->children[i], ir_element_kind(func, node));
+                IRInstruction *store = ir_emit(func, IR_STORE_ELEM, NULL, ir_value_clone(array),
+                                               ir_value_create_int(i));
+                ir_instruction_add_arg(store, elem);
+            }
+            return ir_value_clone(array);
+        }
+        
+        case AST_ARRAY_ACCESS: {
+            IRValue *array = ir_generate_expr(func, node->left);
+            IRValue *index = ir_generate_expr(func, node->right);
+            if (ir_expr_kind(func, node->left) == IR_KIND_STRING) {
+                // s[i]: the one-character string at byte i
+                return ir_emit_runtime_call(func, "__sub_str_at", array, index);
+            }
+            IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_LOAD_ELEM, dest, array, index);
+            return ir_value_clone(dest);
+        }
+        
+        case AST_CALL_EXPR: {
+            if (node->value && strcmp(node->value, "array") == 0 && node->child_count == 1) {
+                // array(n): n zero-initialized elements
+                IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_POINTER);
+                ir_emit(func, IR_ALLOC_ARRAY, dest, ir_generate_expr(func, node->children[0]), NULL);
+                return ir_value_clone(dest);
+            }
+            if (node->value && strcmp(node->value, "len") == 0 && node->child_count == 1) {
+                IRValue *dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+                ir_emit(func, IR_ARRAY_LEN, dest, ir_generate_expr(func, node->children[0]), NULL);
+                return ir_value_clone(dest);
+            }
+            if (ir_is_call_to(node, "str", 1)) {
+                return ir_generate_string(func, node->children[0]);
+            }
+            if (ir_is_call_to(node, "append", 2)) {
+                // append(a, x): a with x added, grown in place while it has room
+                IRValue *array = ir_generate_expr(func, node->children[0]);
+                return ir_emit_runtime_call(func, "__sub_array_append", array,
+                                            ir_generate_as(func, node->children[1], ir_element_kind(func, node)));
+            }
+            if (node->value && strcmp(node->value, "print") == 0) {
+                // Check children array (legacy/multi-arg), then left (enhanced parser single arg)
+                ASTNode *arg = node->child_count > 0 ? node->children[0] : node->left;
+                ir_emit_print(func, arg);
+                for (int i = 1; i < node->child_count; i++) {
+                    ir_emit_print(func, node->children[i]);
+                }
+                return ir_value_create_int(0);
+            }
+            
+            // Generic function call to the copy for these argument kinds:
+            // evaluate arguments left to right (an integer passed to a
+            // parameter annotated or assigned as a string becomes its text)
+            IRKindScope *callee = ir_scope_of_call(ir_scope_find(func->name), node);
+            IRInstruction *call = ir_instruction_create(IR_CALL);
+            for (int i = 0; i < node->child_count; i++) {
+                const ASTNode *param = callee && callee->decl && i < callee->decl->child_count
+                                       ? callee->decl->children[i] : NULL;
+                IRKind kind = param ? ir_kind_lookup(callee, param->value) : IR_KIND_INT;
+                if (kind == IR_KIND_STRINGS && ir_expr_kind(func, node->children[i]) != kind) {
+                    fprintf(stderr, "Warning: Parameter %s of %s is passed both string arrays and other values\n",
+                            param->value, node->value);
+                }
+                ir_instruction_add_arg(call, ir_generate_as(func, node->children[i], kind));
+            }
+            call->dest = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            call->src1 = ir_value_create_label(callee ? callee->function : node->value ? node->value : "");
+            ir_function_add_instruction(func, call);
+            return ir_value_clone(call->dest);
+        }
+        
+        default:
+            // Not an expression the native backend understands
+            ir_generate_from_ast_node(func, node);
+            return ir_value_create_int(0);
+    }
+}
+
 /* Generate IR from AST node (recursive) */
 static void ir_generate_from_ast_node(IRFunction *func, ASTNode *node) {
     if (!node) return;
     
     switch (node->type) {
         case AST_PROGRAM:
-            // fprintf(stderr, "DEBUG: Visiting AST_PROGRAM (left=%p, children=%d)\n", node->left, node->child_count);
             // Process linked list of statements (via node->left)
-            // Process statements
             for (ASTNode *stmt = node->left; stmt != NULL; stmt = stmt->next) {
-                if (stmt->type == AST_FUNCTION_DECL) {
-                    if (stmt->value) {
-                         IRFunction *new_func = ir_function_create(stmt->value, IR_TYPE_INT);
-                         // Add to module (we need to pass module to this function or link it)
-                         // Helper needed: ir_module_add_function(module, new_func)
-                         // Since we don't have 'module' arg here, we might need to change signature.
-                         // But wait, ir_generate_from_ast creates the module.
-                    }
-                } else {
+                // Nested function declarations are lifted at top level only
+                if (stmt->type != AST_FUNCTION_DECL) {
                     ir_generate_from_ast_node(func, stmt);
                 }
             }
@@ -230,272 +1123,170 @@ static void ir_generate_from_ast_node(IRFunction *func, ASTNode *node) {
             break;
 
         case AST_RETURN_STMT: {
-            if (node->left) ir_generate_from_ast_node(func, node->left);
-            else if (node->child_count > 0) ir_generate_from_ast_node(func, node->children[0]);
-            else {
-                // Return 0 if void
-                IRInstruction *zero = ir_instruction_create(IR_CONST_INT);
-                zero->dest = ir_value_create_reg(func->reg_count++, IR_TYPE_INT);
-                zero->src1 = ir_value_create_int(0);
-                ir_function_add_instruction(func, zero);
-            }
-            
-            IRInstruction *ret = ir_instruction_create(IR_RETURN);
-            // Use the last register as return value
-            ret->src1 = ir_value_create_reg(func->reg_count - 1, IR_TYPE_INT); 
-            ir_function_add_instruction(func, ret);
+            ASTNode *expr = node->left;
+            if (!expr && node->child_count > 0) expr = node->children[0];
+            IRKindScope *scope = ir_scope_find(func->name);
+            IRValue *value = expr ? ir_generate_as(func, expr, scope ? scope->returns : IR_KIND_INT)
+                                  : ir_value_create_int(0);
+            ir_emit(func, IR_RETURN, NULL, value, NULL);
             break;
         }
             
-        case AST_VAR_DECL: {
-            // Variable declaration: allocate space
-            IRInstruction *alloc = ir_instruction_create(IR_ALLOC);
-            alloc->dest = ir_value_create_reg(func->local_count++, IR_TYPE_INT);
-            alloc->dest->name = node->value ? strdup(node->value) : NULL;
-            ir_function_add_instruction(func, alloc);
+        case AST_VAR_DECL:
+        case AST_CONST_DECL: {
+            // Variable/constant declaration: allocate space
+            int slot = func->local_count++;
+            ir_emit(func, IR_ALLOC, ir_value_create_var(slot, node->value), NULL, NULL);
             
             // If there's an initializer, store it
-            if (node->child_count > 0 || node->right) {
-                if (node->child_count > 0)
-                    ir_generate_from_ast_node(func, node->children[0]);
-                else
-                    ir_generate_from_ast_node(func, node->right);
-                
-                IRInstruction *store = ir_instruction_create(IR_STORE);
-                store->dest = alloc->dest;
-                ir_function_add_instruction(func, store);
+            ASTNode *init = node->child_count > 0 ? node->children[0] : node->right;
+            if (init) {
+                IRValue *value = ir_generate_as(func, init, ir_kind_lookup(ir_scope_find(func->name), node->value));
+                ir_emit(func, IR_STORE, ir_value_create_var(slot, node->value), value, NULL);
             }
             break;
         }
             
         case AST_CALL_EXPR:
-            if (node->value && strcmp(node->value, "print") == 0) {
-                // Generate code for arguments
-                // Check children array (legacy/multi-arg)
-                for (int i = 0; i < node->child_count; i++) {
-                    ir_generate_from_ast_node(func, node->children[i]);
-                }
-                // Check left (enhanced parser single arg)
-                if (node->child_count == 0 && node->left) {
-                    ir_generate_from_ast_node(func, node->left);
-                }
-                
-                IRInstruction *print = ir_instruction_create(IR_PRINT);
-                ir_function_add_instruction(func, print);
-            } else {
-                // Generic function call
-                // Generate arguments (pushing them to stack/regs)
-                for (int i = 0; i < node->child_count; i++) {
-                    ir_generate_from_ast_node(func, node->children[i]);
-                    // Result of arg is in last reg. Push it?
-                    // Yes, consistency: expr leaves result in reg. We PUSH it to save for call.
-                    IRInstruction *push = ir_instruction_create(IR_PUSH);
-                    ir_function_add_instruction(func, push);
+            if (ir_is_call_to(node, "append", 2) && node->children[0]->type == AST_IDENTIFIER) {
+                // append(v, x) on its own stores the result back into v
+                int slot = ir_lookup_local(func, node->children[0]->value);
+                if (slot != -1) {
+                    ir_emit(func, IR_STORE, ir_value_create_var(slot, node->children[0]->value),
+                            ir_generate_expr(func, node), NULL);
+                    break;
                 }
-                
-                IRInstruction *call = ir_instruction_create(IR_CALL);
-                call->dest = ir_value_create_label(node->value);
-                call->src1 = ir_value_create_int(node->child_count); // Store arg count
-                ir_function_add_instruction(func, call);
-                
-                // Result of call is in RAX. Put it in a new register for subsequent use.
-                IRInstruction *move_ret = ir_instruction_create(IR_ADD); // Hack: use ADD 0 to move? Or define IR_MOVE/IR_COPY.
-                // Or just assume result is implicit. But our IR uses explicit regs.
-                // Let's create a dummy instruction that signifies "result of call".
-                // Actually, if we use RAX, we can just treat it as a source.
-                // But let's assume we want to use it.
-                // For now, let's leave it in RAX (implicit).
             }
+            ir_value_free(ir_generate_expr(func, node));
             break;
-            
-        case AST_BINARY_EXPR: {
-            // Check for assignment (=)
-            if (node->value && strcmp(node->value, "=") == 0) {
-                // Left side must be identifier
-                if (node->left && node->left->type == AST_IDENTIFIER && node->left->value) {
-                    // Find variable register
-                     int reg_num = -1;
-                    IRInstruction *scan = func->instructions;
-                    while (scan) {
-                        if (scan->opcode == IR_ALLOC && scan->dest && 
-                            scan->dest->name && strcmp(scan->dest->name, node->left->value) == 0) {
-                            reg_num = scan->dest->data.reg_num;
-                            break;
-                        }
-                        scan = scan->next;
-                    }
-                    
-                    if (reg_num != -1) {
-                        // Generate right side (value)
-                        if (node->right) ir_generate_from_ast_node(func, node->right);
-                        
-                        // Store result to variable
-                        IRInstruction *store = ir_instruction_create(IR_STORE);
-                        store->dest = ir_value_create_reg(reg_num, IR_TYPE_INT);
-                        ir_function_add_instruction(func, store);
-                    } else {
-                        fprintf(stderr, "Warning: Assignment to undefined variable %s\n", node->left->value);
-                    }
-                }
-                break;
-            }
 
-            // Generate left operand
-            if (node->left) ir_generate_from_ast_node(func, node->left);
-            
-            // Push left result (RAX) to stack
-            IRInstruction *push = ir_instruction_create(IR_PUSH);
-            ir_function_add_instruction(func, push);
-            
-            // Generate right operand
-            if (node->right) ir_generate_from_ast_node(func, node->right);
-            
-            // Determine operation
-            IROpcode op = IR_ADD;
-            if (node->value) {
-                if (strcmp(node->value, "+") == 0) op = IR_ADD;
-                else if (strcmp(node->value, "-") == 0) op = IR_SUB;
-                else if (strcmp(node->value, "*") == 0) op = IR_MUL;
-                else if (strcmp(node->value, "/") == 0) op = IR_DIV;
-                else if (strcmp(node->value, ">") == 0) op = IR_GT;
-                else if (strcmp(node->value, "<") == 0) op = IR_LT;
-                else if (strcmp(node->value, ">=") == 0) op = IR_GE;
-                else if (strcmp(node->value, "<=") == 0) op = IR_LE;
-                else if (strcmp(node->value, "==") == 0) op = IR_EQ;
-                else if (strcmp(node->value, "!=") == 0) op = IR_NE;
-            }
-            
-            IRInstruction *bin_op = ir_instruction_create(op);
-            bin_op->dest = ir_value_create_reg(func->reg_count++, IR_TYPE_INT);
-            ir_function_add_instruction(func, bin_op);
-            break;
-        }
-            
-        case AST_LITERAL: {
-            // Load constant
-            IRInstruction *load_const = ir_instruction_create(IR_CONST_INT);
-            load_const->dest = ir_value_create_reg(func->reg_count++, IR_TYPE_INT);
-            if (node->value) {
-                load_const->src1 = ir_value_create_int(atoll(node->value));
-            } else {
-                load_const->src1 = ir_value_create_int(0);
-            }
-            ir_function_add_instruction(func, load_const);
+        case AST_BINARY_EXPR:
+        case AST_LITERAL:
+        case AST_IDENTIFIER:
+        case AST_ARRAY_LITERAL:
+        case AST_ARRAY_ACCESS:
+            // Expression statement: evaluate for side effects
+            ir_value_free(ir_generate_expr(func, node));
             break;
-        }
             
         case AST_IF_STMT: {
+            // A condition on program consts selects its arm at compile time
+            int64_t known;
+            if (ir_eval_const_expr(func, node->condition, &known, 0)) {
+                ASTNode *arm = known ? node->body : node->right;
+                if (arm) ir_generate_from_ast_node(func, arm);
+                break;
+            }
+
             // Generate condition
-            ir_generate_from_ast_node(func, node->condition);
-            
-            // Assume the result of condition is in the last register
-            IRValue *cond_reg = ir_value_create_reg(func->reg_count - 1, IR_TYPE_INT);
+            IRValue *cond = ir_generate_expr(func, node->condition);
             
             // Create labels
-            char label_else[32], label_end[32];
-            static int label_counter = 0;
-            snprintf(label_else, sizeof(label_else), "L_ELSE_%d", label_counter);
-            snprintf(label_end, sizeof(label_end), "L_END_%d", label_counter++);
+            IRValue *label_else = ir_value_create_unique_label("L_ELSE");
+            IRValue *label_end = ir_value_create_unique_label("L_END");
             
             // Jump to else if condition is false (0)
-            IRInstruction *jump_if_false = ir_instruction_create(IR_JUMP_IF_NOT);
-            jump_if_false->src1 = cond_reg;
-            jump_if_false->dest = ir_value_create_label(node->right ? label_else : label_end);
-            ir_function_add_instruction(func, jump_if_false);
+            ir_emit(func, IR_JUMP_IF_NOT, ir_value_clone(node->right ? label_else : label_end), cond, NULL);
             
             // Generate 'then' block
             ir_generate_from_ast_node(func, node->body);
             
             // Jump to end
-            IRInstruction *jump_end = ir_instruction_create(IR_JUMP);
-            jump_end->dest = ir_value_create_label(label_end);
-            ir_function_add_instruction(func, jump_end);
+            ir_emit(func, IR_JUMP, ir_value_clone(label_end), NULL, NULL);
             
             // Generate 'else' block if it exists
             if (node->right) {
-                IRInstruction *label_instr = ir_instruction_create(IR_LABEL);
-                label_instr->dest = ir_value_create_label(label_else);
-                ir_function_add_instruction(func, label_instr);
-                
+                ir_emit(func, IR_LABEL, ir_value_clone(label_else), NULL, NULL);
                 ir_generate_from_ast_node(func, node->right);
             }
             
             // End label
-            IRInstruction *label_end_instr = ir_instruction_create(IR_LABEL);
-            label_end_instr->dest = ir_value_create_label(label_end);
-            ir_function_add_instruction(func, label_end_instr);
+            ir_emit(func, IR_LABEL, ir_value_clone(label_end), NULL, NULL);
+            ir_value_free(label_else);
+            ir_value_free(label_end);
             break;
         }
             
         case AST_WHILE_STMT: {
             // Create labels
-            char label_start[32], label_end[32];
-            static int loop_counter = 0;
-            snprintf(label_start, sizeof(label_start), "L_LOOP_%d", loop_counter);
-            snprintf(label_end, sizeof(label_end), "L_LOOP_END_%d", loop_counter++);
+            IRValue *label_start = ir_value_create_unique_label("L_LOOP");
+            IRValue *label_end = ir_value_create_unique_label("L_LOOP_END");
             
             // Start label
-            IRInstruction *label_start_instr = ir_instruction_create(IR_LABEL);
-            label_start_instr->dest = ir_value_create_label(label_start);
-            ir_function_add_instruction(func, label_start_instr);
-            
-            // Generate condition
-            ir_generate_from_ast_node(func, node->condition);
-            IRValue *cond_reg = ir_value_create_reg(func->reg_count - 1, IR_TYPE_INT);
+            ir_emit(func, IR_LABEL, ir_value_clone(label_start), NULL, NULL);
             
             // Jump to end if condition is false
-            IRInstruction *jump_if_false = ir_instruction_create(IR_JUMP_IF_NOT);
-            jump_if_false->src1 = cond_reg;
-            jump_if_false->dest = ir_value_create_label(label_end);
-            ir_function_add_instruction(func, jump_if_false);
+            IRValue *cond = ir_generate_expr(func, node->condition);
+            ir_emit(func, IR_JUMP_IF_NOT, ir_value_clone(label_end), cond, NULL);
             
             // Generate body
             ir_generate_from_ast_node(func, node->body);
             
             // Jump back to start
-            IRInstruction *jump_loop = ir_instruction_create(IR_JUMP);
-            jump_loop->dest = ir_value_create_label(label_start);
-            ir_function_add_instruction(func, jump_loop);
+            ir_emit(func, IR_JUMP, ir_value_clone(label_start), NULL, NULL);
             
             // End label
-            IRInstruction *label_end_instr = ir_instruction_create(IR_LABEL);
-            label_end_instr->dest = ir_value_create_label(label_end);
-            ir_function_add_instruction(func, label_end_instr);
+            ir_emit(func, IR_LABEL, ir_value_clone(label_end), NULL, NULL);
+            ir_value_free(label_start);
+            ir_value_free(label_end);
             break;
         }
 
-        case AST_BLOCK:
-            // Process block statements
-            for (ASTNode *stmt = node->body; stmt != NULL; stmt = stmt->next) {
-                ir_generate_from_ast_node(func, stmt);
+        case AST_FOR_STMT: {
+            // for v in range(n) / range(a, b): v counts up by one
+            ASTNode *range = node->child_count > 0 ? node->children[0] : NULL;
+            if (!range || range->type != AST_RANGE_EXPR || !node->value) {
+                fprintf(stderr, "Warning: Only range() for-loops are supported natively\n");
+                break;
             }
-            break;
-            
-        case AST_IDENTIFIER: {
-            // Find variable declaration to get its register index
-            // Simple linear scan of instructions for now
-            int reg_num = -1;
-            IRInstruction *scan = func->instructions;
-            while (scan) {
-                if (scan->opcode == IR_ALLOC && scan->dest && 
-                    scan->dest->name && strcmp(scan->dest->name, node->value) == 0) {
-                    reg_num = scan->dest->data.reg_num;
-                    break;
-                }
-                scan = scan->next;
+            int slot = ir_lookup_local(func, node->value);
+            if (slot == -1) {
+                slot = func->local_count++;
+                ir_emit(func, IR_ALLOC, ir_value_create_var(slot, node->value), NULL, NULL);
             }
             
-            if (reg_num != -1) {
-                IRInstruction *load = ir_instruction_create(IR_LOAD);
-                load->dest = ir_value_create_reg(func->reg_count++, IR_TYPE_INT); // Temporary result reg
-                load->src1 = ir_value_create_reg(reg_num, IR_TYPE_INT); // Source variable reg
-                ir_function_add_instruction(func, load);
-            } else {
-                fprintf(stderr, "Warning: Undefined variable %s in IR generation\n", node->value);
+            IRValue *start = range->right ? ir_generate_expr(func, range->left) : ir_value_create_int(0);
+            IRValue *end = ir_generate_expr(func, range->right ? range->right : range->left);
+            ir_emit(func, IR_STORE, ir_value_create_var(slot, node->value), start, NULL);
+            
+            IRValue *label_start = ir_value_create_unique_label("L_FOR");
+            IRValue *label_end = ir_value_create_unique_label("L_FOR_END");
+            
+            IRInstruction *header = ir_emit(func, IR_LABEL, ir_value_clone(label_start), NULL, NULL);
+            if (node->child_count > 1 && node->children[1] && node->children[1]->value) {
+                header->unroll_hint = atoi(node->children[1]->value);
             }
+            
+            // Exit once v >= end (end is evaluated once, before the loop)
+            IRValue *iv = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_LOAD, iv, ir_value_create_var(slot, node->value), NULL);
+            IRValue *cond = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_LT, cond, ir_value_clone(iv), end);
+            ir_emit(func, IR_JUMP_IF_NOT, ir_value_clone(label_end), ir_value_clone(cond), NULL);
+            
+            ir_generate_from_ast_node(func, node->body);
+            
+            // v = v + 1
+            IRValue *cur = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_LOAD, cur, ir_value_create_var(slot, node->value), NULL);
+            IRValue *next = ir_value_create_reg(ir_function_new_reg(func), IR_TYPE_INT);
+            ir_emit(func, IR_ADD, next, ir_value_clone(cur), ir_value_create_int(1));
+            ir_emit(func, IR_STORE, ir_value_create_var(slot, node->value), ir_value_clone(next), NULL);
+            
+            ir_emit(func, IR_JUMP, ir_value_clone(label_start), NULL, NULL);
+            ir_emit(func, IR_LABEL, ir_value_clone(label_end), NULL, NULL);
+            ir_value_free(label_start);
+            ir_value_free(label_end);
             break;
         }
 
+        case AST_BLOCK:
+            // Process block statements
+            for (ASTNode *stmt = node->body; stmt != NULL; stmt = stmt->next) {
+                ir_generate_from_ast_node(func, stmt);
+            }
+            break;
+
         default:
             // Recurse on children if not handled above
             for (int i = 0; i < node->child_count; i++) {
@@ -505,13 +1296,125 @@ static void ir_generate_from_ast_node(IRFunction *func, ASTNode *node) {
     }
 }
 
-/* Optimize IR (placeholder) */
+void ir_options_init(IROptions *opts, int level) {
+    opts->level = level;
+    opts->inline_threshold = -1;
+    opts->vector_width = 2;  // SSE2 is baseline on x86-64
+    opts->passes = NULL;
+    opts->time_passes = false;
+    opts->verify = false;
+}
+
+/* Optimize IR */
 void ir_optimize(IRModule *module) {
-    // TODO: Implement optimizations
-    // - Dead code elimination
-    // - Constant folding
-    // - Common subexpression elimination
-    (void)module;
+    IROptions opts;
+    ir_options_init(&opts, 2);
+    ir_optimize_with_options(module, &opts);
+}
+
+bool ir_optimize_with_options(IRModule *module, const IROptions *opts) {
+    if (!module || !opts) return false;
+    
+    IRPassManager *pm = ir_pass_manager_create(opts);
+    bool ok = true;
+    if (opts->passes) {
+        ok = ir_pass_manager_parse_pipeline(pm, opts->passes);
+    } else {
+        ir_pass_manager_add_default_pipeline(pm, opts->level);
+    }
+    if (ok) ok = ir_pass_manager_run(pm, module);
+    if (opts->time_passes) ir_pass_manager_print_timing(pm, stderr);
+    ir_pass_manager_free(pm);
+    return ok;
+}
+
+/* Print a single operand */
+static void ir_print_value(const IRValue *val) {
+    if (!val) {
+        printf("_");
+        return;
+    }
+    switch (val->kind) {
+        case IR_VAL_CONST:
+            if (val->type == IR_TYPE_STRING) printf("\"%s\"", val->data.string_val);
+            else if (val->type == IR_TYPE_FLOAT) printf("%g", val->data.float_val);
+            else printf("%" PRId64, val->data.int_val);
+            break;
+        case IR_VAL_REG:
+            printf("%%%d", val->data.reg_num);
+            break;
+        case IR_VAL_VAR:
+            printf("$%d", val->data.reg_num);
+            if (val->name) printf("(%s)", val->name);
+            break;
+        case IR_VAL_LABEL:
+            printf("%s", val->data.label);
+            break;
+    }
+}
+
+/* Print a single instruction */
+void ir_print_instruction(const IRInstruction *instr) {
+    switch (instr->opcode) {
+        case IR_LABEL:
+            printf("  %s:", instr->dest ? instr->dest->data.label : "?");
+            if (instr->unroll_hint) printf("  unroll(%d)", instr->unroll_hint);
+            if (instr->profile_count >= 0) printf("  count %" PRId64, instr->profile_count);
+            break;
+        case IR_JUMP:
+        case IR_JUMP_IF:
+        case IR_JUMP_IF_NOT:
+            printf("    %s ", ir_opcode_name(instr->opcode));
+            if (instr->src1) {
+                ir_print_value(instr->src1);
+                printf(", ");
+            }
+            ir_print_value(instr->dest);
+            break;
+        case IR_STORE:
+            printf("    STORE ");
+            ir_print_value(instr->dest);
+            printf(", ");
+            ir_print_value(instr->src1);
+            break;
+        case IR_ALLOC:
+            printf("    ALLOC ");
+            ir_print_value(instr->dest);
+            break;
+        default:
+            printf("    ");
+            if (instr->dest) {
+                ir_print_value(instr->dest);
+                printf(" = ");
+            }
+            printf("%s", ir_opcode_name(instr->opcode));
+            if (instr->src1) {
+                printf(" ");
+                ir_print_value(instr->src1);
+            }
+            if (instr->src2) {
+                printf(", ");
+                ir_print_value(instr->src2);
+            }
+            if (instr->arg_count > 0) {
+                printf(" (");
+                for (int i = 0; i < instr->arg_count; i++) {
+                    if (i > 0) printf(", ");
+                    ir_print_value(instr->args[i]);
+                }
+                printf(")");
+            }
+            if (instr->in_bounds) printf("  in bounds");
+            if (instr->vector) {
+                printf("  x%d, %d nodes, %d stores", instr->vector->width,
+                       instr->vector->node_count, instr->vector->store_count);
+                if (instr->vector->reduce != IR_NOT) {
+                    printf(", reduce %s", ir_opcode_name(instr->vector->reduce));
+                }
+            }
+            break;
+    }
+    printf("\n");
 }
 
 /* Print IR for debugging */
@@ -526,49 +1429,12 @@ void ir_print(IRModule *module) {
         printf("Function: %s\n", func->name);
         printf("  Locals: %d\n", func->local_count);
         printf("  Registers: %d\n", func->reg_count);
+        if (func->frame_words > 0) printf("  Frame arrays: %d words\n", func->frame_words);
+        if (func->profile_entry >= 0) printf("  Profile: %" PRId64 " calls\n", func->profile_entry);
         printf("  Instructions:\n");
         
-        IRInstruction *instr = func->instructions;
-        while (instr) {
-            printf("    ");
-            switch (instr->opcode) {
-                case IR_ADD: printf("ADD"); break;
-                case IR_SUB: printf("SUB"); break;
-                case IR_MUL: printf("MUL"); break;
-                case IR_DIV: printf("DIV"); break;
-                case IR_CONST_INT: 
-                    printf("CONST_INT %" PRId64, instr->src1->data.int_val); 
-                    break;
-                case IR_ALLOC:
-                    printf("ALLOC %d", instr->dest->data.reg_num);
-                    if (instr->dest->name) printf(" (%s)", instr->dest->name);
-                    break;
-                case IR_STORE:
-                    printf("STORE %d", instr->dest->data.reg_num);
-                    break;
-                case IR_LOAD:
-                    printf("LOAD %d", instr->src1 ? instr->src1->data.reg_num : -1);
-                    break;
-                case IR_PUSH: printf("PUSH"); break;
-                case IR_POP: printf("POP"); break;
-                case IR_PRINT: printf("PRINT"); break;
-                case IR_RETURN: printf("RETURN"); break;
-                case IR_EQ: printf("EQ"); break;
-                case IR_NE: printf("NE"); break;
-                case IR_LT: printf("LT"); break;
-                case IR_LE: printf("LE"); break;
-                case IR_GT: printf("GT"); break;
-                case IR_GE: printf("GE"); break;
-                case IR_JUMP: printf("JUMP"); break;
-                case IR_JUMP_IF_NOT: printf("JUMP_IF_NOT"); break;
-                case IR_LABEL: printf("LABEL %s", instr->dest->data.label); break;
-                case IR_CALL: 
-                    printf("CALL %s (args=%" PRId64 ")", instr->dest->data.label, instr->src1 ? instr->src1->data.int_val : 0); 
-                    break;
-                default: printf("UNKNOWN (%d)", instr->opcode); break;
-            }
-            printf("\n");
-            instr = instr->next;
+        for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+            ir_print_instruction(instr);
         }
         
         func = func->next;
@@ -18,6 +18,10 @@ typedef enum {
     IR_MUL,
     IR_DIV,
     IR_MOD,
+    IR_SHL,        // Shift left (strength-reduced multiply)
+    IR_SHR,        // Logical shift right
+    IR_SAR,        // Arithmetic shift right
+    IR_MULHI,      // High 64 bits of signed 128-bit product (magic division)
     
     // Comparison
     IR_EQ,
@@ -37,8 +41,10 @@ typedef enum {
     IR_STORE,
     IR_ALLOC,
     IR_ALLOC_ARRAY,
+    IR_ALLOC_FRAME_ARRAY, // Non-escaping array in the function's frame
     IR_LOAD_ELEM,
     IR_STORE_ELEM,
+    IR_ARRAY_LEN,  // Element count of an array
     
     // Control flow
     IR_LABEL,
@@ -46,6 +52,8 @@ typedef enum {
     IR_JUMP_IF,
     IR_JUMP_IF_NOT,
     IR_CALL,
+    IR_TAIL_CALL,  // Call in tail position: frame released, callee returns to our caller
+    IR_VECTOR_LOOP, // SIMD loop over array elements (see IRVectorKernel)
     IR_RETURN,
     
     // Data
@@ -65,6 +73,8 @@ typedef enum {
     IR_CAST,
     IR_PUSH,   // Push generic register/value to stack
     IR_POP,    // Pop to generic register
+    IR_PROFILE_COUNT, // Bump training-run counter src1 (--profile-generate)
+    IR_PROFILE_WRITE, // Write the training-run counters to the profile file
     IR_PHI,
     IR_NEW,    // Allocate object (new ClassName)
     IR_GET_FIELD, // Get object field (obj.field)
@@ -91,6 +101,43 @@ typedef enum {
     IR_VAL_LABEL
 } IRValueKind;
 
+/*
+ * Operand conventions (three-address form):
+ *   - Every value-producing instruction defines exactly one virtual
+ *     register in `dest` (IR_VAL_REG). A register is never redefined.
+ *   - Operands in src1/src2/args are virtual registers or constants.
+ *   - Mutable variables are stack locals (IR_VAL_VAR, slot in reg_num),
+ *     only touched by IR_ALLOC, IR_LOAD (dest <- src1) and
+ *     IR_STORE (dest <- src1). Parameter i lives in local i.
+ *   - IR_CALL: dest = result register, src1 = callee label, args[].
+ *     IR_TAIL_CALL has no dest and ends the function like IR_RETURN.
+ *   - IR_JUMP/IR_LABEL carry the label in dest; IR_JUMP_IF(_NOT)
+ *     branch to dest on src1.
+ *   - Arrays are pointers to 64-bit elements with the element count
+ *     stored just before element 0. IR_ALLOC_ARRAY: dest = new zeroed
+ *     array of src1 elements; IR_LOAD_ELEM: dest = src1[src2];
+ *     IR_STORE_ELEM (no dest): src1[src2] = args[0];
+ *     IR_ARRAY_LEN: dest = element count of src1. An element access
+ *     outside [0, count) stops the program with an error unless the
+ *     instruction is marked in_bounds. Heap arrays also keep their
+ *     capacity before the count so __sub_array_append can grow them.
+ *   - Strings are pointers to immutable bytes with the length stored
+ *     before them and a NUL after; IR_ARRAY_LEN gives the length.
+ *     IR_CONST_STRING: dest = the literal in src1. String operations
+ *     are IR_CALLs to reserved __sub_* runtime labels.
+ *   - IR_ALLOC_FRAME_ARRAY: like IR_ALLOC_ARRAY for a constant src1,
+ *     stored in the frame at word offset src2 of the function's
+ *     frame_words area; the array dies when the function returns.
+ *   - IR_PRINT (no dest) writes src1 and a newline: an integer, or a
+ *     string constant holding the text of a string or float literal.
+ *   - IR_PROFILE_COUNT (no dest): src1 = constant counter index;
+ *     IR_PROFILE_WRITE (no operands) precedes the entry function's
+ *     returns in instrumented builds.
+ *   - IR_VECTOR_LOOP runs `vector` for i in [args[0], args[1]) in
+ *     steps of its lane count; further args are the kernel's operands.
+ *     dest receives the reduction result, if any.
+ */
+
 /* IR Value */
 typedef struct IRValue {
     IRType type;
@@ -105,12 +152,54 @@ typedef struct IRValue {
     char *name;           // Optional variable name
 } IRValue;
 
+/* Vector kernel node: one SIMD value per iteration (lanes i .. i+width-1) */
+typedef enum {
+    IR_VEC_ELEM,     // array operand `arg` at [i + offset]
+    IR_VEC_SCALAR,   // operand `arg` broadcast to every lane
+    IR_VEC_INDEX,    // i + offset in each lane
+    IR_VEC_OP        // `op` (ADD/SUB/MUL/SHL/SHR) of nodes a and b
+} IRVecNodeKind;
+
+typedef struct {
+    IRVecNodeKind kind;
+    IROpcode op;
+    int a, b;             // Operand nodes (IR_VEC_OP)
+    int arg;              // Instruction arg index (IR_VEC_ELEM/IR_VEC_SCALAR)
+    int offset;           // Index offset (IR_VEC_ELEM/IR_VEC_INDEX)
+} IRVecNode;
+
+/* Element store `array arg`[i + offset] = node, after node `after` - 1
+   has been evaluated */
+typedef struct {
+    int arg;
+    int offset;
+    int node;
+    int after;
+} IRVecStore;
+
+typedef struct IRVectorKernel {
+    int width;            // Lanes of 64-bit integers: 2 (SSE2) or 4 (AVX2)
+    IRVecNode *nodes;     // In evaluation order
+    int node_count;
+    IRVecStore *stores;   // In program order
+    int store_count;
+    IROpcode reduce;      // IR_ADD (sum), IR_LT (min), IR_GT (max); IR_NOT if none
+    int reduce_node;      // Value folded into the reduction each iteration
+    int reduce_init;      // Arg index of the incoming accumulator value
+} IRVectorKernel;
+
 /* IR Instruction */
 typedef struct IRInstruction {
     IROpcode opcode;
     IRValue *dest;        // Destination (result)
     IRValue *src1;        // First operand
     IRValue *src2;        // Second operand
+    IRValue **args;       // Call arguments (IR_CALL)
+    int arg_count;
+    int unroll_hint;      // Loop header IR_LABEL: source unroll(N) factor (0 = none)
+    int64_t profile_count; // Training-run executions of its block (-1: no profile)
+    bool in_bounds;       // IR_LOAD_ELEM/IR_STORE_ELEM: index proven in range, no check
+    IRVectorKernel *vector; // IR_VECTOR_LOOP body
     char *comment;        // Optional comment for debugging
     struct IRInstruction *next;
 } IRInstruction;
@@ -124,6 +213,8 @@ typedef struct IRFunction {
     IRInstruction *instructions;  // Linked list of instructions
     int local_count;      // Number of local variables
     int reg_count;        // Number of virtual registers used
+    int frame_words;      // Frame area for IR_ALLOC_FRAME_ARRAY (64-bit words)
+    int64_t profile_entry; // Training-run calls (-1: no profile)
     struct IRFunction *next;
 } IRFunction;
 
@@ -151,6 +242,8 @@ typedef struct IRModule {
     char **string_literals;  // Global string constants
     int string_count;
     char *entry_point;       // Name of main function
+    int profile_counters;    // IR_PROFILE_COUNT counters (0: not instrumented)
+    uint64_t profile_checksum; // Shape of the uninstrumented module (ir_profile.h)
 } IRModule;
 
 /* IR Builder API */
@@ -158,15 +251,34 @@ IRModule* ir_module_create(void);
 void ir_module_free(IRModule *module);
 
 IRFunction* ir_function_create(const char *name, IRType return_type);
+void ir_function_free(IRFunction *func);
 void ir_function_add_param(IRFunction *func, IRValue *param);
 void ir_function_add_instruction(IRFunction *func, IRInstruction *instr);
+void ir_function_insert_after(IRFunction *func, IRInstruction *after, IRInstruction *instr);
+void ir_function_remove_after(IRFunction *func, IRInstruction *prev, IRInstruction *instr);
+int ir_function_new_reg(IRFunction *func);
+int ir_function_new_local(IRFunction *func, const char *name);
 
 IRInstruction* ir_instruction_create(IROpcode opcode);
+void ir_instruction_add_arg(IRInstruction *instr, IRValue *arg);
+void ir_instruction_free(IRInstruction *instr);
+IRVectorKernel* ir_vector_kernel_clone(const IRVectorKernel *kernel);
+void ir_vector_kernel_free(IRVectorKernel *kernel);
 IRValue* ir_value_create_int(int64_t value);
 IRValue* ir_value_create_float(double value);
 IRValue* ir_value_create_string(const char *value);
 IRValue* ir_value_create_reg(int reg_num, IRType type);
+IRValue* ir_value_create_var(int slot, const char *name);
 IRValue* ir_value_create_label(const char *label);
+IRValue* ir_value_create_unique_label(const char *prefix);
+IRValue* ir_value_clone(const IRValue *val);
+void ir_value_free(IRValue *val);
+
+/* Opcode helpers */
+const char* ir_opcode_name(IROpcode opcode);
+bool ir_opcode_is_binary(IROpcode opcode);
+bool ir_opcode_has_side_effects(IROpcode opcode);
+bool ir_value_is_const_int(const IRValue *val, int64_t value);
 
 /* Convert AST to IR */
 IRModule* ir_generate_from_ast(void *ast_root);
@@ -177,10 +289,25 @@ void ir_class_add_field(IRClass *cls, const char *field_name, IRType type);
 IRClass* ir_class_lookup(IRModule *module, const char *name);
 void ir_class_free(IRClass *cls);
 
-/* Optimize IR */
+/* Optimization options (set by the native driver from -O / --inline-threshold / --march /
+   --passes / --time-passes / --verify-ir) */
+typedef struct {
+    int level;               // 0-3, as -O0 .. -O3
+    int inline_threshold;    // Inlining budget in IR instructions (-1: level default)
+    int vector_width;        // 64-bit lanes for the loop vectorizer (0: off, 2: SSE2, 4: AVX2)
+    const char *passes;      // Comma-separated pipeline replacing the -O default (NULL: default)
+    bool time_passes;        // Report per-pass time and instruction counts on stderr
+    bool verify;             // Verify the IR before the first and after every pass
+} IROptions;
+
+/* Optimize IR through the pass manager (ir_pass.h). Returns false if
+   the pipeline is invalid or verification failed. */
+void ir_options_init(IROptions *opts, int level);
 void ir_optimize(IRModule *module);
+bool ir_optimize_with_options(IRModule *module, const IROptions *opts);
 
 /* Print IR (for debugging) */
 void ir_print(IRModule *module);
+void ir_print_instruction(const IRInstruction *instr);
 
 #endif /* SUB_IR_H */
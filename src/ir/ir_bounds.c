@@ -0,0 +1,761 @@
+/* ========================================
+   SUB Language - Range Analysis
+   Value ranges, proven array indices, bounds-check removal
+   File: ir_bounds.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Element accesses are checked at run time unless this pass proves the
+ * index lies in [0, length). It is a forward dataflow over blocks in the
+ * style of ir_sccp. The state on each CFG edge describes every local,
+ * and every register used outside the block that defines it, with an
+ * interval and symbolic facts about another state slot:
+ *     ub:  value <= slot + off   (or the length of the array in slot)
+ *     eq:  value == slot + off
+ * Arrays also carry what is known about their length. Writing a slot
+ * drops every fact mentioning it, so no fact outlives the value it is
+ * about. Branches on comparisons refine the locals they read: past
+ * `i < len(a)` the body knows i <= len(a) - 1. Facts are mathematical:
+ * arithmetic that might wrap produces no facts at all. Blocks are
+ * revisited only when an incoming edge changes, earliest in reverse
+ * postorder first, so each loop settles before the code after it. Block
+ * exits widen after a few visits, which bounds the iteration; a function
+ * that still needs too much work keeps all its checks.
+ */
+
+#define RANGE_MIN INT64_MIN
+#define RANGE_MAX INT64_MAX
+#define BOUNDS_WIDEN_AFTER 3                    // Visits of a block before its exits widen
+#define BOUNDS_MAX_OFFSET ((int64_t)1 << 40)    // Larger symbolic offsets are dropped
+#define BOUNDS_MAX_LENGTH ((int64_t)1 << 60)    // Arrays of 8-byte elements are smaller
+#define BOUNDS_MAX_STATE (1 << 22)              // Slot states kept per function
+#define BOUNDS_MAX_WORK ((int64_t)1 << 26)      // Slot updates before giving up
+
+typedef enum { BOUND_NONE, BOUND_VALUE, BOUND_LENGTH } BoundKind;
+
+typedef struct {
+    BoundKind kind;
+    int slot;              // State slot the fact refers to
+    int64_t off;
+} Bound;
+
+typedef struct {
+    int64_t lo, hi;
+    Bound ub;              // value <= bound
+    Bound eq;              // value == bound
+    int64_t len_lo;        // Arrays: length >= len_lo
+    Bound len_eq;          // Arrays: length == bound
+} Range;
+
+typedef struct {
+    IRFunction *func;
+    IRCFG *cfg;
+    int locals;
+    int slots;             // Locals, then one per register used across blocks
+    int *reg_slot;         // Register -> slot, or -1
+    Range *out;            // Per block, per successor index: state on that edge
+    bool *reached;
+    int *visits;
+    bool *pending;         // Block: an incoming edge changed since its last visit
+    int resume;            // Lowest RPO position made pending by the current visit
+    int64_t work;          // Slot updates so far
+    IRInstruction **defs;  // Register -> defining instruction
+    Range *state;          // Scratch: slots while walking a block
+    Range *join;           // Scratch: block entry being joined
+    Range *info;           // Registers defined in the block being walked
+    int *stamp;            // info[r] is valid when stamp[r] == walk
+    int walk;
+    int *defined;          // Registers defined in this walk
+    int defined_count;
+    bool calls;            // A call may append to an array, growing it in place
+} BoundsState;
+
+static const Bound bound_none = { BOUND_NONE, -1, 0 };
+
+static Range range_unknown(void) {
+    Range r = { RANGE_MIN, RANGE_MAX, bound_none, bound_none, 0, bound_none };
+    return r;
+}
+
+static Range range_const(int64_t value) {
+    Range r = range_unknown();
+    r.lo = r.hi = value;
+    return r;
+}
+
+static bool bound_equal(Bound a, Bound b) {
+    return a.kind == b.kind && (a.kind == BOUND_NONE || (a.slot == b.slot && a.off == b.off));
+}
+
+static bool bound_same_base(Bound a, Bound b) {
+    return a.kind != BOUND_NONE && a.kind == b.kind && a.slot == b.slot;
+}
+
+static bool range_equal(const Range *a, const Range *b) {
+    return a->lo == b->lo && a->hi == b->hi && a->len_lo == b->len_lo && bound_equal(a->ub, b->ub) &&
+           bound_equal(a->eq, b->eq) && bound_equal(a->len_eq, b->len_eq);
+}
+
+static Bound bound_shift(Bound b, int64_t delta) {
+    if (b.kind == BOUND_NONE || delta > BOUNDS_MAX_OFFSET || delta < -BOUNDS_MAX_OFFSET) return bound_none;
+    b.off += delta;
+    if (b.off > BOUNDS_MAX_OFFSET || b.off < -BOUNDS_MAX_OFFSET) return bound_none;
+    return b;
+}
+
+/* Lengths are preferred: they are what index checks compare against */
+static Bound bound_better(Bound cur, Bound cand) {
+    if (cand.kind == BOUND_NONE) return cur;
+    if (cur.kind == BOUND_NONE) return cand;
+    if (bound_same_base(cur, cand)) return cand.off < cur.off ? cand : cur;
+    return cand.kind == BOUND_LENGTH && cur.kind == BOUND_VALUE ? cand : cur;
+}
+
+static void range_normalize(Range *r) {
+    if (r->ub.kind == BOUND_NONE) r->ub = r->eq;
+}
+
+static void range_forget(Range *r, int slot) {
+    if (r->ub.slot == slot) r->ub = bound_none;
+    if (r->eq.slot == slot) r->eq = bound_none;
+    if (r->len_eq.slot == slot) r->len_eq = bound_none;
+}
+
+/* `slot` is about to change: facts about its old value are void */
+static void bounds_kill(BoundsState *st, int slot) {
+    st->work += st->slots;
+    for (int s = 0; s < st->slots; s++) range_forget(&st->state[s], slot);
+    for (int i = 0; i < st->defined_count; i++) range_forget(&st->info[st->defined[i]], slot);
+}
+
+static int reg_of(const IRValue *val) {
+    return val && val->kind == IR_VAL_REG ? val->data.reg_num : -1;
+}
+
+static Range value_of(const BoundsState *st, const IRValue *val) {
+    if (!val) return range_unknown();
+    if (val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING && val->type != IR_TYPE_FLOAT) {
+        return range_const(val->data.int_val);
+    }
+    int reg = reg_of(val);
+    if (reg < 0 || reg >= st->func->reg_count) return range_unknown();
+    if (st->reg_slot[reg] >= 0) {
+        // The register is the current value of its slot
+        int slot = st->reg_slot[reg];
+        Range r = st->state[slot];
+        if (r.eq.kind == BOUND_NONE) {
+            Bound self = { BOUND_VALUE, slot, 0 };
+            r.eq = self;
+        }
+        range_normalize(&r);
+        return r;
+    }
+    return st->stamp[reg] == st->walk ? st->info[reg] : range_unknown();
+}
+
+static void set_reg(BoundsState *st, const IRValue *dest, Range r) {
+    int reg = reg_of(dest);
+    if (reg < 0 || reg >= st->func->reg_count) return;
+    range_normalize(&r);
+    int slot = st->reg_slot[reg];
+    if (slot >= 0) {
+        // A new value of a register redefined in a loop
+        bounds_kill(st, slot);
+        range_forget(&r, slot);
+        st->state[slot] = r;
+        return;
+    }
+    st->info[reg] = r;
+    if (st->stamp[reg] != st->walk) {
+        st->stamp[reg] = st->walk;
+        st->defined[st->defined_count++] = reg;
+    }
+}
+
+/* ---------- Arithmetic ---------- */
+
+/* Can a sum with this symbolic maximum not exceed INT64_MAX? */
+static bool bound_caps(Bound b) {
+    return (b.kind == BOUND_LENGTH && b.off <= BOUNDS_MAX_OFFSET) || (b.kind == BOUND_VALUE && b.off <= 0);
+}
+
+static Range range_add(const Range *a, const Range *b) {
+    Range r = range_unknown();
+    bool lo_ok = a->lo != RANGE_MIN && b->lo != RANGE_MIN && !__builtin_add_overflow(a->lo, b->lo, &r.lo);
+    bool hi_ok = a->hi != RANGE_MAX && b->hi != RANGE_MAX && !__builtin_add_overflow(a->hi, b->hi, &r.hi);
+    if (!lo_ok) r.lo = RANGE_MIN;
+    if (!hi_ok) r.hi = RANGE_MAX;
+
+    // Symbolic maxima: one side's bound plus the other side's maximum
+    Bound ub = bound_none, eq = bound_none;
+    if (b->hi != RANGE_MAX) ub = bound_better(ub, bound_shift(a->ub, b->hi));
+    if (a->hi != RANGE_MAX) ub = bound_better(ub, bound_shift(b->ub, a->hi));
+    if (b->lo == b->hi) eq = bound_shift(a->eq, b->lo);
+    else if (a->lo == a->hi) eq = bound_shift(b->eq, a->lo);
+
+    // Wrapping needs a positive (negative) operand and no finite limit
+    bool may_wrap_up = !hi_ok && a->hi > 0 && b->hi > 0 && !bound_caps(ub);
+    bool may_wrap_down = !lo_ok && a->lo < 0 && b->lo < 0;
+    if (may_wrap_up || may_wrap_down) return range_unknown();
+    r.ub = ub;
+    r.eq = eq;
+    range_normalize(&r);
+    return r;
+}
+
+static Range range_negate(const Range *a) {
+    Range r = range_unknown();
+    if (a->hi != RANGE_MAX && a->hi != RANGE_MIN) r.lo = -a->hi;
+    if (a->lo != RANGE_MIN) r.hi = -a->lo;
+    if (a->lo == RANGE_MIN && a->hi != RANGE_MAX) return range_unknown();   // -INT64_MIN wraps
+    return r;
+}
+
+static Range range_mul(const Range *a, const Range *b) {
+    if ((a->lo == 0 && a->hi == 0) || (b->lo == 0 && b->hi == 0)) return range_const(0);
+    if (a->lo == RANGE_MIN || a->hi == RANGE_MAX || b->lo == RANGE_MIN || b->hi == RANGE_MAX) {
+        return range_unknown();
+    }
+    int64_t corners[4];
+    if (__builtin_mul_overflow(a->lo, b->lo, &corners[0]) || __builtin_mul_overflow(a->lo, b->hi, &corners[1]) ||
+        __builtin_mul_overflow(a->hi, b->lo, &corners[2]) || __builtin_mul_overflow(a->hi, b->hi, &corners[3])) {
+        return range_unknown();
+    }
+    Range r = range_const(corners[0]);
+    for (int i = 1; i < 4; i++) {
+        if (corners[i] < r.lo) r.lo = corners[i];
+        if (corners[i] > r.hi) r.hi = corners[i];
+    }
+    return r;
+}
+
+static Range eval_binary(IROpcode op, const Range *a, const Range *b) {
+    Range r = range_unknown();
+    switch (op) {
+        case IR_ADD:
+            return range_add(a, b);
+        case IR_SUB: {
+            if (b->lo == b->hi && b->lo != RANGE_MIN) {
+                Range negated = range_const(-b->lo);
+                return range_add(a, &negated);
+            }
+            Range negated = range_negate(b);
+            return range_add(a, &negated);
+        }
+        case IR_MUL:
+            return range_mul(a, b);
+        case IR_AND:
+            // Masking with a non-negative value
+            if (a->lo >= 0 || b->lo >= 0) {
+                r.lo = 0;
+                r.hi = RANGE_MAX;
+                if (a->lo >= 0) r.hi = a->hi;
+                if (b->lo >= 0 && b->hi < r.hi) r.hi = b->hi;
+            }
+            return r;
+        case IR_MOD: {
+            // The result has the dividend's sign and is smaller than the divisor
+            if (b->lo <= 0 || b->hi == RANGE_MAX) return r;
+            int64_t limit = b->hi - 1;
+            r.lo = a->lo >= 0 ? 0 : -limit;
+            r.hi = a->lo >= 0 && a->hi < limit ? a->hi : limit;
+            return r;
+        }
+        case IR_DIV:
+            if (a->lo >= 0 && b->lo > 0) {
+                r.lo = 0;
+                r.hi = a->hi == RANGE_MAX ? RANGE_MAX : a->hi / b->lo;
+            }
+            return r;
+        case IR_SAR:
+            if (a->lo >= 0 && b->lo == b->hi && b->lo >= 0 && b->lo < 64) {
+                r.lo = 0;
+                r.hi = a->hi >> b->lo;
+            }
+            return r;
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            r.lo = 0;
+            r.hi = 1;
+            return r;
+        default:
+            return r;
+    }
+}
+
+/* ---------- Transfer ---------- */
+
+/* Slot naming an array value, looking through one copy (`b = a`) so that
+   lengths read through either name agree; -1 if none */
+static int array_slot(const BoundsState *st, const Range *array) {
+    if (array->eq.kind != BOUND_VALUE || array->eq.off != 0) return -1;
+    Bound copy = st->state[array->eq.slot].eq;
+    return copy.kind == BOUND_VALUE && copy.off == 0 ? copy.slot : array->eq.slot;
+}
+
+static void transfer(BoundsState *st, IRInstruction *instr) {
+    if (ir_opcode_is_binary(instr->opcode)) {
+        Range a = value_of(st, instr->src1);
+        Range b = value_of(st, instr->src2);
+        set_reg(st, instr->dest, eval_binary(instr->opcode, &a, &b));
+        return;
+    }
+    switch (instr->opcode) {
+        case IR_STORE: {
+            if (!instr->dest || instr->dest->kind != IR_VAL_VAR || instr->dest->data.reg_num >= st->locals) return;
+            int slot = instr->dest->data.reg_num;
+            Range value = value_of(st, instr->src1);
+            bounds_kill(st, slot);
+            range_forget(&value, slot);
+            st->state[slot] = value;
+            return;
+        }
+        case IR_LOAD: {
+            if (!instr->src1 || instr->src1->kind != IR_VAL_VAR || instr->src1->data.reg_num >= st->locals) break;
+            int slot = instr->src1->data.reg_num;
+            Range r = st->state[slot];
+            r.ub = bound_better(r.ub, r.eq);
+            Bound self = { BOUND_VALUE, slot, 0 };
+            r.eq = self;
+            set_reg(st, instr->dest, r);
+            return;
+        }
+        case IR_CONST_INT:
+        case IR_MOVE:
+            set_reg(st, instr->dest, value_of(st, instr->src1));
+            return;
+        case IR_NOT: {
+            Range r = range_const(0);
+            r.hi = 1;
+            set_reg(st, instr->dest, r);
+            return;
+        }
+        case IR_ARRAY_LEN: {
+            Range base = value_of(st, instr->src1);
+            Range r = range_unknown();
+            r.lo = base.len_lo > 0 ? base.len_lo : 0;
+            r.hi = BOUNDS_MAX_LENGTH;
+            // The allocated length is only a lower bound once arrays may grow
+            Bound allocated = st->calls ? bound_none : base.len_eq;
+            int array = array_slot(st, &base);
+            if (array >= 0) {
+                Bound length = { BOUND_LENGTH, array, 0 };
+                r.eq = length;
+            } else {
+                r.eq = allocated;
+            }
+            r.ub = allocated.kind != BOUND_NONE ? allocated : r.eq;
+            set_reg(st, instr->dest, r);
+            return;
+        }
+        case IR_ALLOC_ARRAY: {
+            Range size = value_of(st, instr->src1);
+            Range r = range_unknown();
+            if (size.lo > 0) r.len_lo = size.lo;
+            r.len_eq = size.eq;
+            set_reg(st, instr->dest, r);
+            return;
+        }
+        case IR_ALLOC_FRAME_ARRAY: {
+            Range r = range_unknown();
+            if (instr->src1 && instr->src1->kind == IR_VAL_CONST) r.len_lo = instr->src1->data.int_val;
+            set_reg(st, instr->dest, r);
+            return;
+        }
+        default:
+            break;
+    }
+    if (instr->dest && instr->dest->kind == IR_VAL_REG) set_reg(st, instr->dest, range_unknown());
+}
+
+/* Does `index` lie in [0, length of `base`)? */
+static bool index_in_bounds(const BoundsState *st, const Range *base, const Range *index) {
+    if (index->lo < 0) return false;
+    if (index->hi < base->len_lo) return true;
+    int array = array_slot(st, base);
+    const Bound facts[2] = { index->ub, index->eq };
+    for (int i = 0; i < 2; i++) {
+        Bound b = facts[i];
+        if (b.kind == BOUND_LENGTH && array >= 0 && b.slot == array && b.off <= -1) return true;
+        if (bound_same_base(b, base->len_eq) && b.off <= base->len_eq.off - 1) return true;
+    }
+    return false;
+}
+
+/* ---------- Branch refinement ---------- */
+
+static IROpcode negate_compare(IROpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GE;
+        case IR_LE: return IR_GT;
+        case IR_GT: return IR_LE;
+        case IR_GE: return IR_LT;
+        case IR_EQ: return IR_NE;
+        default: return IR_EQ;
+    }
+}
+
+static IROpcode mirror_compare(IROpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GT;
+        case IR_LE: return IR_GE;
+        case IR_GT: return IR_LT;
+        case IR_GE: return IR_LE;
+        default: return op;
+    }
+}
+
+/* Slot `t` with t + k (op) b */
+static void refine_slot(BoundsState *st, int t, int64_t k, IROpcode op, const Range *b) {
+    Range shifted = *b;
+    if (k != 0) {
+        Range delta = range_const(-k);
+        shifted = range_add(b, &delta);
+    }
+    Range *x = &st->state[t];
+    int64_t strict = op == IR_LT || op == IR_GT ? 1 : 0;
+    if (op == IR_LT || op == IR_LE || op == IR_EQ) {
+        int64_t hi;
+        if (shifted.hi != RANGE_MAX && !__builtin_sub_overflow(shifted.hi, strict, &hi) && hi < x->hi) x->hi = hi;
+        Bound cands[2] = { bound_shift(shifted.ub, -strict), bound_shift(shifted.eq, -strict) };
+        for (int i = 0; i < 2; i++) {
+            if (cands[i].slot != t) x->ub = bound_better(x->ub, cands[i]);
+        }
+    }
+    if (op == IR_GT || op == IR_GE || op == IR_EQ) {
+        int64_t lo;
+        if (shifted.lo != RANGE_MIN && !__builtin_add_overflow(shifted.lo, strict, &lo) && lo > x->lo) x->lo = lo;
+    }
+}
+
+/* Learn what `cond` being `truth` says about the slots its comparison read */
+static void refine_cond(BoundsState *st, const IRValue *cond, bool truth, int depth) {
+    int reg = reg_of(cond);
+    if (reg < 0 || reg >= st->func->reg_count || !st->defs[reg] || depth > 4) return;
+    const IRInstruction *def = st->defs[reg];
+    IROpcode op = def->opcode;
+    if (op == IR_NOT) {
+        refine_cond(st, def->src1, !truth, depth + 1);
+        return;
+    }
+    if ((op == IR_AND && truth) || (op == IR_OR && !truth)) {
+        refine_cond(st, def->src1, truth, depth + 1);
+        refine_cond(st, def->src2, truth, depth + 1);
+        return;
+    }
+    if (op != IR_LT && op != IR_LE && op != IR_GT && op != IR_GE && op != IR_EQ && op != IR_NE) return;
+    if (!truth) op = negate_compare(op);
+    if (op == IR_NE) return;
+
+    Range a = value_of(st, def->src1);
+    Range b = value_of(st, def->src2);
+    if (a.eq.kind == BOUND_VALUE) refine_slot(st, a.eq.slot, a.eq.off, op, &b);
+    if (b.eq.kind == BOUND_VALUE) refine_slot(st, b.eq.slot, b.eq.off, mirror_compare(op), &a);
+}
+
+/* ---------- Joins ---------- */
+
+/* Known minimum of a bound's base in `state` */
+static bool bound_minimum(const Range *state, Bound b, int64_t *out) {
+    if (b.kind == BOUND_LENGTH) {
+        *out = state[b.slot].len_lo > 0 ? state[b.slot].len_lo : 0;
+        return true;
+    }
+    if (b.kind == BOUND_VALUE && state[b.slot].lo != RANGE_MIN) {
+        *out = state[b.slot].lo;
+        return true;
+    }
+    return false;
+}
+
+/* Offset with which `x` (in `state`) satisfies value <= base of `b` + offset */
+static bool satisfies(const Range *x, const Range *state, Bound b, int64_t *off) {
+    if (bound_same_base(x->ub, b)) {
+        *off = x->ub.off;
+        return true;
+    }
+    if (bound_same_base(x->eq, b)) {
+        *off = x->eq.off;
+        return true;
+    }
+    int64_t minimum;
+    if (x->hi == RANGE_MAX || !bound_minimum(state, b, &minimum)) return false;
+    return !__builtin_sub_overflow(x->hi, minimum, off) && *off <= BOUNDS_MAX_OFFSET && *off >= -BOUNDS_MAX_OFFSET;
+}
+
+static Range range_join(const Range *a, const Range *sa, const Range *b, const Range *sb) {
+    Range r;
+    r.lo = a->lo < b->lo ? a->lo : b->lo;
+    r.hi = a->hi > b->hi ? a->hi : b->hi;
+    r.len_lo = a->len_lo < b->len_lo ? a->len_lo : b->len_lo;
+    r.len_eq = bound_equal(a->len_eq, b->len_eq) ? a->len_eq : bound_none;
+    r.eq = bound_equal(a->eq, b->eq) ? a->eq : bound_none;
+    r.ub = bound_none;
+    int64_t off;
+    if (a->ub.kind != BOUND_NONE && satisfies(b, sb, a->ub, &off)) {
+        r.ub = bound_better(r.ub, bound_shift(a->ub, (off > a->ub.off ? off : a->ub.off) - a->ub.off));
+    }
+    if (b->ub.kind != BOUND_NONE && satisfies(a, sa, b->ub, &off)) {
+        r.ub = bound_better(r.ub, bound_shift(b->ub, (off > b->ub.off ? off : b->ub.off) - b->ub.off));
+    }
+    range_normalize(&r);
+    return r;
+}
+
+/* Give up facts still moving after a few visits */
+static Range range_widen(const Range *old, const Range *r) {
+    Range w = *r;
+    if (w.lo < old->lo) w.lo = RANGE_MIN;
+    if (w.hi > old->hi) w.hi = RANGE_MAX;
+    if (w.len_lo < old->len_lo) w.len_lo = 0;
+    if (!bound_equal(w.ub, old->ub)) w.ub = bound_none;
+    if (!bound_equal(w.eq, old->eq)) w.eq = bound_none;
+    if (!bound_equal(w.len_eq, old->len_eq)) w.len_eq = bound_none;
+    return w;
+}
+
+static Range* edge_state(const BoundsState *st, int block, int succ) {
+    return &st->out[((size_t)block * 2 + succ) * st->slots];
+}
+
+static int succ_index(const IRBlock *from, int to) {
+    for (int i = 0; i < from->succ_count; i++) {
+        if (from->succs[i] == to) return i;
+    }
+    return -1;
+}
+
+/* Entry state of block `b` into st->state; false if no edge reaches it */
+static bool block_entry(BoundsState *st, int b) {
+    if (b == 0) {
+        for (int s = 0; s < st->slots; s++) st->state[s] = range_unknown();
+        return true;
+    }
+    const IRBlock *block = &st->cfg->blocks[b];
+    bool any = false;
+    for (int i = 0; i < block->pred_count; i++) {
+        int p = block->preds[i];
+        int k = succ_index(&st->cfg->blocks[p], b);
+        if (k < 0 || !st->reached[p * 2 + k]) continue;
+        const Range *in = edge_state(st, p, k);
+        if (!any) {
+            memcpy(st->state, in, sizeof(Range) * st->slots);
+            any = true;
+            continue;
+        }
+        st->work += st->slots;
+        for (int s = 0; s < st->slots; s++) st->join[s] = range_join(&st->state[s], st->state, &in[s], in);
+        memcpy(st->state, st->join, sizeof(Range) * st->slots);
+    }
+    return any;
+}
+
+/* Merge st->state into the state on edge (b, k); true on change. Only
+   back edges widen, so the refinement on a loop's exit test survives. */
+static bool update_edge(BoundsState *st, int b, int k) {
+    Range *out = edge_state(st, b, k);
+    if (!st->reached[b * 2 + k]) {
+        memcpy(out, st->state, sizeof(Range) * st->slots);
+        st->reached[b * 2 + k] = true;
+        return true;
+    }
+    bool changed = false;
+    const IRBlock *block = &st->cfg->blocks[b];
+    bool back_edge = st->cfg->blocks[block->succs[k]].rpo_index <= block->rpo_index;
+    bool widen = back_edge && st->visits[b] > BOUNDS_WIDEN_AFTER;
+    st->work += st->slots;
+    for (int s = 0; s < st->slots; s++) {
+        Range joined = range_join(&out[s], out, &st->state[s], st->state);
+        if (widen) joined = range_widen(&out[s], &joined);
+        if (!range_equal(&joined, &out[s])) {
+            out[s] = joined;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool state_feasible(const BoundsState *st) {
+    for (int s = 0; s < st->slots; s++) {
+        if (st->state[s].lo > st->state[s].hi) return false;
+    }
+    return true;
+}
+
+/* Block a branch in block `b` lands on */
+static int jump_target(const BoundsState *st, int b, const IRInstruction *jump) {
+    const IRBlock *block = &st->cfg->blocks[b];
+    for (int i = 0; i < block->succ_count; i++) {
+        const IRInstruction *first = st->cfg->blocks[block->succs[i]].first;
+        if (first->opcode == IR_LABEL && first->dest && jump->dest &&
+            strcmp(first->dest->data.label, jump->dest->data.label) == 0) {
+            return block->succs[i];
+        }
+    }
+    return -1;
+}
+
+/* Walk block `b`; with `mark`, flag the accesses it proves. Otherwise
+   successors whose edge state changed become pending. */
+static void visit_block(BoundsState *st, int b, bool mark) {
+    if (!block_entry(st, b)) return;
+    st->walk++;
+    st->defined_count = 0;
+    st->visits[b]++;
+    IRBlock *block = &st->cfg->blocks[b];
+    for (IRInstruction *instr = block->first;; instr = instr->next) {
+        if (mark && !instr->in_bounds && (instr->opcode == IR_LOAD_ELEM || instr->opcode == IR_STORE_ELEM)) {
+            Range base = value_of(st, instr->src1);
+            Range index = value_of(st, instr->src2);
+            instr->in_bounds = index_in_bounds(st, &base, &index);
+        }
+        transfer(st, instr);
+        if (instr == block->last) break;
+    }
+    if (mark) return;
+
+    IRInstruction *last = block->last;
+    bool branch = last->opcode == IR_JUMP_IF || last->opcode == IR_JUMP_IF_NOT;
+    int target = branch ? jump_target(st, b, last) : -1;
+    int fallthrough = b + 1;
+    Range *saved = NULL;
+    if (branch && target != fallthrough) {
+        saved = malloc(sizeof(Range) * st->slots);
+        memcpy(saved, st->state, sizeof(Range) * st->slots);
+    }
+    for (int k = 0; k < block->succ_count; k++) {
+        if (saved) {
+            memcpy(st->state, saved, sizeof(Range) * st->slots);
+            bool taken = block->succs[k] == target;
+            refine_cond(st, last->src1, taken == (last->opcode == IR_JUMP_IF), 0);
+            if (!state_feasible(st)) continue;   // The branch never goes this way
+        }
+        if (update_edge(st, b, k)) {
+            int succ = block->succs[k];
+            st->pending[succ] = true;
+            if (st->cfg->blocks[succ].rpo_index < st->resume) st->resume = st->cfg->blocks[succ].rpo_index;
+        }
+    }
+    free(saved);
+}
+
+/* ---------- Driver ---------- */
+
+/* Registers read outside their defining block get a state slot */
+static int assign_slots(BoundsState *st) {
+    int regs = st->func->reg_count;
+    int *def_block = malloc(sizeof(int) * (regs > 0 ? regs : 1));
+    for (int r = 0; r < regs; r++) def_block[r] = -1;
+    for (int b = 0; b < st->cfg->block_count; b++) {
+        for (IRInstruction *instr = st->cfg->blocks[b].first;; instr = instr->next) {
+            int reg = instr->opcode == IR_STORE ? -1 : reg_of(instr->dest);
+            if (reg >= 0 && reg < regs) {
+                def_block[reg] = b;
+                st->defs[reg] = instr;
+            }
+            if (instr == st->cfg->blocks[b].last) break;
+        }
+    }
+    int slots = st->locals;
+    for (int b = 0; b < st->cfg->block_count; b++) {
+        for (IRInstruction *instr = st->cfg->blocks[b].first;; instr = instr->next) {
+            const IRValue *uses[2] = { instr->src1, instr->src2 };
+            for (int u = 0; u < 2 + instr->arg_count; u++) {
+                int reg = reg_of(u < 2 ? uses[u] : instr->args[u - 2]);
+                if (reg >= 0 && reg < regs && def_block[reg] >= 0 && def_block[reg] != b && st->reg_slot[reg] < 0) {
+                    st->reg_slot[reg] = slots++;
+                }
+            }
+            if (instr == st->cfg->blocks[b].last) break;
+        }
+    }
+    free(def_block);
+    return slots;
+}
+
+bool ir_bounds_function(IRFunction *func) {
+    if (!func || !func->instructions) return false;
+    bool any_access = false;
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if ((instr->opcode == IR_LOAD_ELEM || instr->opcode == IR_STORE_ELEM) && !instr->in_bounds) any_access = true;
+    }
+    if (!any_access) return false;
+
+    IRCFG *cfg = ir_cfg_build(func);
+    int n = cfg->block_count;
+    int regs = func->reg_count > 0 ? func->reg_count : 1;
+    BoundsState st;
+    memset(&st, 0, sizeof(st));
+    st.func = func;
+    st.cfg = cfg;
+    st.locals = func->local_count;
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        st.calls |= instr->opcode == IR_CALL || instr->opcode == IR_TAIL_CALL;
+    }
+    st.reg_slot = malloc(sizeof(int) * regs);
+    for (int r = 0; r < regs; r++) st.reg_slot[r] = -1;
+    st.defs = calloc(regs, sizeof(IRInstruction*));
+    st.slots = assign_slots(&st);
+
+    bool fits = true;
+    for (int b = 0; b < n; b++) fits &= cfg->blocks[b].succ_count <= 2;
+    if (!fits || (int64_t)n * 2 * (st.slots + 1) > BOUNDS_MAX_STATE) {
+        free(st.reg_slot);
+        free(st.defs);
+        ir_cfg_free(cfg);
+        return false;
+    }
+
+    int slots = st.slots > 0 ? st.slots : 1;
+    st.out = malloc(sizeof(Range) * (size_t)n * 2 * slots);
+    st.reached = calloc((size_t)n * 2 + 1, sizeof(bool));
+    st.visits = calloc(n + 1, sizeof(int));
+    st.pending = calloc(n + 1, sizeof(bool));
+    st.state = malloc(sizeof(Range) * slots);
+    st.join = malloc(sizeof(Range) * slots);
+    st.info = malloc(sizeof(Range) * regs);
+    st.stamp = calloc(regs, sizeof(int));
+    st.defined = malloc(sizeof(int) * regs);
+
+    // Always resume at the earliest pending block in reverse postorder
+    st.pending[0] = true;
+    int at = 0;
+    while (at < cfg->rpo_count && st.work <= BOUNDS_MAX_WORK) {
+        int b = cfg->rpo[at];
+        if (!st.pending[b]) {
+            at++;
+            continue;
+        }
+        st.pending[b] = false;
+        st.resume = at + 1;
+        visit_block(&st, b, false);
+        at = st.resume;
+    }
+
+    int before = 0, after = 0;
+    if (st.work <= BOUNDS_MAX_WORK) {
+        for (IRInstruction *instr = func->instructions; instr; instr = instr->next) before += instr->in_bounds;
+        for (int i = 0; i < cfg->rpo_count; i++) visit_block(&st, cfg->rpo[i], true);
+        for (IRInstruction *instr = func->instructions; instr; instr = instr->next) after += instr->in_bounds;
+    }
+
+    free(st.out);
+    free(st.reached);
+    free(st.visits);
+    free(st.pending);
+    free(st.state);
+    free(st.join);
+    free(st.info);
+    free(st.stamp);
+    free(st.defined);
+    free(st.reg_slot);
+    free(st.defs);
+    ir_cfg_free(cfg);
+    return after > before;
+}
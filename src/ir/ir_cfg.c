@@ -0,0 +1,312 @@
+/* ========================================
+   SUB Language - IR Control Flow Graph
+   Implementation
+   File: ir_cfg.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool ir_instruction_is_terminator(const IRInstruction *instr) {
+    if (!instr) return false;
+    return instr->opcode == IR_JUMP || instr->opcode == IR_JUMP_IF ||
+           instr->opcode == IR_JUMP_IF_NOT || instr->opcode == IR_RETURN ||
+           instr->opcode == IR_TAIL_CALL;
+}
+
+static void cfg_add_edge(IRCFG *cfg, int from, int to) {
+    IRBlock *a = &cfg->blocks[from];
+    IRBlock *b = &cfg->blocks[to];
+    for (int i = 0; i < a->succ_count; i++) {
+        if (a->succs[i] == to) return;
+    }
+    a->succs = realloc(a->succs, sizeof(int) * (a->succ_count + 1));
+    a->succs[a->succ_count++] = to;
+    b->preds = realloc(b->preds, sizeof(int) * (b->pred_count + 1));
+    b->preds[b->pred_count++] = from;
+}
+
+static int cfg_find_label(IRCFG *cfg, const char *label) {
+    if (!label) return -1;
+    for (int i = 0; i < cfg->block_count; i++) {
+        IRInstruction *first = cfg->blocks[i].first;
+        if (first->opcode == IR_LABEL && first->dest &&
+            strcmp(first->dest->data.label, label) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Split the instruction list into basic blocks */
+static void cfg_build_blocks(IRCFG *cfg) {
+    int capacity = 16;
+    cfg->blocks = calloc(capacity, sizeof(IRBlock));
+
+    IRInstruction *prev = NULL;
+    IRBlock *current = NULL;
+    for (IRInstruction *instr = cfg->func->instructions; instr; instr = instr->next) {
+        bool leader = !current || instr->opcode == IR_LABEL ||
+                      ir_instruction_is_terminator(prev);
+        if (leader) {
+            if (cfg->block_count == capacity) {
+                capacity *= 2;
+                cfg->blocks = realloc(cfg->blocks, sizeof(IRBlock) * capacity);
+            }
+            current = &cfg->blocks[cfg->block_count];
+            memset(current, 0, sizeof(IRBlock));
+            current->id = cfg->block_count++;
+            current->first = instr;
+            current->before = prev;
+            current->idom = -1;
+            current->rpo_index = -1;
+            current->loop = -1;
+        }
+        current->last = instr;
+        current->instr_count++;
+        prev = instr;
+    }
+
+    // Wire successors
+    for (int i = 0; i < cfg->block_count; i++) {
+        IRInstruction *last = cfg->blocks[i].last;
+        bool falls_through = true;
+        if (last->opcode == IR_JUMP || last->opcode == IR_JUMP_IF ||
+            last->opcode == IR_JUMP_IF_NOT) {
+            int target = cfg_find_label(cfg, last->dest ? last->dest->data.label : NULL);
+            if (target >= 0) cfg_add_edge(cfg, i, target);
+            falls_through = last->opcode != IR_JUMP;
+        } else if (last->opcode == IR_RETURN || last->opcode == IR_TAIL_CALL) {
+            falls_through = false;
+        }
+        if (falls_through && i + 1 < cfg->block_count) {
+            cfg_add_edge(cfg, i, i + 1);
+        }
+    }
+}
+
+/* Reverse post-order over reachable blocks (iterative DFS) */
+static void cfg_compute_rpo(IRCFG *cfg) {
+    int n = cfg->block_count;
+    cfg->rpo = malloc(sizeof(int) * (n ? n : 1));
+    if (n == 0) return;
+
+    int *post = malloc(sizeof(int) * n);
+    int post_count = 0;
+    int *stack = malloc(sizeof(int) * n);
+    int *next_succ = calloc(n, sizeof(int));
+    bool *visited = calloc(n, sizeof(bool));
+    int sp = 0;
+
+    stack[sp++] = 0;
+    visited[0] = true;
+    while (sp > 0) {
+        int b = stack[sp - 1];
+        IRBlock *block = &cfg->blocks[b];
+        if (next_succ[b] < block->succ_count) {
+            int s = block->succs[next_succ[b]++];
+            if (!visited[s]) {
+                visited[s] = true;
+                stack[sp++] = s;
+            }
+        } else {
+            post[post_count++] = b;
+            sp--;
+        }
+    }
+
+    for (int i = 0; i < post_count; i++) {
+        cfg->rpo[i] = post[post_count - 1 - i];
+        cfg->blocks[cfg->rpo[i]].rpo_index = i;
+    }
+    cfg->rpo_count = post_count;
+
+    free(post);
+    free(stack);
+    free(next_succ);
+    free(visited);
+}
+
+static int cfg_intersect(IRCFG *cfg, int a, int b) {
+    while (a != b) {
+        while (cfg->blocks[a].rpo_index > cfg->blocks[b].rpo_index) a = cfg->blocks[a].idom;
+        while (cfg->blocks[b].rpo_index > cfg->blocks[a].rpo_index) b = cfg->blocks[b].idom;
+    }
+    return a;
+}
+
+/* Cooper/Harvey/Kennedy iterative dominators */
+static void cfg_compute_dominators(IRCFG *cfg) {
+    if (cfg->rpo_count == 0) return;
+    cfg->blocks[0].idom = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < cfg->rpo_count; i++) {
+            IRBlock *block = &cfg->blocks[cfg->rpo[i]];
+            int new_idom = -1;
+            for (int p = 0; p < block->pred_count; p++) {
+                int pred = block->preds[p];
+                if (cfg->blocks[pred].idom == -1) continue;
+                new_idom = new_idom == -1 ? pred : cfg_intersect(cfg, pred, new_idom);
+            }
+            if (new_idom != -1 && block->idom != new_idom) {
+                block->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool ir_cfg_dominates(const IRCFG *cfg, int a, int b) {
+    if (cfg->blocks[b].rpo_index < 0 || cfg->blocks[a].rpo_index < 0) return false;
+    while (true) {
+        if (a == b) return true;
+        if (b == 0) return false;
+        b = cfg->blocks[b].idom;
+    }
+}
+
+/* Natural loops from back edges (tail -> header, header dominates tail) */
+static void cfg_find_loops(IRCFG *cfg) {
+    int n = cfg->block_count;
+    int *worklist = malloc(sizeof(int) * (n ? n : 1));
+
+    for (int h = 0; h < n; h++) {
+        IRBlock *header = &cfg->blocks[h];
+        IRLoop *loop = NULL;
+        for (int p = 0; p < header->pred_count; p++) {
+            int tail = header->preds[p];
+            if (!ir_cfg_dominates(cfg, h, tail)) continue;
+
+            if (!loop) {
+                cfg->loops = realloc(cfg->loops, sizeof(IRLoop) * (cfg->loop_count + 1));
+                loop = &cfg->loops[cfg->loop_count++];
+                memset(loop, 0, sizeof(IRLoop));
+                loop->header = h;
+                loop->body = calloc(n, sizeof(bool));
+                loop->body[h] = true;
+                loop->block_count = 1;
+                loop->parent = -1;
+                loop->preheader = -1;
+            }
+
+            int wl = 0;
+            if (!loop->body[tail]) {
+                loop->body[tail] = true;
+                loop->block_count++;
+                worklist[wl++] = tail;
+            }
+            while (wl > 0) {
+                IRBlock *block = &cfg->blocks[worklist[--wl]];
+                for (int q = 0; q < block->pred_count; q++) {
+                    int pred = block->preds[q];
+                    if (cfg->blocks[pred].rpo_index < 0 || loop->body[pred]) continue;
+                    loop->body[pred] = true;
+                    loop->block_count++;
+                    worklist[wl++] = pred;
+                }
+            }
+        }
+    }
+    free(worklist);
+
+    // Nesting: parent is the smallest other loop containing our header
+    for (int i = 0; i < cfg->loop_count; i++) {
+        IRLoop *loop = &cfg->loops[i];
+        int best = -1;
+        for (int j = 0; j < cfg->loop_count; j++) {
+            if (i == j || !cfg->loops[j].body[loop->header]) continue;
+            if (cfg->loops[j].block_count < loop->block_count) continue;
+            if (cfg->loops[j].header == loop->header) continue;
+            if (best == -1 || cfg->loops[j].block_count < cfg->loops[best].block_count) best = j;
+        }
+        loop->parent = best;
+    }
+    for (int i = 0; i < cfg->loop_count; i++) {
+        int depth = 0;
+        for (int l = i; l != -1; l = cfg->loops[l].parent) depth++;
+        cfg->loops[i].depth = depth;
+    }
+
+    // Per-block depth and innermost loop
+    for (int b = 0; b < n; b++) {
+        IRBlock *block = &cfg->blocks[b];
+        for (int i = 0; i < cfg->loop_count; i++) {
+            if (!cfg->loops[i].body[b]) continue;
+            if (cfg->loops[i].depth > block->loop_depth) {
+                block->loop_depth = cfg->loops[i].depth;
+                block->loop = i;
+            }
+        }
+    }
+
+    // Preheaders: a single outside predecessor whose only successor is the header
+    for (int i = 0; i < cfg->loop_count; i++) {
+        IRLoop *loop = &cfg->loops[i];
+        IRBlock *header = &cfg->blocks[loop->header];
+        int outside = -1, outside_count = 0;
+        for (int p = 0; p < header->pred_count; p++) {
+            if (!loop->body[header->preds[p]]) {
+                outside = header->preds[p];
+                outside_count++;
+            }
+        }
+        if (outside_count == 1 && cfg->blocks[outside].succ_count == 1) {
+            loop->preheader = outside;
+        }
+    }
+}
+
+IRCFG* ir_cfg_build(IRFunction *func) {
+    IRCFG *cfg = calloc(1, sizeof(IRCFG));
+    cfg->func = func;
+    if (!func || !func->instructions) return cfg;
+
+    cfg_build_blocks(cfg);
+    cfg_compute_rpo(cfg);
+    cfg_compute_dominators(cfg);
+    cfg_find_loops(cfg);
+    return cfg;
+}
+
+void ir_cfg_free(IRCFG *cfg) {
+    if (!cfg) return;
+    for (int i = 0; i < cfg->block_count; i++) {
+        free(cfg->blocks[i].succs);
+        free(cfg->blocks[i].preds);
+    }
+    for (int i = 0; i < cfg->loop_count; i++) {
+        free(cfg->loops[i].body);
+    }
+    free(cfg->blocks);
+    free(cfg->rpo);
+    free(cfg->loops);
+    free(cfg);
+}
+
+int ir_cfg_block_of(const IRCFG *cfg, const IRInstruction *instr) {
+    for (int b = 0; b < cfg->block_count; b++) {
+        const IRBlock *block = &cfg->blocks[b];
+        for (IRInstruction *it = block->first; it; it = it->next) {
+            if (it == instr) return b;
+            if (it == block->last) break;
+        }
+    }
+    return -1;
+}
+
+IRInstruction* ir_cfg_insertion_point(const IRCFG *cfg, int block_id) {
+    const IRBlock *block = &cfg->blocks[block_id];
+    if (!ir_instruction_is_terminator(block->last)) return block->last;
+
+    IRInstruction *prev = block->before;
+    for (IRInstruction *it = block->first; it != block->last; it = it->next) {
+        prev = it;
+    }
+    return prev;
+}
@@ -0,0 +1,68 @@
+/* ========================================
+   SUB Language - IR Control Flow Graph
+   Basic blocks, dominators and natural loops over an IRFunction
+   File: ir_cfg.h
+   ======================================== */
+
+#ifndef SUB_IR_CFG_H
+#define SUB_IR_CFG_H
+
+#include "ir.h"
+
+/* Basic block: a maximal straight-line run [first, last] of the
+   function's instruction list. A leading IR_LABEL belongs to the block. */
+typedef struct IRBlock {
+    int id;
+    IRInstruction *first;
+    IRInstruction *last;
+    IRInstruction *before;   // Instruction preceding `first` (NULL at head)
+    int instr_count;
+    int *succs;
+    int succ_count;
+    int *preds;
+    int pred_count;
+    int idom;                // Immediate dominator (-1 for entry/unreachable)
+    int rpo_index;           // Position in reverse post-order (-1 if unreachable)
+    int loop_depth;          // 0 outside loops
+    int loop;                // Innermost loop index (-1 if none)
+} IRBlock;
+
+/* Natural loop (all back edges to the same header merged) */
+typedef struct IRLoop {
+    int header;
+    bool *body;              // body[block_id] membership
+    int block_count;
+    int preheader;           // Unique out-of-loop predecessor falling into header, or -1
+    int parent;              // Enclosing loop index, or -1
+    int depth;               // 1 for outermost loops
+} IRLoop;
+
+typedef struct IRCFG {
+    IRFunction *func;
+    IRBlock *blocks;
+    int block_count;
+    int *rpo;                // Reachable block ids in reverse post-order
+    int rpo_count;
+    IRLoop *loops;
+    int loop_count;
+} IRCFG;
+
+/* Build the CFG with dominators and loops. Any change to the
+   instruction list invalidates it. */
+IRCFG* ir_cfg_build(IRFunction *func);
+void ir_cfg_free(IRCFG *cfg);
+
+/* Does block a dominate block b? */
+bool ir_cfg_dominates(const IRCFG *cfg, int a, int b);
+
+/* Block containing `instr` (linear search, -1 if not found) */
+int ir_cfg_block_of(const IRCFG *cfg, const IRInstruction *instr);
+
+/* Is `instr` a block terminator (jump/branch/return)? */
+bool ir_instruction_is_terminator(const IRInstruction *instr);
+
+/* Last non-terminator instruction of a block where code can be appended
+   (returns the instruction to insert after; may be block->before). */
+IRInstruction* ir_cfg_insertion_point(const IRCFG *cfg, int block);
+
+#endif /* SUB_IR_CFG_H */
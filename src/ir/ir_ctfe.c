@@ -0,0 +1,415 @@
+/* ========================================
+   SUB Language - Compile-Time Function Evaluation
+   Pure calls with constant arguments replaced by their results
+   File: ir_ctfe.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A function is pure when it only computes on integers, its locals and
+ * arrays it allocates itself, and calls nothing but pure functions (a
+ * fixpoint over the call graph). A call to a pure function whose
+ * arguments are all constants is run by a small IR interpreter; if it
+ * returns an integer within its fuel the call becomes that constant.
+ * Anything the interpreter cannot decide (division by zero, an index
+ * out of bounds, running out of fuel or depth) leaves the call alone,
+ * so the program still fails or loops at run time as written.
+ */
+
+#define CTFE_CALL_FUEL    1000000    // Instructions one folded call may execute
+#define CTFE_MODULE_FUEL  10000000   // Instructions for the whole module
+#define CTFE_MAX_DEPTH    200        // Nested calls inside one evaluation
+#define CTFE_MAX_CELLS    (1 << 20)  // Array elements one evaluation may allocate
+
+typedef struct {
+    int64_t value;
+    int array;                 // 1-based array handle, 0 for an integer
+} CtfeValue;
+
+typedef struct {
+    int64_t *elems;
+    int64_t length;
+} CtfeArray;
+
+typedef struct {
+    IRInstruction **instrs;
+    int count;
+} CtfeLabels;
+
+typedef struct {
+    IRFunction **funcs;
+    int count;
+    bool *pure;
+    CtfeLabels *labels;        // Per function, built on first use
+    int64_t fuel;              // Left for the current evaluation
+    int64_t module_fuel;
+    CtfeArray *arrays;
+    int array_count;
+    int64_t cells;
+} Ctfe;
+
+static int ctfe_find(const Ctfe *c, const IRValue *label) {
+    if (!label || label->kind != IR_VAL_LABEL || !label->data.label) return -1;
+    for (int i = 0; i < c->count; i++) {
+        if (strcmp(c->funcs[i]->name, label->data.label) == 0) return i;
+    }
+    return -1;
+}
+
+static bool ctfe_opcode_allowed(IROpcode op) {
+    if (ir_opcode_is_binary(op)) return true;
+    switch (op) {
+        case IR_NOT: case IR_LOAD: case IR_STORE: case IR_ALLOC:
+        case IR_ALLOC_ARRAY: case IR_ALLOC_FRAME_ARRAY:
+        case IR_LOAD_ELEM: case IR_STORE_ELEM: case IR_ARRAY_LEN:
+        case IR_LABEL: case IR_JUMP: case IR_JUMP_IF: case IR_JUMP_IF_NOT:
+        case IR_CALL: case IR_TAIL_CALL: case IR_RETURN:
+        case IR_CONST_INT: case IR_MOVE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Optimistically pure, then anything with an effect or a call to an
+   impure (or unknown) function is removed until nothing changes */
+static void ctfe_find_pure(Ctfe *c, const char *entry) {
+    for (int i = 0; i < c->count; i++) {
+        c->pure[i] = !entry || strcmp(c->funcs[i]->name, entry) != 0;
+        for (IRInstruction *instr = c->funcs[i]->instructions; instr && c->pure[i]; instr = instr->next) {
+            if (!ctfe_opcode_allowed(instr->opcode)) c->pure[i] = false;
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < c->count; i++) {
+            if (!c->pure[i]) continue;
+            for (IRInstruction *instr = c->funcs[i]->instructions; instr; instr = instr->next) {
+                if (instr->opcode != IR_CALL && instr->opcode != IR_TAIL_CALL) continue;
+                int callee = ctfe_find(c, instr->src1);
+                if (callee < 0 || !c->pure[callee] || instr->arg_count != c->funcs[callee]->param_count) {
+                    c->pure[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static IRInstruction* ctfe_label(Ctfe *c, int f, const IRValue *label) {
+    CtfeLabels *labels = &c->labels[f];
+    if (!labels->instrs) {
+        int count = 0;
+        for (IRInstruction *instr = c->funcs[f]->instructions; instr; instr = instr->next) {
+            if (instr->opcode == IR_LABEL) count++;
+        }
+        labels->instrs = malloc(sizeof(IRInstruction*) * (count > 0 ? count : 1));
+        for (IRInstruction *instr = c->funcs[f]->instructions; instr; instr = instr->next) {
+            if (instr->opcode == IR_LABEL) labels->instrs[labels->count++] = instr;
+        }
+    }
+    if (!label || !label->data.label) return NULL;
+    for (int i = 0; i < labels->count; i++) {
+        const IRValue *name = labels->instrs[i]->dest;
+        if (name && name->data.label && strcmp(name->data.label, label->data.label) == 0) return labels->instrs[i];
+    }
+    return NULL;
+}
+
+typedef struct {
+    CtfeValue *locals;
+    CtfeValue *regs;
+    int local_count;
+    int reg_count;
+} CtfeFrame;
+
+static bool ctfe_operand(const CtfeFrame *frame, const IRValue *val, CtfeValue *out) {
+    if (!val) return false;
+    if (val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING && val->type != IR_TYPE_FLOAT) {
+        out->value = val->data.int_val;
+        out->array = 0;
+        return true;
+    }
+    if (val->kind == IR_VAL_REG && val->data.reg_num >= 0 && val->data.reg_num < frame->reg_count) {
+        *out = frame->regs[val->data.reg_num];
+        return true;
+    }
+    return false;
+}
+
+static bool ctfe_define(CtfeFrame *frame, const IRValue *dest, CtfeValue value) {
+    if (!dest || dest->kind != IR_VAL_REG || dest->data.reg_num < 0 || dest->data.reg_num >= frame->reg_count) {
+        return false;
+    }
+    frame->regs[dest->data.reg_num] = value;
+    return true;
+}
+
+static int ctfe_local(const CtfeFrame *frame, const IRValue *val) {
+    if (!val || val->kind != IR_VAL_VAR || val->data.reg_num < 0 || val->data.reg_num >= frame->local_count) {
+        return -1;
+    }
+    return val->data.reg_num;
+}
+
+static CtfeArray* ctfe_array(Ctfe *c, CtfeValue value) {
+    return value.array > 0 && value.array <= c->array_count ? &c->arrays[value.array - 1] : NULL;
+}
+
+static bool ctfe_run(Ctfe *c, int f, const CtfeValue *args, CtfeValue *result, int depth);
+
+/* Execute one call to a pure function */
+static bool ctfe_call(Ctfe *c, const IRInstruction *instr, const CtfeFrame *frame, CtfeValue *result, int depth) {
+    int callee = ctfe_find(c, instr->src1);
+    if (callee < 0 || !c->pure[callee] || depth >= CTFE_MAX_DEPTH) return false;
+    CtfeValue *args = malloc(sizeof(CtfeValue) * (instr->arg_count > 0 ? instr->arg_count : 1));
+    bool ok = true;
+    for (int i = 0; i < instr->arg_count && ok; i++) ok = ctfe_operand(frame, instr->args[i], &args[i]);
+    ok = ok && ctfe_run(c, callee, args, result, depth + 1);
+    free(args);
+    return ok;
+}
+
+static bool ctfe_step(Ctfe *c, int f, CtfeFrame *frame, IRInstruction **pc, CtfeValue *result,
+                      bool *returned, int depth) {
+    IRInstruction *instr = *pc;
+    IROpcode op = instr->opcode;
+    CtfeValue a, b, out = { 0, 0 };
+    *pc = instr->next;
+
+    if (ir_opcode_is_binary(op)) {
+        if (!ctfe_operand(frame, instr->src1, &a) || !ctfe_operand(frame, instr->src2, &b) ||
+            a.array || b.array || !ir_fold_binary(op, a.value, b.value, &out.value)) {
+            return false;
+        }
+        return ctfe_define(frame, instr->dest, out);
+    }
+    switch (op) {
+        case IR_CONST_INT:
+        case IR_MOVE:
+            return ctfe_operand(frame, instr->src1, &out) && ctfe_define(frame, instr->dest, out);
+
+        case IR_NOT:
+            if (!ctfe_operand(frame, instr->src1, &a) || a.array) return false;
+            out.value = a.value == 0;
+            return ctfe_define(frame, instr->dest, out);
+
+        case IR_LOAD: {
+            int slot = ctfe_local(frame, instr->src1);
+            return slot >= 0 && ctfe_define(frame, instr->dest, frame->locals[slot]);
+        }
+
+        case IR_STORE: {
+            int slot = ctfe_local(frame, instr->dest);
+            if (slot < 0 || !ctfe_operand(frame, instr->src1, &a)) return false;
+            frame->locals[slot] = a;
+            return true;
+        }
+
+        case IR_ALLOC:
+        case IR_LABEL:
+            return true;
+
+        case IR_ALLOC_ARRAY:
+        case IR_ALLOC_FRAME_ARRAY: {
+            if (!ctfe_operand(frame, instr->src1, &a) || a.array || a.value < 0 ||
+                a.value > CTFE_MAX_CELLS - c->cells) {
+                return false;
+            }
+            c->arrays = realloc(c->arrays, sizeof(CtfeArray) * (c->array_count + 1));
+            c->arrays[c->array_count].elems = calloc(a.value > 0 ? a.value : 1, sizeof(int64_t));
+            c->arrays[c->array_count].length = a.value;
+            c->array_count++;
+            c->cells += a.value;
+            out.array = c->array_count;
+            return ctfe_define(frame, instr->dest, out);
+        }
+
+        case IR_LOAD_ELEM:
+        case IR_STORE_ELEM: {
+            if (!ctfe_operand(frame, instr->src1, &a) || !ctfe_operand(frame, instr->src2, &b) || b.array) {
+                return false;
+            }
+            CtfeArray *array = ctfe_array(c, a);
+            if (!array || b.value < 0 || b.value >= array->length) return false;
+            if (op == IR_LOAD_ELEM) {
+                out.value = array->elems[b.value];
+                return ctfe_define(frame, instr->dest, out);
+            }
+            // Elements are integers: storing an array handle would lose it
+            CtfeValue value;
+            if (instr->arg_count < 1 || !ctfe_operand(frame, instr->args[0], &value) || value.array) return false;
+            array->elems[b.value] = value.value;
+            return true;
+        }
+
+        case IR_ARRAY_LEN: {
+            if (!ctfe_operand(frame, instr->src1, &a)) return false;
+            CtfeArray *array = ctfe_array(c, a);
+            if (!array) return false;
+            out.value = array->length;
+            return ctfe_define(frame, instr->dest, out);
+        }
+
+        case IR_JUMP_IF:
+        case IR_JUMP_IF_NOT:
+            if (!ctfe_operand(frame, instr->src1, &a) || a.array) return false;
+            if ((a.value != 0) != (op == IR_JUMP_IF)) return true;
+            *pc = ctfe_label(c, f, instr->dest);
+            return *pc != NULL;
+
+        case IR_JUMP:
+            *pc = ctfe_label(c, f, instr->dest);
+            return *pc != NULL;
+
+        case IR_CALL:
+            return ctfe_call(c, instr, frame, &out, depth) && ctfe_define(frame, instr->dest, out);
+
+        case IR_TAIL_CALL:
+            *returned = true;
+            return ctfe_call(c, instr, frame, result, depth);
+
+        case IR_RETURN:
+            *returned = true;
+            if (!instr->src1) {
+                result->value = 0;
+                result->array = 0;
+                return true;
+            }
+            return ctfe_operand(frame, instr->src1, result);
+
+        default:
+            return false;
+    }
+}
+
+static bool ctfe_run(Ctfe *c, int f, const CtfeValue *args, CtfeValue *result, int depth) {
+    IRFunction *func = c->funcs[f];
+    CtfeFrame frame;
+    frame.local_count = func->local_count > func->param_count ? func->local_count : func->param_count;
+    frame.reg_count = func->reg_count;
+    frame.locals = calloc(frame.local_count > 0 ? frame.local_count : 1, sizeof(CtfeValue));
+    frame.regs = calloc(frame.reg_count > 0 ? frame.reg_count : 1, sizeof(CtfeValue));
+    for (int i = 0; i < func->param_count; i++) frame.locals[i] = args[i];
+
+    bool ok = true, returned = false;
+    IRInstruction *pc = func->instructions;
+    while (ok && !returned) {
+        if (!pc || --c->fuel < 0) ok = false;   // Fell off the end or out of fuel
+        else ok = ctfe_step(c, f, &frame, &pc, result, &returned, depth);
+    }
+    free(frame.locals);
+    free(frame.regs);
+    return ok;
+}
+
+/* Evaluate `callee(args)` from scratch; true with an integer result */
+static bool ctfe_evaluate(Ctfe *c, int callee, const CtfeValue *args, int64_t *out) {
+    c->fuel = c->module_fuel < CTFE_CALL_FUEL ? c->module_fuel : CTFE_CALL_FUEL;
+    int64_t start = c->fuel;
+    CtfeValue result = { 0, 0 };
+    bool ok = ctfe_run(c, callee, args, &result, 0) && !result.array;
+    c->module_fuel -= start - (c->fuel > 0 ? c->fuel : 0);
+    for (int i = 0; i < c->array_count; i++) free(c->arrays[i].elems);
+    c->array_count = 0;
+    c->cells = 0;
+    *out = result.value;
+    return ok;
+}
+
+/* Fold the constant-argument calls to pure functions in `func` */
+static bool ctfe_function(Ctfe *c, IRFunction *func) {
+    // Registers known to hold a constant (CONST_INT defines them once)
+    int64_t *known = calloc(func->reg_count > 0 ? func->reg_count : 1, sizeof(int64_t));
+    bool *is_known = calloc(func->reg_count > 0 ? func->reg_count : 1, sizeof(bool));
+    bool changed = false;
+
+    for (IRInstruction *instr = func->instructions; instr && c->module_fuel > 0; instr = instr->next) {
+        if (instr->opcode == IR_CONST_INT && instr->dest && instr->dest->kind == IR_VAL_REG &&
+            instr->dest->data.reg_num < func->reg_count && instr->src1 && instr->src1->kind == IR_VAL_CONST) {
+            known[instr->dest->data.reg_num] = instr->src1->data.int_val;
+            is_known[instr->dest->data.reg_num] = true;
+            continue;
+        }
+        if (instr->opcode != IR_CALL || !instr->dest) continue;
+        int callee = ctfe_find(c, instr->src1);
+        if (callee < 0 || !c->pure[callee] || instr->arg_count != c->funcs[callee]->param_count) continue;
+
+        CtfeValue *args = malloc(sizeof(CtfeValue) * (instr->arg_count > 0 ? instr->arg_count : 1));
+        bool constant = true;
+        for (int i = 0; i < instr->arg_count && constant; i++) {
+            const IRValue *arg = instr->args[i];
+            args[i].array = 0;
+            if (arg && arg->kind == IR_VAL_CONST && arg->type != IR_TYPE_STRING && arg->type != IR_TYPE_FLOAT) {
+                args[i].value = arg->data.int_val;
+            } else if (arg && arg->kind == IR_VAL_REG && arg->data.reg_num < func->reg_count &&
+                       is_known[arg->data.reg_num]) {
+                args[i].value = known[arg->data.reg_num];
+            } else {
+                constant = false;
+            }
+        }
+        int64_t value;
+        if (constant && ctfe_evaluate(c, callee, args, &value)) {
+            for (int i = 0; i < instr->arg_count; i++) ir_value_free(instr->args[i]);
+            free(instr->args);
+            instr->args = NULL;
+            instr->arg_count = 0;
+            ir_value_free(instr->src1);
+            instr->opcode = IR_CONST_INT;
+            instr->src1 = ir_value_create_int(value);
+            if (instr->dest->data.reg_num < func->reg_count) {
+                known[instr->dest->data.reg_num] = value;
+                is_known[instr->dest->data.reg_num] = true;
+            }
+            changed = true;
+        }
+        free(args);
+    }
+    free(known);
+    free(is_known);
+    return changed;
+}
+
+bool ir_ctfe_module(IRModule *module) {
+    if (!module || !module->functions) return false;
+
+    Ctfe c;
+    memset(&c, 0, sizeof(c));
+    for (IRFunction *func = module->functions; func; func = func->next) c.count++;
+    c.funcs = malloc(sizeof(IRFunction*) * c.count);
+    c.pure = malloc(sizeof(bool) * c.count);
+    c.labels = calloc(c.count, sizeof(CtfeLabels));
+    int i = 0;
+    for (IRFunction *func = module->functions; func; func = func->next) c.funcs[i++] = func;
+    c.module_fuel = CTFE_MODULE_FUEL;
+    ctfe_find_pure(&c, module->entry_point);
+
+    bool changed = false;
+    for (i = 0; i < c.count; i++) {
+        if (ctfe_function(&c, c.funcs[i])) {
+            // Results feed further folding and may decide branches
+            ir_sccp_function(c.funcs[i]);
+            ir_simplify_function(c.funcs[i]);
+            // Label tables of a rewritten function are stale
+            free(c.labels[i].instrs);
+            c.labels[i].instrs = NULL;
+            c.labels[i].count = 0;
+            changed = true;
+        }
+    }
+
+    for (i = 0; i < c.count; i++) free(c.labels[i].instrs);
+    free(c.labels);
+    free(c.arrays);
+    free(c.pure);
+    free(c.funcs);
+    return changed;
+}
@@ -0,0 +1,356 @@
+/* ========================================
+   SUB Language - IR Escape Analysis
+   Frame allocation and scalar replacement of non-escaping arrays
+   File: ir_escape.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Largest array moved out of the heap, and the frame area each
+   function may spend on such arrays (both in 64-bit words) */
+#define ESCAPE_MAX_ELEMENTS 16
+#define ESCAPE_FRAME_BUDGET 128
+
+/* Parameters whose incoming array never escapes the callee */
+typedef struct {
+    IRFunction **funcs;
+    int count;
+    bool **param_escapes;
+} EscapeSummary;
+
+/* Values that may hold one tracked array pointer, and how it is used */
+typedef struct {
+    bool *reg_in;
+    bool *local_in;
+    bool escapes;            // Returned, stored into memory, printed, computed with...
+    bool foreign_store;      // A local of the set is also assigned another pointer
+    bool materialized;       // Passed to a callee or a vector loop
+    bool constant_indices;   // Every element access has an in-range constant index
+    int local_count;
+    int local;               // A local of the set
+} EscapeSet;
+
+static int summary_index(const EscapeSummary *sum, const char *name) {
+    for (int i = 0; name && i < sum->count; i++) {
+        if (strcmp(sum->funcs[i]->name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static bool set_has(const EscapeSet *set, const IRValue *v) {
+    if (!v) return false;
+    if (v->kind == IR_VAL_REG) return set->reg_in[v->data.reg_num];
+    if (v->kind == IR_VAL_VAR) return set->local_in[v->data.reg_num];
+    return false;
+}
+
+static void set_init(EscapeSet *set, const IRFunction *func) {
+    memset(set, 0, sizeof(EscapeSet));
+    set->reg_in = calloc((size_t)func->reg_count + 1, sizeof(bool));
+    set->local_in = calloc((size_t)func->local_count + 1, sizeof(bool));
+    set->constant_indices = true;
+    set->local = -1;
+}
+
+static void set_free(EscapeSet *set) {
+    free(set->reg_in);
+    free(set->local_in);
+}
+
+/* Follow the pointer through locals and copies */
+static void set_close(const IRFunction *func, EscapeSet *set) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const IRInstruction *in = func->instructions; in; in = in->next) {
+            const IRValue *to = NULL;
+            if ((in->opcode == IR_STORE || in->opcode == IR_LOAD || in->opcode == IR_MOVE) && set_has(set, in->src1)) {
+                to = in->dest;
+            }
+            if (to && !set_has(set, to) && (to->kind == IR_VAL_REG || to->kind == IR_VAL_VAR)) {
+                if (to->kind == IR_VAL_REG) set->reg_in[to->data.reg_num] = true;
+                else set->local_in[to->data.reg_num] = true;
+                changed = true;
+            }
+        }
+    }
+    for (int l = 0; l < func->local_count; l++) {
+        if (!set->local_in[l]) continue;
+        set->local_count++;
+        set->local = l;
+    }
+}
+
+static void check_index(EscapeSet *set, const IRValue *index, int64_t length) {
+    if (!index || index->kind != IR_VAL_CONST || index->data.int_val < 0 || index->data.int_val >= length) {
+        set->constant_indices = false;
+    }
+}
+
+/* A vector loop only indexes its array operands */
+static bool vector_indexes_only(const IRInstruction *in, int arg) {
+    const IRVectorKernel *k = in->vector;
+    if (!k || arg < 2 || arg == k->reduce_init) return false;
+    for (int i = 0; i < k->node_count; i++) {
+        if (k->nodes[i].kind == IR_VEC_SCALAR && k->nodes[i].arg == arg) return false;
+    }
+    return true;
+}
+
+/* Classify every use of the set (length < 0: no index checks) */
+static void set_classify(const EscapeSummary *sum, const IRFunction *func, EscapeSet *set, int64_t length) {
+    for (const IRInstruction *in = func->instructions; in; in = in->next) {
+        switch (in->opcode) {
+            case IR_LOAD:
+            case IR_MOVE:
+                break;
+            case IR_STORE:
+                if (set_has(set, in->dest) && !set_has(set, in->src1) &&
+                    !(in->src1 && in->src1->kind == IR_VAL_CONST)) {
+                    set->foreign_store = true;
+                }
+                break;
+            case IR_LOAD_ELEM:
+            case IR_ARRAY_LEN:
+                if (set_has(set, in->src2)) set->escapes = true;
+                if (in->opcode == IR_LOAD_ELEM && set_has(set, in->src1)) check_index(set, in->src2, length);
+                break;
+            case IR_STORE_ELEM:
+                if (set_has(set, in->src2) || (in->arg_count > 0 && set_has(set, in->args[0]))) set->escapes = true;
+                if (set_has(set, in->src1)) check_index(set, in->src2, length);
+                break;
+            case IR_CALL: {
+                int callee = summary_index(sum, in->src1 ? in->src1->data.label : NULL);
+                for (int i = 0; i < in->arg_count; i++) {
+                    if (!set_has(set, in->args[i])) continue;
+                    if (callee < 0 || i >= sum->funcs[callee]->param_count || sum->param_escapes[callee][i]) {
+                        set->escapes = true;
+                    }
+                    set->materialized = true;
+                }
+                break;
+            }
+            case IR_VECTOR_LOOP:
+                if (set_has(set, in->src1) || set_has(set, in->src2)) set->escapes = true;
+                for (int i = 0; i < in->arg_count; i++) {
+                    if (!set_has(set, in->args[i])) continue;
+                    if (!vector_indexes_only(in, i)) set->escapes = true;
+                    set->materialized = true;
+                }
+                break;
+            default:
+                // Tail calls release the frame; anything else leaks the address
+                if (set_has(set, in->src1) || set_has(set, in->src2)) set->escapes = true;
+                for (int i = 0; i < in->arg_count; i++) {
+                    if (set_has(set, in->args[i])) set->escapes = true;
+                }
+                break;
+        }
+    }
+}
+
+/* ---------- Call graph summaries ---------- */
+
+/* Optimistic start, then mark escaping parameters until nothing changes
+   (recursive calls settle on the least solution) */
+static void summarize(EscapeSummary *sum, IRModule *module) {
+    for (IRFunction *f = module->functions; f; f = f->next) sum->count++;
+    sum->funcs = calloc((size_t)sum->count + 1, sizeof(IRFunction*));
+    sum->param_escapes = calloc((size_t)sum->count + 1, sizeof(bool*));
+    int i = 0;
+    for (IRFunction *f = module->functions; f; f = f->next, i++) {
+        sum->funcs[i] = f;
+        sum->param_escapes[i] = calloc((size_t)f->param_count + 1, sizeof(bool));
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (i = 0; i < sum->count; i++) {
+            IRFunction *f = sum->funcs[i];
+            for (int p = 0; p < f->param_count; p++) {
+                int slot = f->params[p]->data.reg_num;
+                if (sum->param_escapes[i][p] || slot < 0 || slot >= f->local_count) continue;
+                EscapeSet set;
+                set_init(&set, f);
+                set.local_in[slot] = true;
+                set_close(f, &set);
+                set_classify(sum, f, &set, -1);
+                if (set.escapes) {
+                    sum->param_escapes[i][p] = true;
+                    changed = true;
+                }
+                set_free(&set);
+            }
+        }
+    }
+}
+
+static void summary_free(EscapeSummary *sum) {
+    for (int i = 0; i < sum->count; i++) free(sum->param_escapes[i]);
+    free(sum->param_escapes);
+    free(sum->funcs);
+}
+
+/* ---------- Allocation sites ---------- */
+
+static int count_uses(const IRInstruction *in, int reg) {
+    int n = 0;
+    if (in->src1 && in->src1->kind == IR_VAL_REG && in->src1->data.reg_num == reg) n++;
+    if (in->src2 && in->src2->kind == IR_VAL_REG && in->src2->data.reg_num == reg) n++;
+    for (int i = 0; i < in->arg_count; i++) {
+        if (in->args[i]->kind == IR_VAL_REG && in->args[i]->data.reg_num == reg) n++;
+    }
+    return n;
+}
+
+/*
+ * One storage per site is enough when no older array from the site is
+ * still in use when it runs again. The site's own register always names
+ * the newest array, and the local holding it is assigned later in the
+ * same block without being read in between; a register loaded from that
+ * local must be used up in its block before the site can run again.
+ */
+static bool site_reuses_storage(const IRFunction *func, const IRInstruction *site, const EscapeSet *set) {
+    if (set->local_count == 0) return true;
+    if (set->local_count > 1 || set->local < func->param_count) return false;
+    const IRInstruction *store = site->next;
+    while (store && !(store->opcode == IR_STORE && store->dest->data.reg_num == set->local)) {
+        if (store->opcode == IR_LABEL || ir_instruction_is_terminator(store) ||
+            (store->opcode == IR_LOAD && store->src1->data.reg_num == set->local)) {
+            return false;
+        }
+        store = store->next;
+    }
+    if (!store || !store->src1 || store->src1->kind != IR_VAL_REG || store->src1->data.reg_num != site->dest->data.reg_num) {
+        return false;
+    }
+    for (const IRInstruction *load = func->instructions; load; load = load->next) {
+        if (load->opcode != IR_LOAD || !set_has(set, load->src1)) continue;
+        int reg = load->dest->data.reg_num;
+        int remaining = 0;
+        for (const IRInstruction *in = func->instructions; in; in = in->next) remaining += count_uses(in, reg);
+        for (const IRInstruction *in = load->next; in && remaining > 0; in = in->next) {
+            if (in == site || in->opcode == IR_LABEL) return false;
+            remaining -= count_uses(in, reg);
+            if (remaining > 0 && ir_instruction_is_terminator(in)) return false;
+        }
+        if (remaining > 0) return false;
+    }
+    return true;
+}
+
+/* Every element of the array becomes a local of its own; returns the
+   first instruction after the site that survives the rewrite */
+static IRInstruction* scalar_replace(IRFunction *func, IRInstruction *site, const EscapeSet *set, int length) {
+    int base = func->local_count;
+    char name[64];
+    for (int i = 0; i < length; i++) {
+        snprintf(name, sizeof(name), "elem%d", i);
+        ir_function_new_local(func, name);
+    }
+
+    IRInstruction *prev = NULL;
+    IRInstruction *resume = NULL;
+    bool past_site = false;
+    IRInstruction *in = func->instructions;
+    while (in) {
+        IRInstruction *next = in->next;
+        bool remove = false;
+        if (in == site) {
+            past_site = true;
+            // A fresh array is all zeros
+            IRInstruction *at = prev;
+            for (int i = 0; i < length; i++) {
+                IRInstruction *zero = ir_instruction_create(IR_STORE);
+                zero->dest = ir_value_create_var(base + i, "elem");
+                zero->src1 = ir_value_create_int(0);
+                ir_function_insert_after(func, at, zero);
+                at = zero;
+            }
+            prev = at;
+            remove = true;
+        } else if ((in->opcode == IR_LOAD_ELEM || in->opcode == IR_STORE_ELEM) && set_has(set, in->src1)) {
+            int slot = base + (int)in->src2->data.int_val;
+            ir_value_free(in->src1);
+            ir_value_free(in->src2);
+            in->src2 = NULL;
+            if (in->opcode == IR_LOAD_ELEM) {
+                in->opcode = IR_LOAD;
+                in->src1 = ir_value_create_var(slot, "elem");
+            } else {
+                in->opcode = IR_STORE;
+                in->dest = ir_value_create_var(slot, "elem");
+                in->src1 = in->args[0];
+                free(in->args);
+                in->args = NULL;
+                in->arg_count = 0;
+            }
+        } else if (in->opcode == IR_ARRAY_LEN && set_has(set, in->src1)) {
+            in->opcode = IR_MOVE;
+            ir_value_free(in->src1);
+            in->src1 = ir_value_create_int(length);
+        } else if ((in->opcode == IR_LOAD || in->opcode == IR_MOVE || in->opcode == IR_STORE) &&
+                   set_has(set, in->dest)) {
+            remove = true;   // Only fed the accesses rewritten above
+        }
+        if (remove) {
+            ir_function_remove_after(func, prev, in);
+        } else {
+            if (past_site && !resume) resume = in;
+            prev = in;
+        }
+        in = next;
+    }
+    return resume;
+}
+
+static bool escape_function(const EscapeSummary *sum, IRFunction *func) {
+    bool changed = false;
+    IRInstruction *in = func->instructions;
+    while (in) {
+        IRInstruction *next = in->next;
+        if (in->opcode == IR_ALLOC_ARRAY && in->dest && in->dest->kind == IR_VAL_REG && in->src1 &&
+            in->src1->kind == IR_VAL_CONST && in->src1->data.int_val >= 0 &&
+            in->src1->data.int_val <= ESCAPE_MAX_ELEMENTS) {
+            int length = (int)in->src1->data.int_val;
+            EscapeSet set;
+            set_init(&set, func);
+            set.reg_in[in->dest->data.reg_num] = true;
+            set_close(func, &set);
+            set_classify(sum, func, &set, length);
+            if (!set.escapes && !set.foreign_store && site_reuses_storage(func, in, &set)) {
+                if (set.constant_indices && !set.materialized) {
+                    next = scalar_replace(func, in, &set, length);
+                    changed = true;
+                } else if (func->frame_words + length + 1 <= ESCAPE_FRAME_BUDGET) {
+                    in->opcode = IR_ALLOC_FRAME_ARRAY;
+                    in->src2 = ir_value_create_int(func->frame_words);
+                    func->frame_words += length + 1;
+                    changed = true;
+                }
+            }
+            set_free(&set);
+        }
+        in = next;
+    }
+    return changed;
+}
+
+bool ir_escape_module(IRModule *module) {
+    if (!module) return false;
+    EscapeSummary sum = {0};
+    summarize(&sum, module);
+    bool changed = false;
+    for (int i = 0; i < sum.count; i++) {
+        if (escape_function(&sum, sum.funcs[i])) changed = true;
+    }
+    summary_free(&sum);
+    return changed;
+}
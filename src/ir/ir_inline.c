@@ -0,0 +1,451 @@
+/* ========================================
+   SUB Language - IR Function Inlining
+   Call-graph driven inliner with a size/benefit cost model
+   File: ir_inline.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/* Instructions saved by removing a call: argument moves, call/ret,
+   frame setup and teardown */
+#define INLINE_CALL_OVERHEAD 5
+/* Callers stop receiving inlined bodies past this size */
+#define INLINE_CALLER_LIMIT 2000
+
+/* ---------- Call graph ---------- */
+
+typedef struct {
+    IRFunction **funcs;
+    int count;
+    int *site_count;      // Static call sites targeting each function
+    bool **calls;         // calls[a][b]: a contains a call to b
+    int *scc;             // Strongly connected component id
+    int *order;           // Function indices, callees before callers
+} CallGraph;
+
+static int cg_index(const CallGraph *cg, const char *name) {
+    if (!name) return -1;
+    for (int i = 0; i < cg->count; i++) {
+        if (strcmp(cg->funcs[i]->name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int cg_callee(const CallGraph *cg, const IRInstruction *instr) {
+    if (instr->opcode != IR_CALL || !instr->src1 || instr->src1->kind != IR_VAL_LABEL) {
+        return -1;
+    }
+    return cg_index(cg, instr->src1->data.label);
+}
+
+/* Tarjan's algorithm; SCCs are emitted callees-first */
+typedef struct {
+    CallGraph *cg;
+    int *index;
+    int *lowlink;
+    bool *on_stack;
+    int *stack;
+    int sp;
+    int next_index;
+    int scc_count;
+    int order_len;
+} TarjanState;
+
+static void tarjan_visit(TarjanState *t, int v) {
+    CallGraph *cg = t->cg;
+    t->index[v] = t->lowlink[v] = t->next_index++;
+    t->stack[t->sp++] = v;
+    t->on_stack[v] = true;
+
+    for (int w = 0; w < cg->count; w++) {
+        if (!cg->calls[v][w]) continue;
+        if (t->index[w] < 0) {
+            tarjan_visit(t, w);
+            if (t->lowlink[w] < t->lowlink[v]) t->lowlink[v] = t->lowlink[w];
+        } else if (t->on_stack[w] && t->index[w] < t->lowlink[v]) {
+            t->lowlink[v] = t->index[w];
+        }
+    }
+
+    if (t->lowlink[v] == t->index[v]) {
+        int w;
+        do {
+            w = t->stack[--t->sp];
+            t->on_stack[w] = false;
+            cg->scc[w] = t->scc_count;
+            cg->order[t->order_len++] = w;
+        } while (w != v);
+        t->scc_count++;
+    }
+}
+
+static CallGraph* cg_build(IRModule *module) {
+    CallGraph *cg = calloc(1, sizeof(CallGraph));
+    for (IRFunction *f = module->functions; f; f = f->next) cg->count++;
+
+    cg->funcs = malloc(sizeof(IRFunction*) * (cg->count + 1));
+    cg->site_count = calloc(cg->count + 1, sizeof(int));
+    cg->calls = malloc(sizeof(bool*) * (cg->count + 1));
+    cg->scc = malloc(sizeof(int) * (cg->count + 1));
+    cg->order = malloc(sizeof(int) * (cg->count + 1));
+
+    int n = 0;
+    for (IRFunction *f = module->functions; f; f = f->next) {
+        cg->calls[n] = calloc(cg->count, sizeof(bool));
+        cg->funcs[n++] = f;
+    }
+
+    for (int i = 0; i < cg->count; i++) {
+        for (IRInstruction *instr = cg->funcs[i]->instructions; instr; instr = instr->next) {
+            int callee = cg_callee(cg, instr);
+            if (callee < 0) continue;
+            cg->calls[i][callee] = true;
+            cg->site_count[callee]++;
+        }
+    }
+
+    TarjanState t = {0};
+    t.cg = cg;
+    t.index = malloc(sizeof(int) * (cg->count + 1));
+    t.lowlink = malloc(sizeof(int) * (cg->count + 1));
+    t.on_stack = calloc(cg->count + 1, sizeof(bool));
+    t.stack = malloc(sizeof(int) * (cg->count + 1));
+    for (int i = 0; i < cg->count; i++) t.index[i] = -1;
+    for (int i = 0; i < cg->count; i++) {
+        if (t.index[i] < 0) tarjan_visit(&t, i);
+    }
+    free(t.index);
+    free(t.lowlink);
+    free(t.on_stack);
+    free(t.stack);
+    return cg;
+}
+
+static void cg_free(CallGraph *cg) {
+    if (!cg) return;
+    for (int i = 0; i < cg->count; i++) free(cg->calls[i]);
+    free(cg->calls);
+    free(cg->funcs);
+    free(cg->site_count);
+    free(cg->scc);
+    free(cg->order);
+    free(cg);
+}
+
+/* ---------- Cost model ---------- */
+
+/* Size of a function body in "instruction units": labels and ALLOC
+   markers emit no code, nested calls carry their own overhead */
+static int function_cost(const IRFunction *func) {
+    int cost = 0;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        switch (instr->opcode) {
+            case IR_LABEL:
+            case IR_ALLOC:
+                break;
+            case IR_CALL:
+                cost += 1 + instr->arg_count;
+                break;
+            default:
+                cost++;
+                break;
+        }
+    }
+    return cost;
+}
+
+static int instruction_count(const IRFunction *func) {
+    int count = 0;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) count++;
+    return count;
+}
+
+/*
+ * Decide whether a call site is worth inlining. The callee's cost is
+ * reduced by the call overhead it removes and by constant arguments
+ * (which the simplifier will fold through the body). The remaining
+ * growth must fit the threshold, which doubles per level of heat up
+ * to 4x: loop depth, or with a profile the site's share of the busiest
+ * call site's count (sites that never ran are not inlined). A callee with a single call site is inlined more
+ * eagerly since its out-of-line copy is deleted afterwards.
+ */
+static bool should_inline(const IRInstruction *call, int callee_cost, int site_count,
+                          int loop_depth, int threshold) {
+    int benefit = INLINE_CALL_OVERHEAD + call->arg_count;
+    for (int i = 0; i < call->arg_count; i++) {
+        if (call->args[i] && call->args[i]->kind == IR_VAL_CONST) benefit += 2;
+    }
+
+    int budget = threshold << (loop_depth < 2 ? loop_depth : 2);
+    if (site_count == 1) budget *= 4;
+    return callee_cost - benefit <= budget;
+}
+
+/* ---------- Body cloning ---------- */
+
+typedef struct {
+    int local_base;
+    int reg_base;
+    char **label_from;
+    IRValue **label_to;
+    int label_count;
+} InlineMap;
+
+static IRValue* remap_value(const InlineMap *map, const IRValue *val) {
+    IRValue *copy = ir_value_clone(val);
+    if (!copy) return NULL;
+    if (copy->kind == IR_VAL_REG) {
+        copy->data.reg_num += map->reg_base;
+    } else if (copy->kind == IR_VAL_VAR) {
+        copy->data.reg_num += map->local_base;
+    }
+    return copy;
+}
+
+static IRValue* remap_label(const InlineMap *map, const IRValue *val) {
+    if (val && val->kind == IR_VAL_LABEL) {
+        for (int i = 0; i < map->label_count; i++) {
+            if (strcmp(map->label_from[i], val->data.label) == 0) {
+                return ir_value_clone(map->label_to[i]);
+            }
+        }
+    }
+    return ir_value_clone(val);
+}
+
+static IRInstruction* append(IRFunction *func, IRInstruction *after, IROpcode opcode,
+                             IRValue *dest, IRValue *src1) {
+    IRInstruction *instr = ir_instruction_create(opcode);
+    instr->dest = dest;
+    instr->src1 = src1;
+    ir_function_insert_after(func, after, instr);
+    return instr;
+}
+
+/* Replace `call` in `caller` by a copy of `callee`'s body. Callee locals
+   and registers are renumbered past the caller's, labels are renamed,
+   and every RETURN stores into a fresh result local and jumps to the
+   continuation, which reloads it into the call's destination register. */
+static void inline_call_site(IRFunction *caller, IRInstruction *call, const IRFunction *callee) {
+    InlineMap map = {0};
+    char name[256];
+
+    // Fresh locals for the callee's slots (params first) and the result
+    const char **slot_names = calloc(callee->local_count + 1, sizeof(char*));
+    for (const IRInstruction *instr = callee->instructions; instr; instr = instr->next) {
+        if (instr->opcode == IR_ALLOC && instr->dest &&
+            instr->dest->data.reg_num < callee->local_count) {
+            slot_names[instr->dest->data.reg_num] = instr->dest->name;
+        }
+    }
+    map.local_base = caller->local_count;
+    for (int i = 0; i < callee->local_count; i++) {
+        snprintf(name, sizeof(name), "%s.%s", callee->name, slot_names[i] ? slot_names[i] : "tmp");
+        ir_function_new_local(caller, name);
+    }
+    free(slot_names);
+    snprintf(name, sizeof(name), "%s.ret", callee->name);
+    int ret_slot = ir_function_new_local(caller, name);
+
+    map.reg_base = caller->reg_count;
+    caller->reg_count += callee->reg_count;
+    int frame_base = caller->frame_words;
+    caller->frame_words += callee->frame_words;
+
+    for (const IRInstruction *instr = callee->instructions; instr; instr = instr->next) {
+        if (instr->opcode != IR_LABEL || !instr->dest) continue;
+        map.label_from = realloc(map.label_from, sizeof(char*) * (map.label_count + 1));
+        map.label_to = realloc(map.label_to, sizeof(IRValue*) * (map.label_count + 1));
+        map.label_from[map.label_count] = instr->dest->data.label;
+        map.label_to[map.label_count] = ir_value_create_unique_label("L_INL");
+        map.label_count++;
+    }
+    IRValue *exit_label = ir_value_create_unique_label("L_INL_RET");
+
+    // Locate the call after the ALLOC markers were prepended
+    IRInstruction *prev = NULL;
+    for (IRInstruction *scan = caller->instructions; scan && scan != call; scan = scan->next) {
+        prev = scan;
+    }
+
+    // Bind arguments to the parameter locals
+    IRInstruction *cursor = prev;
+    for (int i = 0; i < call->arg_count && i < callee->param_count; i++) {
+        snprintf(name, sizeof(name), "%s.%s", callee->name,
+                 callee->params[i]->name ? callee->params[i]->name : "arg");
+        cursor = append(caller, cursor, IR_STORE,
+                        ir_value_create_var(map.local_base + callee->params[i]->data.reg_num, name),
+                        ir_value_clone(call->args[i]));
+    }
+
+    for (const IRInstruction *instr = callee->instructions; instr; instr = instr->next) {
+        if (instr->opcode == IR_ALLOC) continue;
+
+        if (instr->opcode == IR_RETURN) {
+            snprintf(name, sizeof(name), "%s.ret", callee->name);
+            cursor = append(caller, cursor, IR_STORE, ir_value_create_var(ret_slot, name),
+                            instr->src1 ? remap_value(&map, instr->src1) : ir_value_create_int(0));
+            cursor = append(caller, cursor, IR_JUMP, ir_value_clone(exit_label), NULL);
+            continue;
+        }
+
+        IRInstruction *copy = ir_instruction_create(instr->opcode);
+        switch (instr->opcode) {
+            case IR_LABEL:
+            case IR_JUMP:
+            case IR_JUMP_IF:
+            case IR_JUMP_IF_NOT:
+                copy->dest = remap_label(&map, instr->dest);
+                break;
+            default:
+                copy->dest = remap_value(&map, instr->dest);
+                break;
+        }
+        copy->src1 = remap_value(&map, instr->src1);
+        copy->src2 = instr->opcode == IR_ALLOC_FRAME_ARRAY
+                         ? ir_value_create_int(instr->src2->data.int_val + frame_base)
+                         : remap_value(&map, instr->src2);
+        for (int i = 0; i < instr->arg_count; i++) {
+            ir_instruction_add_arg(copy, remap_value(&map, instr->args[i]));
+        }
+        copy->comment = instr->comment ? strdup(instr->comment) : NULL;
+        copy->unroll_hint = instr->unroll_hint;
+        copy->profile_count = instr->profile_count;
+        copy->in_bounds = instr->in_bounds;
+        copy->vector = ir_vector_kernel_clone(instr->vector);
+        ir_function_insert_after(caller, cursor, copy);
+        cursor = copy;
+    }
+
+    cursor = append(caller, cursor, IR_LABEL, exit_label, NULL);
+    snprintf(name, sizeof(name), "%s.ret", callee->name);
+    cursor = append(caller, cursor, IR_LOAD, ir_value_clone(call->dest),
+                    ir_value_create_var(ret_slot, name));
+
+    // `call` now follows the inlined body
+    ir_function_remove_after(caller, cursor, call);
+
+    for (int i = 0; i < map.label_count; i++) ir_value_free(map.label_to[i]);
+    free(map.label_from);
+    free(map.label_to);
+}
+
+/* ---------- Driver ---------- */
+
+typedef struct {
+    IRInstruction *call;
+    int callee;
+    int depth;
+} CallSite;
+
+/* Inline eligible call sites in `caller` (one CFG snapshot per round) */
+/* Hotness level of a call site: from the profile when there is one
+   (-1 for a site that never ran), otherwise its loop depth */
+static int site_heat(const IRInstruction *call, int loop_depth, int64_t hottest) {
+    if (call->profile_count < 0 || hottest <= 0) return loop_depth;
+    if (call->profile_count == 0) return -1;
+    if (call->profile_count * 16 >= hottest) return 2;
+    return call->profile_count * 256 >= hottest ? 1 : 0;
+}
+
+static bool inline_into(CallGraph *cg, int caller_idx, int threshold, const char *entry,
+                        int64_t hottest) {
+    IRFunction *caller = cg->funcs[caller_idx];
+    IRCFG *cfg = ir_cfg_build(caller);
+    CallSite *sites = NULL;
+    int site_count = 0;
+
+    for (IRInstruction *instr = caller->instructions; instr; instr = instr->next) {
+        int callee = cg_callee(cg, instr);
+        if (callee < 0) continue;
+        // Never inline within a recursive cycle or the program entry
+        if (cg->scc[callee] == cg->scc[caller_idx]) continue;
+        if (entry && strcmp(cg->funcs[callee]->name, entry) == 0) continue;
+        if (instr->arg_count != cg->funcs[callee]->param_count) continue;
+
+        int block = ir_cfg_block_of(cfg, instr);
+        sites = realloc(sites, sizeof(CallSite) * (site_count + 1));
+        sites[site_count].call = instr;
+        sites[site_count].callee = callee;
+        sites[site_count].depth = site_heat(instr, block >= 0 ? cfg->blocks[block].loop_depth : 0, hottest);
+        site_count++;
+    }
+    ir_cfg_free(cfg);
+
+    bool changed = false;
+    int size = instruction_count(caller);
+    for (int i = 0; i < site_count; i++) {
+        IRFunction *callee = cg->funcs[sites[i].callee];
+        int cost = function_cost(callee);
+        if (size + cost > INLINE_CALLER_LIMIT) break;
+        if (sites[i].depth < 0) continue;
+        if (!should_inline(sites[i].call, cost, cg->site_count[sites[i].callee],
+                           sites[i].depth, threshold)) {
+            continue;
+        }
+        inline_call_site(caller, sites[i].call, callee);
+        cg->site_count[sites[i].callee]--;
+        size += instruction_count(callee) + 4;
+        changed = true;
+    }
+    free(sites);
+    return changed;
+}
+
+/* Remove functions left without call sites (other than the entry) */
+static void remove_dead_functions(IRModule *module, const CallGraph *cg) {
+    for (int i = 0; i < cg->count; i++) {
+        IRFunction *func = cg->funcs[i];
+        bool is_entry = module->entry_point && strcmp(func->name, module->entry_point) == 0;
+        if (is_entry || cg->site_count[i] > 0) continue;
+
+        IRFunction **link = &module->functions;
+        while (*link && *link != func) link = &(*link)->next;
+        if (!*link) continue;
+        *link = func->next;
+        ir_function_free(func);
+    }
+}
+
+bool ir_inline_module(IRModule *module, int threshold) {
+    if (!module || threshold < 0) return false;
+
+    CallGraph *cg = cg_build(module);
+    // Busiest call site of a profiled module scales the others
+    int64_t hottest = -1;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+            if (instr->opcode == IR_CALL && instr->profile_count > hottest) hottest = instr->profile_count;
+        }
+    }
+    bool changed = false;
+    // Bottom-up: callees are already expanded (and their cost final)
+    // by the time their callers are visited
+    for (int i = 0; i < cg->count; i++) {
+        int caller = cg->order[i];
+        if (inline_into(cg, caller, threshold, module->entry_point, hottest)) {
+            ir_simplify_function(cg->funcs[caller]);
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        // Recount call sites (simplification may have dropped some)
+        for (int i = 0; i < cg->count; i++) cg->site_count[i] = 0;
+        for (int i = 0; i < cg->count; i++) {
+            for (IRInstruction *instr = cg->funcs[i]->instructions; instr; instr = instr->next) {
+                int callee = cg_callee(cg, instr);
+                if (callee >= 0 && callee != i) cg->site_count[callee]++;
+            }
+        }
+        remove_dead_functions(module, cg);
+    }
+    cg_free(cg);
+    return changed;
+}
@@ -0,0 +1,891 @@
+/* ========================================
+   SUB Language - IR Loop Nest Optimizer
+   Fusion of adjacent range loops, interchange of loop nests
+   File: ir_loopnest.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Both transformations work on range loops in the layout FOR lowering
+ * produces: `STORE iv, start` in the preheader, a header that is just
+ * `LOAD iv; LT bound; JUMP_IF_NOT exit`, and a latch ending in
+ * `STORE iv, iv + 1; JUMP header`. Bodies may only contain code whose
+ * order is invisible apart from memory: no calls, output or trapping
+ * division (an index error stops the program the same way wherever it
+ * happens). Element indices are read as affine forms in the induction
+ * variables, with coefficients that are constants or unmodified locals
+ * (a[i * m + j]). Arrays in different locals alias unless both locals
+ * only ever hold their own fresh allocation.
+ *
+ * Fusion merges two adjacent innermost loops with the same start and
+ * bound, when no element is written by one loop at a later iteration
+ * than the other touches it, and they share no scalars.
+ *
+ * Interchange swaps a perfect two-deep rectangular nest, when more
+ * accesses step through memory with the outer index than with the inner
+ * one and every pair of accesses that may touch the same element (one
+ * a store) uses the same injective index. Scalars the body writes must
+ * be sums or temporaries set before use. Only the loop control is
+ * rewritten: the outer loop counts the former inner variable.
+ */
+
+#define LOOPNEST_MAX_CHANGES 32      // Transformations per function
+#define LOOPNEST_MAX_BODY 400        // Instructions in a fused body
+#define LOOPNEST_MAX_ACCESSES 64     // Element accesses examined per nest
+
+typedef struct {
+    int header, latch;               // Block ids
+    IRInstruction *label;            // Header IR_LABEL
+    IRInstruction *iv_load;          // %t = LOAD iv
+    IRInstruction *test;             // %c = LT %t, bound
+    IRInstruction *branch;           // JUMP_IF_NOT %c, exit
+    IRInstruction *init;             // STORE iv, start (preheader)
+    IRInstruction *step;             // STORE iv, iv + 1 (latch)
+    IRInstruction *back;             // JUMP header
+    IRInstruction *exit_label;       // IR_LABEL right after the loop
+    int iv;
+} RangeLoop;
+
+typedef struct {
+    IRFunction *func;
+    IRCFG *cfg;
+    IRInstruction **seq;             // Instructions in list order
+    int count;
+    IRInstruction **defs;            // Register -> definition
+    int *uses;                       // Register -> operand uses
+    int *def_pos;                    // Register -> position of definition (-1)
+} Nest;
+
+/* Affine index: k[x] * (sym[x] < 0 ? 1 : local sym[x]) * iv[x] summed,
+   plus add_k * local `add`, plus c */
+typedef struct {
+    bool ok;
+    int64_t k[2];
+    int sym[2];
+    int add;
+    int64_t add_k;
+    int64_t c;
+} Affine;
+
+typedef struct {
+    int array;                       // Local holding the array, or -1
+    bool store;
+    Affine index;
+} Access;
+
+static bool const_int(const IRValue *val, int64_t *out) {
+    if (!val || val->kind != IR_VAL_CONST || val->type == IR_TYPE_STRING ||
+        val->type == IR_TYPE_FLOAT) {
+        return false;
+    }
+    *out = val->data.int_val;
+    return true;
+}
+
+static int reg_of(const Nest *n, const IRValue *val) {
+    return val && val->kind == IR_VAL_REG && val->data.reg_num < n->func->reg_count ? val->data.reg_num : -1;
+}
+
+static int slot_of(const IRValue *val) {
+    return val && val->kind == IR_VAL_VAR ? val->data.reg_num : -1;
+}
+
+static IRInstruction* def_of(const Nest *n, const IRValue *val) {
+    int reg = reg_of(n, val);
+    return reg >= 0 ? n->defs[reg] : NULL;
+}
+
+static int pos_of(const Nest *n, const IRInstruction *instr) {
+    for (int i = 0; i < n->count; i++) {
+        if (n->seq[i] == instr) return i;
+    }
+    return -1;
+}
+
+static void nest_index(Nest *n) {
+    free(n->seq);
+    n->count = 0;
+    for (IRInstruction *instr = n->func->instructions; instr; instr = instr->next) n->count++;
+    n->seq = malloc(sizeof(IRInstruction*) * (n->count + 1));
+    int regs = n->func->reg_count + 1;
+    free(n->defs);
+    free(n->uses);
+    free(n->def_pos);
+    n->defs = calloc(regs, sizeof(IRInstruction*));
+    n->uses = calloc(regs, sizeof(int));
+    n->def_pos = malloc(sizeof(int) * regs);
+    for (int r = 0; r < regs; r++) n->def_pos[r] = -1;
+    int i = 0;
+    for (IRInstruction *instr = n->func->instructions; instr; instr = instr->next, i++) {
+        n->seq[i] = instr;
+        int dest = instr->opcode == IR_STORE ? -1 : reg_of(n, instr->dest);
+        if (dest >= 0) {
+            n->defs[dest] = instr;
+            n->def_pos[dest] = i;
+        }
+        const IRValue *ops[2] = { instr->src1, instr->src2 };
+        for (int o = 0; o < 2; o++) {
+            if (reg_of(n, ops[o]) >= 0) n->uses[ops[o]->data.reg_num]++;
+        }
+        for (int a = 0; a < instr->arg_count; a++) {
+            if (reg_of(n, instr->args[a]) >= 0) n->uses[instr->args[a]->data.reg_num]++;
+        }
+    }
+}
+
+/* Relink the function in the order of `order` */
+static void relink(Nest *n, IRInstruction **order, int count) {
+    n->func->instructions = count > 0 ? order[0] : NULL;
+    for (int i = 0; i < count; i++) order[i]->next = i + 1 < count ? order[i + 1] : NULL;
+}
+
+/* ---------- Range loops ---------- */
+
+static bool is_increment(const Nest *n, const IRValue *val, int iv) {
+    IRInstruction *add = def_of(n, val);
+    if (!add || add->opcode != IR_ADD) return false;
+    int64_t one;
+    const IRValue *other = NULL;
+    if (const_int(add->src2, &one) && one == 1) other = add->src1;
+    else if (const_int(add->src1, &one) && one == 1) other = add->src2;
+    IRInstruction *load = def_of(n, other);
+    return load && load->opcode == IR_LOAD && slot_of(load->src1) == iv;
+}
+
+static bool match_range_loop(const Nest *n, const IRLoop *loop, RangeLoop *rl) {
+    const IRCFG *cfg = n->cfg;
+    memset(rl, 0, sizeof(*rl));
+    rl->header = loop->header;
+    const IRBlock *header = &cfg->blocks[loop->header];
+    if (loop->preheader != loop->header - 1 || header->pred_count != 2 || header->instr_count != 4) return false;
+
+    rl->latch = -1;
+    for (int p = 0; p < header->pred_count; p++) {
+        if (loop->body[header->preds[p]]) rl->latch = header->preds[p];
+    }
+    if (rl->latch < 0 || rl->latch + 1 >= cfg->block_count) return false;
+    // Contiguous blocks [header, latch], leaving only through the header
+    for (int b = 0; b < cfg->block_count; b++) {
+        bool inside = b >= loop->header && b <= rl->latch;
+        if (inside != loop->body[b]) return false;
+        if (!inside || b == loop->header) continue;
+        for (int s = 0; s < cfg->blocks[b].succ_count; s++) {
+            if (!loop->body[cfg->blocks[b].succs[s]]) return false;
+        }
+    }
+
+    rl->label = header->first;
+    rl->iv_load = rl->label->next;
+    rl->test = rl->iv_load->next;
+    rl->branch = rl->test->next;
+    if (rl->label->opcode != IR_LABEL || rl->label->unroll_hint || rl->iv_load->opcode != IR_LOAD ||
+        rl->test->opcode != IR_LT || rl->branch->opcode != IR_JUMP_IF_NOT) {
+        return false;
+    }
+    rl->iv = slot_of(rl->iv_load->src1);
+    if (rl->iv < 0 || reg_of(n, rl->test->src1) != reg_of(n, rl->iv_load->dest) ||
+        reg_of(n, rl->branch->src1) != reg_of(n, rl->test->dest) || reg_of(n, rl->test->dest) < 0 ||
+        n->uses[rl->test->dest->data.reg_num] != 1 || n->uses[rl->iv_load->dest->data.reg_num] != 1) {
+        return false;
+    }
+    // The bound is fixed before the loop starts
+    int64_t k;
+    if (!const_int(rl->test->src2, &k)) {
+        int reg = reg_of(n, rl->test->src2);
+        if (reg < 0 || !n->defs[reg]) return false;
+        int block = ir_cfg_block_of(cfg, n->defs[reg]);
+        if (block < 0 || loop->body[block]) return false;
+    }
+
+    const IRBlock *latch = &cfg->blocks[rl->latch];
+    rl->back = latch->last;
+    const IRInstruction *exit_first = cfg->blocks[rl->latch + 1].first;
+    if (rl->back->opcode != IR_JUMP || !rl->back->dest || !rl->branch->dest ||
+        strcmp(rl->back->dest->data.label, rl->label->dest->data.label) != 0 ||
+        exit_first->opcode != IR_LABEL ||
+        strcmp(exit_first->dest->data.label, rl->branch->dest->data.label) != 0) {
+        return false;
+    }
+    rl->exit_label = cfg->blocks[rl->latch + 1].first;
+
+    // The latch increment is the only store to iv in the loop
+    for (IRInstruction *instr = rl->label;; instr = instr->next) {
+        if (instr->opcode == IR_STORE && slot_of(instr->dest) == rl->iv) {
+            if (instr->next != rl->back || rl->step) return false;
+            rl->step = instr;
+        }
+        if (instr == rl->back) break;
+    }
+    if (!rl->step || !is_increment(n, rl->step->src1, rl->iv)) return false;
+
+    // Last store to iv in the preheader
+    const IRBlock *pre = &cfg->blocks[loop->preheader];
+    for (IRInstruction *instr = pre->first;; instr = instr->next) {
+        if (instr->opcode == IR_STORE && slot_of(instr->dest) == rl->iv) rl->init = instr;
+        if (instr == pre->last) break;
+    }
+    return rl->init != NULL;
+}
+
+static bool is_innermost(const IRCFG *cfg, int loop) {
+    for (int j = 0; j < cfg->loop_count; j++) {
+        if (cfg->loops[j].parent == loop) return false;
+    }
+    return true;
+}
+
+/* Code whose relative order only matters through memory */
+static bool reorderable(const IRInstruction *instr) {
+    int64_t d;
+    switch (instr->opcode) {
+        case IR_LABEL: case IR_JUMP: case IR_JUMP_IF: case IR_JUMP_IF_NOT:
+        case IR_ALLOC: case IR_LOAD: case IR_STORE: case IR_CONST_INT: case IR_MOVE:
+        case IR_LOAD_ELEM: case IR_STORE_ELEM: case IR_ARRAY_LEN:
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_MULHI: case IR_SHL: case IR_SHR: case IR_SAR:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR: case IR_NOT:
+            return true;
+        case IR_DIV: case IR_MOD:
+            // Constant divisors cannot trap (-1 overflows on INT64_MIN)
+            return const_int(instr->src2, &d) && d != 0 && d != -1;
+        default:
+            return false;
+    }
+}
+
+/* Pure, invariant code that can run before the loop instead */
+static bool hoistable(const Nest *n, const IRInstruction *instr, const bool *stored, int before) {
+    if (!reorderable(instr) || instr->opcode == IR_LABEL || instr->opcode == IR_STORE ||
+        instr->opcode == IR_STORE_ELEM || instr->opcode == IR_LOAD_ELEM || instr->opcode == IR_ALLOC ||
+        instr->opcode == IR_DIV || instr->opcode == IR_MOD || instr->opcode == IR_JUMP ||
+        instr->opcode == IR_JUMP_IF || instr->opcode == IR_JUMP_IF_NOT) {
+        return false;
+    }
+    if (instr->opcode == IR_LOAD) {
+        int slot = slot_of(instr->src1);
+        return slot >= 0 && !stored[slot];
+    }
+    const IRValue *ops[2] = { instr->src1, instr->src2 };
+    for (int o = 0; o < 2; o++) {
+        int reg = reg_of(n, ops[o]);
+        if (reg >= 0 && n->def_pos[reg] >= before && !hoistable(n, n->defs[reg], stored, before)) return false;
+    }
+    return instr->arg_count == 0;
+}
+
+/* Slots written by the instructions [from, to] */
+static void mark_stores(const Nest *n, int from, int to, bool *stored) {
+    for (int i = from; i <= to; i++) {
+        if (n->seq[i]->opcode == IR_STORE && slot_of(n->seq[i]->dest) >= 0) stored[slot_of(n->seq[i]->dest)] = true;
+    }
+}
+
+/* Is `slot` read before being written on some path from `block`? */
+static bool slot_live(const Nest *n, int block, int slot) {
+    const IRCFG *cfg = n->cfg;
+    bool *seen = calloc(cfg->block_count + 1, sizeof(bool));
+    int *stack = malloc(sizeof(int) * (cfg->block_count + 1));
+    int sp = 0;
+    bool live = false;
+    stack[sp++] = block;
+    seen[block] = true;
+    while (sp > 0 && !live) {
+        const IRBlock *b = &cfg->blocks[stack[--sp]];
+        bool killed = false;
+        for (IRInstruction *instr = b->first; !killed && !live; instr = instr->next) {
+            if (instr->opcode == IR_LOAD && slot_of(instr->src1) == slot) live = true;
+            if (instr->opcode == IR_STORE && slot_of(instr->dest) == slot) killed = true;
+            if (instr == b->last) break;
+        }
+        if (killed) continue;
+        for (int s = 0; s < b->succ_count; s++) {
+            if (!seen[b->succs[s]]) {
+                seen[b->succs[s]] = true;
+                stack[sp++] = b->succs[s];
+            }
+        }
+    }
+    free(seen);
+    free(stack);
+    return live;
+}
+
+/* ---------- Affine indices ---------- */
+
+static Affine affine_none(void) {
+    Affine a = { false, { 0, 0 }, { -1, -1 }, -1, 0, 0 };
+    return a;
+}
+
+static Affine affine_const(int64_t c) {
+    Affine a = affine_none();
+    a.ok = true;
+    a.c = c;
+    return a;
+}
+
+static bool affine_is_const(const Affine *a) {
+    return a->ok && a->k[0] == 0 && a->k[1] == 0 && a->add < 0;
+}
+
+static Affine affine_scale(Affine a, int64_t factor) {
+    if (!a.ok) return a;
+    if (factor == 0) return affine_const(0);
+    if (__builtin_mul_overflow(a.k[0], factor, &a.k[0]) || __builtin_mul_overflow(a.k[1], factor, &a.k[1]) ||
+        __builtin_mul_overflow(a.add_k, factor, &a.add_k) || __builtin_mul_overflow(a.c, factor, &a.c)) {
+        return affine_none();
+    }
+    return a;
+}
+
+static Affine affine_add(Affine a, const Affine *b) {
+    if (!a.ok || !b->ok) return affine_none();
+    for (int x = 0; x < 2; x++) {
+        if (b->k[x] == 0) continue;
+        if (a.k[x] != 0 && a.sym[x] != b->sym[x]) return affine_none();
+        if (__builtin_add_overflow(a.k[x], b->k[x], &a.k[x])) return affine_none();
+        a.sym[x] = a.k[x] ? b->sym[x] : -1;
+    }
+    if (b->add >= 0) {
+        if (a.add >= 0 && a.add != b->add) return affine_none();
+        if (__builtin_add_overflow(a.add_k, b->add_k, &a.add_k)) return affine_none();
+        a.add = a.add_k ? b->add : -1;
+    }
+    if (__builtin_add_overflow(a.c, b->c, &a.c)) return affine_none();
+    return a;
+}
+
+/* a * (local `slot`), for forms not yet scaled by a local */
+static Affine affine_times_slot(Affine a, int slot) {
+    if (!a.ok || a.add >= 0) return affine_none();
+    for (int x = 0; x < 2; x++) {
+        if (a.k[x] == 0) continue;
+        if (a.sym[x] >= 0) return affine_none();
+        a.sym[x] = slot;
+    }
+    if (a.c != 0) {
+        a.add = slot;
+        a.add_k = a.c;
+        a.c = 0;
+    }
+    return a;
+}
+
+static bool affine_equal(const Affine *a, const Affine *b) {
+    return a->ok && b->ok && a->k[0] == b->k[0] && a->k[1] == b->k[1] && a->sym[0] == b->sym[0] &&
+           a->sym[1] == b->sym[1] && a->add == b->add && a->add_k == b->add_k && a->c == b->c;
+}
+
+static Affine affine_of(const Nest *n, const IRValue *val, const int *ivs, const bool *stored, int depth) {
+    int64_t c;
+    if (const_int(val, &c)) return affine_const(c);
+    IRInstruction *def = def_of(n, val);
+    if (!def || depth > 16) return affine_none();
+    switch (def->opcode) {
+        case IR_CONST_INT:
+        case IR_MOVE:
+            return affine_of(n, def->src1, ivs, stored, depth + 1);
+        case IR_LOAD: {
+            int slot = slot_of(def->src1);
+            Affine a = affine_const(0);
+            for (int x = 0; x < 2; x++) {
+                if (slot >= 0 && slot == ivs[x]) {
+                    a.k[x] = 1;
+                    return a;
+                }
+            }
+            if (slot < 0 || stored[slot]) return affine_none();
+            a.add = slot;
+            a.add_k = 1;
+            return a;
+        }
+        case IR_ADD:
+        case IR_SUB: {
+            Affine l = affine_of(n, def->src1, ivs, stored, depth + 1);
+            Affine r = affine_of(n, def->src2, ivs, stored, depth + 1);
+            if (def->opcode == IR_SUB) r = affine_scale(r, -1);
+            return affine_add(l, &r);
+        }
+        case IR_MUL: {
+            Affine l = affine_of(n, def->src1, ivs, stored, depth + 1);
+            Affine r = affine_of(n, def->src2, ivs, stored, depth + 1);
+            if (affine_is_const(&r)) return affine_scale(l, r.c);
+            if (affine_is_const(&l)) return affine_scale(r, l.c);
+            // A local by itself scales the other side
+            if (r.ok && r.k[0] == 0 && r.k[1] == 0 && r.c == 0 && r.add_k == 1) return affine_times_slot(l, r.add);
+            if (l.ok && l.k[0] == 0 && l.k[1] == 0 && l.c == 0 && l.add_k == 1) return affine_times_slot(r, l.add);
+            return affine_none();
+        }
+        case IR_SHL: {
+            Affine l = affine_of(n, def->src1, ivs, stored, depth + 1);
+            return const_int(def->src2, &c) && c >= 0 && c < 62 ? affine_scale(l, (int64_t)1 << c) : affine_none();
+        }
+        default:
+            return affine_none();
+    }
+}
+
+/* ---------- Arrays ---------- */
+
+/* Does every value ever stored in `slot` come from its own allocation? */
+static bool fresh_array(const Nest *n, int slot) {
+    bool any = false;
+    for (int i = 0; i < n->count; i++) {
+        const IRInstruction *instr = n->seq[i];
+        if (instr->opcode != IR_STORE || slot_of(instr->dest) != slot) continue;
+        IRInstruction *def = def_of(n, instr->src1);
+        if (!def || (def->opcode != IR_ALLOC_ARRAY && def->opcode != IR_ALLOC_FRAME_ARRAY) ||
+            n->uses[instr->src1->data.reg_num] != 1) {
+            return false;
+        }
+        any = true;
+    }
+    return any;
+}
+
+static bool may_alias(const Nest *n, const Access *a, const Access *b) {
+    if (a->array >= 0 && a->array == b->array) return true;
+    return a->array < 0 || b->array < 0 || !fresh_array(n, a->array) || !fresh_array(n, b->array);
+}
+
+/* Element accesses in [from, to]; false past the budget */
+static bool collect_accesses(const Nest *n, int from, int to, const int *ivs, const bool *stored,
+                             Access *out, int *count) {
+    *count = 0;
+    for (int i = from; i <= to; i++) {
+        const IRInstruction *instr = n->seq[i];
+        if (instr->opcode != IR_LOAD_ELEM && instr->opcode != IR_STORE_ELEM) continue;
+        if (*count == LOOPNEST_MAX_ACCESSES) return false;
+        Access *acc = &out[(*count)++];
+        IRInstruction *base = def_of(n, instr->src1);
+        int slot = base && base->opcode == IR_LOAD ? slot_of(base->src1) : -1;
+        acc->array = slot >= 0 && !stored[slot] ? slot : -1;
+        acc->store = instr->opcode == IR_STORE_ELEM;
+        acc->index = affine_of(n, instr->src2, ivs, stored, 0);
+    }
+    return true;
+}
+
+/* ---------- Fusion ---------- */
+
+static bool same_value(const Nest *n, const IRValue *a, const IRValue *b, const bool *stored, int depth) {
+    int64_t x, y;
+    if (const_int(a, &x) || const_int(b, &y)) return const_int(a, &x) && const_int(b, &y) && x == y;
+    int ra = reg_of(n, a), rb = reg_of(n, b);
+    if (ra < 0 || rb < 0) return false;
+    if (ra == rb) return true;
+    IRInstruction *da = n->defs[ra], *db = n->defs[rb];
+    if (!da || !db || da->opcode != db->opcode || depth > 3) return false;
+    switch (da->opcode) {
+        case IR_LOAD:
+            return slot_of(da->src1) >= 0 && slot_of(da->src1) == slot_of(db->src1) && !stored[slot_of(da->src1)];
+        case IR_ARRAY_LEN:
+        case IR_MOVE:
+            return same_value(n, da->src1, db->src1, stored, depth + 1);
+        default:
+            return false;
+    }
+}
+
+/* Locals a range of code reads or writes */
+static void mark_slots(const Nest *n, int from, int to, bool *read, bool *written) {
+    for (int i = from; i <= to; i++) {
+        const IRInstruction *instr = n->seq[i];
+        if (instr->opcode == IR_LOAD && slot_of(instr->src1) >= 0) read[slot_of(instr->src1)] = true;
+        if (instr->opcode == IR_STORE && slot_of(instr->dest) >= 0) written[slot_of(instr->dest)] = true;
+    }
+}
+
+/* Can the iterations of `b` run interleaved with those of `a` (which
+   originally all finished first)? */
+static bool fusion_legal(const Nest *n, const RangeLoop *a, int a_from, int a_to,
+                         const RangeLoop *b, int b_from, int b_to) {
+    int locals = n->func->local_count + 1;
+    bool *read_a = calloc(locals, sizeof(bool)), *write_a = calloc(locals, sizeof(bool));
+    bool *read_b = calloc(locals, sizeof(bool)), *write_b = calloc(locals, sizeof(bool));
+    mark_slots(n, a_from, a_to, read_a, write_a);
+    mark_slots(n, b_from, b_to, read_b, write_b);
+    bool ok = true;
+    for (int s = 0; s < locals - 1 && ok; s++) {
+        bool shared_iv = s == a->iv && s == b->iv;
+        if (shared_iv) continue;
+        if ((write_a[s] && (read_b[s] || write_b[s])) || (write_b[s] && read_a[s])) ok = false;
+    }
+
+    Access *acc_a = malloc(sizeof(Access) * LOOPNEST_MAX_ACCESSES);
+    Access *acc_b = malloc(sizeof(Access) * LOOPNEST_MAX_ACCESSES);
+    int count_a = 0, count_b = 0;
+    bool *stored = calloc(locals, sizeof(bool));
+    for (int s = 0; s < locals; s++) stored[s] = write_a[s] || write_b[s];
+    int ivs_a[2] = { a->iv, -1 }, ivs_b[2] = { b->iv, -1 };
+    ok = ok && collect_accesses(n, a_from, a_to, ivs_a, stored, acc_a, &count_a) &&
+         collect_accesses(n, b_from, b_to, ivs_b, stored, acc_b, &count_b);
+
+    // Element x touched by a at iteration p and by b at iteration q:
+    // fused, b's access comes first when q < p
+    for (int i = 0; ok && i < count_a; i++) {
+        for (int j = 0; ok && j < count_b; j++) {
+            const Access *x = &acc_a[i], *y = &acc_b[j];
+            if ((!x->store && !y->store) || !may_alias(n, x, y)) continue;
+            const Affine *fx = &x->index, *fy = &y->index;
+            if (!fx->ok || !fy->ok || fx->k[1] || fy->k[1] || fx->k[0] != fy->k[0] || fx->sym[0] >= 0 ||
+                fy->sym[0] >= 0 || fx->add != fy->add || fx->add_k != fy->add_k) {
+                ok = false;
+                break;
+            }
+            int64_t k = fx->k[0], diff = fy->c - fx->c;   // p - q = diff / k
+            if (k == 0) ok = diff != 0;
+            else if (diff % k == 0) ok = diff / k <= 0;
+        }
+    }
+    free(acc_a);
+    free(acc_b);
+    free(stored);
+    free(read_a);
+    free(write_a);
+    free(read_b);
+    free(write_b);
+    return ok;
+}
+
+static IRInstruction* make_copy_load(Nest *n, int slot, const IRValue *name_from, IRValue **reg_out) {
+    IRInstruction *load = ir_instruction_create(IR_LOAD);
+    load->dest = ir_value_create_reg(ir_function_new_reg(n->func), IR_TYPE_INT);
+    load->src1 = ir_value_create_var(slot, name_from ? name_from->name : NULL);
+    *reg_out = load->dest;
+    return load;
+}
+
+/* `STORE to_slot, LOAD from_slot` as two instructions */
+static int emit_copy(Nest *n, IRInstruction **order, int at, const IRValue *from, const IRValue *to) {
+    IRValue *reg;
+    order[at++] = make_copy_load(n, from->data.reg_num, from, &reg);
+    IRInstruction *store = ir_instruction_create(IR_STORE);
+    store->dest = ir_value_clone(to);
+    store->src1 = ir_value_clone(reg);
+    order[at++] = store;
+    return at;
+}
+
+/* Fuse `b` into `a` when it directly follows it */
+static bool try_fuse(Nest *n, const RangeLoop *a, const RangeLoop *b) {
+    int h1 = pos_of(n, a->label), s1 = pos_of(n, a->step), e1 = pos_of(n, a->exit_label);
+    int h2 = pos_of(n, b->label), s2 = pos_of(n, b->step), e2 = pos_of(n, b->exit_label);
+    if (h1 < 0 || h2 <= e1 || s2 - h2 + s1 - h1 > LOOPNEST_MAX_BODY) return false;
+
+    int locals = n->func->local_count + 1;
+    bool *stored = calloc(locals, sizeof(bool));
+    mark_stores(n, h1, s1 + 1, stored);
+
+    // Between the loops: b's start, its bound and declarations only
+    bool ok = true;
+    for (int i = e1 + 1; i < h2 && ok; i++) {
+        IRInstruction *instr = n->seq[i];
+        if (instr == b->init || instr->opcode == IR_ALLOC) continue;
+        ok = hoistable(n, instr, stored, e1 + 1);
+    }
+    stored[b->iv] = true;
+    ok = ok && pos_of(n, b->init) > e1 && same_value(n, a->init->src1, b->init->src1, stored, 0) &&
+         same_value(n, a->test->src2, b->test->src2, stored, 0);
+    free(stored);
+    if (!ok) return false;
+
+    // Registers of either loop stay inside it
+    for (int r = 0; r < n->func->reg_count; r++) {
+        int p = n->def_pos[r];
+        if (p < 0 || !((p >= h1 && p <= s1 + 1) || (p >= h2 && p <= s2 + 1))) continue;
+        int lo = p >= h2 ? h2 : h1, hi = p >= h2 ? s2 + 1 : s1 + 1;
+        for (int i = 0; i < n->count && ok; i++) {
+            if (i >= lo && i <= hi) continue;
+            const IRInstruction *instr = n->seq[i];
+            if (reg_of(n, instr->src1) == r || reg_of(n, instr->src2) == r) ok = false;
+            for (int k = 0; k < instr->arg_count; k++) ok = ok && reg_of(n, instr->args[k]) != r;
+        }
+    }
+    if (!ok || !fusion_legal(n, a, h1, s1 + 1, b, h2, s2 + 1)) return false;
+
+    // pre | hoisted | a's header and body | declarations | iv copy |
+    // b's body | a's latch | exits | iv copy
+    IRInstruction **order = malloc(sizeof(IRInstruction*) * (n->count + 8));
+    int at = 0;
+    for (int i = 0; i < h1; i++) order[at++] = n->seq[i];
+    for (int i = e1 + 1; i < h2; i++) {
+        if (n->seq[i] != b->init && n->seq[i]->opcode != IR_ALLOC) order[at++] = n->seq[i];
+    }
+    for (int i = h1; i < s1; i++) order[at++] = n->seq[i];
+    for (int i = e1 + 1; i < h2; i++) {
+        if (n->seq[i]->opcode == IR_ALLOC) order[at++] = n->seq[i];
+    }
+    if (a->iv != b->iv) at = emit_copy(n, order, at, a->iv_load->src1, b->init->dest);
+    order[at++] = b->iv_load;
+    for (int i = h2 + 4; i < s2; i++) order[at++] = n->seq[i];
+    order[at++] = a->step;
+    order[at++] = a->back;
+    order[at++] = b->exit_label;
+    order[at++] = a->exit_label;
+    if (a->iv != b->iv) at = emit_copy(n, order, at, a->iv_load->src1, b->init->dest);
+    for (int i = e2 + 1; i < n->count; i++) order[at++] = n->seq[i];
+
+    IRInstruction *dropped[6] = { b->label, b->test, b->branch, b->init, b->step, b->back };
+    relink(n, order, at);
+    for (int i = 0; i < 6; i++) {
+        dropped[i]->next = NULL;
+        ir_instruction_free(dropped[i]);
+    }
+    free(order);
+    return true;
+}
+
+/* ---------- Interchange ---------- */
+
+/* Is the index map (i, j) -> form one-to-one over the nest's ranges? */
+static bool injective(const Nest *n, const Affine *f, const RangeLoop *loops) {
+    for (int x = 0; x < 2; x++) {
+        int y = 1 - x;   // f = k[y] * iv[y] * stride + iv[x] + ...: iv[x] must stay below the stride
+        int64_t start, bound;
+        if (f->k[x] != 1 || f->sym[x] >= 0 || !const_int(loops[x].init->src1, &start) || start != 0) continue;
+        if (f->sym[y] < 0) {
+            if (const_int(loops[x].test->src2, &bound) && f->k[y] >= bound && bound >= 0) return true;
+            continue;
+        }
+        IRInstruction *def = def_of(n, loops[x].test->src2);
+        if (f->k[y] == 1 && def && def->opcode == IR_LOAD && slot_of(def->src1) == f->sym[y]) return true;
+    }
+    return false;
+}
+
+static bool unit_stride(int64_t k, int sym) {
+    return (k == 1 || k == -1) && sym < 0;
+}
+
+/* Is `slot` only updated as slot = slot +/- x in [from, to)? Integer sums
+   wrap, so any order of the terms gives the same result */
+static bool is_sum(const Nest *n, int slot, int from, int to) {
+    IRInstruction *load = NULL, *store = NULL;
+    for (int i = from; i < to; i++) {
+        IRInstruction *instr = n->seq[i];
+        if (instr->opcode == IR_LOAD && slot_of(instr->src1) == slot) {
+            if (load) return false;
+            load = instr;
+        }
+        if (instr->opcode == IR_STORE && slot_of(instr->dest) == slot) {
+            if (store || !load) return false;
+            store = instr;
+        }
+    }
+    IRInstruction *op = store ? def_of(n, store->src1) : NULL;
+    int reg = reg_of(n, load ? load->dest : NULL);
+    if (!op || reg < 0 || n->uses[reg] != 1 || n->uses[op->dest->data.reg_num] != 1) return false;
+    return (op->opcode == IR_ADD && (reg_of(n, op->src1) == reg || reg_of(n, op->src2) == reg)) ||
+           (op->opcode == IR_SUB && reg_of(n, op->src1) == reg);
+}
+
+/* Swap the loop control of the perfect nest outer { inner } */
+static bool try_interchange(Nest *n, const RangeLoop *outer, const RangeLoop *inner) {
+    int ho = pos_of(n, outer->label), so = pos_of(n, outer->step);
+    int hi = pos_of(n, inner->label), si = pos_of(n, inner->step), ei = pos_of(n, inner->exit_label);
+    int init_o = pos_of(n, outer->init);
+    if (hi <= ho + 4 || ei >= so || init_o < 0 || init_o >= ho) return false;
+
+    int locals = n->func->local_count + 1;
+    bool *stored = calloc(locals, sizeof(bool));
+    mark_stores(n, ho, so + 1, stored);
+    bool ok = true;
+
+    // Between the headers: declarations, the inner start and invariant code
+    for (int i = ho + 4; i < hi && ok; i++) {
+        IRInstruction *instr = n->seq[i];
+        if (instr == inner->init || instr->opcode == IR_ALLOC) continue;
+        ok = hoistable(n, instr, stored, ho);
+    }
+    // After the inner loop: the outer increment only
+    for (int i = ei + 1; i < so && ok; i++) {
+        IRInstruction *instr = n->seq[i];
+        ok = (instr->opcode == IR_ADD || (instr->opcode == IR_LOAD && slot_of(instr->src1) == outer->iv)) &&
+             reg_of(n, instr->dest) >= 0 && n->uses[instr->dest->data.reg_num] == 1;
+    }
+    // Nothing between the outer start and header touches the counters
+    for (int i = init_o + 1; i < ho && ok; i++) {
+        const IRInstruction *instr = n->seq[i];
+        int slot = slot_of(instr->opcode == IR_STORE ? instr->dest : instr->src1);
+        ok = slot != outer->iv && slot != inner->iv;
+    }
+    // Inner start and bound must not depend on the outer counter
+    int ivs[2] = { outer->iv, inner->iv };
+    const IRValue *bounds[4] = { inner->init->src1, inner->test->src2, outer->init->src1, outer->test->src2 };
+    for (int v = 0; v < 4 && ok; v++) {
+        int reg = reg_of(n, bounds[v]);
+        if (reg < 0) continue;
+        int p = n->def_pos[reg];
+        ok = p >= 0 && (p < init_o || (p > ho && p < hi && hoistable(n, n->defs[reg], stored, ho)));
+        if (v >= 2) ok = ok && p < init_o;
+    }
+
+    // Scalars written in the body are sums or per-iteration temporaries,
+    // and no temporary or counter is read after the nest
+    int first_body = ir_cfg_block_of(n->cfg, inner->branch) + 1;
+    int after = ir_cfg_block_of(n->cfg, outer->exit_label);
+    bool *seen = calloc(locals, sizeof(bool));
+    bool *sums = calloc(locals, sizeof(bool));
+    for (int i = hi + 4; i < si && ok; i++) {
+        const IRInstruction *instr = n->seq[i];
+        int slot = -1;
+        if (instr->opcode == IR_STORE) slot = slot_of(instr->dest);
+        else if (instr->opcode == IR_LOAD) slot = slot_of(instr->src1);
+        if (slot < 0 || slot == outer->iv || slot == inner->iv || seen[slot] || !stored[slot]) continue;
+        seen[slot] = true;
+        if (instr->opcode == IR_LOAD) ok = sums[slot] = is_sum(n, slot, hi + 4, si);
+        else ok = ir_cfg_block_of(n->cfg, instr) == first_body;
+    }
+    for (int s = 0; s < locals - 1 && ok; s++) {
+        if (stored[s] && !sums[s] && slot_live(n, after, s)) ok = false;
+    }
+    free(seen);
+    free(sums);
+
+    Access *acc = malloc(sizeof(Access) * LOOPNEST_MAX_ACCESSES);
+    int count = 0;
+    ok = ok && collect_accesses(n, hi, si, ivs, stored, acc, &count);
+    free(stored);
+
+    // Pairs that may meet need one injective index: then they meet only
+    // within one iteration, or along one counter
+    RangeLoop loops[2] = { *outer, *inner };
+    int gain = 0;
+    for (int i = 0; ok && i < count; i++) {
+        const Affine *f = &acc[i].index;
+        if (f->ok) {
+            if (unit_stride(f->k[0], f->sym[0]) && f->k[1] != 0 && !unit_stride(f->k[1], f->sym[1])) gain++;
+            if (unit_stride(f->k[1], f->sym[1]) && f->k[0] != 0 && !unit_stride(f->k[0], f->sym[0])) gain--;
+        }
+        for (int j = i; ok && j < count; j++) {
+            if ((!acc[i].store && !acc[j].store) || !may_alias(n, &acc[i], &acc[j])) continue;
+            if (!affine_equal(&acc[i].index, &acc[j].index)) {
+                ok = false;
+                break;
+            }
+            if (f->k[0] == 0 && f->k[1] == 0) ok = false;
+            else if (f->k[0] != 0 && f->k[1] != 0) ok = injective(n, f, loops);
+        }
+    }
+    free(acc);
+    if (!ok || gain <= 0) return false;
+
+    // Hoist the invariant code between the headers above the nest
+    IRInstruction **order = malloc(sizeof(IRInstruction*) * (n->count + 8));
+    int at = 0;
+    for (int i = 0; i < ho; i++) {
+        if (i != init_o) order[at++] = n->seq[i];
+    }
+    for (int i = ho + 4; i < hi; i++) {
+        if (n->seq[i] != inner->init && n->seq[i]->opcode != IR_ALLOC) order[at++] = n->seq[i];
+    }
+    order[at++] = outer->init;
+    for (int i = ho; i < ho + 4; i++) order[at++] = n->seq[i];
+    for (int i = ho + 4; i < hi; i++) {
+        if (n->seq[i] == inner->init || n->seq[i]->opcode == IR_ALLOC) order[at++] = n->seq[i];
+    }
+    for (int i = hi; i < n->count; i++) order[at++] = n->seq[i];
+    relink(n, order, at);
+    free(order);
+
+    // Exchange start, bound and counter between the two loops
+    IRValue *tmp;
+    tmp = outer->init->dest; outer->init->dest = inner->init->dest; inner->init->dest = tmp;
+    tmp = outer->init->src1; outer->init->src1 = inner->init->src1; inner->init->src1 = tmp;
+    tmp = outer->iv_load->src1; outer->iv_load->src1 = inner->iv_load->src1; inner->iv_load->src1 = tmp;
+    tmp = outer->test->src2; outer->test->src2 = inner->test->src2; inner->test->src2 = tmp;
+    tmp = outer->step->dest; outer->step->dest = inner->step->dest; inner->step->dest = tmp;
+    const RangeLoop *loops_now[2] = { outer, inner };
+    for (int l = 0; l < 2; l++) {
+        // Fresh increments: the old ones may feed other uses of the counter
+        IRInstruction *step = loops_now[l]->step;
+        IRValue *reg;
+        IRInstruction *load = make_copy_load(n, step->dest->data.reg_num, step->dest, &reg);
+        IRInstruction *add = ir_instruction_create(IR_ADD);
+        add->dest = ir_value_create_reg(ir_function_new_reg(n->func), IR_TYPE_INT);
+        add->src1 = ir_value_clone(reg);
+        add->src2 = ir_value_create_int(1);
+        IRInstruction *prev = n->func->instructions;
+        while (prev->next != step) prev = prev->next;
+        ir_function_insert_after(n->func, prev, load);
+        ir_function_insert_after(n->func, load, add);
+        ir_value_free(step->src1);
+        step->src1 = ir_value_clone(add->dest);
+    }
+    return true;
+}
+
+/* ---------- Driver ---------- */
+
+/* One transformation; false when none applies */
+static bool transform_once(IRFunction *func) {
+    Nest n;
+    memset(&n, 0, sizeof(n));
+    n.func = func;
+    n.cfg = ir_cfg_build(func);
+    nest_index(&n);
+
+    int loops = n.cfg->loop_count;
+    RangeLoop *rl = calloc(loops + 1, sizeof(RangeLoop));
+    bool *matched = calloc(loops + 1, sizeof(bool));
+    for (int l = 0; l < loops; l++) matched[l] = match_range_loop(&n, &n.cfg->loops[l], &rl[l]);
+
+    bool changed = false;
+    // Fusion: an innermost loop whose exit block leads into the next loop
+    for (int a = 0; a < loops && !changed; a++) {
+        if (!matched[a] || !is_innermost(n.cfg, a)) continue;
+        for (int b = 0; b < loops && !changed; b++) {
+            if (b == a || !matched[b] || !is_innermost(n.cfg, b) ||
+                n.cfg->loops[b].parent != n.cfg->loops[a].parent || rl[b].header != rl[a].latch + 2) {
+                continue;
+            }
+            bool body_ok = true;
+            for (int i = pos_of(&n, rl[a].label); body_ok && n.seq[i] != rl[b].exit_label; i++) {
+                body_ok = reorderable(n.seq[i]);
+            }
+            changed = body_ok && try_fuse(&n, &rl[a], &rl[b]);
+        }
+    }
+    // Interchange: a loop whose only child fills its body
+    for (int o = 0; o < loops && !changed; o++) {
+        if (!matched[o]) continue;
+        for (int i = 0; i < loops && !changed; i++) {
+            if (!matched[i] || n.cfg->loops[i].parent != o || !is_innermost(n.cfg, i) ||
+                rl[i].header != rl[o].header + 2 || rl[i].latch + 1 != rl[o].latch) {
+                continue;
+            }
+            bool body_ok = true;
+            for (int k = pos_of(&n, rl[o].label); body_ok && n.seq[k] != rl[o].exit_label; k++) {
+                body_ok = reorderable(n.seq[k]);
+            }
+            changed = body_ok && try_interchange(&n, &rl[o], &rl[i]);
+        }
+    }
+
+    free(rl);
+    free(matched);
+    free(n.seq);
+    free(n.defs);
+    free(n.uses);
+    free(n.def_pos);
+    ir_cfg_free(n.cfg);
+    return changed;
+}
+
+bool ir_loop_nest_function(IRFunction *func) {
+    if (!func || !func->instructions) return false;
+    int changes = 0;
+    // Cleaning up between steps drops the counter copies fusion leaves
+    while (changes < LOOPNEST_MAX_CHANGES && transform_once(func)) {
+        ir_simplify_function(func);
+        changes++;
+    }
+    return changes > 0;
+}
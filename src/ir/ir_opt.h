@@ -0,0 +1,99 @@
+/* ========================================
+   SUB Language - IR Optimization Passes
+   Function- and module-level transformations run by ir_optimize()
+   File: ir_opt.h
+   ======================================== */
+
+#ifndef SUB_IR_OPT_H
+#define SUB_IR_OPT_H
+
+#include "ir.h"
+
+/* Constant folding, copy/constant propagation, block-local load
+   forwarding, algebraic identities (x+0, x*1, x-x, x<x, ...), branch
+   folding and dead/unreachable code removal. Returns true on change. */
+bool ir_simplify_function(IRFunction *func);
+
+/* Evaluate a binary opcode on constants with the backends' wrapping
+   semantics; false when it cannot be folded (division traps, non-binary). */
+bool ir_fold_binary(IROpcode op, int64_t a, int64_t b, int64_t *out);
+
+/* Sparse conditional constant propagation: values of registers and of
+   locals at block entry are propagated only along edges that can
+   execute, so branches on constants flowing through locals and joins
+   are decided and the arms they skip removed. Returns true on change. */
+bool ir_sccp_function(IRFunction *func);
+
+/* Range analysis: intervals and symbolic bounds (local + k, array
+   length + k) for locals along CFG edges, refined by branch conditions.
+   Element accesses whose index is proven in [0, length) are marked
+   in_bounds and lose their run-time check. Returns true on change. */
+bool ir_bounds_function(IRFunction *func);
+
+/* Loop nest optimizer over the CFG loop tree: adjacent range loops with
+   the same start and bound are fused when no element dependence runs
+   backwards between them; perfect two-deep nests are interchanged when
+   most accesses stride by the inner index and the index maps allow it.
+   Returns true on change. */
+bool ir_loop_nest_function(IRFunction *func);
+
+/* Compile-time evaluation: calls with constant arguments to pure
+   functions (integers, own locals and arrays, pure callees only) are
+   run by a fuel-bounded IR interpreter and replaced by their result.
+   Calls it cannot finish are left for run time. Returns true on change. */
+bool ir_ctfe_module(IRModule *module);
+
+/* Multiply/divide/modulo by constants rewritten into shift, lea-able and
+   multiply-high sequences; multiplications of loop induction variables
+   replaced by additive derived induction variables. */
+bool ir_strength_reduce_function(IRFunction *func);
+
+/* Function specialization: call sites passing constants call a copy of
+   the callee with those parameters bound, kept when simplification and
+   constant propagation shrink it; sites with the same constants share a
+   copy. Recursive functions bind only parameters passed on unchanged.
+   Returns true on change. */
+bool ir_specialize_module(IRModule *module);
+
+/* Bottom-up inlining over the module call graph. Call sites whose
+   callee cost (less call overhead and constant-argument bonus) fits
+   `threshold`, scaled by loop depth, are expanded; calls inside a
+   recursive cycle are never inlined. Functions left without callers
+   are removed. Returns true on change. */
+bool ir_inline_module(IRModule *module, int threshold);
+
+/* Unroll innermost counted loops (constant start, bound and step):
+   fully when small, otherwise by a factor with a straight-line
+   remainder. Honors per-loop unroll(N) hints; automatic decisions
+   grow with `level` (-O2 tiny loops, -O3 partial unrolling). */
+bool ir_unroll_loops_function(IRFunction *func, int level);
+
+/* Replace innermost counted loops over arrays (element-wise bodies,
+   sum reductions and, with 4 lanes, min/max reductions) by an
+   IR_VECTOR_LOOP over `width` 64-bit lanes. The original loop stays as
+   the scalar epilogue and as the fallback when a runtime alias check
+   finds two arrays that must not be the same. */
+bool ir_vectorize_function(IRFunction *func, int width);
+
+/* Escape analysis over the call graph: a constant-size array that is
+   only indexed, copied between locals and passed to parameters that do
+   not escape is allocated in its function's frame (IR_ALLOC_FRAME_ARRAY),
+   or split into one local per element when every index is constant. */
+bool ir_escape_module(IRModule *module);
+
+/* Profile-guided layout (no-op without --profile-use counts): blocks
+   chained along their hottest successor with never-executed blocks
+   last, so hot branches fall through, and functions ordered hottest
+   first. */
+bool ir_profile_layout_module(IRModule *module);
+
+/* Self tail calls become jumps to the function entry with parameters
+   rebound; `return x + f(..)` / `return x * f(..)` recursion is turned
+   into a loop over an accumulator local. */
+bool ir_eliminate_tail_recursion(IRFunction *func);
+
+/* `%r = CALL f(args); RETURN %r` becomes IR_TAIL_CALL, which the
+   backend emits as a jump reusing the caller's frame. Run last. */
+bool ir_mark_tail_calls(IRFunction *func);
+
+#endif /* SUB_IR_OPT_H */
@@ -0,0 +1,278 @@
+/* ========================================
+   SUB Language - IR Pass Manager
+   Implementation
+   File: ir_pass.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_pass.h"
+#include "ir_opt.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ---------- Pass adapters ---------- */
+
+/* Default inlining budget per optimization level */
+static int ir_default_inline_threshold(int level) {
+    switch (level) {
+        case 0: return -1;   // disabled
+        case 1: return 10;
+        case 2: return 25;
+        default: return 60;
+    }
+}
+
+static bool pass_simplify(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    return ir_simplify_function(func);
+}
+
+/* Cleans up the parameter rebinding it introduces */
+static bool pass_tailrec(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    if (!ir_eliminate_tail_recursion(func)) return false;
+    ir_simplify_function(func);
+    return true;
+}
+
+/* Folds the constants it finds and drops the arms it proves dead */
+static bool pass_sccp(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    if (!ir_sccp_function(func)) return false;
+    ir_simplify_function(func);
+    return true;
+}
+
+static bool pass_bounds(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    return ir_bounds_function(func);
+}
+
+static bool pass_loopnest(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    return ir_loop_nest_function(func);
+}
+
+static bool pass_inline(IRModule *module, const IROptions *opts) {
+    int threshold = opts->inline_threshold >= 0 ? opts->inline_threshold
+                                                : ir_default_inline_threshold(opts->level);
+    return ir_inline_module(module, threshold);
+}
+
+static bool pass_vectorize(IRFunction *func, const IROptions *opts) {
+    if (opts->vector_width < 2) return false;
+    return ir_vectorize_function(func, opts->vector_width);
+}
+
+static bool pass_unroll(IRFunction *func, const IROptions *opts) {
+    return ir_unroll_loops_function(func, opts->level);
+}
+
+static bool pass_strength(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    return ir_strength_reduce_function(func);
+}
+
+static bool pass_escape(IRModule *module, const IROptions *opts) {
+    (void)opts;
+    return ir_escape_module(module);
+}
+
+static bool pass_ctfe(IRModule *module, const IROptions *opts) {
+    (void)opts;
+    return ir_ctfe_module(module);
+}
+
+static bool pass_specialize(IRModule *module, const IROptions *opts) {
+    (void)opts;
+    return ir_specialize_module(module);
+}
+
+static bool pass_layout(IRModule *module, const IROptions *opts) {
+    (void)opts;
+    return ir_profile_layout_module(module);
+}
+
+static bool pass_tailcall(IRFunction *func, const IROptions *opts) {
+    (void)opts;
+    return ir_mark_tail_calls(func);
+}
+
+static const IRPass ir_passes[] = {
+    { "simplify",  "constant folding, propagation, dead code removal", pass_simplify, NULL },
+    { "tailrec",   "tail recursion to loops",                          pass_tailrec, NULL },
+    { "sccp",      "conditional constant propagation, dead branches",  pass_sccp, NULL },
+    { "bounds",    "range analysis, drop proven array bounds checks",  pass_bounds, NULL },
+    { "loopnest",  "loop fusion and interchange",                      pass_loopnest, NULL },
+    { "inline",    "call-graph inliner (--inline-threshold)",          NULL, pass_inline },
+    { "vectorize", "SIMD counted array loops (--march)",               pass_vectorize, NULL },
+    { "ctfe",      "evaluate pure calls with constant arguments",      NULL, pass_ctfe },
+    { "specialize", "clone functions for constant arguments",          NULL, pass_specialize },
+    { "unroll",    "counted loop unrolling",                           pass_unroll, NULL },
+    { "strength",  "strength reduction, induction variables",          pass_strength, NULL },
+    { "escape",    "frame allocation, scalar replacement of arrays",   NULL, pass_escape },
+    { "layout",    "profile-guided block and function order",          NULL, pass_layout },
+    { "tailcall",  "mark frame-reusing tail calls (run last)",         pass_tailcall, NULL },
+    { "verify",    "check IR invariants, stop on failure",             NULL, NULL },
+};
+
+#define IR_PASS_COUNT ((int)(sizeof(ir_passes) / sizeof(ir_passes[0])))
+
+const IRPass* ir_pass_registry(int *count) {
+    if (count) *count = IR_PASS_COUNT;
+    return ir_passes;
+}
+
+const IRPass* ir_pass_lookup(const char *name) {
+    for (int i = 0; i < IR_PASS_COUNT; i++) {
+        if (strcmp(ir_passes[i].name, name) == 0) return &ir_passes[i];
+    }
+    return NULL;
+}
+
+void ir_pass_print_registry(FILE *out) {
+    for (int i = 0; i < IR_PASS_COUNT; i++) {
+        fprintf(out, "  %-10s %s\n", ir_passes[i].name, ir_passes[i].description);
+    }
+}
+
+/* ---------- Pipelines ---------- */
+
+IRPassManager* ir_pass_manager_create(const IROptions *opts) {
+    IRPassManager *pm = calloc(1, sizeof(IRPassManager));
+    pm->opts = opts;
+    pm->time_passes = opts->time_passes;
+    pm->verify = opts->verify;
+    return pm;
+}
+
+void ir_pass_manager_free(IRPassManager *pm) {
+    if (!pm) return;
+    free(pm->passes);
+    free(pm->stats);
+    free(pm);
+}
+
+void ir_pass_manager_add(IRPassManager *pm, const IRPass *pass) {
+    if (pm->pass_count == pm->capacity) {
+        pm->capacity = pm->capacity ? pm->capacity * 2 : 16;
+        pm->passes = realloc(pm->passes, sizeof(IRPass*) * pm->capacity);
+        pm->stats = realloc(pm->stats, sizeof(IRPassStats) * pm->capacity);
+    }
+    memset(&pm->stats[pm->pass_count], 0, sizeof(IRPassStats));
+    pm->stats[pm->pass_count].pass = pass;
+    pm->passes[pm->pass_count++] = pass;
+}
+
+/*
+ * -O1: cleanup, tail recursion, compile-time calls, small-callee
+ *      inlining, constant propagation, bounds-check removal, hinted
+ *      unrolling.
+ * -O2: adds function specialization, loop fusion and interchange,
+ *      vectorization, tiny-loop unrolling and strength reduction.
+ * -O3: same passes; inline budget and unroll factors grow with the level.
+ * Both lay out blocks and functions by a --profile-use profile, if any.
+ */
+void ir_pass_manager_add_default_pipeline(IRPassManager *pm, int level) {
+    static const char *o1[] = { "simplify", "tailrec", "ctfe", "inline", "sccp",
+                                "bounds", "unroll", "escape", "layout", "tailcall", NULL };
+    static const char *o2[] = { "simplify", "tailrec", "ctfe", "specialize", "inline", "sccp", "loopnest",
+                                "bounds",
+                                // Vectorize before unrolling claims the same loops
+                                "vectorize", "unroll", "strength", "escape", "simplify", "layout", "tailcall", NULL };
+    if (level <= 0) return;
+    const char **names = level == 1 ? o1 : o2;
+    for (int i = 0; names[i]; i++) {
+        ir_pass_manager_add(pm, ir_pass_lookup(names[i]));
+    }
+}
+
+bool ir_pass_manager_parse_pipeline(IRPassManager *pm, const char *spec) {
+    char *copy = strdup(spec);
+    bool ok = true;
+    char *save = NULL;
+    for (char *name = strtok_r(copy, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        const IRPass *pass = ir_pass_lookup(name);
+        if (!pass) {
+            fprintf(stderr, "Error: Unknown pass '%s'. Available passes:\n", name);
+            ir_pass_print_registry(stderr);
+            ok = false;
+            break;
+        }
+        ir_pass_manager_add(pm, pass);
+    }
+    free(copy);
+    return ok;
+}
+
+/* ---------- Execution ---------- */
+
+int ir_module_instruction_count(const IRModule *module) {
+    int count = 0;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static double pass_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool pass_run_one(const IRPass *pass, IRModule *module, const IROptions *opts) {
+    if (pass->run_module) return pass->run_module(module, opts);
+    bool changed = false;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        changed |= pass->run_function(func, opts);
+    }
+    return changed;
+}
+
+bool ir_pass_manager_run(IRPassManager *pm, IRModule *module) {
+    if (!module) return false;
+    if (pm->verify && !ir_verify_module(module, "IR generation")) return false;
+
+    for (int i = 0; i < pm->pass_count; i++) {
+        const IRPass *pass = pm->passes[i];
+        IRPassStats *st = &pm->stats[i];
+
+        // `verify` in a --passes pipeline is a checkpoint rather than a transformation
+        bool checkpoint = !pass->run_function && !pass->run_module;
+        bool ok = true;
+        double start = 0.0;
+        if (pm->time_passes) {
+            st->instrs_before = ir_module_instruction_count(module);
+            start = pass_clock();
+        }
+        if (checkpoint) ok = ir_verify_module(module, "verify");
+        else st->changed = pass_run_one(pass, module, pm->opts);
+        if (pm->time_passes) {
+            st->seconds = pass_clock() - start;
+            st->instrs_after = ir_module_instruction_count(module);
+        }
+        if (!ok) return false;
+
+        if (pm->verify && !checkpoint && !ir_verify_module(module, pass->name)) return false;
+    }
+    return true;
+}
+
+void ir_pass_manager_print_timing(const IRPassManager *pm, FILE *out) {
+    double total = 0.0;
+    fprintf(out, "===== IR pass timing =====\n");
+    fprintf(out, "  %-3s %-10s %10s %9s %9s %7s\n", "#", "pass", "time(ms)", "before", "after", "delta");
+    for (int i = 0; i < pm->pass_count; i++) {
+        const IRPassStats *st = &pm->stats[i];
+        fprintf(out, "  %-3d %-10s %10.3f %9d %9d %+7d%s\n", i + 1, st->pass->name,
+                st->seconds * 1000.0, st->instrs_before, st->instrs_after,
+                st->instrs_after - st->instrs_before, st->changed ? "" : "  (no change)");
+        total += st->seconds;
+    }
+    fprintf(out, "  %-3s %-10s %10.3f\n", "", "total", total * 1000.0);
+}
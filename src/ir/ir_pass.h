@@ -0,0 +1,67 @@
+/* ========================================
+   SUB Language - IR Pass Manager
+   Pass registry, -O pipelines, per-pass timing and IR verification
+   File: ir_pass.h
+   ======================================== */
+
+#ifndef SUB_IR_PASS_H
+#define SUB_IR_PASS_H
+
+#include "ir.h"
+#include <stdio.h>
+
+/* A registered transformation. Exactly one of run_function (applied to
+   every function in turn) and run_module is set; both return true when
+   the IR changed. The `verify` checkpoint sets neither. */
+typedef struct IRPass {
+    const char *name;
+    const char *description;
+    bool (*run_function)(IRFunction *func, const IROptions *opts);
+    bool (*run_module)(IRModule *module, const IROptions *opts);
+} IRPass;
+
+/* Statistics for one pipeline step (--time-passes) */
+typedef struct {
+    const IRPass *pass;
+    double seconds;
+    int instrs_before;
+    int instrs_after;
+    bool changed;
+} IRPassStats;
+
+typedef struct IRPassManager {
+    const IROptions *opts;
+    const IRPass **passes;   // Pipeline in execution order
+    IRPassStats *stats;      // One entry per pipeline step
+    int pass_count;
+    int capacity;
+    bool time_passes;        // Collect IRPassStats
+    bool verify;             // Run ir_verify_module before the first and after every pass
+} IRPassManager;
+
+/* Registry */
+const IRPass* ir_pass_lookup(const char *name);
+const IRPass* ir_pass_registry(int *count);
+void ir_pass_print_registry(FILE *out);
+
+/* Pipeline construction and execution */
+IRPassManager* ir_pass_manager_create(const IROptions *opts);
+void ir_pass_manager_free(IRPassManager *pm);
+void ir_pass_manager_add(IRPassManager *pm, const IRPass *pass);
+/* Standard pipeline for -O<level> (empty at -O0) */
+void ir_pass_manager_add_default_pipeline(IRPassManager *pm, int level);
+/* Comma-separated pass names; reports unknown names and returns false */
+bool ir_pass_manager_parse_pipeline(IRPassManager *pm, const char *spec);
+/* Returns false if verification failed (the module is left as is) */
+bool ir_pass_manager_run(IRPassManager *pm, IRModule *module);
+void ir_pass_manager_print_timing(const IRPassManager *pm, FILE *out);
+
+/* Structural IR checks (see the operand conventions in ir.h).
+   ir_verify_function writes the first problem to `msg`;
+   ir_verify_module reports every broken function on stderr. */
+bool ir_verify_function(IRFunction *func, char *msg, size_t msg_size);
+bool ir_verify_module(IRModule *module, const char *stage);
+
+int ir_module_instruction_count(const IRModule *module);
+
+#endif /* SUB_IR_PASS_H */
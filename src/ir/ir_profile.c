@@ -0,0 +1,291 @@
+/* ========================================
+   SUB Language - Profile-Guided Optimization
+   Instrumentation, profile loading, block and function layout
+   File: ir_profile.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_profile.h"
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---------- Counter layout ---------- */
+
+static uint64_t fnv_bytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 1099511628211ULL;
+    return hash;
+}
+
+uint64_t ir_profile_checksum(const IRModule *module) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const IRFunction *func = module->functions; func; func = func->next) {
+        hash = fnv_bytes(hash, func->name, strlen(func->name) + 1);
+        hash = fnv_bytes(hash, &func->param_count, sizeof(func->param_count));
+        for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+            uint32_t op = (uint32_t)instr->opcode;
+            hash = fnv_bytes(hash, &op, sizeof(op));
+        }
+    }
+    return hash;
+}
+
+static int module_block_count(IRModule *module) {
+    int count = 0;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        IRCFG *cfg = ir_cfg_build(func);
+        count += cfg->block_count;
+        ir_cfg_free(cfg);
+    }
+    return count;
+}
+
+void ir_profile_instrument(IRModule *module) {
+    module->profile_checksum = ir_profile_checksum(module);
+    int counter = 0;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        IRCFG *cfg = ir_cfg_build(func);
+        for (int b = 0; b < cfg->block_count; b++) {
+            // After the block's label and ALLOC markers
+            IRBlock *block = &cfg->blocks[b];
+            IRInstruction *after = block->before;
+            for (IRInstruction *instr = block->first;
+                 instr->opcode == IR_LABEL || instr->opcode == IR_ALLOC; instr = instr->next) {
+                after = instr;
+                if (instr == block->last) break;
+            }
+            IRInstruction *count = ir_instruction_create(IR_PROFILE_COUNT);
+            count->src1 = ir_value_create_int(counter++);
+            ir_function_insert_after(func, after, count);
+        }
+        ir_cfg_free(cfg);
+
+        if (!module->entry_point || strcmp(func->name, module->entry_point) != 0) continue;
+        IRInstruction *prev = NULL;
+        for (IRInstruction *instr = func->instructions; instr; prev = instr, instr = instr->next) {
+            if (instr->opcode != IR_RETURN) continue;
+            IRInstruction *write = ir_instruction_create(IR_PROFILE_WRITE);
+            ir_function_insert_after(func, prev, write);
+        }
+    }
+    module->profile_counters = counter;
+}
+
+bool ir_profile_apply(IRModule *module, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open profile %s\n", path);
+        return false;
+    }
+    uint64_t header[IR_PROFILE_HEADER_WORDS];
+    if (fread(header, sizeof(uint64_t), IR_PROFILE_HEADER_WORDS, file) != IR_PROFILE_HEADER_WORDS ||
+        header[0] != IR_PROFILE_MAGIC || header[2] > (1u << 28)) {
+        fprintf(stderr, "Error: %s is not a SUB profile\n", path);
+        fclose(file);
+        return false;
+    }
+    size_t counter_count = (size_t)header[2];
+    uint64_t *counts = malloc(sizeof(uint64_t) * (counter_count ? counter_count : 1));
+    size_t got = fread(counts, sizeof(uint64_t), counter_count, file);
+    fclose(file);
+    if (got != counter_count) {
+        fprintf(stderr, "Error: %s is truncated\n", path);
+        free(counts);
+        return false;
+    }
+    if (header[1] != ir_profile_checksum(module) || counter_count != (size_t)module_block_count(module)) {
+        fprintf(stderr, "Warning: profile %s was recorded for a different program; ignoring it\n", path);
+        free(counts);
+        return true;
+    }
+
+    size_t counter = 0;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        IRCFG *cfg = ir_cfg_build(func);
+        for (int b = 0; b < cfg->block_count; b++) {
+            uint64_t raw = counts[counter++];
+            int64_t count = raw > INT64_MAX ? INT64_MAX : (int64_t)raw;
+            if (b == 0) func->profile_entry = count;
+            for (IRInstruction *instr = cfg->blocks[b].first;; instr = instr->next) {
+                instr->profile_count = count;
+                if (instr == cfg->blocks[b].last) break;
+            }
+        }
+        ir_cfg_free(cfg);
+    }
+    free(counts);
+    return true;
+}
+
+/* ---------- Layout ---------- */
+
+static int64_t block_count(const IRBlock *block) {
+    int64_t count = -1;
+    for (const IRInstruction *instr = block->first;; instr = instr->next) {
+        if (instr->profile_count > count) count = instr->profile_count;
+        if (instr == block->last) break;
+    }
+    return count;
+}
+
+static bool falls_through(const IRInstruction *last) {
+    return last->opcode != IR_JUMP && last->opcode != IR_RETURN && last->opcode != IR_TAIL_CALL;
+}
+
+static IROpcode inverted_branch(IROpcode op) {
+    return op == IR_JUMP_IF ? IR_JUMP_IF_NOT : IR_JUMP_IF;
+}
+
+/*
+ * Place blocks in chains that continue with the hottest successor,
+ * blocks that never ran in training last; a conditional branch whose
+ * hot successor now follows it is inverted so that path falls through.
+ * Blocks are first given explicit jumps to their fall-through successor
+ * so they can move freely; simplify drops the ones that end up jumping
+ * to the next block.
+ */
+static bool layout_function(IRFunction *func) {
+    IRCFG *cfg = ir_cfg_build(func);
+    int n = cfg->block_count;
+    if (n < 3 || falls_through(cfg->blocks[n - 1].last)) {
+        ir_cfg_free(cfg);
+        return false;
+    }
+    int64_t *count = malloc(sizeof(int64_t) * n);
+    bool profiled = false;
+    for (int b = 0; b < n; b++) {
+        count[b] = block_count(&cfg->blocks[b]);
+        profiled |= count[b] >= 0;
+    }
+
+    // Chains along the hottest successor; ties keep the fall-through
+    int *order = malloc(sizeof(int) * n);
+    bool *placed = calloc(n, sizeof(bool));
+    bool moved = false;
+    for (int k = 0, cur = 0; profiled && k < n; k++) {
+        placed[cur] = true;
+        order[k] = cur;
+        moved |= cur != k;
+        int next = -1;
+        const IRBlock *block = &cfg->blocks[cur];
+        for (int i = 0; i < block->succ_count; i++) {
+            int s = block->succs[i];
+            if (placed[s] || count[s] == 0) continue;
+            if (next < 0 || count[s] > count[next] || (count[s] == count[next] && s == cur + 1)) next = s;
+        }
+        for (int b = 0; next < 0 && b < n; b++) {
+            if (!placed[b] && count[b] != 0) next = b;
+        }
+        for (int b = 0; next < 0 && b < n; b++) {
+            if (!placed[b]) next = b;
+        }
+        cur = next;
+    }
+    if (!moved) {
+        free(order);
+        free(placed);
+        free(count);
+        ir_cfg_free(cfg);
+        return false;
+    }
+
+    IRInstruction **first = malloc(sizeof(IRInstruction*) * n);
+    IRInstruction **last = malloc(sizeof(IRInstruction*) * n);
+    for (int b = 0; b < n; b++) {
+        first[b] = cfg->blocks[b].first;
+        last[b] = cfg->blocks[b].last;
+    }
+    for (int b = 0; b + 1 < n; b++) {
+        if (!falls_through(last[b])) continue;
+        if (first[b + 1]->opcode != IR_LABEL) {
+            IRInstruction *label = ir_instruction_create(IR_LABEL);
+            label->dest = ir_value_create_unique_label("L_LAYOUT");
+            label->profile_count = count[b + 1];
+            ir_function_insert_after(func, last[b], label);
+            first[b + 1] = label;
+        }
+        IRInstruction *jump = ir_instruction_create(IR_JUMP);
+        jump->dest = ir_value_clone(first[b + 1]->dest);
+        jump->profile_count = count[b];
+        ir_function_insert_after(func, last[b], jump);
+        last[b] = jump;
+    }
+
+    func->instructions = first[order[0]];
+    for (int k = 0; k < n; k++) {
+        last[order[k]]->next = k + 1 < n ? first[order[k + 1]] : NULL;
+    }
+
+    // `JUMP_IF c, Lnext; JUMP Lother` becomes `JUMP_IF_NOT c, Lother`
+    for (int k = 0; k + 1 < n; k++) {
+        int b = order[k];
+        IRInstruction *next_first = first[order[k + 1]];
+        if (last[b]->opcode != IR_JUMP || first[b] == last[b] || next_first->opcode != IR_LABEL) continue;
+        IRInstruction *branch = first[b];
+        while (branch->next != last[b]) branch = branch->next;
+        if ((branch->opcode != IR_JUMP_IF && branch->opcode != IR_JUMP_IF_NOT) ||
+            strcmp(branch->dest->data.label, next_first->dest->data.label) != 0) {
+            continue;
+        }
+        IRValue *target = branch->dest;
+        branch->dest = last[b]->dest;
+        last[b]->dest = target;
+        branch->opcode = inverted_branch(branch->opcode);
+    }
+
+    free(first);
+    free(last);
+    free(order);
+    free(placed);
+    free(count);
+    ir_cfg_free(cfg);
+    ir_simplify_function(func);
+    return true;
+}
+
+/* Hottest block of a function (-1 without a profile) */
+static int64_t function_heat(const IRFunction *func) {
+    int64_t heat = func->profile_entry;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->profile_count > heat) heat = instr->profile_count;
+    }
+    return heat;
+}
+
+bool ir_profile_layout_module(IRModule *module) {
+    bool changed = false;
+    int count = 0;
+    bool profiled = false;
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        changed |= layout_function(func);
+        profiled |= func->profile_entry >= 0;
+        count++;
+    }
+    if (!profiled || count < 2) return changed;
+
+    // Hot functions first in .text (stable insertion sort)
+    IRFunction **funcs = malloc(sizeof(IRFunction*) * count);
+    int64_t *heat = malloc(sizeof(int64_t) * count);
+    int i = 0;
+    for (IRFunction *func = module->functions; func; func = func->next, i++) {
+        int j = i;
+        int64_t h = function_heat(func);
+        while (j > 0 && heat[j - 1] < h) {
+            funcs[j] = funcs[j - 1];
+            heat[j] = heat[j - 1];
+            j--;
+        }
+        funcs[j] = func;
+        heat[j] = h;
+        changed |= j != i;
+    }
+    module->functions = funcs[0];
+    for (i = 0; i < count; i++) funcs[i]->next = i + 1 < count ? funcs[i + 1] : NULL;
+    free(funcs);
+    free(heat);
+    return changed;
+}
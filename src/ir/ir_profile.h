@@ -0,0 +1,40 @@
+/* ========================================
+   SUB Language - Profile-Guided Optimization
+   Block counters, .subprof files and profile annotations
+   File: ir_profile.h
+   ======================================== */
+
+#ifndef SUB_IR_PROFILE_H
+#define SUB_IR_PROFILE_H
+
+#include "ir.h"
+
+/*
+ * Counters are numbered on the unoptimized IR, one per basic block in
+ * function order, so an instrumented build and a --profile-use build of
+ * the same source agree on them. A .subprof file is the instrumented
+ * program's counter area, written when main returns (little-endian):
+ *   u64 IR_PROFILE_MAGIC, u64 module checksum, u64 counter count,
+ *   one u64 execution count per counter.
+ * Calls need no counters of their own: a call runs once per execution
+ * of its block.
+ */
+#define IR_PROFILE_MAGIC 0x31464f5250425553ULL   // "SUBPROF1"
+#define IR_PROFILE_HEADER_WORDS 3
+
+/* Shape of a module as generated: function names, parameter counts and
+   opcode sequences (computed before instrumentation) */
+uint64_t ir_profile_checksum(const IRModule *module);
+
+/* Put an IR_PROFILE_COUNT at the start of every block and an
+   IR_PROFILE_WRITE before each return of the entry function; sets
+   module->profile_counters and profile_checksum. Run before optimizing. */
+void ir_profile_instrument(IRModule *module);
+
+/* Annotate a module as generated with the counts recorded in `path`:
+   profile_count of every instruction and profile_entry of every function.
+   False after an "Error:" when the file cannot be read or is not a
+   profile; a profile of a different program is ignored with a warning. */
+bool ir_profile_apply(IRModule *module, const char *path);
+
+#endif /* SUB_IR_PROFILE_H */
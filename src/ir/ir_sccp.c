@@ -0,0 +1,297 @@
+/* ========================================
+   SUB Language - Sparse Conditional Constant Propagation
+   Constants through locals and joins, decided branches, dead arms
+   File: ir_sccp.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Wegman-Zadeck style propagation adapted to this IR: registers have a
+ * single definition and get one lattice value each, while mutable
+ * variables live in locals, so every block keeps the lattice value of
+ * each local at its exit. A block is evaluated only once an edge into
+ * it is known to execute; a branch on a constant marks only the edge it
+ * takes. Values only move down (unknown -> constant -> varying), which
+ * bounds the iteration.
+ */
+
+typedef enum { LAT_TOP, LAT_CONST, LAT_BOTTOM } LatticeKind;
+
+typedef struct {
+    LatticeKind kind;
+    int64_t value;
+} Lattice;
+
+static const Lattice lat_top = { LAT_TOP, 0 };
+static const Lattice lat_bottom = { LAT_BOTTOM, 0 };
+
+static Lattice lat_const(int64_t value) {
+    Lattice lat = { LAT_CONST, value };
+    return lat;
+}
+
+static Lattice lat_meet(Lattice a, Lattice b) {
+    if (a.kind == LAT_TOP) return b;
+    if (b.kind == LAT_TOP) return a;
+    if (a.kind == LAT_CONST && b.kind == LAT_CONST && a.value == b.value) return a;
+    return lat_bottom;
+}
+
+static bool lat_equal(Lattice a, Lattice b) {
+    return a.kind == b.kind && (a.kind != LAT_CONST || a.value == b.value);
+}
+
+typedef struct {
+    IRCFG *cfg;
+    int regs;
+    int locals;
+    Lattice *values;      // Per register
+    Lattice *out;         // Per block: locals at exit (block * locals + slot)
+    bool *executable;     // Per block
+    bool **edge;          // Per block, per successor index: may execute
+    Lattice *state;       // Scratch: locals while walking a block
+} SCCPState;
+
+static Lattice value_of(const SCCPState *st, const IRValue *val) {
+    if (!val) return lat_bottom;
+    if (val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING && val->type != IR_TYPE_FLOAT) {
+        return lat_const(val->data.int_val);
+    }
+    if (val->kind == IR_VAL_REG && val->data.reg_num < st->regs) return st->values[val->data.reg_num];
+    return lat_bottom;
+}
+
+static int local_of(const SCCPState *st, const IRValue *val) {
+    if (!val || val->kind != IR_VAL_VAR || val->data.reg_num >= st->locals) return -1;
+    return val->data.reg_num;
+}
+
+static Lattice eval_binary(IROpcode op, Lattice a, Lattice b) {
+    // `0 && x` and `1 || x` are decided by one side
+    if (op == IR_AND && ((a.kind == LAT_CONST && a.value == 0) || (b.kind == LAT_CONST && b.value == 0))) {
+        return lat_const(0);
+    }
+    if (op == IR_OR && ((a.kind == LAT_CONST && a.value != 0) || (b.kind == LAT_CONST && b.value != 0))) {
+        return lat_const(1);
+    }
+    if (a.kind == LAT_TOP || b.kind == LAT_TOP) return lat_top;
+    if (a.kind == LAT_CONST && b.kind == LAT_CONST) {
+        int64_t folded;
+        if (ir_fold_binary(op, a.value, b.value, &folded)) return lat_const(folded);
+    }
+    return lat_bottom;
+}
+
+/* Lattice value of the register `instr` defines, given st->state */
+static Lattice eval_instruction(SCCPState *st, IRInstruction *instr) {
+    if (ir_opcode_is_binary(instr->opcode)) {
+        return eval_binary(instr->opcode, value_of(st, instr->src1), value_of(st, instr->src2));
+    }
+    switch (instr->opcode) {
+        case IR_CONST_INT:
+        case IR_MOVE:
+            return value_of(st, instr->src1);
+        case IR_NOT: {
+            Lattice a = value_of(st, instr->src1);
+            return a.kind == LAT_CONST ? lat_const(a.value == 0) : a;
+        }
+        case IR_LOAD: {
+            int slot = local_of(st, instr->src1);
+            return slot >= 0 ? st->state[slot] : lat_bottom;
+        }
+        default:
+            return lat_bottom;
+    }
+}
+
+/* Successor index of `to` in block `from`, or -1 */
+static int succ_index(const IRBlock *from, int to) {
+    for (int i = 0; i < from->succ_count; i++) {
+        if (from->succs[i] == to) return i;
+    }
+    return -1;
+}
+
+/* Block a jump in block `b` lands on */
+static int jump_target(const SCCPState *st, int b, const IRInstruction *jump) {
+    const IRBlock *block = &st->cfg->blocks[b];
+    for (int i = 0; i < block->succ_count; i++) {
+        const IRInstruction *first = st->cfg->blocks[block->succs[i]].first;
+        if (first->opcode == IR_LABEL && first->dest && jump->dest &&
+            strcmp(first->dest->data.label, jump->dest->data.label) == 0) {
+            return block->succs[i];
+        }
+    }
+    return -1;
+}
+
+static bool mark_edge(SCCPState *st, int from, int to) {
+    int index = to >= 0 ? succ_index(&st->cfg->blocks[from], to) : -1;
+    if (index < 0 || st->edge[from][index]) return false;
+    st->edge[from][index] = true;
+    st->executable[to] = true;
+    return true;
+}
+
+/* Re-evaluate block `b`; true if anything it feeds changed */
+static bool visit_block(SCCPState *st, int b) {
+    IRCFG *cfg = st->cfg;
+    IRBlock *block = &cfg->blocks[b];
+    bool changed = false;
+
+    // Locals at entry: parameters and uninitialized slots vary at the
+    // function entry, otherwise the meet over executable incoming edges
+    for (int l = 0; l < st->locals; l++) st->state[l] = b == 0 ? lat_bottom : lat_top;
+    for (int i = 0; i < block->pred_count; i++) {
+        int p = block->preds[i];
+        int index = succ_index(&cfg->blocks[p], b);
+        if (index < 0 || !st->edge[p][index]) continue;
+        for (int l = 0; l < st->locals; l++) {
+            st->state[l] = lat_meet(st->state[l], st->out[p * st->locals + l]);
+        }
+    }
+
+    for (IRInstruction *instr = block->first;; instr = instr->next) {
+        if (instr->opcode == IR_STORE) {
+            int slot = local_of(st, instr->dest);
+            if (slot >= 0) st->state[slot] = value_of(st, instr->src1);
+        } else if (instr->dest && instr->dest->kind == IR_VAL_VAR && instr->opcode != IR_ALLOC) {
+            int slot = local_of(st, instr->dest);
+            if (slot >= 0) st->state[slot] = lat_bottom;
+        } else if (instr->dest && instr->dest->kind == IR_VAL_REG && instr->dest->data.reg_num < st->regs) {
+            int reg = instr->dest->data.reg_num;
+            Lattice next = lat_meet(st->values[reg], eval_instruction(st, instr));
+            if (!lat_equal(next, st->values[reg])) {
+                st->values[reg] = next;
+                changed = true;
+            }
+        }
+        if (instr == block->last) break;
+    }
+
+    for (int l = 0; l < st->locals; l++) {
+        Lattice *slot = &st->out[b * st->locals + l];
+        Lattice next = lat_meet(*slot, st->state[l]);
+        if (!lat_equal(next, *slot)) {
+            *slot = next;
+            changed = true;
+        }
+    }
+
+    // Outgoing edges
+    IRInstruction *last = block->last;
+    int fallthrough = b + 1 < cfg->block_count ? b + 1 : -1;
+    if (last->opcode == IR_JUMP) {
+        changed |= mark_edge(st, b, jump_target(st, b, last));
+    } else if (last->opcode == IR_JUMP_IF || last->opcode == IR_JUMP_IF_NOT) {
+        Lattice cond = value_of(st, last->src1);
+        if (cond.kind == LAT_CONST) {
+            bool taken = (cond.value != 0) == (last->opcode == IR_JUMP_IF);
+            changed |= mark_edge(st, b, taken ? jump_target(st, b, last) : fallthrough);
+        } else if (cond.kind == LAT_BOTTOM) {
+            changed |= mark_edge(st, b, jump_target(st, b, last));
+            changed |= mark_edge(st, b, fallthrough);
+        }
+    } else if (last->opcode != IR_RETURN && last->opcode != IR_TAIL_CALL) {
+        changed |= mark_edge(st, b, fallthrough);
+    }
+    return changed;
+}
+
+/* Apply the solution: constant registers become CONST_INT and decided
+   branches become jumps (or disappear); simplify drops the dead arms */
+static bool sccp_rewrite(IRFunction *func, SCCPState *st) {
+    IRCFG *cfg = st->cfg;
+    bool changed = false;
+    // Blocks tile the list in order; `prev` survives a removed terminator
+    IRInstruction *prev = NULL;
+    for (int b = 0; b < cfg->block_count; b++) {
+        IRBlock *block = &cfg->blocks[b];
+        if (!st->executable[b]) {
+            prev = block->last;
+            continue;
+        }
+        IRInstruction *instr = block->first;
+        IRInstruction *stop = block->last->next;
+        while (instr != stop) {
+            IRInstruction *next = instr->next;
+            if (instr->dest && instr->dest->kind == IR_VAL_REG && instr->dest->data.reg_num < st->regs &&
+                instr->opcode != IR_CONST_INT && !ir_opcode_has_side_effects(instr->opcode) &&
+                !(instr->opcode == IR_LOAD_ELEM && !instr->in_bounds)) {
+                Lattice lat = st->values[instr->dest->data.reg_num];
+                if (lat.kind == LAT_CONST) {
+                    ir_value_free(instr->src1);
+                    ir_value_free(instr->src2);
+                    instr->opcode = IR_CONST_INT;
+                    instr->src1 = ir_value_create_int(lat.value);
+                    instr->src2 = NULL;
+                    changed = true;
+                }
+            } else if (instr->opcode == IR_JUMP_IF || instr->opcode == IR_JUMP_IF_NOT) {
+                Lattice cond = value_of(st, instr->src1);
+                if (cond.kind == LAT_CONST) {
+                    if ((cond.value != 0) == (instr->opcode == IR_JUMP_IF)) {
+                        instr->opcode = IR_JUMP;
+                        ir_value_free(instr->src1);
+                        instr->src1 = NULL;
+                    } else {
+                        ir_function_remove_after(func, prev, instr);
+                        instr = next;
+                        changed = true;
+                        continue;
+                    }
+                    changed = true;
+                }
+            }
+            prev = instr;
+            instr = next;
+        }
+    }
+    return changed;
+}
+
+bool ir_sccp_function(IRFunction *func) {
+    if (!func || !func->instructions) return false;
+
+    IRCFG *cfg = ir_cfg_build(func);
+    int n = cfg->block_count;
+    SCCPState st;
+    st.cfg = cfg;
+    st.regs = func->reg_count;
+    st.locals = func->local_count;
+    st.values = malloc(sizeof(Lattice) * (st.regs > 0 ? st.regs : 1));
+    for (int r = 0; r < st.regs; r++) st.values[r] = lat_top;
+    st.out = malloc(sizeof(Lattice) * (n * st.locals > 0 ? n * st.locals : 1));
+    for (int i = 0; i < n * st.locals; i++) st.out[i] = lat_top;
+    st.state = malloc(sizeof(Lattice) * (st.locals > 0 ? st.locals : 1));
+    st.executable = calloc(n > 0 ? n : 1, sizeof(bool));
+    st.edge = malloc(sizeof(bool*) * (n > 0 ? n : 1));
+    for (int b = 0; b < n; b++) st.edge[b] = calloc(cfg->blocks[b].succ_count + 1, sizeof(bool));
+
+    if (n > 0) st.executable[0] = true;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (int i = 0; i < cfg->rpo_count; i++) {
+            int b = cfg->rpo[i];
+            if (st.executable[b]) progress |= visit_block(&st, b);
+        }
+    }
+
+    bool changed = sccp_rewrite(func, &st);
+
+    for (int b = 0; b < n; b++) free(st.edge[b]);
+    free(st.edge);
+    free(st.executable);
+    free(st.state);
+    free(st.out);
+    free(st.values);
+    ir_cfg_free(cfg);
+    return changed;
+}
@@ -0,0 +1,470 @@
+/* ========================================
+   SUB Language - IR Simplifier
+   Folding, propagation, algebraic identities and dead code removal
+   File: ir_simplify.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Lightweight reference to a register or constant */
+typedef enum { REF_NONE, REF_REG, REF_CONST } RefKind;
+
+typedef struct {
+    RefKind kind;
+    int64_t value;   // register number or constant
+} ValueRef;
+
+static ValueRef ref_of(const IRValue *val) {
+    ValueRef ref = { REF_NONE, 0 };
+    if (!val) return ref;
+    if (val->kind == IR_VAL_REG) {
+        ref.kind = REF_REG;
+        ref.value = val->data.reg_num;
+    } else if (val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING &&
+               val->type != IR_TYPE_FLOAT) {
+        ref.kind = REF_CONST;
+        ref.value = val->data.int_val;
+    }
+    return ref;
+}
+
+static bool is_int_const(const IRValue *val) {
+    return ref_of(val).kind == REF_CONST;
+}
+
+/* Replace an operand with a constant / register */
+static void set_const(IRValue **slot, int64_t value) {
+    ir_value_free(*slot);
+    *slot = ir_value_create_int(value);
+}
+
+/* Rewrite `instr` in place into `dest = CONST_INT value` */
+static void become_const(IRInstruction *instr, int64_t value) {
+    instr->opcode = IR_CONST_INT;
+    set_const(&instr->src1, value);
+    ir_value_free(instr->src2);
+    instr->src2 = NULL;
+}
+
+/* Rewrite `instr` in place into `dest = MOVE src` (src is taken) */
+static void become_move(IRInstruction *instr, IRValue *src) {
+    if (src == instr->src1) instr->src1 = NULL;
+    if (src == instr->src2) instr->src2 = NULL;
+    ir_value_free(instr->src1);
+    ir_value_free(instr->src2);
+    instr->opcode = IR_MOVE;
+    instr->src1 = src;
+    instr->src2 = NULL;
+}
+
+/* ---------- Propagation ---------- */
+
+static ValueRef resolve(ValueRef *subst, int reg_count, ValueRef ref) {
+    int guard = 0;
+    while (ref.kind == REF_REG && ref.value < reg_count &&
+           subst[ref.value].kind != REF_NONE && guard++ < reg_count) {
+        ref = subst[ref.value];
+    }
+    return ref;
+}
+
+static bool apply_subst(IRValue **slot, ValueRef *subst, int reg_count) {
+    IRValue *val = *slot;
+    if (!val || val->kind != IR_VAL_REG || val->data.reg_num >= reg_count) return false;
+    ValueRef to = resolve(subst, reg_count, ref_of(val));
+    if (to.kind == REF_CONST) {
+        set_const(slot, to.value);
+        return true;
+    }
+    if (to.kind == REF_REG && to.value != val->data.reg_num) {
+        val->data.reg_num = (int)to.value;
+        return true;
+    }
+    return false;
+}
+
+/* Constant/copy propagation plus block-local load forwarding.
+   Registers are single-definition and every def dominates its uses, so
+   a register defined by CONST/MOVE (or a LOAD whose local's value is
+   already known in the block) can be replaced everywhere. */
+static bool simplify_propagate(IRFunction *func) {
+    int regs = func->reg_count;
+    int locals = func->local_count;
+    if (regs == 0) return false;
+
+    ValueRef *subst = calloc(regs, sizeof(ValueRef));
+    ValueRef *known = calloc(locals > 0 ? locals : 1, sizeof(ValueRef));
+
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode == IR_LABEL) {
+            memset(known, 0, sizeof(ValueRef) * (locals > 0 ? locals : 1));
+        }
+
+        int dest = (instr->dest && instr->dest->kind == IR_VAL_REG) ? instr->dest->data.reg_num : -1;
+        switch (instr->opcode) {
+            case IR_CONST_INT:
+                if (dest >= 0 && dest < regs && is_int_const(instr->src1)) subst[dest] = ref_of(instr->src1);
+                break;
+            case IR_MOVE:
+                if (dest >= 0 && dest < regs) subst[dest] = ref_of(instr->src1);
+                break;
+            case IR_LOAD:
+                if (dest >= 0 && dest < regs && instr->src1 && instr->src1->kind == IR_VAL_VAR) {
+                    int slot = instr->src1->data.reg_num;
+                    if (slot < locals) {
+                        if (known[slot].kind != REF_NONE) subst[dest] = known[slot];
+                        else known[slot] = ref_of(instr->dest);
+                    }
+                }
+                break;
+            case IR_STORE:
+                if (instr->dest && instr->dest->kind == IR_VAL_VAR && instr->dest->data.reg_num < locals) {
+                    known[instr->dest->data.reg_num] = ref_of(instr->src1);
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (ir_instruction_is_terminator(instr)) {
+            memset(known, 0, sizeof(ValueRef) * (locals > 0 ? locals : 1));
+        }
+    }
+
+    bool changed = false;
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        changed |= apply_subst(&instr->src1, subst, regs);
+        changed |= apply_subst(&instr->src2, subst, regs);
+        for (int i = 0; i < instr->arg_count; i++) {
+            changed |= apply_subst(&instr->args[i], subst, regs);
+        }
+    }
+
+    free(subst);
+    free(known);
+    return changed;
+}
+
+/* ---------- Folding and algebraic identities ---------- */
+
+bool ir_fold_binary(IROpcode op, int64_t a, int64_t b, int64_t *out) {
+    uint64_t ua = (uint64_t)a, ub = (uint64_t)b;
+    switch (op) {
+        case IR_ADD: *out = (int64_t)(ua + ub); return true;
+        case IR_SUB: *out = (int64_t)(ua - ub); return true;
+        case IR_MUL: *out = (int64_t)(ua * ub); return true;
+        case IR_DIV:
+            if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+            *out = a / b;
+            return true;
+        case IR_MOD:
+            if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+            *out = a % b;
+            return true;
+        case IR_SHL: *out = (int64_t)(ua << (ub & 63)); return true;
+        case IR_SHR: *out = (int64_t)(ua >> (ub & 63)); return true;
+        case IR_SAR: {
+            int s = (int)(ub & 63);
+            *out = a < 0 ? (int64_t)~(~ua >> s) : (int64_t)(ua >> s);
+            return true;
+        }
+        case IR_MULHI: {
+#if defined(__SIZEOF_INT128__)
+            __int128 p = (__int128)a * (__int128)b;
+            *out = (int64_t)(p >> 64);
+            return true;
+#else
+            return false;
+#endif
+        }
+        case IR_EQ: *out = a == b; return true;
+        case IR_NE: *out = a != b; return true;
+        case IR_LT: *out = a < b; return true;
+        case IR_LE: *out = a <= b; return true;
+        case IR_GT: *out = a > b; return true;
+        case IR_GE: *out = a >= b; return true;
+        case IR_AND: *out = (a != 0) && (b != 0); return true;
+        case IR_OR: *out = (a != 0) || (b != 0); return true;
+        default: return false;
+    }
+}
+
+static bool same_reg(const IRValue *a, const IRValue *b) {
+    return a && b && a->kind == IR_VAL_REG && b->kind == IR_VAL_REG &&
+           a->data.reg_num == b->data.reg_num;
+}
+
+static bool is_commutative(IROpcode op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE ||
+           op == IR_AND || op == IR_OR || op == IR_MULHI;
+}
+
+/* Apply identities to a binary instruction; returns true if rewritten */
+static bool simplify_binary(IRInstruction *instr) {
+    IROpcode op = instr->opcode;
+    int64_t folded;
+
+    if (is_int_const(instr->src1) && is_int_const(instr->src2)) {
+        if (ir_fold_binary(op, instr->src1->data.int_val, instr->src2->data.int_val, &folded)) {
+            become_const(instr, folded);
+            return true;
+        }
+        return false;
+    }
+
+    // Canonicalize constants to the right for commutative ops
+    if (is_commutative(op) && is_int_const(instr->src1)) {
+        IRValue *tmp = instr->src1;
+        instr->src1 = instr->src2;
+        instr->src2 = tmp;
+    }
+
+    IRValue *x = instr->src1;
+    IRValue *k = instr->src2;
+
+    // Operations on the same value
+    if (same_reg(x, k)) {
+        switch (op) {
+            case IR_SUB: case IR_NE: case IR_LT: case IR_GT:
+                become_const(instr, 0);
+                return true;
+            case IR_EQ: case IR_LE: case IR_GE:
+                become_const(instr, 1);
+                return true;
+            default:
+                break;
+        }
+    }
+
+    if (is_int_const(k)) {
+        int64_t c = k->data.int_val;
+        switch (op) {
+            case IR_ADD: case IR_SUB: case IR_SHL: case IR_SHR: case IR_SAR:
+                if (c == 0) { become_move(instr, x); return true; }
+                break;
+            case IR_MUL:
+                if (c == 0) { become_const(instr, 0); return true; }
+                if (c == 1) { become_move(instr, x); return true; }
+                break;
+            // x / -1 and x % -1 stay: idiv traps on INT64_MIN, as at -O0
+            case IR_DIV:
+                if (c == 1) { become_move(instr, x); return true; }
+                break;
+            case IR_MOD:
+                if (c == 1) { become_const(instr, 0); return true; }
+                break;
+            case IR_MULHI:
+                if (c == 0) { become_const(instr, 0); return true; }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // 0 - x stays (negation); 0 / x, 0 % x, 0 << x fold to 0 when x cannot trap
+    if (is_int_const(x) && x->data.int_val == 0) {
+        if (op == IR_SHL || op == IR_SHR || op == IR_SAR) {
+            become_const(instr, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool simplify_fold(IRFunction *func) {
+    bool changed = false;
+    IRInstruction *prev = NULL;
+    IRInstruction *instr = func->instructions;
+    while (instr) {
+        IRInstruction *next = instr->next;
+
+        if (ir_opcode_is_binary(instr->opcode) && instr->dest) {
+            changed |= simplify_binary(instr);
+        } else if (instr->opcode == IR_NOT && is_int_const(instr->src1)) {
+            become_const(instr, instr->src1->data.int_val == 0);
+            changed = true;
+        } else if (instr->opcode == IR_MOVE && is_int_const(instr->src1)) {
+            instr->opcode = IR_CONST_INT;
+            changed = true;
+        } else if ((instr->opcode == IR_JUMP_IF_NOT || instr->opcode == IR_JUMP_IF) &&
+                   is_int_const(instr->src1)) {
+            bool taken = (instr->src1->data.int_val != 0) == (instr->opcode == IR_JUMP_IF);
+            if (taken) {
+                instr->opcode = IR_JUMP;
+                ir_value_free(instr->src1);
+                instr->src1 = NULL;
+            } else {
+                ir_function_remove_after(func, prev, instr);
+                instr = next;
+                changed = true;
+                continue;
+            }
+            changed = true;
+        }
+
+        prev = instr;
+        instr = next;
+    }
+    return changed;
+}
+
+/* ---------- Control flow cleanup ---------- */
+
+static bool label_is_referenced(IRFunction *func, const char *label) {
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if ((instr->opcode == IR_JUMP || instr->opcode == IR_JUMP_IF ||
+             instr->opcode == IR_JUMP_IF_NOT) &&
+            instr->dest && strcmp(instr->dest->data.label, label) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Drop unreachable blocks, jumps to the next instruction and unused labels */
+static bool simplify_control_flow(IRFunction *func) {
+    bool changed = false;
+
+    IRCFG *cfg = ir_cfg_build(func);
+    for (int b = cfg->block_count - 1; b >= 0; b--) {
+        IRBlock *block = &cfg->blocks[b];
+        if (block->rpo_index >= 0) continue;
+        // Unlink [first, last]; `before` stays valid since we walk backwards
+        IRInstruction *instr = block->first;
+        IRInstruction *stop = block->last->next;
+        if (block->before) block->before->next = stop;
+        else func->instructions = stop;
+        while (instr != stop) {
+            IRInstruction *next = instr->next;
+            ir_instruction_free(instr);
+            instr = next;
+        }
+        changed = true;
+    }
+    ir_cfg_free(cfg);
+
+    IRInstruction *prev = NULL;
+    IRInstruction *instr = func->instructions;
+    while (instr) {
+        IRInstruction *next = instr->next;
+        if (instr->opcode == IR_JUMP && next && next->opcode == IR_LABEL &&
+            instr->dest && next->dest &&
+            strcmp(instr->dest->data.label, next->dest->data.label) == 0) {
+            ir_function_remove_after(func, prev, instr);
+            instr = next;
+            changed = true;
+            continue;
+        }
+        prev = instr;
+        instr = next;
+    }
+
+    prev = NULL;
+    instr = func->instructions;
+    while (instr) {
+        IRInstruction *next = instr->next;
+        if (instr->opcode == IR_LABEL && instr->dest &&
+            !label_is_referenced(func, instr->dest->data.label)) {
+            ir_function_remove_after(func, prev, instr);
+            instr = next;
+            changed = true;
+            continue;
+        }
+        prev = instr;
+        instr = next;
+    }
+    return changed;
+}
+
+/* ---------- Dead code ---------- */
+
+static void count_use(int *uses, int reg_count, const IRValue *val) {
+    if (val && val->kind == IR_VAL_REG && val->data.reg_num < reg_count) {
+        uses[val->data.reg_num]++;
+    }
+}
+
+/* Can this instruction be deleted when its result is unused? */
+static bool is_removable(const IRInstruction *instr) {
+    if (ir_opcode_has_side_effects(instr->opcode)) return false;
+    if (instr->opcode == IR_LOAD_ELEM) return instr->in_bounds;   // Keep index checks
+    if (instr->opcode == IR_DIV || instr->opcode == IR_MOD) {
+        // Keep potential traps
+        return is_int_const(instr->src2) && instr->src2->data.int_val != 0 &&
+               instr->src2->data.int_val != -1;
+    }
+    return true;
+}
+
+static bool simplify_dead_code(IRFunction *func) {
+    bool changed = false;
+    int regs = func->reg_count;
+    int locals = func->local_count;
+
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        int *uses = calloc(regs > 0 ? regs : 1, sizeof(int));
+        bool *loaded = calloc(locals > 0 ? locals : 1, sizeof(bool));
+        for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+            count_use(uses, regs, instr->src1);
+            count_use(uses, regs, instr->src2);
+            for (int i = 0; i < instr->arg_count; i++) count_use(uses, regs, instr->args[i]);
+            if (instr->opcode == IR_LOAD && instr->src1 && instr->src1->kind == IR_VAL_VAR &&
+                instr->src1->data.reg_num < locals) {
+                loaded[instr->src1->data.reg_num] = true;
+            }
+        }
+
+        IRInstruction *prev = NULL;
+        IRInstruction *instr = func->instructions;
+        while (instr) {
+            IRInstruction *next = instr->next;
+            bool dead = false;
+            if (instr->dest && instr->dest->kind == IR_VAL_REG &&
+                instr->dest->data.reg_num < regs && uses[instr->dest->data.reg_num] == 0 &&
+                is_removable(instr)) {
+                dead = true;
+            } else if (instr->opcode == IR_STORE && instr->dest &&
+                       instr->dest->kind == IR_VAL_VAR && instr->dest->data.reg_num < locals &&
+                       !loaded[instr->dest->data.reg_num]) {
+                // Stores to locals that are never read
+                dead = true;
+            }
+            if (dead) {
+                ir_function_remove_after(func, prev, instr);
+                progress = true;
+                changed = true;
+            } else {
+                prev = instr;
+            }
+            instr = next;
+        }
+        free(uses);
+        free(loaded);
+    }
+    return changed;
+}
+
+/* ---------- Driver ---------- */
+
+bool ir_simplify_function(IRFunction *func) {
+    if (!func) return false;
+
+    bool any = false;
+    for (int round = 0; round < 16; round++) {
+        bool changed = false;
+        changed |= simplify_propagate(func);
+        changed |= simplify_fold(func);
+        changed |= simplify_control_flow(func);
+        changed |= simplify_dead_code(func);
+        if (!changed) break;
+        any = true;
+    }
+    return any;
+}
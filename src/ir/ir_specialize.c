@@ -0,0 +1,324 @@
+/* ========================================
+   SUB Language - IR Function Specialization
+   Clones of functions for call sites with constant arguments
+   File: ir_specialize.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * A call site passing constants calls a copy of the callee in which
+ * those parameters are bound to the constants. The copy is simplified
+ * and constant-propagated right away and kept only when that shrinks it
+ * noticeably: flags that select a code path, loop bounds and strides.
+ * Sites passing the same constants share one copy, including the
+ * callee's own recursive calls once they are retargeted; a recursive
+ * function only has the parameters it passes on unchanged bound, so
+ * `f(n - 1, mode)` does not copy f once per n. The signature
+ * is unchanged; the bound parameters are just overwritten on entry.
+ * Functions left without callers are removed.
+ */
+
+#define SPECIALIZE_MAX_PER_FUNCTION 4    // Copies kept of one function
+#define SPECIALIZE_MAX_TOTAL 64          // Copies kept per module
+#define SPECIALIZE_MAX_COST 1000         // Larger callees are not copied
+#define SPECIALIZE_MIN_SAVING 4          // Instructions a copy must save...
+#define SPECIALIZE_MIN_SAVING_PART 8     // ...and at least 1/8 of the callee
+
+typedef struct {
+    IRFunction *original;
+    bool *bound;              // Per parameter: bound to a constant
+    int64_t *values;
+    IRFunction *clone;        // NULL: tried and rejected
+} Specialization;
+
+typedef struct {
+    IRModule *module;
+    Specialization *specs;
+    int count;
+    int kept;
+} Specializer;
+
+static IRFunction* find_function(IRModule *module, const char *name) {
+    for (IRFunction *f = module->functions; f; f = f->next) {
+        if (strcmp(f->name, name) == 0) return f;
+    }
+    return NULL;
+}
+
+static bool const_arg(const IRValue *val) {
+    return val && val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING && val->type != IR_TYPE_FLOAT;
+}
+
+/* Code-emitting instructions, as the inliner counts them */
+static int function_cost(const IRFunction *func) {
+    int cost = 0;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode != IR_LABEL && instr->opcode != IR_ALLOC) cost++;
+    }
+    return cost;
+}
+
+static bool calls_self(const IRInstruction *instr, const IRFunction *func) {
+    return instr->opcode == IR_CALL && instr->src1 && instr->src1->kind == IR_VAL_LABEL &&
+           strcmp(instr->src1->data.label, func->name) == 0 && instr->arg_count == func->param_count;
+}
+
+/* Parameter `p` of `func` may be bound: the function is not recursive,
+   or its self-calls pass the parameter's own, never reassigned, value */
+static bool bindable(const IRFunction *func, int p) {
+    int slot = func->params[p]->data.reg_num;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode == IR_STORE && instr->dest && instr->dest->kind == IR_VAL_VAR &&
+            instr->dest->data.reg_num == slot) {
+            for (const IRInstruction *c = func->instructions; c; c = c->next) {
+                if (calls_self(c, func)) return false;
+            }
+            return true;
+        }
+    }
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (!calls_self(instr, func)) continue;
+        const IRValue *arg = instr->args[p];
+        if (!arg || arg->kind != IR_VAL_REG) return false;
+        // The argument register must be a load of the parameter
+        bool loaded = false;
+        for (const IRInstruction *def = func->instructions; def && !loaded; def = def->next) {
+            loaded = def->opcode == IR_LOAD && def->dest && def->dest->kind == IR_VAL_REG &&
+                     def->dest->data.reg_num == arg->data.reg_num && def->src1 &&
+                     def->src1->kind == IR_VAL_VAR && def->src1->data.reg_num == slot;
+        }
+        if (!loaded) return false;
+    }
+    return true;
+}
+
+/* Parameters a call site binds: constant arguments that may be bound */
+static bool site_binding(const IRFunction *callee, const IRInstruction *call, bool *bound) {
+    bool any = false;
+    for (int p = 0; p < callee->param_count; p++) {
+        bound[p] = const_arg(call->args[p]) && bindable(callee, p);
+        any |= bound[p];
+    }
+    return any;
+}
+
+static int clones_of(const Specializer *sp, const IRFunction *func) {
+    int n = 0;
+    for (int i = 0; i < sp->count; i++) n += sp->specs[i].original == func && sp->specs[i].clone;
+    return n;
+}
+
+static Specialization* find_spec(Specializer *sp, const IRFunction *callee, const IRInstruction *call,
+                                 const bool *bound) {
+    for (int i = 0; i < sp->count; i++) {
+        Specialization *spec = &sp->specs[i];
+        if (spec->original != callee) continue;
+        bool match = true;
+        for (int p = 0; p < callee->param_count && match; p++) {
+            match = spec->bound[p] == bound[p] && (!bound[p] || spec->values[p] == call->args[p]->data.int_val);
+        }
+        if (match) return spec;
+    }
+    return NULL;
+}
+
+/* ---------- Cloning ---------- */
+
+static IRValue* rename_label(char **from, IRValue **to, int count, const IRValue *val) {
+    if (val && val->kind == IR_VAL_LABEL) {
+        for (int i = 0; i < count; i++) {
+            if (strcmp(from[i], val->data.label) == 0) return ir_value_clone(to[i]);
+        }
+    }
+    return ir_value_clone(val);
+}
+
+/* Copy of `func` named `name`, with fresh labels */
+static IRFunction* clone_function(const IRFunction *func, const char *name) {
+    IRFunction *copy = ir_function_create(name, func->return_type);
+    for (int i = 0; i < func->param_count; i++) ir_function_add_param(copy, ir_value_clone(func->params[i]));
+    copy->local_count = func->local_count;
+    copy->reg_count = func->reg_count;
+    copy->frame_words = func->frame_words;
+
+    char **from = NULL;
+    IRValue **to = NULL;
+    int count = 0;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode != IR_LABEL || !instr->dest) continue;
+        from = realloc(from, sizeof(char*) * (count + 1));
+        to = realloc(to, sizeof(IRValue*) * (count + 1));
+        from[count] = instr->dest->data.label;
+        to[count] = ir_value_create_unique_label("L_SPEC");
+        count++;
+    }
+
+    IRInstruction *tail = NULL;
+    for (const IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        IRInstruction *c = ir_instruction_create(instr->opcode);
+        bool labelled = instr->opcode == IR_LABEL || instr->opcode == IR_JUMP ||
+                        instr->opcode == IR_JUMP_IF || instr->opcode == IR_JUMP_IF_NOT;
+        c->dest = labelled ? rename_label(from, to, count, instr->dest) : ir_value_clone(instr->dest);
+        c->src1 = ir_value_clone(instr->src1);
+        c->src2 = ir_value_clone(instr->src2);
+        for (int i = 0; i < instr->arg_count; i++) ir_instruction_add_arg(c, ir_value_clone(instr->args[i]));
+        c->comment = instr->comment ? strdup(instr->comment) : NULL;
+        c->unroll_hint = instr->unroll_hint;
+        c->profile_count = instr->profile_count;
+        c->in_bounds = instr->in_bounds;
+        c->vector = ir_vector_kernel_clone(instr->vector);
+        ir_function_insert_after(copy, tail, c);
+        tail = c;
+    }
+
+    for (int i = 0; i < count; i++) ir_value_free(to[i]);
+    free(from);
+    free(to);
+    return copy;
+}
+
+/* Store the bound constants into their parameters ahead of the body */
+static void bind_parameters(IRFunction *func, const Specialization *spec) {
+    IRInstruction *cursor = NULL;
+    for (IRInstruction *instr = func->instructions; instr && instr->opcode == IR_ALLOC; instr = instr->next) {
+        cursor = instr;
+    }
+    for (int p = 0; p < func->param_count; p++) {
+        if (!spec->bound[p]) continue;
+        IRInstruction *store = ir_instruction_create(IR_STORE);
+        store->dest = ir_value_clone(func->params[p]);
+        store->src1 = ir_value_create_int(spec->values[p]);
+        ir_function_insert_after(func, cursor, store);
+        cursor = store;
+    }
+}
+
+/* Try a copy of `callee` for the constants at `call`; the result is
+   remembered either way */
+static Specialization* specialize(Specializer *sp, IRFunction *callee, const IRInstruction *call,
+                                  const bool *bound) {
+    sp->specs = realloc(sp->specs, sizeof(Specialization) * (sp->count + 1));
+    Specialization *spec = &sp->specs[sp->count++];
+    spec->original = callee;
+    spec->bound = calloc(callee->param_count + 1, sizeof(bool));
+    spec->values = calloc(callee->param_count + 1, sizeof(int64_t));
+    spec->clone = NULL;
+    for (int p = 0; p < callee->param_count; p++) {
+        spec->bound[p] = bound[p];
+        if (bound[p]) spec->values[p] = call->args[p]->data.int_val;
+    }
+
+    int cost = function_cost(callee);
+    if (cost > SPECIALIZE_MAX_COST || sp->kept >= SPECIALIZE_MAX_TOTAL ||
+        clones_of(sp, callee) >= SPECIALIZE_MAX_PER_FUNCTION) {
+        return spec;
+    }
+
+    char name[256];
+    snprintf(name, sizeof(name), "%s.spec%d", callee->name, clones_of(sp, callee) + 1);
+    IRFunction *clone = clone_function(callee, name);
+    bind_parameters(clone, spec);
+    ir_simplify_function(clone);
+    if (ir_sccp_function(clone)) ir_simplify_function(clone);
+
+    int saving = cost - function_cost(clone);
+    if (saving < SPECIALIZE_MIN_SAVING || saving * SPECIALIZE_MIN_SAVING_PART < cost) {
+        ir_function_free(clone);
+        return spec;
+    }
+    clone->profile_entry = callee->profile_entry >= 0 ? 0 : -1;
+    clone->next = callee->next;
+    callee->next = clone;
+    spec->clone = clone;
+    sp->kept++;
+    return spec;
+}
+
+/* Retarget the calls in `func` that pass constants */
+static bool specialize_calls(Specializer *sp, IRFunction *func) {
+    bool changed = false;
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode != IR_CALL || !instr->src1 || instr->src1->kind != IR_VAL_LABEL) continue;
+        IRFunction *callee = find_function(sp->module, instr->src1->data.label);
+        if (!callee || instr->arg_count != callee->param_count) continue;
+        if (sp->module->entry_point && strcmp(callee->name, sp->module->entry_point) == 0) continue;
+
+        // Calls into a copy are already specialized for what it binds
+        bool is_copy = false;
+        for (int i = 0; i < sp->count; i++) is_copy |= sp->specs[i].clone == callee;
+        if (is_copy) continue;
+
+        bool *bound = calloc(callee->param_count + 1, sizeof(bool));
+        Specialization *spec = NULL;
+        if (site_binding(callee, instr, bound)) {
+            spec = find_spec(sp, callee, instr, bound);
+            if (!spec) spec = specialize(sp, callee, instr, bound);
+        }
+        free(bound);
+        if (!spec || !spec->clone) continue;
+        if (!spec->clone) continue;
+        if (instr->profile_count > 0 && spec->clone->profile_entry >= 0) {
+            spec->clone->profile_entry += instr->profile_count;
+        }
+        ir_value_free(instr->src1);
+        instr->src1 = ir_value_create_label(spec->clone->name);
+        changed = true;
+    }
+    return changed;
+}
+
+static bool has_callers(const IRModule *module, const IRFunction *func) {
+    for (const IRFunction *f = module->functions; f; f = f->next) {
+        if (f == func) continue;
+        for (const IRInstruction *instr = f->instructions; instr; instr = instr->next) {
+            if ((instr->opcode == IR_CALL || instr->opcode == IR_TAIL_CALL) && instr->src1 &&
+                instr->src1->kind == IR_VAL_LABEL && strcmp(instr->src1->data.label, func->name) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Drop originals whose every outside caller now calls a copy */
+static void remove_replaced(Specializer *sp) {
+    for (int i = 0; i < sp->count; i++) {
+        IRFunction *func = sp->specs[i].original;
+        if (!func || !sp->specs[i].clone || has_callers(sp->module, func)) continue;
+        IRFunction **link = &sp->module->functions;
+        while (*link && *link != func) link = &(*link)->next;
+        if (!*link) continue;
+        *link = func->next;
+        for (int j = 0; j < sp->count; j++) {
+            if (sp->specs[j].original == func) sp->specs[j].original = NULL;
+        }
+        ir_function_free(func);
+    }
+}
+
+bool ir_specialize_module(IRModule *module) {
+    if (!module) return false;
+    Specializer sp = { module, NULL, 0, 0 };
+    bool changed = false;
+    // Copies are inserted after their original, so the walk reaches the
+    // ones made for later functions; a second sweep catches the rest
+    for (int sweep = 0; sweep < 2; sweep++) {
+        for (IRFunction *func = module->functions; func; func = func->next) {
+            changed |= specialize_calls(&sp, func);
+        }
+    }
+    if (changed) remove_replaced(&sp);
+
+    for (int i = 0; i < sp.count; i++) {
+        free(sp.specs[i].bound);
+        free(sp.specs[i].values);
+    }
+    free(sp.specs);
+    return changed;
+}
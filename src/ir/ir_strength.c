@@ -0,0 +1,384 @@
+/* ========================================
+   SUB Language - Strength Reduction
+   Constant multiply/divide/modulo lowering and induction variables
+   File: ir_strength.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REG(n) ir_value_create_reg((n), IR_TYPE_INT)
+#define IMM(v) ir_value_create_int((v))
+
+/* Appends instructions after `cursor` */
+typedef struct {
+    IRFunction *func;
+    IRInstruction *cursor;
+} SRBuilder;
+
+static int sr_emit(SRBuilder *b, IROpcode op, IRValue *src1, IRValue *src2) {
+    IRInstruction *instr = ir_instruction_create(op);
+    int reg = ir_function_new_reg(b->func);
+    instr->dest = REG(reg);
+    instr->src1 = src1;
+    instr->src2 = src2;
+    ir_function_insert_after(b->func, b->cursor, instr);
+    b->cursor = instr;
+    return reg;
+}
+
+static bool is_pow2(uint64_t v) {
+    return v != 0 && (v & (v - 1)) == 0;
+}
+
+static int log2u(uint64_t v) {
+    int n = 0;
+    while (v > 1) {
+        v >>= 1;
+        n++;
+    }
+    return n;
+}
+
+static bool is_int_const(const IRValue *val) {
+    return val && val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING &&
+           val->type != IR_TYPE_FLOAT;
+}
+
+/* ---------- Multiplication ---------- */
+
+/* Multipliers the backend emits as a single lea (x + x*2/4/8) */
+static bool is_lea_factor(uint64_t m) {
+    return m == 3 || m == 5 || m == 9;
+}
+
+/* Number of single-cycle ops needed for x * m, or -1 if imul is better.
+   imul r64 has 3-cycle latency, so at most two shift/lea/add steps win. */
+static int mul_cost(uint64_t m) {
+    if (m == 0 || m == 1) return 0;
+    if (is_pow2(m)) return 1;
+    if (is_lea_factor(m)) return 1;
+    int tz = __builtin_ctzll(m);
+    if (tz > 0 && is_lea_factor(m >> tz)) return 2;
+    if (is_pow2(m - 1)) return 2;
+    if (is_pow2(m + 1)) return 2;
+    return -1;
+}
+
+/* Emit x * m for a positive multiplier with mul_cost(m) > 0 */
+static int emit_mul_positive(SRBuilder *b, const IRValue *x, uint64_t m) {
+    if (is_pow2(m)) {
+        return sr_emit(b, IR_SHL, ir_value_clone(x), IMM(log2u(m)));
+    }
+    if (is_lea_factor(m)) {
+        return sr_emit(b, IR_MUL, ir_value_clone(x), IMM((int64_t)m));
+    }
+    int tz = __builtin_ctzll(m);
+    if (tz > 0 && is_lea_factor(m >> tz)) {
+        int t = sr_emit(b, IR_MUL, ir_value_clone(x), IMM((int64_t)(m >> tz)));
+        return sr_emit(b, IR_SHL, REG(t), IMM(tz));
+    }
+    if (is_pow2(m - 1)) {
+        int t = sr_emit(b, IR_SHL, ir_value_clone(x), IMM(log2u(m - 1)));
+        return sr_emit(b, IR_ADD, REG(t), ir_value_clone(x));
+    }
+    int t = sr_emit(b, IR_SHL, ir_value_clone(x), IMM(log2u(m + 1)));
+    return sr_emit(b, IR_SUB, REG(t), ir_value_clone(x));
+}
+
+/* Emit x * c; falls back to a plain MUL when no cheaper sequence exists */
+static int emit_mul_const(SRBuilder *b, const IRValue *x, int64_t c) {
+    if (c == INT64_MIN) return sr_emit(b, IR_SHL, ir_value_clone(x), IMM(63));
+    uint64_t m = c < 0 ? (uint64_t)(-c) : (uint64_t)c;
+    int cost = mul_cost(m);
+    if (c < 0 && cost >= 1) cost++;   // trailing negate
+    if (m <= 1 || cost < 0 || cost > 2) {
+        return sr_emit(b, IR_MUL, ir_value_clone(x), IMM(c));
+    }
+    int r = emit_mul_positive(b, x, m);
+    if (c < 0) r = sr_emit(b, IR_SUB, IMM(0), REG(r));
+    return r;
+}
+
+/* ---------- Division ---------- */
+
+/* Signed 64-bit magic number (Hacker's Delight, 10-1); |d| >= 2 */
+static void signed_magic(int64_t d, int64_t *magic, int *shift) {
+    const uint64_t two63 = 1ULL << 63;
+    uint64_t ad = d < 0 ? (uint64_t)0 - (uint64_t)d : (uint64_t)d;
+    uint64_t t = two63 + ((uint64_t)d >> 63);
+    uint64_t anc = t - 1 - t % ad;
+    int p = 63;
+    uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+    uint64_t delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) { q1++; r1 -= anc; }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    int64_t m = (int64_t)(q2 + 1);
+    *magic = d < 0 ? (int64_t)((uint64_t)0 - (uint64_t)m) : m;
+    *shift = p - 64;
+}
+
+/* Emit truncating x / d for d not in {0, 1, -1, INT64_MIN} */
+static int emit_div_const(SRBuilder *b, const IRValue *x, int64_t d) {
+    uint64_t ad = d < 0 ? (uint64_t)(-d) : (uint64_t)d;
+    int q;
+    if (is_pow2(ad)) {
+        // Bias negative dividends by (2^k - 1) so the shift truncates toward zero
+        int k = log2u(ad);
+        int sign = sr_emit(b, IR_SAR, ir_value_clone(x), IMM(63));
+        int bias = sr_emit(b, IR_SHR, REG(sign), IMM(64 - k));
+        int sum = sr_emit(b, IR_ADD, ir_value_clone(x), REG(bias));
+        q = sr_emit(b, IR_SAR, REG(sum), IMM(k));
+        if (d < 0) q = sr_emit(b, IR_SUB, IMM(0), REG(q));
+        return q;
+    }
+
+    int64_t magic;
+    int shift;
+    signed_magic(d, &magic, &shift);
+    q = sr_emit(b, IR_MULHI, ir_value_clone(x), IMM(magic));
+    if (d > 0 && magic < 0) q = sr_emit(b, IR_ADD, REG(q), ir_value_clone(x));
+    if (d < 0 && magic > 0) q = sr_emit(b, IR_SUB, REG(q), ir_value_clone(x));
+    if (shift > 0) q = sr_emit(b, IR_SAR, REG(q), IMM(shift));
+    int sign = sr_emit(b, IR_SHR, REG(q), IMM(63));
+    return sr_emit(b, IR_ADD, REG(q), REG(sign));
+}
+
+/* Emit x % d (sign follows the dividend, as in C) */
+static int emit_mod_const(SRBuilder *b, const IRValue *x, int64_t d) {
+    int64_t ad = d < 0 ? -d : d;
+    int q = emit_div_const(b, x, ad);
+    IRValue *qv = REG(q);
+    int p = emit_mul_const(b, qv, ad);
+    ir_value_free(qv);
+    return sr_emit(b, IR_SUB, ir_value_clone(x), REG(p));
+}
+
+static void become_move_reg(IRInstruction *instr, int reg) {
+    ir_value_free(instr->src1);
+    ir_value_free(instr->src2);
+    instr->opcode = IR_MOVE;
+    instr->src1 = REG(reg);
+    instr->src2 = NULL;
+}
+
+/* Rewrite MUL/DIV/MOD with a constant operand */
+static bool reduce_arithmetic(IRFunction *func) {
+    bool changed = false;
+    IRInstruction *prev = NULL;
+    for (IRInstruction *instr = func->instructions; instr; prev = instr, instr = instr->next) {
+        if (!instr->dest || !instr->src1 || !instr->src2) continue;
+
+        if (instr->opcode == IR_MUL) {
+            if (is_int_const(instr->src1) && !is_int_const(instr->src2)) {
+                IRValue *tmp = instr->src1;
+                instr->src1 = instr->src2;
+                instr->src2 = tmp;
+            }
+            if (!is_int_const(instr->src2) || is_int_const(instr->src1)) continue;
+            int64_t c = instr->src2->data.int_val;
+            uint64_t m = c < 0 ? (uint64_t)0 - (uint64_t)c : (uint64_t)c;
+            // Already optimal: single lea or plain imul
+            if (is_lea_factor(m) && c > 0) continue;
+            int cost = c == INT64_MIN ? 1 : mul_cost(m);
+            if (c < 0 && cost >= 1) cost++;
+            if (m <= 1 || cost < 0 || cost > 2) continue;
+
+            SRBuilder b = { func, prev };
+            int r = emit_mul_const(&b, instr->src1, c);
+            become_move_reg(instr, r);
+            changed = true;
+        } else if (instr->opcode == IR_DIV || instr->opcode == IR_MOD) {
+            if (!is_int_const(instr->src2) || is_int_const(instr->src1)) continue;
+            int64_t d = instr->src2->data.int_val;
+            if (d == 0 || d == 1 || d == -1 || d == INT64_MIN) continue;
+
+            SRBuilder b = { func, prev };
+            int r = instr->opcode == IR_DIV ? emit_div_const(&b, instr->src1, d)
+                                            : emit_mod_const(&b, instr->src1, d);
+            become_move_reg(instr, r);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* ---------- Induction variables ---------- */
+
+/* Register whose value equals local `slot` just before `target` in its
+   block (tracked from LOADs/STOREs in the block), or -1 if unknown. */
+static int current_value_before(const IRBlock *block, const IRInstruction *target, int slot) {
+    int cur = -1;
+    for (IRInstruction *it = block->first; it && it != target; it = it->next) {
+        if (it->opcode == IR_LOAD && it->src1 && it->src1->kind == IR_VAL_VAR &&
+            it->src1->data.reg_num == slot && it->dest) {
+            cur = it->dest->data.reg_num;
+        } else if (it->opcode == IR_STORE && it->dest && it->dest->data.reg_num == slot) {
+            cur = (it->src1 && it->src1->kind == IR_VAL_REG) ? it->src1->data.reg_num : -1;
+        }
+        if (it == block->last) break;
+    }
+    return cur;
+}
+
+/* Is local `slot` a basic induction variable of `loop` (a single
+   `slot = slot +/- c` store)? On success returns the store and step. */
+static IRInstruction* find_basic_iv(IRCFG *cfg, IRLoop *loop, IRInstruction **defs,
+                                    int slot, int64_t *step) {
+    IRInstruction *store = NULL;
+    int store_block = -1;
+    for (int b = 0; b < cfg->block_count; b++) {
+        if (!loop->body[b]) continue;
+        IRBlock *block = &cfg->blocks[b];
+        for (IRInstruction *it = block->first; it; it = it->next) {
+            if (it->opcode == IR_STORE && it->dest && it->dest->kind == IR_VAL_VAR &&
+                it->dest->data.reg_num == slot) {
+                if (store) return NULL;
+                store = it;
+                store_block = b;
+            }
+            if (it == block->last) break;
+        }
+    }
+    if (!store || !store->src1 || store->src1->kind != IR_VAL_REG) return NULL;
+
+    IRInstruction *update = defs[store->src1->data.reg_num];
+    if (!update || (update->opcode != IR_ADD && update->opcode != IR_SUB)) return NULL;
+
+    int cur = current_value_before(&cfg->blocks[store_block], store, slot);
+    if (cur < 0) return NULL;
+
+    IRValue *a = update->src1, *c = update->src2;
+    if (update->opcode == IR_ADD && is_int_const(a)) {
+        IRValue *tmp = a;
+        a = c;
+        c = tmp;
+    }
+    if (!a || a->kind != IR_VAL_REG || a->data.reg_num != cur || !is_int_const(c)) return NULL;
+
+    *step = update->opcode == IR_ADD ? c->data.int_val
+                                     : (int64_t)((uint64_t)0 - (uint64_t)c->data.int_val);
+    return store;
+}
+
+/* Find one (loop, iv, factor) candidate and rewrite every `iv * factor`
+   in the loop into loads of a derived variable kept equal to iv*factor. */
+static bool reduce_one_induction(IRFunction *func) {
+    IRCFG *cfg = ir_cfg_build(func);
+    IRInstruction **defs = calloc(func->reg_count > 0 ? func->reg_count : 1, sizeof(IRInstruction*));
+    for (IRInstruction *it = func->instructions; it; it = it->next) {
+        if (it->dest && it->dest->kind == IR_VAL_REG && it->dest->data.reg_num < func->reg_count) {
+            defs[it->dest->data.reg_num] = it;
+        }
+    }
+
+    bool changed = false;
+    for (int l = 0; l < cfg->loop_count && !changed; l++) {
+        IRLoop *loop = &cfg->loops[l];
+        if (loop->preheader < 0) continue;
+
+        for (int b = 0; b < cfg->block_count && !changed; b++) {
+            if (!loop->body[b]) continue;
+            IRBlock *block = &cfg->blocks[b];
+            for (IRInstruction *mul = block->first; mul && !changed; mul = mul->next) {
+                if (mul->opcode == IR_MUL && mul->src1 && mul->src2) {
+                    IRValue *var = mul->src1, *k = mul->src2;
+                    if (is_int_const(var)) {
+                        IRValue *tmp = var;
+                        var = k;
+                        k = tmp;
+                    }
+                    IRInstruction *load = (var && var->kind == IR_VAL_REG) ? defs[var->data.reg_num] : NULL;
+                    int load_block = load ? ir_cfg_block_of(cfg, load) : -1;
+                    if (load && load->opcode == IR_LOAD && is_int_const(k) &&
+                        !is_pow2((uint64_t)k->data.int_val) &&
+                        load_block >= 0 && loop->body[load_block]) {
+                        int slot = load->src1->data.reg_num;
+                        int64_t factor = k->data.int_val;
+                        int64_t step;
+                        IRInstruction *store = find_basic_iv(cfg, loop, defs, slot, &step);
+                        if (store) {
+                            int derived = func->local_count++;
+                            const char *name = load->src1->name;
+
+                            // Preheader: derived = iv * factor
+                            SRBuilder pre = { func, ir_cfg_insertion_point(cfg, loop->preheader) };
+                            int t0 = sr_emit(&pre, IR_LOAD, ir_value_create_var(slot, name), NULL);
+                            int t1 = sr_emit(&pre, IR_MUL, REG(t0), IMM(factor));
+                            IRInstruction *init = ir_instruction_create(IR_STORE);
+                            init->dest = ir_value_create_var(derived, NULL);
+                            init->src1 = REG(t1);
+                            ir_function_insert_after(func, pre.cursor, init);
+
+                            // After the iv update: derived += step * factor
+                            SRBuilder upd = { func, store };
+                            int t2 = sr_emit(&upd, IR_LOAD, ir_value_create_var(derived, NULL), NULL);
+                            int t3 = sr_emit(&upd, IR_ADD, REG(t2),
+                                             IMM((int64_t)((uint64_t)step * (uint64_t)factor)));
+                            IRInstruction *bump = ir_instruction_create(IR_STORE);
+                            bump->dest = ir_value_create_var(derived, NULL);
+                            bump->src1 = REG(t3);
+                            ir_function_insert_after(func, upd.cursor, bump);
+
+                            // Every iv*factor in the loop reads derived where iv was read
+                            for (int bb = 0; bb < cfg->block_count; bb++) {
+                                if (!loop->body[bb]) continue;
+                                IRBlock *blk = &cfg->blocks[bb];
+                                for (IRInstruction *m = blk->first; m; m = m->next) {
+                                    if (m->opcode == IR_MUL && m->src1 && m->src2) {
+                                        IRValue *mv = is_int_const(m->src1) ? m->src2 : m->src1;
+                                        IRValue *mk = is_int_const(m->src1) ? m->src1 : m->src2;
+                                        IRInstruction *ml = (mv && mv->kind == IR_VAL_REG) ? defs[mv->data.reg_num] : NULL;
+                                        int ml_block = ml ? ir_cfg_block_of(cfg, ml) : -1;
+                                        if (ml && ml->opcode == IR_LOAD && ml->src1->data.reg_num == slot &&
+                                            is_int_const(mk) && mk->data.int_val == factor &&
+                                            ml_block >= 0 && loop->body[ml_block]) {
+                                            SRBuilder at = { func, ml };
+                                            int t4 = sr_emit(&at, IR_LOAD, ir_value_create_var(derived, NULL), NULL);
+                                            become_move_reg(m, t4);
+                                        }
+                                    }
+                                    if (m == blk->last) break;
+                                }
+                            }
+
+                            IRInstruction *alloc = ir_instruction_create(IR_ALLOC);
+                            alloc->dest = ir_value_create_var(derived, NULL);
+                            ir_function_insert_after(func, NULL, alloc);
+                            changed = true;
+                        }
+                    }
+                }
+                if (mul == block->last) break;
+            }
+        }
+    }
+
+    free(defs);
+    ir_cfg_free(cfg);
+    return changed;
+}
+
+bool ir_strength_reduce_function(IRFunction *func) {
+    if (!func) return false;
+
+    bool changed = false;
+    for (int i = 0; i < 64 && reduce_one_induction(func); i++) {
+        changed = true;
+    }
+    changed |= reduce_arithmetic(func);
+    return changed;
+}
@@ -0,0 +1,239 @@
+/* ========================================
+   SUB Language - IR Tail Call Optimization
+   Self-recursion to loops, accumulator introduction, tail call marking
+   File: ir_tailcall.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Tail calls jump with all arguments in registers */
+#define TAIL_CALL_MAX_ARGS 6
+
+static bool is_self_call(const IRFunction *func, const IRInstruction *instr) {
+    return instr->opcode == IR_CALL && instr->src1 && instr->src1->kind == IR_VAL_LABEL &&
+           strcmp(instr->src1->data.label, func->name) == 0 &&
+           instr->arg_count == func->param_count;
+}
+
+static bool uses_reg(const IRInstruction *instr, int reg) {
+    const IRValue *ops[2] = { instr->src1, instr->src2 };
+    for (int i = 0; i < 2; i++) {
+        if (ops[i] && ops[i]->kind == IR_VAL_REG && ops[i]->data.reg_num == reg) return true;
+    }
+    for (int i = 0; i < instr->arg_count; i++) {
+        if (instr->args[i]->kind == IR_VAL_REG && instr->args[i]->data.reg_num == reg) return true;
+    }
+    // A STORE's dest is a local, never a register
+    return false;
+}
+
+static bool returns_reg(const IRInstruction *instr, int reg) {
+    return instr && instr->opcode == IR_RETURN && instr->src1 &&
+           instr->src1->kind == IR_VAL_REG && instr->src1->data.reg_num == reg;
+}
+
+/* A self-recursive call in (accumulator-)tail position */
+typedef struct {
+    IRInstruction *call;
+    IRInstruction *op;       // `%s = OP %r, X` combining the result, or NULL
+    IRInstruction *ret;      // The RETURN ending the pattern
+    IROpcode acc_op;         // IR_ADD / IR_MUL when `op` is set
+} TailSite;
+
+/*
+ * Match `%r = CALL self(args); <pure, %r-free>*; [%s = OP %r, X;] RETURN`.
+ * OP must be associative and commutative (ADD or MUL on wrapping
+ * 64-bit integers) and X independent of %r, so that
+ * f(a) = X op f(a') can be evaluated as acc = acc op X; a = a'; loop.
+ */
+static bool match_tail_site(const IRFunction *func, IRInstruction *call, TailSite *site) {
+    if (!is_self_call(func, call) || !call->dest || call->dest->kind != IR_VAL_REG) return false;
+    int r = call->dest->data.reg_num;
+
+    site->call = call;
+    site->op = NULL;
+    site->ret = NULL;
+
+    IRInstruction *scan = call->next;
+    if (returns_reg(scan, r)) {
+        site->ret = scan;
+        return true;
+    }
+
+    for (; scan; scan = scan->next) {
+        if (ir_opcode_has_side_effects(scan->opcode)) return false;
+        if (!uses_reg(scan, r)) continue;
+
+        // First use of the result: must be the combining operation
+        if (scan->opcode != IR_ADD && scan->opcode != IR_MUL) return false;
+        if (!scan->src1 || !scan->src2 || !scan->dest) return false;
+        bool lhs = scan->src1->kind == IR_VAL_REG && scan->src1->data.reg_num == r;
+        bool rhs = scan->src2->kind == IR_VAL_REG && scan->src2->data.reg_num == r;
+        if (lhs == rhs) return false;
+        if (!returns_reg(scan->next, scan->dest->data.reg_num)) return false;
+
+        site->op = scan;
+        site->ret = scan->next;
+        site->acc_op = scan->opcode;
+        return true;
+    }
+    return false;
+}
+
+static IRInstruction* emit_after(IRFunction *func, IRInstruction *after, IROpcode opcode,
+                                 IRValue *dest, IRValue *src1, IRValue *src2) {
+    IRInstruction *instr = ir_instruction_create(opcode);
+    instr->dest = dest;
+    instr->src1 = src1;
+    instr->src2 = src2;
+    ir_function_insert_after(func, after, instr);
+    return instr;
+}
+
+static IRInstruction* find_prev(IRFunction *func, IRInstruction *target) {
+    IRInstruction *prev = NULL;
+    for (IRInstruction *scan = func->instructions; scan && scan != target; scan = scan->next) {
+        prev = scan;
+    }
+    return prev;
+}
+
+/* `%u = acc OP value` emitted after `cursor`; returns the new cursor */
+static IRInstruction* emit_acc_combine(IRFunction *func, IRInstruction *cursor, int acc_slot,
+                                       IROpcode op, IRValue *value, int *result_reg) {
+    int t = ir_function_new_reg(func);
+    cursor = emit_after(func, cursor, IR_LOAD, ir_value_create_reg(t, IR_TYPE_INT),
+                        ir_value_create_var(acc_slot, "tailrec.acc"), NULL);
+    int u = ir_function_new_reg(func);
+    cursor = emit_after(func, cursor, op, ir_value_create_reg(u, IR_TYPE_INT),
+                        ir_value_create_reg(t, IR_TYPE_INT), value);
+    *result_reg = u;
+    return cursor;
+}
+
+/* Turn self tail calls into jumps back to the function entry. When some
+   sites combine the recursive result with ADD/MUL, an accumulator local
+   carries the pending operations and every remaining RETURN applies it. */
+bool ir_eliminate_tail_recursion(IRFunction *func) {
+    // Re-entering would reuse frame arrays the arguments may point to
+    if (!func || !func->instructions || func->frame_words > 0) return false;
+
+    TailSite *sites = NULL;
+    int site_count = 0;
+    IROpcode acc_op = IR_ADD;
+    bool use_acc = false;
+
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        TailSite site;
+        if (!match_tail_site(func, instr, &site)) continue;
+        if (site.op) {
+            // One accumulator operation per function
+            if (use_acc && site.acc_op != acc_op) continue;
+            use_acc = true;
+            acc_op = site.acc_op;
+        }
+        sites = realloc(sites, sizeof(TailSite) * (site_count + 1));
+        sites[site_count++] = site;
+    }
+    if (site_count == 0) return false;
+
+    // Loop header after the leading ALLOC markers (parameters)
+    int acc_slot = use_acc ? ir_function_new_local(func, "tailrec.acc") : -1;
+    IRInstruction *entry = NULL;
+    while ((entry ? entry->next : func->instructions) &&
+           (entry ? entry->next : func->instructions)->opcode == IR_ALLOC) {
+        entry = entry ? entry->next : func->instructions;
+    }
+    if (use_acc) {
+        entry = emit_after(func, entry, IR_STORE, ir_value_create_var(acc_slot, "tailrec.acc"),
+                           ir_value_create_int(acc_op == IR_MUL ? 1 : 0), NULL);
+    }
+    IRValue *header = ir_value_create_unique_label("L_TAILREC");
+    emit_after(func, entry, IR_LABEL, ir_value_clone(header), NULL, NULL);
+
+    // Apply the pending accumulator at every RETURN not being rewritten
+    if (use_acc) {
+        IRInstruction *prev = NULL;
+        for (IRInstruction *instr = func->instructions; instr; prev = instr, instr = instr->next) {
+            if (instr->opcode != IR_RETURN) continue;
+            bool is_site = false;
+            for (int i = 0; i < site_count; i++) {
+                if (sites[i].ret == instr) is_site = true;
+            }
+            if (is_site) continue;
+            IRValue *value = instr->src1 ? instr->src1 : ir_value_create_int(0);
+            instr->src1 = NULL;
+            int result;
+            emit_acc_combine(func, prev, acc_slot, acc_op, value, &result);
+            instr->src1 = ir_value_create_reg(result, IR_TYPE_INT);
+            // Skip over the inserted instructions
+            while (prev->next != instr) prev = prev->next;
+        }
+    }
+
+    for (int i = 0; i < site_count; i++) {
+        TailSite *site = &sites[i];
+        IRInstruction *cursor;
+
+        if (site->op) {
+            // acc = acc OP X, placed where the combining operation was
+            IRValue *other = site->op->src1->kind == IR_VAL_REG &&
+                             site->op->src1->data.reg_num == site->call->dest->data.reg_num
+                             ? site->op->src2 : site->op->src1;
+            int combined;
+            cursor = emit_acc_combine(func, find_prev(func, site->op), acc_slot, acc_op,
+                                      ir_value_clone(other), &combined);
+            cursor = emit_after(func, cursor, IR_STORE, ir_value_create_var(acc_slot, "tailrec.acc"),
+                                ir_value_create_reg(combined, IR_TYPE_INT), NULL);
+        } else {
+            cursor = find_prev(func, site->ret);
+        }
+
+        // Rebind parameters; arguments are immutable registers/constants
+        // evaluated before the call, so sequential stores are safe
+        for (int k = 0; k < site->call->arg_count; k++) {
+            const IRValue *param = func->params[k];
+            cursor = emit_after(func, cursor, IR_STORE,
+                                ir_value_create_var(param->data.reg_num, param->name),
+                                ir_value_clone(site->call->args[k]), NULL);
+        }
+        cursor = emit_after(func, cursor, IR_JUMP, ir_value_clone(header), NULL, NULL);
+
+        // Drop the combining op and RETURN (now after the jump) and the call
+        IRInstruction *next = cursor->next;
+        if (site->op) {
+            ir_function_remove_after(func, cursor, next);
+            next = cursor->next;
+        }
+        ir_function_remove_after(func, cursor, next);
+        ir_function_remove_after(func, find_prev(func, site->call), site->call);
+    }
+
+    ir_value_free(header);
+    free(sites);
+    return true;
+}
+
+/* Rewrite `%r = CALL f(args); RETURN %r` into a frame-reusing jump */
+bool ir_mark_tail_calls(IRFunction *func) {
+    // Arguments may point into the frame a tail call releases
+    if (!func || func->frame_words > 0) return false;
+    bool changed = false;
+
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode != IR_CALL || !instr->dest || instr->dest->kind != IR_VAL_REG) continue;
+        if (instr->arg_count > TAIL_CALL_MAX_ARGS) continue;
+        if (!returns_reg(instr->next, instr->dest->data.reg_num)) continue;
+
+        instr->opcode = IR_TAIL_CALL;
+        ir_value_free(instr->dest);
+        instr->dest = NULL;
+        ir_function_remove_after(func, instr, instr->next);
+        changed = true;
+    }
+    return changed;
+}
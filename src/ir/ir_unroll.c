@@ -0,0 +1,412 @@
+/* ========================================
+   SUB Language - IR Loop Unrolling
+   Full and partial unrolling of constant-trip-count counted loops
+   File: ir_unroll.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Upper bound on the straight-line code a full unroll may produce */
+#define UNROLL_MAX_FULL_SIZE 2048
+/* Body size budget for automatic partial unrolling (-O3) */
+#define UNROLL_PARTIAL_BUDGET 64
+/* Trip counts are limited so bound arithmetic cannot overflow */
+#define UNROLL_MAX_BOUND ((int64_t)1 << 40)
+
+/* A loop `for (iv = start; iv < bound; iv += step)` in canonical layout:
+   header label, test, body..., latch `STORE iv; JUMP header`, contiguous
+   in the instruction list. */
+typedef struct {
+    IRInstruction *header;       // Header IR_LABEL
+    IRInstruction *test;         // `%c = LT/LE %iv, bound`
+    IRInstruction *exit_branch;  // `JUMP_IF_NOT %c, exit`
+    IRInstruction *latch_jump;   // Back edge `JUMP header`
+    int64_t trip_count;
+    int64_t start;
+    int64_t step;
+    int size;                    // Instructions per iteration (test excluded)
+} CountedLoop;
+
+static bool const_int(const IRValue *val, int64_t *out) {
+    if (!val || val->kind != IR_VAL_CONST || val->type == IR_TYPE_STRING ||
+        val->type == IR_TYPE_FLOAT) {
+        return false;
+    }
+    *out = val->data.int_val;
+    return true;
+}
+
+static bool is_reg(const IRValue *val, int reg) {
+    return val && val->kind == IR_VAL_REG && val->data.reg_num == reg;
+}
+
+static bool is_slot(const IRValue *val, int slot) {
+    return val && val->kind == IR_VAL_VAR && val->data.reg_num == slot;
+}
+
+/* Definition of register `reg` within block `b`, or NULL */
+static IRInstruction* block_def(const IRBlock *block, int reg) {
+    for (IRInstruction *instr = block->first; instr; instr = instr->next) {
+        if (is_reg(instr->dest, reg) && instr->opcode != IR_STORE) return instr;
+        if (instr == block->last) break;
+    }
+    return NULL;
+}
+
+/* Do the loop's blocks form the contiguous id range [header, latch]
+   with the only exit edge leaving from the header? */
+static bool loop_is_canonical(const IRCFG *cfg, const IRLoop *loop, int latch) {
+    for (int b = 0; b < cfg->block_count; b++) {
+        bool inside = b >= loop->header && b <= latch;
+        if (inside != loop->body[b]) return false;
+        if (!inside) continue;
+        const IRBlock *block = &cfg->blocks[b];
+        for (int s = 0; s < block->succ_count; s++) {
+            if (!loop->body[block->succs[s]] && b != loop->header) return false;
+        }
+    }
+    return true;
+}
+
+/* Registers defined inside the loop must not be used after it */
+static bool loop_defs_are_local(const IRCFG *cfg, const IRLoop *loop, int latch) {
+    int regs = cfg->func->reg_count;
+    bool *defined = calloc(regs + 1, sizeof(bool));
+    for (IRInstruction *instr = cfg->blocks[loop->header].first; instr; instr = instr->next) {
+        if (instr->dest && instr->dest->kind == IR_VAL_REG && instr->dest->data.reg_num < regs) {
+            defined[instr->dest->data.reg_num] = true;
+        }
+        if (instr == cfg->blocks[latch].last) break;
+    }
+
+    bool ok = true;
+    bool inside = false;
+    for (IRInstruction *instr = cfg->func->instructions; instr && ok; instr = instr->next) {
+        if (instr == cfg->blocks[loop->header].first) inside = true;
+        if (!inside) {
+            const IRValue *ops[2] = { instr->src1, instr->src2 };
+            for (int i = 0; i < 2; i++) {
+                if (ops[i] && ops[i]->kind == IR_VAL_REG && ops[i]->data.reg_num < regs &&
+                    defined[ops[i]->data.reg_num]) ok = false;
+            }
+            for (int i = 0; i < instr->arg_count; i++) {
+                const IRValue *arg = instr->args[i];
+                if (arg->kind == IR_VAL_REG && arg->data.reg_num < regs &&
+                    defined[arg->data.reg_num]) ok = false;
+            }
+        }
+        if (instr == cfg->blocks[latch].last) inside = false;
+    }
+    free(defined);
+    return ok;
+}
+
+/* Recognize a counted loop with compile-time start, bound and step */
+static bool match_counted_loop(const IRCFG *cfg, const IRLoop *loop, CountedLoop *out) {
+    const IRBlock *header = &cfg->blocks[loop->header];
+    if (loop->preheader < 0 || header->pred_count != 2) return false;
+    if (!header->first || header->first->opcode != IR_LABEL) return false;
+
+    int latch = -1;
+    for (int p = 0; p < header->pred_count; p++) {
+        if (loop->body[header->preds[p]]) latch = header->preds[p];
+    }
+    if (latch < 0 || cfg->blocks[latch].last->opcode != IR_JUMP) return false;
+    if (!loop_is_canonical(cfg, loop, latch)) return false;
+
+    // Header test: %c = LT/LE %a, K; JUMP_IF_NOT %c -> exit, %a = LOAD iv
+    IRInstruction *branch = header->last;
+    if (branch->opcode != IR_JUMP_IF_NOT || !branch->src1 || branch->src1->kind != IR_VAL_REG) {
+        return false;
+    }
+    IRInstruction *test = block_def(header, branch->src1->data.reg_num);
+    int64_t bound;
+    if (!test || (test->opcode != IR_LT && test->opcode != IR_LE) ||
+        !test->src1 || test->src1->kind != IR_VAL_REG || !const_int(test->src2, &bound)) {
+        return false;
+    }
+    IRInstruction *iv_load = block_def(header, test->src1->data.reg_num);
+    if (!iv_load || iv_load->opcode != IR_LOAD || !iv_load->src1 ||
+        iv_load->src1->kind != IR_VAL_VAR) {
+        return false;
+    }
+    int iv = iv_load->src1->data.reg_num;
+
+    // Exactly one store to iv in the loop: `STORE iv, ADD(LOAD iv, step)` in the latch
+    IRInstruction *iv_store = NULL;
+    for (int b = loop->header; b <= latch; b++) {
+        for (IRInstruction *instr = cfg->blocks[b].first; instr; instr = instr->next) {
+            if (instr->opcode == IR_STORE && is_slot(instr->dest, iv)) {
+                if (iv_store || b != latch) return false;
+                iv_store = instr;
+            }
+            if (instr == cfg->blocks[b].last) break;
+        }
+    }
+    if (!iv_store || !iv_store->src1 || iv_store->src1->kind != IR_VAL_REG) return false;
+    IRInstruction *incr = block_def(&cfg->blocks[latch], iv_store->src1->data.reg_num);
+    int64_t step;
+    if (!incr || incr->opcode != IR_ADD || !incr->src1 || incr->src1->kind != IR_VAL_REG ||
+        !const_int(incr->src2, &step) || step <= 0) {
+        return false;
+    }
+    IRInstruction *incr_load = block_def(&cfg->blocks[latch], incr->src1->data.reg_num);
+    if (!incr_load || incr_load->opcode != IR_LOAD || !is_slot(incr_load->src1, iv)) return false;
+
+    // Start: last store to iv in the preheader
+    int64_t start = 0;
+    bool have_start = false;
+    const IRBlock *pre = &cfg->blocks[loop->preheader];
+    for (IRInstruction *instr = pre->first; instr; instr = instr->next) {
+        if (instr->opcode == IR_STORE && is_slot(instr->dest, iv)) {
+            have_start = const_int(instr->src1, &start);
+        }
+        if (instr == pre->last) break;
+    }
+    if (!have_start) return false;
+
+    if (start <= -UNROLL_MAX_BOUND || start >= UNROLL_MAX_BOUND ||
+        bound <= -UNROLL_MAX_BOUND || bound >= UNROLL_MAX_BOUND || step >= UNROLL_MAX_BOUND) {
+        return false;
+    }
+    if (test->opcode == IR_LE) bound++;
+    if (!loop_defs_are_local(cfg, loop, latch)) return false;
+
+    out->header = header->first;
+    out->test = test;
+    out->exit_branch = branch;
+    out->latch_jump = cfg->blocks[latch].last;
+    out->start = start;
+    out->step = step;
+    out->trip_count = start < bound ? (bound - start + step - 1) / step : 0;
+    out->size = 0;
+    for (IRInstruction *instr = out->header->next; instr != out->latch_jump; instr = instr->next) {
+        if (instr->opcode != IR_LABEL && instr->opcode != IR_ALLOC && instr != branch) out->size++;
+    }
+    return true;
+}
+
+/* ---------- Cloning ---------- */
+
+typedef struct {
+    IRInstruction **instrs;      // One iteration: header->next .. before latch jump
+    int count;
+    int reg_limit;               // Registers >= this were created by cloning
+} IterationSnapshot;
+
+static IRValue* clone_operand(const IRValue *val, const int *reg_map, int reg_limit) {
+    IRValue *copy = ir_value_clone(val);
+    if (copy && copy->kind == IR_VAL_REG && copy->data.reg_num < reg_limit &&
+        reg_map[copy->data.reg_num] >= 0) {
+        copy->data.reg_num = reg_map[copy->data.reg_num];
+    }
+    return copy;
+}
+
+/* Append one copy of the iteration after `cursor` (registers and
+   internal labels renamed, exit test dropped); returns the new cursor */
+static IRInstruction* clone_iteration(IRFunction *func, const IterationSnapshot *snap,
+                                      const IRInstruction *skip, IRInstruction *cursor) {
+    int *reg_map = malloc(sizeof(int) * (snap->reg_limit + 1));
+    for (int i = 0; i < snap->reg_limit; i++) reg_map[i] = -1;
+
+    int label_count = 0;
+    const char **label_from = malloc(sizeof(char*) * (snap->count + 1));
+    IRValue **label_to = malloc(sizeof(IRValue*) * (snap->count + 1));
+    for (int i = 0; i < snap->count; i++) {
+        const IRInstruction *instr = snap->instrs[i];
+        if (instr->opcode == IR_LABEL && instr->dest) {
+            label_from[label_count] = instr->dest->data.label;
+            label_to[label_count++] = ir_value_create_unique_label("L_UNR");
+        }
+        if (instr->dest && instr->dest->kind == IR_VAL_REG && instr->opcode != IR_STORE &&
+            instr->dest->data.reg_num < snap->reg_limit) {
+            reg_map[instr->dest->data.reg_num] = ir_function_new_reg(func);
+        }
+    }
+
+    for (int i = 0; i < snap->count; i++) {
+        const IRInstruction *instr = snap->instrs[i];
+        if (instr == skip || instr->opcode == IR_ALLOC) continue;
+
+        IRInstruction *copy = ir_instruction_create(instr->opcode);
+        if (instr->opcode == IR_LABEL || instr->opcode == IR_JUMP ||
+            instr->opcode == IR_JUMP_IF || instr->opcode == IR_JUMP_IF_NOT) {
+            copy->dest = ir_value_clone(instr->dest);
+            for (int l = 0; l < label_count; l++) {
+                if (instr->dest && strcmp(instr->dest->data.label, label_from[l]) == 0) {
+                    ir_value_free(copy->dest);
+                    copy->dest = ir_value_clone(label_to[l]);
+                }
+            }
+        } else {
+            copy->dest = clone_operand(instr->dest, reg_map, snap->reg_limit);
+        }
+        copy->src1 = clone_operand(instr->src1, reg_map, snap->reg_limit);
+        copy->src2 = clone_operand(instr->src2, reg_map, snap->reg_limit);
+        for (int a = 0; a < instr->arg_count; a++) {
+            ir_instruction_add_arg(copy, clone_operand(instr->args[a], reg_map, snap->reg_limit));
+        }
+        copy->unroll_hint = instr->unroll_hint;
+        copy->profile_count = instr->profile_count;
+        copy->in_bounds = instr->in_bounds;
+        copy->vector = ir_vector_kernel_clone(instr->vector);
+        ir_function_insert_after(func, cursor, copy);
+        cursor = copy;
+    }
+
+    for (int l = 0; l < label_count; l++) ir_value_free(label_to[l]);
+    free(label_from);
+    free(label_to);
+    free(reg_map);
+    return cursor;
+}
+
+static IRInstruction* find_prev(IRFunction *func, const IRInstruction *target) {
+    IRInstruction *prev = NULL;
+    for (IRInstruction *scan = func->instructions; scan && scan != target; scan = scan->next) {
+        prev = scan;
+    }
+    return prev;
+}
+
+/* ---------- Policy ---------- */
+
+/*
+ * Returns the unroll factor for a loop (0 = leave it), setting *full
+ * when every iteration should be expanded. An explicit unroll(N) hint
+ * wins: N == 1 disables unrolling, N >= trip count unrolls fully.
+ * Without a hint, -O2 fully unrolls tiny loops and -O3 also fully
+ * unrolls larger ones and partially unrolls the rest by the largest
+ * power of two whose copies fit UNROLL_PARTIAL_BUDGET.
+ */
+static int choose_factor(const CountedLoop *loop, int level, bool *full) {
+    int64_t trips = loop->trip_count;
+    int64_t size = loop->size > 0 ? loop->size : 1;
+    int hint = loop->header->unroll_hint;
+    *full = false;
+
+    if (trips <= 0 || hint == 1) return 0;
+
+    if (hint > 1) {
+        if (hint >= trips && trips * size <= UNROLL_MAX_FULL_SIZE) {
+            *full = true;
+            return (int)trips;
+        }
+        return hint < trips ? hint : 0;
+    }
+
+    int64_t full_budget = level >= 3 ? 256 : (level >= 2 ? 64 : 0);
+    if (trips <= 32 && trips * size <= full_budget) {
+        *full = true;
+        return (int)trips;
+    }
+
+    if (level >= 3) {
+        for (int factor = 8; factor >= 2; factor /= 2) {
+            if (factor * size <= UNROLL_PARTIAL_BUDGET && factor <= trips / 2) return factor;
+        }
+    }
+    return 0;
+}
+
+/* ---------- Transformation ---------- */
+
+static void unroll_loop(IRFunction *func, CountedLoop *loop, int factor, bool full) {
+    IterationSnapshot snap = {0};
+    snap.reg_limit = func->reg_count;
+    for (IRInstruction *instr = loop->header->next; instr != loop->latch_jump; instr = instr->next) {
+        snap.instrs = realloc(snap.instrs, sizeof(IRInstruction*) * (snap.count + 1));
+        snap.instrs[snap.count++] = instr;
+    }
+
+    IRInstruction *body_end = find_prev(func, loop->latch_jump);
+
+    if (full) {
+        // The first iteration runs in place: its test is always true
+        for (int i = 1; i < factor; i++) {
+            body_end = clone_iteration(func, &snap, loop->exit_branch, body_end);
+        }
+        ir_function_remove_after(func, body_end, loop->latch_jump);
+        ir_function_remove_after(func, find_prev(func, loop->exit_branch), loop->exit_branch);
+        free(snap.instrs);
+        return;
+    }
+
+    int64_t main_trips = loop->trip_count / factor;
+    int64_t remainder = loop->trip_count % factor;
+
+    // Main loop: `factor` iterations per test, exits after main_trips rounds
+    for (int i = 1; i < factor; i++) {
+        body_end = clone_iteration(func, &snap, loop->exit_branch, body_end);
+    }
+    loop->test->opcode = IR_LT;
+    ir_value_free(loop->test->src2);
+    loop->test->src2 = ir_value_create_int(loop->start + main_trips * factor * loop->step);
+    loop->header->unroll_hint = 1;   // Done; never unroll this loop again
+
+    if (remainder > 0) {
+        // Remainder iterations straight-line after the loop, then on to the exit
+        IRValue *exit_label = loop->exit_branch->dest;
+        IRValue *rem_label = ir_value_create_unique_label("L_UNR_REM");
+        loop->exit_branch->dest = ir_value_clone(rem_label);
+
+        IRInstruction *cursor = ir_instruction_create(IR_LABEL);
+        cursor->dest = rem_label;
+        ir_function_insert_after(func, loop->latch_jump, cursor);
+        for (int64_t i = 0; i < remainder; i++) {
+            cursor = clone_iteration(func, &snap, loop->exit_branch, cursor);
+        }
+        IRInstruction *jump = ir_instruction_create(IR_JUMP);
+        jump->dest = exit_label;
+        ir_function_insert_after(func, cursor, jump);
+    }
+    free(snap.instrs);
+}
+
+/*
+ * Innermost loops are disjoint and each transformation only rewrites its
+ * own loop (and the code it places right after it), so every candidate
+ * of one CFG is matched first and then unrolled. A full unroll can make
+ * the enclosing loop innermost, so rounds repeat until nothing changes;
+ * each round removes or finishes (unroll_hint 1) every loop it touches.
+ */
+bool ir_unroll_loops_function(IRFunction *func, int level) {
+    if (!func || level <= 0) return false;
+    bool changed = false;
+
+    for (;;) {
+        IRCFG *cfg = ir_cfg_build(func);
+        CountedLoop *loops = malloc(sizeof(CountedLoop) * (cfg->loop_count + 1));
+        int *factors = malloc(sizeof(int) * (cfg->loop_count + 1));
+        bool *fulls = malloc(sizeof(bool) * (cfg->loop_count + 1));
+        bool *has_child = calloc(cfg->loop_count + 1, sizeof(bool));
+        for (int k = 0; k < cfg->loop_count; k++) {
+            if (cfg->loops[k].parent >= 0) has_child[cfg->loops[k].parent] = true;
+        }
+
+        int count = 0;
+        for (int l = 0; l < cfg->loop_count; l++) {
+            if (has_child[l]) continue;   // Innermost loops only
+            if (!match_counted_loop(cfg, &cfg->loops[l], &loops[count])) continue;
+            factors[count] = choose_factor(&loops[count], level, &fulls[count]);
+            if (factors[count] > 1 || fulls[count]) count++;
+        }
+        for (int i = 0; i < count; i++) unroll_loop(func, &loops[i], factors[i], fulls[i]);
+
+        free(loops);
+        free(factors);
+        free(fulls);
+        free(has_child);
+        ir_cfg_free(cfg);
+        if (count == 0) break;
+        ir_simplify_function(func);
+        changed = true;
+    }
+    return changed;
+}
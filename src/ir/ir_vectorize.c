@@ -0,0 +1,726 @@
+/* ========================================
+   SUB Language - IR Loop Vectorizer
+   Counted array loops to SIMD kernels with a scalar epilogue
+   File: ir_vectorize.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_opt.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Backend register budget: one XMM/YMM register per node, one general
+   purpose register per array */
+#define VEC_MAX_NODES 12
+#define VEC_MAX_ARRAYS 6
+#define VEC_MAX_OPERANDS 16
+/* Index offsets (a[i + k]) are kept small so addressing cannot overflow */
+#define VEC_MAX_OFFSET 4096
+
+/* What a register defined inside the loop stands for, per iteration */
+typedef enum {
+    SYM_NONE,      // Not vectorizable
+    SYM_INDEX,     // iv + offset
+    SYM_INV,       // Loop-invariant value (hoistable)
+    SYM_LANE,      // Kernel node
+    SYM_ACC,       // Reduction accumulator as loaded this iteration
+    SYM_ACC_SUM,   // Accumulator + node
+    SYM_ACC_CMP    // Comparison of a node against the accumulator
+} SymKind;
+
+typedef struct {
+    SymKind kind;
+    int value;             // Offset (INDEX) or node (LANE, ACC_SUM, ACC_CMP)
+    const IRValue *inv;    // INV: the value to materialize before the loop
+    IROpcode reduce;       // ACC_CMP: IR_LT (min) or IR_GT (max)
+} Sym;
+
+/* Loop-invariant operand of the kernel; dedup key is kind + id */
+typedef enum { OPND_CONST, OPND_REG, OPND_SLOT } OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int64_t id;
+    const IRValue *value;
+    bool is_array;
+    bool checked;          // Some access to it is not proven in range
+} Operand;
+
+typedef struct {
+    IRFunction *func;
+    IRCFG *cfg;
+    const IRLoop *loop;
+    int width;
+    int iv;                        // Induction variable slot
+    int acc;                       // Reduction local slot, or -1
+
+    IRInstruction *first;          // Header label
+    IRInstruction *last;           // Latch jump
+    IRInstruction **defs;          // In-loop definition of each register
+    Sym *syms;
+    bool *stored;                  // Locals stored inside the loop
+
+    IRVecNode nodes[VEC_MAX_NODES];
+    int node_count;
+    int *node_epoch;               // ELEM nodes are shared only within an epoch
+    int epoch;
+    IRVecStore *stores;
+    int store_count;
+    IROpcode reduce;
+    int reduce_node;
+    bool acc_loaded;
+    bool acc_stored;
+
+    Operand operands[VEC_MAX_OPERANDS];
+    int operand_count;
+    const IRValue *bound;
+
+    // Materialization before the loop
+    IRInstruction *cursor;
+    int *memo;                     // Register -> hoisted register (+1)
+} VecLoop;
+
+static bool const_int(const IRValue *val, int64_t *out) {
+    if (!val || val->kind != IR_VAL_CONST || val->type == IR_TYPE_STRING ||
+        val->type == IR_TYPE_FLOAT) {
+        return false;
+    }
+    *out = val->data.int_val;
+    return true;
+}
+
+static bool reg_in_loop(const VecLoop *vl, const IRValue *val) {
+    return val && val->kind == IR_VAL_REG && val->data.reg_num < vl->func->reg_count &&
+           vl->defs[val->data.reg_num] != NULL;
+}
+
+/* Symbolic value of an operand: in-loop registers by their definition,
+   constants and outside registers are invariant */
+static Sym sym_of(const VecLoop *vl, const IRValue *val) {
+    Sym sym = { SYM_NONE, 0, NULL, IR_NOT };
+    if (!val) return sym;
+    if (reg_in_loop(vl, val)) return vl->syms[val->data.reg_num];
+    if (val->kind == IR_VAL_CONST && val->type != IR_TYPE_STRING && val->type != IR_TYPE_FLOAT) {
+        sym.kind = SYM_INV;
+        sym.inv = val;
+    } else if (val->kind == IR_VAL_REG) {
+        sym.kind = SYM_INV;
+        sym.inv = val;
+    }
+    return sym;
+}
+
+/* ---------- Kernel construction ---------- */
+
+static int operand_index(VecLoop *vl, const IRValue *val, bool is_array) {
+    Operand key = { OPND_REG, 0, val, is_array, false };
+    if (val->kind == IR_VAL_CONST) {
+        key.kind = OPND_CONST;
+        key.id = val->data.int_val;
+    } else if (reg_in_loop(vl, val) && vl->defs[val->data.reg_num]->opcode == IR_LOAD) {
+        // Every load of the same invariant local is the same operand
+        key.kind = OPND_SLOT;
+        key.id = vl->defs[val->data.reg_num]->src1->data.reg_num;
+    } else {
+        key.id = val->data.reg_num;
+    }
+    for (int i = 0; i < vl->operand_count; i++) {
+        if (vl->operands[i].kind == key.kind && vl->operands[i].id == key.id) {
+            vl->operands[i].is_array |= is_array;
+            return i;
+        }
+    }
+    if (vl->operand_count == VEC_MAX_OPERANDS) return -1;
+    vl->operands[vl->operand_count] = key;
+    return vl->operand_count++;
+}
+
+/* Find or append a node; returns -1 when the register budget is exceeded */
+static int add_node(VecLoop *vl, IRVecNode node) {
+    for (int i = 0; i < vl->node_count; i++) {
+        const IRVecNode *n = &vl->nodes[i];
+        if (n->kind != node.kind || n->op != node.op || n->a != node.a || n->b != node.b ||
+            n->arg != node.arg || n->offset != node.offset) {
+            continue;
+        }
+        // A store may have changed what an earlier element load saw
+        if (node.kind == IR_VEC_ELEM && vl->node_epoch[i] != vl->epoch) continue;
+        return i;
+    }
+    if (vl->node_count == VEC_MAX_NODES) return -1;
+    vl->node_epoch[vl->node_count] = vl->epoch;
+    vl->nodes[vl->node_count] = node;
+    return vl->node_count++;
+}
+
+/* Node computing a symbolic value in every lane */
+static int node_of(VecLoop *vl, Sym sym) {
+    IRVecNode node = { IR_VEC_SCALAR, IR_NOT, -1, -1, -1, 0 };
+    switch (sym.kind) {
+        case SYM_LANE:
+            return sym.value;
+        case SYM_INDEX:
+            node.kind = IR_VEC_INDEX;
+            node.offset = sym.value;
+            return add_node(vl, node);
+        case SYM_INV:
+            node.arg = operand_index(vl, sym.inv, false);
+            if (node.arg < 0) return -1;
+            return add_node(vl, node);
+        default:
+            return -1;
+    }
+}
+
+static Sym lane(int node) {
+    Sym sym = { node >= 0 ? SYM_LANE : SYM_NONE, node, NULL, IR_NOT };
+    return sym;
+}
+
+static bool is_small_offset(int64_t value) {
+    return value > -VEC_MAX_OFFSET && value < VEC_MAX_OFFSET;
+}
+
+/* Arithmetic on symbolic values */
+static Sym eval_binary(VecLoop *vl, IRInstruction *instr) {
+    Sym none = { SYM_NONE, 0, NULL, IR_NOT };
+    Sym a = sym_of(vl, instr->src1);
+    Sym b = sym_of(vl, instr->src2);
+    IROpcode op = instr->opcode;
+    int64_t c;
+
+    if (a.kind == SYM_INV && b.kind == SYM_INV) {
+        // Hoistable as long as it cannot trap
+        if (op == IR_DIV || op == IR_MOD) return none;
+        Sym inv = { SYM_INV, 0, instr->dest, IR_NOT };
+        return inv;
+    }
+
+    // Accumulator patterns: acc + x, and x <cmp> acc for min/max
+    if (a.kind == SYM_ACC || b.kind == SYM_ACC) {
+        Sym other = a.kind == SYM_ACC ? b : a;
+        if (other.kind == SYM_ACC) return none;
+        if (op == IR_ADD) {
+            Sym sum = { SYM_ACC_SUM, node_of(vl, other), NULL, IR_NOT };
+            return sum.value >= 0 ? sum : none;
+        }
+        bool acc_right = b.kind == SYM_ACC;
+        bool less = op == IR_LT || op == IR_LE;
+        if (op != IR_LT && op != IR_LE && op != IR_GT && op != IR_GE) return none;
+        // x < acc selects the minimum, acc < x the maximum
+        Sym cmp = { SYM_ACC_CMP, node_of(vl, other), NULL, less == acc_right ? IR_LT : IR_GT };
+        return cmp.value >= 0 ? cmp : none;
+    }
+
+    // (acc + x) + y and (acc + x) - y regroup to acc + (x +/- y): integer
+    // addition wraps, so reassociation is exact
+    if ((a.kind == SYM_ACC_SUM && (op == IR_ADD || op == IR_SUB)) ||
+        (b.kind == SYM_ACC_SUM && op == IR_ADD)) {
+        Sym sum = a.kind == SYM_ACC_SUM ? a : b;
+        Sym other = a.kind == SYM_ACC_SUM ? b : a;
+        IRVecNode node = { IR_VEC_OP, op, sum.value, node_of(vl, other), -1, 0 };
+        if (node.b < 0) return none;
+        sum.value = add_node(vl, node);
+        return sum.value >= 0 ? sum : none;
+    }
+
+    if ((op == IR_ADD || op == IR_SUB) && a.kind == SYM_INDEX && b.kind == SYM_INV &&
+        const_int(b.inv, &c) && is_small_offset(c)) {
+        int64_t offset = a.value + (op == IR_ADD ? c : -c);
+        if (is_small_offset(offset)) {
+            Sym index = { SYM_INDEX, (int)offset, NULL, IR_NOT };
+            return index;
+        }
+    }
+    if (op == IR_ADD && a.kind == SYM_INV && b.kind == SYM_INDEX &&
+        const_int(a.inv, &c) && is_small_offset(c) && is_small_offset(b.value + c)) {
+        Sym index = { SYM_INDEX, (int)(b.value + c), NULL, IR_NOT };
+        return index;
+    }
+
+    IRVecNode node = { IR_VEC_OP, op, -1, -1, -1, 0 };
+    switch (op) {
+        case IR_ADD: case IR_SUB: case IR_MUL:
+            break;
+        case IR_SHL: case IR_SHR:
+            // Shift counts must be immediates
+            if (b.kind != SYM_INV || !const_int(b.inv, &c) || c < 0 || c > 63) return none;
+            break;
+        default:
+            return none;
+    }
+    node.a = node_of(vl, a);
+    node.b = node_of(vl, b);
+    if (node.a < 0 || node.b < 0) return none;
+    return lane(add_node(vl, node));
+}
+
+/* Symbolically execute one loop instruction; false rejects the loop */
+static bool eval_instruction(VecLoop *vl, IRInstruction *instr, IRInstruction *test,
+                             IRInstruction *exit_branch, const char **pending_join) {
+    int dest = instr->dest && instr->dest->kind == IR_VAL_REG ? instr->dest->data.reg_num : -1;
+    Sym result = { SYM_NONE, 0, NULL, IR_NOT };
+
+    switch (instr->opcode) {
+        case IR_LABEL:
+            if (*pending_join && instr->dest &&
+                strcmp(instr->dest->data.label, *pending_join) == 0) {
+                *pending_join = NULL;
+            }
+            return true;
+
+        case IR_ALLOC:
+            return true;
+
+        case IR_JUMP:
+            return instr == vl->last;
+
+        case IR_JUMP_IF_NOT: {
+            if (instr == exit_branch) return true;
+            // if (x < acc) { acc = x }: the branch skips the update
+            Sym cond = sym_of(vl, instr->src1);
+            if (cond.kind != SYM_ACC_CMP || vl->reduce != IR_NOT || *pending_join) return false;
+            vl->reduce = cond.reduce;
+            vl->reduce_node = cond.value;
+            *pending_join = instr->dest->data.label;
+            return true;
+        }
+
+        case IR_CONST_INT:
+        case IR_MOVE:
+            result = sym_of(vl, instr->src1);
+            break;
+
+        case IR_LOAD: {
+            if (!instr->src1 || instr->src1->kind != IR_VAL_VAR) return false;
+            int slot = instr->src1->data.reg_num;
+            if (slot == vl->iv) {
+                result.kind = SYM_INDEX;
+            } else if (slot == vl->acc) {
+                if (vl->acc_loaded || vl->acc_stored) return false;
+                vl->acc_loaded = true;
+                result.kind = SYM_ACC;
+            } else if (!vl->stored[slot]) {
+                result.kind = SYM_INV;
+                result.inv = instr->dest;
+            } else {
+                return false;
+            }
+            break;
+        }
+
+        case IR_ARRAY_LEN: {
+            Sym array = sym_of(vl, instr->src1);
+            if (array.kind != SYM_INV) return false;
+            result.kind = SYM_INV;
+            result.inv = instr->dest;
+            break;
+        }
+
+        case IR_LOAD_ELEM: {
+            Sym array = sym_of(vl, instr->src1);
+            Sym index = sym_of(vl, instr->src2);
+            if (array.kind != SYM_INV || index.kind != SYM_INDEX) return false;
+            IRVecNode node = { IR_VEC_ELEM, IR_NOT, -1, -1, operand_index(vl, array.inv, true),
+                               index.value };
+            if (node.arg < 0) return false;
+            vl->operands[node.arg].checked |= !instr->in_bounds;
+            result = lane(add_node(vl, node));
+            break;
+        }
+
+        case IR_STORE_ELEM: {
+            if (*pending_join || instr->arg_count != 1) return false;
+            Sym array = sym_of(vl, instr->src1);
+            Sym index = sym_of(vl, instr->src2);
+            if (array.kind != SYM_INV || index.kind != SYM_INDEX) return false;
+            IRVecStore store;
+            store.arg = operand_index(vl, array.inv, true);
+            store.offset = index.value;
+            store.node = node_of(vl, sym_of(vl, instr->args[0]));
+            store.after = vl->node_count;
+            if (store.arg < 0 || store.node < 0) return false;
+            vl->operands[store.arg].checked |= !instr->in_bounds;
+            vl->stores = realloc(vl->stores, sizeof(IRVecStore) * (vl->store_count + 1));
+            vl->stores[vl->store_count++] = store;
+            vl->epoch++;
+            return true;
+        }
+
+        case IR_STORE: {
+            if (!instr->dest || instr->dest->kind != IR_VAL_VAR) return false;
+            int slot = instr->dest->data.reg_num;
+            Sym value = sym_of(vl, instr->src1);
+            if (slot == vl->iv) {
+                // iv = iv + 1, last thing before the back edge
+                return value.kind == SYM_INDEX && value.value == 1 && instr->next == vl->last &&
+                       !*pending_join;
+            }
+            if (slot != vl->acc || vl->acc_stored) return false;
+            vl->acc_stored = true;
+            if (*pending_join) {
+                // acc = x inside `if (x < acc)`: x must be the compared value
+                return value.kind == SYM_LANE && value.value == vl->reduce_node;
+            }
+            if (value.kind != SYM_ACC_SUM || vl->reduce != IR_NOT) return false;
+            vl->reduce = IR_ADD;
+            vl->reduce_node = value.value;
+            return true;
+        }
+
+        default:
+            if (instr == test) {
+                // Header test `iv < bound`
+                Sym iv = sym_of(vl, instr->src1);
+                Sym bound = sym_of(vl, instr->src2);
+                if (iv.kind != SYM_INDEX || iv.value != 0 || bound.kind != SYM_INV) return false;
+                vl->bound = bound.inv;
+                return true;
+            }
+            if (!ir_opcode_is_binary(instr->opcode)) return false;
+            result = eval_binary(vl, instr);
+            break;
+    }
+
+    // Accumulator values only flow into the reduction: every other
+    // consumer asks for a node and fails on them
+    if (result.kind == SYM_NONE || dest < 0 || dest >= vl->func->reg_count) return false;
+    vl->syms[dest] = result;
+    return true;
+}
+
+/* The accumulator (if any) is the only non-iv local stored in the loop */
+static bool find_locals(VecLoop *vl) {
+    vl->acc = -1;
+    for (IRInstruction *instr = vl->first; ; instr = instr->next) {
+        if (instr->opcode == IR_STORE && instr->dest && instr->dest->kind == IR_VAL_VAR) {
+            int slot = instr->dest->data.reg_num;
+            if (slot >= vl->func->local_count) return false;
+            vl->stored[slot] = true;
+            if (slot != vl->iv) {
+                if (vl->acc >= 0 && vl->acc != slot) return false;
+                vl->acc = slot;
+            }
+        }
+        if (instr->dest && instr->dest->kind == IR_VAL_REG && instr->opcode != IR_STORE &&
+            instr->dest->data.reg_num < vl->func->reg_count) {
+            vl->defs[instr->dest->data.reg_num] = instr;
+        }
+        if (instr == vl->last) break;
+    }
+    return true;
+}
+
+/* Canonical layout: blocks [header, latch] contiguous, only the header
+   exits, the preheader falls straight into the header */
+static bool match_layout(VecLoop *vl, IRInstruction **test, IRInstruction **exit_branch) {
+    const IRCFG *cfg = vl->cfg;
+    const IRLoop *loop = vl->loop;
+    const IRBlock *header = &cfg->blocks[loop->header];
+    if (loop->preheader < 0 || header->pred_count != 2) return false;
+    if (!header->first || header->first->opcode != IR_LABEL) return false;
+    const IRBlock *pre = &cfg->blocks[loop->preheader];
+    if (pre->last->next != header->first || ir_instruction_is_terminator(pre->last)) return false;
+
+    int latch = -1;
+    for (int p = 0; p < header->pred_count; p++) {
+        if (loop->body[header->preds[p]]) latch = header->preds[p];
+    }
+    if (latch < 0 || cfg->blocks[latch].last->opcode != IR_JUMP) return false;
+    for (int b = 0; b < cfg->block_count; b++) {
+        bool inside = b >= loop->header && b <= latch;
+        if (inside != loop->body[b]) return false;
+        if (!inside || b == loop->header) continue;
+        for (int s = 0; s < cfg->blocks[b].succ_count; s++) {
+            if (!loop->body[cfg->blocks[b].succs[s]]) return false;
+        }
+    }
+
+    *exit_branch = header->last;
+    if ((*exit_branch)->opcode != IR_JUMP_IF_NOT || !(*exit_branch)->src1 ||
+        (*exit_branch)->src1->kind != IR_VAL_REG) {
+        return false;
+    }
+    *test = NULL;
+    for (IRInstruction *instr = header->first; instr != header->last; instr = instr->next) {
+        if (instr->dest && instr->dest->kind == IR_VAL_REG &&
+            instr->dest->data.reg_num == (*exit_branch)->src1->data.reg_num) {
+            *test = instr;
+        }
+    }
+    if (!*test || (*test)->opcode != IR_LT) return false;
+    IRInstruction *iv_load = NULL;
+    for (IRInstruction *instr = header->first; instr != header->last; instr = instr->next) {
+        if (instr->opcode == IR_LOAD && instr->dest && (*test)->src1 &&
+            (*test)->src1->kind == IR_VAL_REG && instr->dest->data.reg_num == (*test)->src1->data.reg_num) {
+            iv_load = instr;
+        }
+    }
+    if (!iv_load || !iv_load->src1 || iv_load->src1->kind != IR_VAL_VAR) return false;
+
+    vl->iv = iv_load->src1->data.reg_num;
+    vl->first = header->first;
+    vl->last = cfg->blocks[latch].last;
+    return true;
+}
+
+/* ---------- Rewriting ---------- */
+
+static IRInstruction* emit(VecLoop *vl, IROpcode opcode, IRValue *dest, IRValue *src1, IRValue *src2) {
+    IRInstruction *instr = ir_instruction_create(opcode);
+    instr->dest = dest;
+    instr->src1 = src1;
+    instr->src2 = src2;
+    ir_function_insert_after(vl->func, vl->cursor, instr);
+    vl->cursor = instr;
+    return instr;
+}
+
+static IRValue* new_reg(VecLoop *vl) {
+    return ir_value_create_reg(ir_function_new_reg(vl->func), IR_TYPE_INT);
+}
+
+/* Recompute an invariant value ahead of the loop */
+static IRValue* materialize(VecLoop *vl, const IRValue *val) {
+    if (!reg_in_loop(vl, val)) return ir_value_clone(val);
+    int reg = val->data.reg_num;
+    if (vl->memo[reg]) return ir_value_create_reg(vl->memo[reg] - 1, IR_TYPE_INT);
+
+    const IRInstruction *def = vl->defs[reg];
+    IRValue *dest = new_reg(vl);
+    if (def->opcode == IR_LOAD) {
+        emit(vl, IR_LOAD, dest, ir_value_clone(def->src1), NULL);
+    } else {
+        IRValue *src1 = def->src1 ? materialize(vl, def->src1) : NULL;
+        IRValue *src2 = def->src2 ? materialize(vl, def->src2) : NULL;
+        emit(vl, def->opcode, dest, src1, src2);
+    }
+    vl->memo[reg] = dest->data.reg_num + 1;
+    return ir_value_clone(dest);
+}
+
+/* Operand pairs that must name different arrays at run time: a store
+   and another access of a different element offset */
+static bool needs_alias_check(const VecLoop *vl, int x, int y, bool *always) {
+    *always = false;
+    bool check = false;
+    for (int s = 0; s < vl->store_count; s++) {
+        const IRVecStore *store = &vl->stores[s];
+        int other = store->arg == x ? y : store->arg == y ? x : -1;
+        if (other < 0) continue;
+        for (int n = 0; n < vl->node_count; n++) {
+            const IRVecNode *node = &vl->nodes[n];
+            if (node->kind == IR_VEC_ELEM && node->arg == other && node->offset != store->offset) {
+                check = true;
+            }
+        }
+        for (int t = 0; t < vl->store_count; t++) {
+            if (vl->stores[t].arg == other && vl->stores[t].offset != store->offset) check = true;
+        }
+    }
+    if (check && x == y) *always = true;
+    return check;
+}
+
+/* Smallest and largest element offset used on array operand `x` */
+static void element_offsets(const VecLoop *vl, int x, int64_t *min_offset, int64_t *max_offset) {
+    *min_offset = VEC_MAX_OFFSET;
+    *max_offset = -VEC_MAX_OFFSET;
+    for (int n = 0; n < vl->node_count; n++) {
+        const IRVecNode *node = &vl->nodes[n];
+        if (node->kind != IR_VEC_ELEM || node->arg != x) continue;
+        if (node->offset < *min_offset) *min_offset = node->offset;
+        if (node->offset > *max_offset) *max_offset = node->offset;
+    }
+    for (int s = 0; s < vl->store_count; s++) {
+        if (vl->stores[s].arg != x) continue;
+        if (vl->stores[s].offset < *min_offset) *min_offset = vl->stores[s].offset;
+        if (vl->stores[s].offset > *max_offset) *max_offset = vl->stores[s].offset;
+    }
+}
+
+static void rewrite_loop(VecLoop *vl, IRValue *skip) {
+    IRInstruction *kernel = ir_instruction_create(IR_VECTOR_LOOP);
+    int shift = vl->width == 4 ? 2 : 1;
+
+    // Enough iterations for one vector step?
+    IRValue *lo = new_reg(vl);
+    emit(vl, IR_LOAD, lo, ir_value_create_var(vl->iv, NULL), NULL);
+    IRValue *hi = materialize(vl, vl->bound);
+    IRValue *count = new_reg(vl);
+    emit(vl, IR_SUB, count, hi, ir_value_clone(lo));
+    IRValue *enough = new_reg(vl);
+    emit(vl, IR_GE, enough, ir_value_clone(count), ir_value_create_int(vl->width));
+    emit(vl, IR_JUMP_IF_NOT, ir_value_clone(skip), ir_value_clone(enough), NULL);
+
+    // Operands, then the runtime alias checks between array operands
+    IRValue *operands[VEC_MAX_OPERANDS];
+    for (int i = 0; i < vl->operand_count; i++) {
+        operands[i] = materialize(vl, vl->operands[i].value);
+    }
+    for (int x = 0; x < vl->operand_count; x++) {
+        for (int y = x + 1; y < vl->operand_count; y++) {
+            bool always;
+            if (!vl->operands[x].is_array || !vl->operands[y].is_array) continue;
+            if (!needs_alias_check(vl, x, y, &always)) continue;
+            IRValue *same = new_reg(vl);
+            emit(vl, IR_EQ, same, ir_value_clone(operands[x]), ir_value_clone(operands[y]));
+            emit(vl, IR_JUMP_IF, ir_value_clone(skip), ir_value_clone(same), NULL);
+        }
+    }
+
+    // Vector part covers [lo, lo + count rounded down to the width)
+    IRValue *steps = new_reg(vl);
+    emit(vl, IR_SAR, steps, ir_value_clone(count), ir_value_create_int(shift));
+    IRValue *span = new_reg(vl);
+    emit(vl, IR_SHL, span, ir_value_clone(steps), ir_value_create_int(shift));
+    IRValue *end = new_reg(vl);
+    emit(vl, IR_ADD, end, ir_value_clone(lo), ir_value_clone(span));
+
+    // Arrays with unproven accesses: the whole vector range must be in
+    // bounds, otherwise the scalar loop runs and stops at the bad index
+    for (int x = 0; x < vl->operand_count; x++) {
+        if (!vl->operands[x].is_array || !vl->operands[x].checked) continue;
+        int64_t min_offset, max_offset;
+        element_offsets(vl, x, &min_offset, &max_offset);
+        IRValue *low_ok = new_reg(vl);
+        emit(vl, IR_GE, low_ok, ir_value_clone(lo), ir_value_create_int(-min_offset));
+        emit(vl, IR_JUMP_IF_NOT, ir_value_clone(skip), ir_value_clone(low_ok), NULL);
+        IRValue *length = new_reg(vl);
+        emit(vl, IR_ARRAY_LEN, length, ir_value_clone(operands[x]), NULL);
+        IRValue *limit = new_reg(vl);
+        emit(vl, IR_SUB, limit, ir_value_clone(length), ir_value_create_int(max_offset));
+        IRValue *high_ok = new_reg(vl);
+        emit(vl, IR_LE, high_ok, ir_value_clone(end), ir_value_clone(limit));
+        emit(vl, IR_JUMP_IF_NOT, ir_value_clone(skip), ir_value_clone(high_ok), NULL);
+    }
+
+    ir_instruction_add_arg(kernel, ir_value_clone(lo));
+    ir_instruction_add_arg(kernel, ir_value_clone(end));
+    for (int i = 0; i < vl->operand_count; i++) {
+        ir_instruction_add_arg(kernel, operands[i]);
+    }
+
+    IRVectorKernel *vk = calloc(1, sizeof(IRVectorKernel));
+    vk->width = vl->width;
+    vk->node_count = vl->node_count;
+    vk->nodes = malloc(sizeof(IRVecNode) * vl->node_count);
+    for (int i = 0; i < vl->node_count; i++) {
+        vk->nodes[i] = vl->nodes[i];
+        if (vk->nodes[i].arg >= 0) vk->nodes[i].arg += 2;
+    }
+    vk->store_count = vl->store_count;
+    vk->stores = malloc(sizeof(IRVecStore) * (vl->store_count ? vl->store_count : 1));
+    for (int i = 0; i < vl->store_count; i++) {
+        vk->stores[i] = vl->stores[i];
+        vk->stores[i].arg += 2;
+    }
+    vk->reduce = vl->reduce;
+    vk->reduce_node = vl->reduce_node;
+    vk->reduce_init = -1;
+    kernel->vector = vk;
+
+    if (vl->reduce != IR_NOT) {
+        IRValue *init = new_reg(vl);
+        emit(vl, IR_LOAD, init, ir_value_create_var(vl->acc, NULL), NULL);
+        vk->reduce_init = kernel->arg_count;
+        ir_instruction_add_arg(kernel, ir_value_clone(init));
+        kernel->dest = new_reg(vl);
+    }
+    ir_function_insert_after(vl->func, vl->cursor, kernel);
+    vl->cursor = kernel;
+    if (kernel->dest) {
+        emit(vl, IR_STORE, ir_value_create_var(vl->acc, NULL), ir_value_clone(kernel->dest), NULL);
+    }
+
+    // The original loop finishes the remaining iterations
+    emit(vl, IR_STORE, ir_value_create_var(vl->iv, NULL), ir_value_clone(end), NULL);
+    emit(vl, IR_LABEL, ir_value_clone(skip), NULL, NULL);
+}
+
+/* Analyze one innermost loop; rewrites it and returns true on success */
+static bool vectorize_loop(IRFunction *func, IRCFG *cfg, const IRLoop *loop, int width) {
+    VecLoop vl;
+    memset(&vl, 0, sizeof(vl));
+    vl.func = func;
+    vl.cfg = cfg;
+    vl.loop = loop;
+    vl.width = width;
+    vl.reduce = IR_NOT;
+    vl.reduce_node = -1;
+
+    IRInstruction *test, *exit_branch;
+    if (!match_layout(&vl, &test, &exit_branch)) return false;
+
+    int regs = func->reg_count;
+    vl.defs = calloc(regs + 1, sizeof(IRInstruction*));
+    vl.syms = calloc(regs + 1, sizeof(Sym));
+    vl.stored = calloc(func->local_count + 1, sizeof(bool));
+    vl.node_epoch = calloc(VEC_MAX_NODES, sizeof(int));
+
+    bool ok = find_locals(&vl);
+    const char *pending_join = NULL;
+    for (IRInstruction *instr = vl.first; ok; instr = instr->next) {
+        ok = eval_instruction(&vl, instr, test, exit_branch, &pending_join);
+        if (instr == vl.last) break;
+    }
+    ok = ok && !pending_join && vl.bound;
+    // A reduction needs both its load and its store; min/max need 4 lanes
+    if (ok && vl.acc >= 0) {
+        ok = vl.reduce != IR_NOT && vl.acc_loaded && vl.acc_stored &&
+             (vl.reduce == IR_ADD || width >= 4);
+    }
+
+    // Something to do on arrays, within the register budget
+    int arrays = 0;
+    bool touches_memory = vl.store_count > 0;
+    for (int i = 0; ok && i < vl.operand_count; i++) {
+        if (vl.operands[i].is_array) arrays++;
+    }
+    for (int n = 0; ok && n < vl.node_count; n++) {
+        if (vl.nodes[n].kind == IR_VEC_ELEM) touches_memory = true;
+    }
+    ok = ok && touches_memory && arrays <= VEC_MAX_ARRAYS;
+
+    // The same array accessed at two offsets with a store is a dependence
+    for (int x = 0; ok && x < vl.operand_count; x++) {
+        bool always;
+        if (vl.operands[x].is_array && needs_alias_check(&vl, x, x, &always) && always) ok = false;
+    }
+
+    if (ok) {
+        vl.memo = calloc(regs + 1, sizeof(int));
+        vl.cursor = cfg->blocks[loop->preheader].last;
+        IRValue *skip = ir_value_create_unique_label("L_VEC_SKIP");
+        rewrite_loop(&vl, skip);
+        ir_value_free(skip);
+        free(vl.memo);
+    }
+
+    free(vl.defs);
+    free(vl.syms);
+    free(vl.stored);
+    free(vl.node_epoch);
+    free(vl.stores);
+    return ok;
+}
+
+bool ir_vectorize_function(IRFunction *func, int width) {
+    if (!func || !func->instructions || (width != 2 && width != 4)) return false;
+
+    // Innermost loops are disjoint, and rewriting one only inserts code
+    // in front of its header, so a single CFG serves all of them
+    IRCFG *cfg = ir_cfg_build(func);
+    bool changed = false;
+    for (int i = 0; i < cfg->loop_count; i++) {
+        bool innermost = true;
+        for (int j = 0; j < cfg->loop_count; j++) {
+            if (cfg->loops[j].parent == i) innermost = false;
+        }
+        if (innermost) changed |= vectorize_loop(func, cfg, &cfg->loops[i], width);
+    }
+    ir_cfg_free(cfg);
+    return changed;
+}
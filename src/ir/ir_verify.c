@@ -0,0 +1,253 @@
+/* ========================================
+   SUB Language - IR Verifier
+   Checks the operand conventions documented in ir.h
+   File: ir_verify.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "ir_pass.h"
+#include "ir_cfg.h"
+#include "windows_compat.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+typedef struct {
+    IRFunction *func;
+    char *msg;
+    size_t msg_size;
+    bool ok;
+    int *def_block;       // Block defining each vreg (-1: undefined)
+    int *def_pos;         // Instruction index of the definition
+} Verifier;
+
+static void verify_fail(Verifier *v, int pos, const IRInstruction *instr, const char *fmt, ...) {
+    if (!v->ok) return;   // Keep the first problem
+    v->ok = false;
+    int n = snprintf(v->msg, v->msg_size, "function %s, instruction %d (%s): ",
+                     v->func->name, pos, instr ? ir_opcode_name(instr->opcode) : "-");
+    if (n < 0 || (size_t)n >= v->msg_size) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(v->msg + n, v->msg_size - n, fmt, ap);
+    va_end(ap);
+}
+
+static bool verify_label_defined(IRFunction *func, const char *label) {
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next) {
+        if (instr->opcode == IR_LABEL && instr->dest &&
+            strcmp(instr->dest->data.label, label) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Kind and range of a single operand */
+static void verify_operand(Verifier *v, int pos, const IRInstruction *instr,
+                           const IRValue *val, const char *role) {
+    if (!val) return;
+    switch (val->kind) {
+        case IR_VAL_REG:
+            if (val->data.reg_num < 0 || val->data.reg_num >= v->func->reg_count) {
+                verify_fail(v, pos, instr, "%s %%%d out of range (reg_count %d)",
+                            role, val->data.reg_num, v->func->reg_count);
+            }
+            break;
+        case IR_VAL_VAR:
+            if (val->data.reg_num < 0 || val->data.reg_num >= v->func->local_count) {
+                verify_fail(v, pos, instr, "%s local $%d out of range (local_count %d)",
+                            role, val->data.reg_num, v->func->local_count);
+            }
+            break;
+        case IR_VAL_LABEL:
+            if (!val->data.label) verify_fail(v, pos, instr, "%s label without a name", role);
+            break;
+        case IR_VAL_CONST:
+            break;
+    }
+}
+
+/* Per-opcode operand shape */
+static void verify_shape(Verifier *v, int pos, const IRInstruction *instr) {
+    IROpcode op = instr->opcode;
+    const IRValue *d = instr->dest;
+    const IRValue *s1 = instr->src1;
+
+    if (ir_opcode_is_binary(op)) {
+        if (!d || d->kind != IR_VAL_REG || !s1 || !instr->src2) {
+            verify_fail(v, pos, instr, "binary operation needs a register dest and two operands");
+        }
+        return;
+    }
+    switch (op) {
+        case IR_LABEL:
+        case IR_JUMP:
+            if (!d || d->kind != IR_VAL_LABEL) verify_fail(v, pos, instr, "missing label");
+            break;
+        case IR_JUMP_IF:
+        case IR_JUMP_IF_NOT:
+            if (!d || d->kind != IR_VAL_LABEL || !s1) {
+                verify_fail(v, pos, instr, "branch needs a condition and a label");
+            }
+            break;
+        case IR_ALLOC:
+            if (!d || d->kind != IR_VAL_VAR) verify_fail(v, pos, instr, "ALLOC dest must be a local");
+            break;
+        case IR_LOAD:
+            if (!d || d->kind != IR_VAL_REG || !s1 || s1->kind != IR_VAL_VAR) {
+                verify_fail(v, pos, instr, "LOAD must read a local into a register");
+            }
+            break;
+        case IR_STORE:
+            if (!d || d->kind != IR_VAL_VAR || !s1) {
+                verify_fail(v, pos, instr, "STORE must write a value to a local");
+            }
+            break;
+        case IR_LOAD_ELEM:
+            if (!d || d->kind != IR_VAL_REG || !s1 || !instr->src2) {
+                verify_fail(v, pos, instr, "LOAD_ELEM needs dest, array and index");
+            }
+            break;
+        case IR_STORE_ELEM:
+            if (d || !s1 || !instr->src2 || instr->arg_count != 1) {
+                verify_fail(v, pos, instr, "STORE_ELEM needs array, index and one value");
+            }
+            break;
+        case IR_ALLOC_FRAME_ARRAY:
+            if (!d || d->kind != IR_VAL_REG || !s1 || s1->kind != IR_VAL_CONST || !instr->src2 ||
+                instr->src2->kind != IR_VAL_CONST || s1->data.int_val < 0 || instr->src2->data.int_val < 0 ||
+                instr->src2->data.int_val + s1->data.int_val + 1 > v->func->frame_words) {
+                verify_fail(v, pos, instr, "ALLOC_FRAME_ARRAY outside the frame array area");
+            }
+            break;
+        case IR_CALL:
+        case IR_TAIL_CALL:
+            if (!s1 || s1->kind != IR_VAL_LABEL) verify_fail(v, pos, instr, "callee must be a label");
+            if (op == IR_TAIL_CALL && d) verify_fail(v, pos, instr, "TAIL_CALL has no result");
+            break;
+        case IR_PROFILE_COUNT:
+            if (d || !s1 || s1->kind != IR_VAL_CONST || s1->data.int_val < 0) {
+                verify_fail(v, pos, instr, "PROFILE_COUNT needs a counter index");
+            }
+            break;
+        case IR_VECTOR_LOOP: {
+            const IRVectorKernel *k = instr->vector;
+            if (!k || instr->arg_count < 2) {
+                verify_fail(v, pos, instr, "VECTOR_LOOP needs a kernel and loop bounds");
+                break;
+            }
+            for (int i = 0; i < k->node_count; i++) {
+                const IRVecNode *n = &k->nodes[i];
+                bool bad = (n->kind == IR_VEC_OP && (n->a < 0 || n->a >= i || n->b < 0 || n->b >= i)) ||
+                           ((n->kind == IR_VEC_ELEM || n->kind == IR_VEC_SCALAR) &&
+                            (n->arg < 2 || n->arg >= instr->arg_count));
+                if (bad) verify_fail(v, pos, instr, "malformed kernel node %d", i);
+            }
+            break;
+        }
+        default:
+            if (d && d->kind != IR_VAL_REG) {
+                verify_fail(v, pos, instr, "result must be a register");
+            }
+            break;
+    }
+}
+
+/* Registers used by `instr` must be defined in a dominating position */
+static void verify_use(Verifier *v, const IRCFG *cfg, int block, int pos,
+                       const IRInstruction *instr, const IRValue *val) {
+    if (!val || val->kind != IR_VAL_REG) return;
+    int r = val->data.reg_num;
+    if (r < 0 || r >= v->func->reg_count) return;   // Reported by verify_operand
+    int db = v->def_block[r];
+    if (db < 0) {
+        verify_fail(v, pos, instr, "use of undefined register %%%d", r);
+    } else if (cfg->blocks[block].rpo_index < 0) {
+        return;   // Unreachable code is not constrained
+    } else if (db == block ? v->def_pos[r] >= pos : !ir_cfg_dominates(cfg, db, block)) {
+        verify_fail(v, pos, instr, "use of %%%d is not dominated by its definition", r);
+    }
+}
+
+bool ir_verify_function(IRFunction *func, char *msg, size_t msg_size) {
+    Verifier v = { func, msg, msg_size, true, NULL, NULL };
+    int regs = func->reg_count > 0 ? func->reg_count : 1;
+    v.def_block = malloc(sizeof(int) * regs);
+    v.def_pos = malloc(sizeof(int) * regs);
+    for (int r = 0; r < regs; r++) v.def_block[r] = -1;
+
+    IRCFG *cfg = ir_cfg_build(func);
+
+    // Operand shapes, single definitions, labels
+    int pos = 0;
+    int block = 0;
+    for (IRInstruction *instr = func->instructions; instr; instr = instr->next, pos++) {
+        verify_shape(&v, pos, instr);
+        if (instr->opcode != IR_LABEL && instr->opcode != IR_JUMP &&
+            instr->opcode != IR_JUMP_IF && instr->opcode != IR_JUMP_IF_NOT) {
+            verify_operand(&v, pos, instr, instr->dest, "dest");
+        }
+        verify_operand(&v, pos, instr, instr->src1, "src1");
+        verify_operand(&v, pos, instr, instr->src2, "src2");
+        for (int i = 0; i < instr->arg_count; i++) {
+            verify_operand(&v, pos, instr, instr->args[i], "arg");
+        }
+
+        if (instr->opcode == IR_LABEL && instr->dest && instr->dest->data.label) {
+            for (IRInstruction *o = instr->next; o; o = o->next) {
+                if (o->opcode == IR_LABEL && o->dest &&
+                    strcmp(o->dest->data.label, instr->dest->data.label) == 0) {
+                    verify_fail(&v, pos, instr, "label %s defined twice", instr->dest->data.label);
+                    break;
+                }
+            }
+        }
+        if ((instr->opcode == IR_JUMP || instr->opcode == IR_JUMP_IF ||
+             instr->opcode == IR_JUMP_IF_NOT) && instr->dest && instr->dest->data.label &&
+            !verify_label_defined(func, instr->dest->data.label)) {
+            verify_fail(&v, pos, instr, "jump to undefined label %s", instr->dest->data.label);
+        }
+
+        if (instr->dest && instr->dest->kind == IR_VAL_REG) {
+            int r = instr->dest->data.reg_num;
+            if (r >= 0 && r < func->reg_count) {
+                if (v.def_block[r] >= 0) {
+                    verify_fail(&v, pos, instr, "register %%%d defined more than once", r);
+                }
+                v.def_block[r] = block;
+                v.def_pos[r] = pos;
+            }
+        }
+        if (block < cfg->block_count && instr == cfg->blocks[block].last) block++;
+    }
+
+    // Def-before-use along every path
+    pos = 0;
+    block = 0;
+    for (IRInstruction *instr = func->instructions; instr && v.ok; instr = instr->next, pos++) {
+        verify_use(&v, cfg, block, pos, instr, instr->src1);
+        verify_use(&v, cfg, block, pos, instr, instr->src2);
+        for (int i = 0; i < instr->arg_count; i++) {
+            verify_use(&v, cfg, block, pos, instr, instr->args[i]);
+        }
+        if (block < cfg->block_count && instr == cfg->blocks[block].last) block++;
+    }
+
+    ir_cfg_free(cfg);
+    free(v.def_block);
+    free(v.def_pos);
+    return v.ok;
+}
+
+bool ir_verify_module(IRModule *module, const char *stage) {
+    bool ok = true;
+    char msg[256];
+    for (IRFunction *func = module->functions; func; func = func->next) {
+        if (!ir_verify_function(func, msg, sizeof(msg))) {
+            fprintf(stderr, "Error: IR verification failed after %s: %s\n", stage, msg);
+            ok = false;
+        }
+    }
+    return ok;
+}
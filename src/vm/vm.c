@@ -0,0 +1,425 @@
+/* ========================================
+   SUB Language - Bytecode Interpreter
+   Threaded dispatch over register bytecode
+   File: vm.c
+   ======================================== */
+
+#include "vm.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Register stack limit in slots (512 MiB) */
+#define VM_STACK_LIMIT ((size_t)1 << 26)
+
+typedef struct {
+    const VMFunction *func;
+    const VMInsn *pc;          // The CALL to resume after
+    size_t base;               // Caller's first register
+} VMFrame;
+
+static const char *vm_opcode_names[VM_OPCODE_COUNT] = {
+#define VM_OPCODE_NAME(name, summary) #name,
+    VM_OPCODES(VM_OPCODE_NAME)
+#undef VM_OPCODE_NAME
+};
+
+static const char *vm_opcode_summaries[VM_OPCODE_COUNT] = {
+#define VM_OPCODE_SUMMARY(name, summary) summary,
+    VM_OPCODES(VM_OPCODE_SUMMARY)
+#undef VM_OPCODE_SUMMARY
+};
+
+static const char *vm_native_names[VM_NATIVE_COUNT] = {
+#define VM_NATIVE_NAME(name, label) label,
+    VM_NATIVES(VM_NATIVE_NAME)
+#undef VM_NATIVE_NAME
+};
+
+static int64_t vm_mulhi(int64_t x, int64_t y) {
+#ifdef __SIZEOF_INT128__
+    return (int64_t)(((__int128)x * (__int128)y) >> 64);
+#else
+    uint64_t ux = (uint64_t)x, uy = (uint64_t)y;
+    uint64_t lo = (ux & 0xffffffffu) * (uy & 0xffffffffu);
+    uint64_t m1 = (ux >> 32) * (uy & 0xffffffffu) + (lo >> 32);
+    uint64_t m2 = (ux & 0xffffffffu) * (uy >> 32) + (m1 & 0xffffffffu);
+    uint64_t hi = (ux >> 32) * (uy >> 32) + (m1 >> 32) + (m2 >> 32);
+    if (x < 0) hi -= uy;
+    if (y < 0) hi -= ux;
+    return (int64_t)hi;
+#endif
+}
+
+/* Grow the register stack to hold `needed` slots */
+static int64_t* vm_grow_stack(int64_t *stack, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return stack;
+    if (needed > VM_STACK_LIMIT) return NULL;
+    size_t grown = *capacity;
+    while (grown < needed) grown *= 2;
+    if (grown > VM_STACK_LIMIT) grown = VM_STACK_LIMIT;
+    int64_t *resized = realloc(stack, grown * sizeof(int64_t));
+    if (!resized) return NULL;
+    memset(resized + *capacity, 0, (grown - *capacity) * sizeof(int64_t));
+    *capacity = grown;
+    return resized;
+}
+
+/* ---------- Runtime routines ---------- */
+
+/* Strings and growable arrays in the native layout: strings are bytes
+   (and a NUL) after their length, heap arrays hold their capacity and
+   length before the elements. One-character strings come from a table. */
+static int64_t vm_chars[256][2];
+
+static int64_t vm_length(int64_t value) {
+    return ((const int64_t *)(intptr_t)value)[-1];
+}
+
+static int64_t vm_char(unsigned char c) {
+    vm_chars[c][0] = 1;
+    vm_chars[c][1] = c;
+    return (int64_t)(intptr_t)&vm_chars[c][1];
+}
+
+/* String of `length` bytes copied from `a` then `b`; 0 when out of memory */
+static int64_t vm_str_join(const char *a, int64_t a_length, const char *b, int64_t b_length) {
+    int64_t *block = malloc(sizeof(int64_t) + (size_t)(a_length + b_length) + 1);
+    if (!block) return 0;
+    block[0] = a_length + b_length;
+    char *text = (char *)(block + 1);
+    memcpy(text, a, (size_t)a_length);
+    memcpy(text + a_length, b, (size_t)b_length);
+    text[a_length + b_length] = '\0';
+    return (int64_t)(intptr_t)text;
+}
+
+/* Result of routine `routine` on x (and y); *error is set on failure */
+static int64_t vm_native(VMNative routine, int64_t x, int64_t y, const char **error) {
+    const char *a = (const char *)(intptr_t)x, *b = (const char *)(intptr_t)y;
+    switch (routine) {
+        case VM_NATIVE_PRINT_STR:
+            fwrite(a, 1, (size_t)vm_length(x), stdout);
+            putchar('\n');
+            return 0;
+        case VM_NATIVE_STR_CONCAT: {
+            if (vm_length(y) == 0) return x;
+            if (vm_length(x) == 0) return y;
+            int64_t joined = vm_str_join(a, vm_length(x), b, vm_length(y));
+            if (!joined) *error = "out of memory";
+            return joined;
+        }
+        case VM_NATIVE_STR_EQUAL:
+            return vm_length(x) == vm_length(y) && memcmp(a, b, (size_t)vm_length(x)) == 0;
+        case VM_NATIVE_STR_COMPARE: {
+            int64_t shorter = vm_length(x) < vm_length(y) ? vm_length(x) : vm_length(y);
+            int order = memcmp(a, b, (size_t)shorter);
+            return order ? order : vm_length(x) - vm_length(y);
+        }
+        case VM_NATIVE_STR_AT:
+            if ((uint64_t)y >= (uint64_t)vm_length(x)) {
+                *error = "string index out of range";
+                return 0;
+            }
+            return vm_char((unsigned char)a[y]);
+        case VM_NATIVE_STR_FROM_INT: {
+            if (x >= 0 && x < 10) return vm_char((unsigned char)('0' + x));
+            char text[24];
+            int length = snprintf(text, sizeof(text), "%" PRId64, x);
+            int64_t string = vm_str_join(text, length, "", 0);
+            if (!string) *error = "out of memory";
+            return string;
+        }
+        case VM_NATIVE_ARRAY_APPEND: {
+            int64_t *array = (int64_t *)(intptr_t)x;
+            int64_t count = array[-1];
+            if (count < array[-2]) {
+                array[count] = y;
+                array[-1] = count + 1;
+                return x;
+            }
+            int64_t capacity = count * 2 > 4 ? count * 2 : 4;
+            int64_t *block = calloc((size_t)capacity + 2, sizeof(int64_t));
+            if (!block) {
+                *error = "out of memory";
+                return 0;
+            }
+            block[0] = capacity;
+            block[1] = count + 1;
+            memcpy(block + 2, array, sizeof(int64_t) * (size_t)count);
+            block[2 + count] = y;
+            return (int64_t)(intptr_t)(block + 2);
+        }
+        default:
+            *error = "invalid runtime routine";
+            return 0;
+    }
+}
+
+int64_t vm_run(const VMProgram *program, bool *ok) {
+    size_t capacity = 1 << 16;
+    int64_t *stack = calloc(capacity, sizeof(int64_t));
+    int frame_capacity = 256, depth = 0;
+    VMFrame *frames = malloc(sizeof(VMFrame) * frame_capacity);
+    int64_t *staging = malloc(sizeof(int64_t) * ((size_t)program->max_call_args + 1));
+    const char *error = NULL;
+    int64_t result = 0;
+
+    const VMFunction *func = &program->functions[program->main_index];
+    size_t base = 0;
+    int64_t *R = stack;
+    const VMInsn *code = func->code;
+    const VMInsn *pc = code;
+    if (!stack || !frames || !staging) {
+        error = "out of memory";
+        goto fail;
+    }
+    {
+        int64_t *grown = vm_grow_stack(stack, &capacity, (size_t)func->register_count);
+        if (!grown) {
+            error = "stack overflow";
+            goto fail;
+        }
+        stack = grown;
+        R = stack;
+    }
+
+/* Handlers are shared between threaded code (GCC/Clang labels as
+   values: every handler ends in its own indirect jump) and a portable
+   switch loop */
+#if defined(__GNUC__)
+    static void *const dispatch[VM_OPCODE_COUNT] = {
+#define VM_DISPATCH_ENTRY(name, summary) [VM_##name] = &&op_##name,
+        VM_OPCODES(VM_DISPATCH_ENTRY)
+#undef VM_DISPATCH_ENTRY
+    };
+#define CASE(name) op_##name:
+#define DISPATCH() goto *dispatch[pc->op]
+#define SWITCH_BEGIN DISPATCH();
+#define SWITCH_END
+#else
+#define CASE(name) case VM_##name:
+#define DISPATCH() goto dispatch_switch
+#define SWITCH_BEGIN dispatch_switch: switch (pc->op) {
+#define SWITCH_END default: error = "invalid opcode"; goto fail; }
+#endif
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+#define JUMP(target) do { pc = code + (target); DISPATCH(); } while (0)
+#define RAISE(message) do { error = (message); goto fail; } while (0)
+
+#define VM_BINARY(name, check, expr)                                        \
+    CASE(name) { int64_t x = R[pc->b], y = R[pc->c]; check; R[pc->a] = (expr); NEXT(); } \
+    CASE(name##K) { int64_t x = R[pc->b], y = pc->k; check; R[pc->a] = (expr); NEXT(); }
+#define VM_BRANCH(name, cmp)                                                \
+    CASE(name) { if (R[pc->b] cmp R[pc->c]) JUMP(pc->j.target); NEXT(); } \
+    CASE(name##K) { if (R[pc->b] cmp (int64_t)pc->j.imm) JUMP(pc->j.target); NEXT(); }
+#define VM_NO_CHECK (void)0
+#define VM_DIVISOR_CHECK if (y == 0) RAISE("division by zero")
+
+    SWITCH_BEGIN
+
+    CASE(MOV) { R[pc->a] = R[pc->b]; NEXT(); }
+    CASE(LOADK) { R[pc->a] = pc->k; NEXT(); }
+
+    VM_BINARY(ADD, VM_NO_CHECK, (int64_t)((uint64_t)x + (uint64_t)y))
+    VM_BINARY(SUB, VM_NO_CHECK, (int64_t)((uint64_t)x - (uint64_t)y))
+    VM_BINARY(MUL, VM_NO_CHECK, (int64_t)((uint64_t)x * (uint64_t)y))
+    VM_BINARY(DIV, VM_DIVISOR_CHECK, y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y)
+    VM_BINARY(MOD, VM_DIVISOR_CHECK, y == -1 ? 0 : x % y)
+    VM_BINARY(AND, VM_NO_CHECK, x & y)
+    VM_BINARY(OR, VM_NO_CHECK, x | y)
+    VM_BINARY(SHL, VM_NO_CHECK, (int64_t)((uint64_t)x << (y & 63)))
+    VM_BINARY(SHR, VM_NO_CHECK, (int64_t)((uint64_t)x >> (y & 63)))
+    VM_BINARY(SAR, VM_NO_CHECK, x < 0 ? ~(~x >> (y & 63)) : x >> (y & 63))
+    VM_BINARY(MULHI, VM_NO_CHECK, vm_mulhi(x, y))
+    VM_BINARY(EQ, VM_NO_CHECK, x == y)
+    VM_BINARY(NE, VM_NO_CHECK, x != y)
+    VM_BINARY(LT, VM_NO_CHECK, x < y)
+    VM_BINARY(LE, VM_NO_CHECK, x <= y)
+    VM_BINARY(GT, VM_NO_CHECK, x > y)
+    VM_BINARY(GE, VM_NO_CHECK, x >= y)
+
+    CASE(NOT) { R[pc->a] = !R[pc->b]; NEXT(); }
+
+    CASE(JMP) { JUMP(pc->j.target); }
+    CASE(JZ) { if (!R[pc->b]) JUMP(pc->j.target); NEXT(); }
+    CASE(JNZ) { if (R[pc->b]) JUMP(pc->j.target); NEXT(); }
+    VM_BRANCH(JEQ, ==)
+    VM_BRANCH(JNE, !=)
+    VM_BRANCH(JLT, <)
+    VM_BRANCH(JLE, <=)
+    VM_BRANCH(JGT, >)
+    VM_BRANCH(JGE, >=)
+
+    // Arrays: the length word sits just before the elements, as in native code
+    CASE(NEWARR) {
+        int64_t n = R[pc->b];
+        if (n < 0) RAISE("negative array size");
+        int64_t *block = calloc((size_t)n + 2, sizeof(int64_t));
+        if (!block) RAISE("out of memory");
+        block[0] = n;
+        block[1] = n;
+        R[pc->a] = (int64_t)(intptr_t)(block + 2);
+        NEXT();
+    }
+    CASE(LEN) {
+        const int64_t *array = (const int64_t *)(intptr_t)R[pc->b];
+        if (!array) RAISE("array used before assignment");
+        R[pc->a] = array[-1];
+        NEXT();
+    }
+    CASE(LDE) {
+        const int64_t *array = (const int64_t *)(intptr_t)R[pc->b];
+        uint64_t i = (uint64_t)R[pc->c];
+        if (!array || i >= (uint64_t)array[-1]) RAISE("array index out of range");
+        R[pc->a] = array[i];
+        NEXT();
+    }
+    CASE(STE) {
+        int64_t *array = (int64_t *)(intptr_t)R[pc->b];
+        uint64_t i = (uint64_t)R[pc->c];
+        if (!array || i >= (uint64_t)array[-1]) RAISE("array index out of range");
+        array[i] = R[pc->a];
+        NEXT();
+    }
+    CASE(LDEU) {
+        R[pc->a] = ((const int64_t *)(intptr_t)R[pc->b])[R[pc->c]];
+        NEXT();
+    }
+    CASE(STEU) {
+        ((int64_t *)(intptr_t)R[pc->b])[R[pc->c]] = R[pc->a];
+        NEXT();
+    }
+
+    CASE(PRINT) { printf("%" PRId64 "\n", R[pc->b]); NEXT(); }
+    CASE(PRINTS) { puts(program->strings[pc->k]); NEXT(); }
+
+    CASE(CALL) {
+        const VMFunction *callee = &program->functions[pc->b];
+        size_t callee_base = base + (size_t)func->register_count;
+        if (callee_base + (size_t)callee->register_count > capacity) {
+            int64_t *grown = vm_grow_stack(stack, &capacity, callee_base + (size_t)callee->register_count);
+            if (!grown) RAISE("stack overflow");
+            stack = grown;
+            R = stack + base;
+        }
+        if (depth == frame_capacity) {
+            VMFrame *more = realloc(frames, sizeof(VMFrame) * (size_t)frame_capacity * 2);
+            if (!more) RAISE("stack overflow");
+            frames = more;
+            frame_capacity *= 2;
+        }
+        int64_t *callee_R = stack + callee_base;
+        const uint16_t *args = func->args + pc->k;
+        for (int i = 0; i < pc->c; i++) callee_R[i] = R[args[i]];
+        frames[depth++] = (VMFrame){ func, pc, base };
+        func = callee;
+        base = callee_base;
+        R = callee_R;
+        code = func->code;
+        pc = code;
+        DISPATCH();
+    }
+    CASE(TCALL) {
+        const VMFunction *callee = &program->functions[pc->b];
+        const uint16_t *args = func->args + pc->k;
+        int count = pc->c;
+        for (int i = 0; i < count; i++) staging[i] = R[args[i]];
+        if (base + (size_t)callee->register_count > capacity) {
+            int64_t *grown = vm_grow_stack(stack, &capacity, base + (size_t)callee->register_count);
+            if (!grown) RAISE("stack overflow");
+            stack = grown;
+            R = stack + base;
+        }
+        memcpy(R, staging, sizeof(int64_t) * (size_t)count);
+        func = callee;
+        code = func->code;
+        pc = code;
+        DISPATCH();
+    }
+    CASE(NATIVE) {
+        const uint16_t *args = func->args + pc->k;
+        int64_t value = vm_native((VMNative)pc->b, R[args[0]], pc->c > 1 ? R[args[1]] : 0, &error);
+        if (error) goto fail;
+        R[pc->a] = value;
+        NEXT();
+    }
+    CASE(RET) { result = R[pc->b]; goto do_return; }
+    CASE(RETK) { result = pc->k; goto do_return; }
+
+    SWITCH_END
+
+do_return:
+    if (depth > 0) {
+        const VMFrame *frame = &frames[--depth];
+        func = frame->func;
+        base = frame->base;
+        R = stack + base;
+        code = func->code;
+        pc = frame->pc;
+        R[pc->a] = result;
+        NEXT();
+    }
+    *ok = true;
+    free(stack);
+    free(frames);
+    free(staging);
+    return result;
+
+fail:
+    // Native code reports its run-time checks with the same line
+    fprintf(stderr, "Runtime error: %s\n", error);
+    *ok = false;
+    free(stack);
+    free(frames);
+    free(staging);
+    return 0;
+
+#undef CASE
+#undef DISPATCH
+#undef SWITCH_BEGIN
+#undef SWITCH_END
+#undef NEXT
+#undef JUMP
+#undef RAISE
+#undef VM_BINARY
+#undef VM_BRANCH
+#undef VM_NO_CHECK
+#undef VM_DIVISOR_CHECK
+}
+
+/* ---------- Listing ---------- */
+
+static bool vm_has_immediate(VMOpcode op) {
+    if (op == VM_LOADK || op == VM_RETK || op == VM_PRINTS) return true;
+    return op >= VM_ADDK && op <= VM_GEK && (op - VM_ADD) % 2 == 1;
+}
+
+static bool vm_is_branch(VMOpcode op) {
+    return op >= VM_JMP && op <= VM_JGEK;
+}
+
+void vm_dump(const VMProgram *program, FILE *out) {
+    for (int f = 0; f < program->function_count; f++) {
+        const VMFunction *func = &program->functions[f];
+        fprintf(out, "function %s: %d params, %d registers, %d instructions\n",
+                func->name, func->param_count, func->register_count, func->code_count);
+        for (int i = 0; i < func->code_count; i++) {
+            const VMInsn *insn = &func->code[i];
+            VMOpcode op = (VMOpcode)insn->op;
+            fprintf(out, "  %4d  %-7s a=%-3u b=%-3u c=%-3u", i, vm_opcode_names[op], insn->a, insn->b, insn->c);
+            if (vm_is_branch(op)) {
+                fprintf(out, " -> %d", insn->j.target);
+                if (op >= VM_JEQ && (op - VM_JEQ) % 2 == 1) fprintf(out, " imm=%d", insn->j.imm);
+            } else if (vm_has_immediate(op)) {
+                fprintf(out, " k=%" PRId64, insn->k);
+            } else if (op == VM_CALL || op == VM_TCALL || op == VM_NATIVE) {
+                fprintf(out, " (%s", op == VM_NATIVE ? vm_native_names[insn->b] : program->functions[insn->b].name);
+                for (int a = 0; a < insn->c; a++) fprintf(out, "%s r%u", a ? "," : "", func->args[insn->k + a]);
+                fprintf(out, ")");
+            }
+            fprintf(out, "   ; %s\n", vm_opcode_summaries[op]);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+/* ========================================
+   SUB Language - Bytecode Virtual Machine
+   Register-based bytecode compiled from the IR, and its interpreter
+   File: vm.h
+   ======================================== */
+
+#ifndef SUB_VM_H
+#define SUB_VM_H
+
+#include "ir.h"
+#include <stdio.h>
+
+/*
+ * Every function runs in a frame of 64-bit registers: IR local i is
+ * register i, virtual register r is register local_count + r, and a few
+ * scratch registers follow for constants that have no immediate form.
+ *
+ * Instructions are three-address over frame registers. Most binary
+ * operations and compare-and-branch pairs also have a K form taking an
+ * immediate in place of the last register operand. The compiler folds
+ * common pairs into one instruction:
+ *   - a load of a local feeds its users directly (load+add -> add),
+ *   - a result stored straight to a local is computed into it,
+ *   - a compare that only feeds a branch becomes a conditional jump.
+ */
+
+/* X(name, operand summary) */
+#define VM_OPCODES(X)                                           \
+    X(MOV,    "a <- b")                                         \
+    X(LOADK,  "a <- k")                                         \
+    X(ADD,    "a <- b + c")     X(ADDK,   "a <- b + k")         \
+    X(SUB,    "a <- b - c")     X(SUBK,   "a <- b - k")         \
+    X(MUL,    "a <- b * c")     X(MULK,   "a <- b * k")         \
+    X(DIV,    "a <- b / c")     X(DIVK,   "a <- b / k")         \
+    X(MOD,    "a <- b % c")     X(MODK,   "a <- b % k")         \
+    X(AND,    "a <- b & c")     X(ANDK,   "a <- b & k")         \
+    X(OR,     "a <- b | c")     X(ORK,    "a <- b | k")         \
+    X(SHL,    "a <- b << c")    X(SHLK,   "a <- b << k")        \
+    X(SHR,    "a <- b >>> c")   X(SHRK,   "a <- b >>> k")       \
+    X(SAR,    "a <- b >> c")    X(SARK,   "a <- b >> k")        \
+    X(MULHI,  "a <- hi(b * c)") X(MULHIK, "a <- hi(b * k)")     \
+    X(EQ,     "a <- b == c")    X(EQK,    "a <- b == k")        \
+    X(NE,     "a <- b != c")    X(NEK,    "a <- b != k")        \
+    X(LT,     "a <- b < c")     X(LTK,    "a <- b < k")         \
+    X(LE,     "a <- b <= c")    X(LEK,    "a <- b <= k")        \
+    X(GT,     "a <- b > c")     X(GTK,    "a <- b > k")         \
+    X(GE,     "a <- b >= c")    X(GEK,    "a <- b >= k")        \
+    X(NOT,    "a <- !b")                                        \
+    X(JMP,    "goto target")                                    \
+    X(JZ,     "if !b goto target")                              \
+    X(JNZ,    "if b goto target")                               \
+    X(JEQ,    "if b == c goto")  X(JEQK,  "if b == imm goto")   \
+    X(JNE,    "if b != c goto")  X(JNEK,  "if b != imm goto")   \
+    X(JLT,    "if b < c goto")   X(JLTK,  "if b < imm goto")    \
+    X(JLE,    "if b <= c goto")  X(JLEK,  "if b <= imm goto")   \
+    X(JGT,    "if b > c goto")   X(JGTK,  "if b > imm goto")    \
+    X(JGE,    "if b >= c goto")  X(JGEK,  "if b >= imm goto")   \
+    X(NEWARR, "a <- array(b)")                                  \
+    X(LEN,    "a <- len(b)")                                    \
+    X(LDE,    "a <- b[c]")                                      \
+    X(STE,    "b[c] <- a")                                      \
+    X(LDEU,   "a <- b[c], index proven in range")               \
+    X(STEU,   "b[c] <- a, index proven in range")               \
+    X(PRINT,  "print b")                                        \
+    X(PRINTS, "print string k")                                 \
+    X(CALL,   "a <- func b (c args at k)")                      \
+    X(TCALL,  "tail call func b (c args at k)")                 \
+    X(NATIVE, "a <- runtime routine b (c args at k)")           \
+    X(RET,    "return b")                                       \
+    X(RETK,   "return k")
+
+/* Runtime routines behind IR calls to `__sub_` labels: X(name, label).
+   Strings are length-prefixed like arrays; heap arrays also keep their
+   capacity before the length (the native layout, see codegen_x64.c). */
+#define VM_NATIVES(X)                                           \
+    X(PRINT_STR,    "__sub_print_str")                          \
+    X(STR_CONCAT,   "__sub_str_concat")                         \
+    X(STR_EQUAL,    "__sub_str_equal")                          \
+    X(STR_COMPARE,  "__sub_str_compare")                        \
+    X(STR_AT,       "__sub_str_at")                             \
+    X(STR_FROM_INT, "__sub_str_from_int")                       \
+    X(ARRAY_APPEND, "__sub_array_append")
+
+typedef enum {
+#define VM_NATIVE_ENUM(name, label) VM_NATIVE_##name,
+    VM_NATIVES(VM_NATIVE_ENUM)
+#undef VM_NATIVE_ENUM
+    VM_NATIVE_COUNT
+} VMNative;
+
+typedef enum {
+#define VM_OPCODE_ENUM(name, summary) VM_##name,
+    VM_OPCODES(VM_OPCODE_ENUM)
+#undef VM_OPCODE_ENUM
+    VM_OPCODE_COUNT
+} VMOpcode;
+
+/* 16 bytes: opcode, three register operands and an immediate */
+typedef struct {
+    uint16_t op;
+    uint16_t a, b, c;
+    union {
+        int64_t k;             // Immediate, CALL/TCALL/NATIVE argument list offset
+        struct {
+            int32_t target;    // Branch destination (instruction index)
+            int32_t imm;       // Compare-and-branch immediate
+        } j;
+    };
+} VMInsn;
+
+typedef struct {
+    char *name;
+    VMInsn *code;
+    int code_count;
+    int register_count;        // Frame size
+    int param_count;
+    uint16_t *args;            // Argument registers of every call, back to back
+    int arg_count;
+} VMFunction;
+
+typedef struct {
+    VMFunction *functions;
+    int function_count;
+    int main_index;
+    int max_call_args;         // Largest argument list (tail call staging)
+    char **strings;            // PRINTS texts and string constants (length-prefixed)
+    int string_count;
+} VMProgram;
+
+/* Compile an optimized module (no IR_VECTOR_LOOP: build it with
+   vector_width 0). NULL after an "Error:" message on stderr. */
+VMProgram* vm_compile(IRModule *module);
+void vm_program_free(VMProgram *program);
+
+/* Run main; returns its result. Runtime errors (division by zero, index
+   out of range, stack overflow) are reported on stderr and give *ok = false. */
+int64_t vm_run(const VMProgram *program, bool *ok);
+
+/* Bytecode listing */
+void vm_dump(const VMProgram *program, FILE *out);
+
+#endif /* SUB_VM_H */
@@ -0,0 +1,538 @@
+/* ========================================
+   SUB Language - Bytecode Compiler
+   IR functions to register bytecode, with superinstruction folding
+   File: vm_compile.c
+   ======================================== */
+
+#define _GNU_SOURCE
+#include "vm.h"
+#include "windows_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VM_MAX_REGISTERS 65535
+
+typedef struct {
+    const char *name;
+    int index;
+} VMLabel;
+
+typedef struct {
+    int insn;
+    const char *label;
+} VMFixup;
+
+typedef struct {
+    IRModule *module;
+    VMProgram *program;
+    VMFunction *func;
+    IRFunction *ir;
+    int code_capacity;
+    int args_capacity;
+    int scratch_base;          // First scratch register
+    int scratch_used;          // Scratch registers taken by the current instruction
+    int scratch_max;
+    int *use_count;            // Reads of each virtual register
+    int *alias;                // Register a folded load's users read instead (-1: none)
+    VMLabel *labels;
+    int label_count;
+    VMFixup *fixups;
+    int fixup_count;
+    bool failed;
+} VMCompiler;
+
+static void vm_compile_error(VMCompiler *c, const char *message, const char *detail) {
+    if (!c->failed) fprintf(stderr, "Error: %s%s%s in function %s\n", message, detail ? " " : "",
+                            detail ? detail : "", c->ir->name);
+    c->failed = true;
+}
+
+static int vm_emit(VMCompiler *c, VMOpcode op, int a, int b, int cc, int64_t k) {
+    VMFunction *f = c->func;
+    if (f->code_count == c->code_capacity) {
+        c->code_capacity = c->code_capacity ? c->code_capacity * 2 : 64;
+        f->code = realloc(f->code, sizeof(VMInsn) * c->code_capacity);
+    }
+    VMInsn *insn = &f->code[f->code_count];
+    memset(insn, 0, sizeof(VMInsn));
+    insn->op = (uint16_t)op;
+    insn->a = (uint16_t)a;
+    insn->b = (uint16_t)b;
+    insn->c = (uint16_t)cc;
+    insn->k = k;
+    return f->code_count++;
+}
+
+static void vm_emit_jump(VMCompiler *c, VMOpcode op, int b, int cc, int32_t imm, const char *label) {
+    int at = vm_emit(c, op, 0, b, cc, 0);
+    c->func->code[at].j.imm = imm;
+    c->fixups = realloc(c->fixups, sizeof(VMFixup) * (c->fixup_count + 1));
+    c->fixups[c->fixup_count++] = (VMFixup){ at, label };
+}
+
+/* ---------- Operands ---------- */
+
+static bool vm_is_const(const IRValue *v) {
+    return !v || v->kind == IR_VAL_CONST;
+}
+
+static int64_t vm_const(const IRValue *v) {
+    return v ? v->data.int_val : 0;
+}
+
+static bool vm_is_reg(const IRValue *v, int reg) {
+    return v && v->kind == IR_VAL_REG && v->data.reg_num == reg;
+}
+
+static bool vm_fits32(int64_t v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+/* Frame register holding `v`; constants are loaded into scratch */
+static int vm_reg(VMCompiler *c, const IRValue *v) {
+    if (v && v->kind == IR_VAL_VAR) return v->data.reg_num;
+    if (v && v->kind == IR_VAL_REG) {
+        int r = v->data.reg_num;
+        return c->alias[r] >= 0 ? c->alias[r] : c->ir->local_count + r;
+    }
+    int scratch = c->scratch_base + c->scratch_used++;
+    if (c->scratch_used > c->scratch_max) c->scratch_max = c->scratch_used;
+    vm_emit(c, VM_LOADK, scratch, 0, 0, vm_const(v));
+    return scratch;
+}
+
+/* A discarded result (call without dest) */
+static int vm_junk(VMCompiler *c) {
+    if (c->scratch_max == 0) c->scratch_max = 1;
+    return c->scratch_base;
+}
+
+static int vm_uses(const IRInstruction *instr, int reg) {
+    int n = vm_is_reg(instr->src1, reg) + vm_is_reg(instr->src2, reg);
+    for (int i = 0; i < instr->arg_count; i++) n += vm_is_reg(instr->args[i], reg);
+    return n;
+}
+
+static bool vm_ends_block(IROpcode op) {
+    return op == IR_LABEL || op == IR_JUMP || op == IR_JUMP_IF || op == IR_JUMP_IF_NOT ||
+           op == IR_RETURN || op == IR_TAIL_CALL;
+}
+
+/* Load+use: users of a loaded local can read the local itself when every
+   use comes before the local is next written, within the block */
+static bool vm_load_foldable(VMCompiler *c, const IRInstruction *load) {
+    int reg = load->dest->data.reg_num;
+    int slot = load->src1->data.reg_num;
+    int remaining = c->use_count[reg];
+    if (remaining == 0) return true;
+    for (const IRInstruction *p = load->next; p; p = p->next) {
+        remaining -= vm_uses(p, reg);
+        if (remaining <= 0) return true;   // Operands are read before the result is written
+        if (vm_ends_block(p->opcode)) return false;
+        if (p->opcode == IR_STORE && p->dest && p->dest->kind == IR_VAL_VAR && p->dest->data.reg_num == slot) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/* Result+store: compute straight into the local when the result's only
+   use is the store right after it */
+static int vm_dest(VMCompiler *c, const IRInstruction *instr, bool *skip_next) {
+    if (!instr->dest) return vm_junk(c);
+    int reg = instr->dest->data.reg_num;
+    const IRInstruction *next = instr->next;
+    if (next && next->opcode == IR_STORE && vm_is_reg(next->src1, reg) && c->use_count[reg] == 1 &&
+        next->dest && next->dest->kind == IR_VAL_VAR) {
+        *skip_next = true;
+        return next->dest->data.reg_num;
+    }
+    return vm_reg(c, instr->dest);
+}
+
+/* ---------- Opcode tables ---------- */
+
+static VMOpcode vm_binary_op(IROpcode op) {
+    switch (op) {
+        case IR_ADD: return VM_ADD;
+        case IR_SUB: return VM_SUB;
+        case IR_MUL: return VM_MUL;
+        case IR_DIV: return VM_DIV;
+        case IR_MOD: return VM_MOD;
+        case IR_AND: return VM_AND;
+        case IR_OR: return VM_OR;
+        case IR_SHL: return VM_SHL;
+        case IR_SHR: return VM_SHR;
+        case IR_SAR: return VM_SAR;
+        case IR_MULHI: return VM_MULHI;
+        case IR_EQ: return VM_EQ;
+        case IR_NE: return VM_NE;
+        case IR_LT: return VM_LT;
+        case IR_LE: return VM_LE;
+        case IR_GT: return VM_GT;
+        case IR_GE: return VM_GE;
+        default: return VM_OPCODE_COUNT;
+    }
+}
+
+/* Every register-register binary opcode is followed by its K form */
+static VMOpcode vm_k_form(VMOpcode op) {
+    return (VMOpcode)(op + 1);
+}
+
+static bool vm_is_compare(IROpcode op) {
+    return op == IR_EQ || op == IR_NE || op == IR_LT || op == IR_LE || op == IR_GT || op == IR_GE;
+}
+
+static bool vm_commutes(IROpcode op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR || op == IR_MULHI ||
+           op == IR_EQ || op == IR_NE;
+}
+
+/* a OP b == b OP' a */
+static IROpcode vm_swap_compare(IROpcode op) {
+    switch (op) {
+        case IR_LT: return IR_GT;
+        case IR_LE: return IR_GE;
+        case IR_GT: return IR_LT;
+        case IR_GE: return IR_LE;
+        default: return op;
+    }
+}
+
+static IROpcode vm_negate_compare(IROpcode op) {
+    switch (op) {
+        case IR_EQ: return IR_NE;
+        case IR_NE: return IR_EQ;
+        case IR_LT: return IR_GE;
+        case IR_LE: return IR_GT;
+        case IR_GT: return IR_LE;
+        default: return IR_LT;
+    }
+}
+
+static VMOpcode vm_branch_op(IROpcode op) {
+    switch (op) {
+        case IR_EQ: return VM_JEQ;
+        case IR_NE: return VM_JNE;
+        case IR_LT: return VM_JLT;
+        case IR_LE: return VM_JLE;
+        case IR_GT: return VM_JGT;
+        default: return VM_JGE;
+    }
+}
+
+/* ---------- Instructions ---------- */
+
+static void vm_compile_binary(VMCompiler *c, IRInstruction *instr, bool *skip_next) {
+    IROpcode op = instr->opcode;
+    const IRValue *lhs = instr->src1;
+    const IRValue *rhs = instr->src2;
+    if (vm_is_const(lhs) && !vm_is_const(rhs) && (vm_commutes(op) || vm_is_compare(op))) {
+        lhs = instr->src2;
+        rhs = instr->src1;
+        op = vm_swap_compare(op);
+    }
+
+    // Compare+branch: a compare whose only use is the next branch
+    const IRInstruction *next = instr->next;
+    if (vm_is_compare(op) && next && (next->opcode == IR_JUMP_IF || next->opcode == IR_JUMP_IF_NOT) &&
+        vm_is_reg(next->src1, instr->dest->data.reg_num) && c->use_count[instr->dest->data.reg_num] == 1 &&
+        next->dest && next->dest->data.label) {
+        IROpcode cond = next->opcode == IR_JUMP_IF ? op : vm_negate_compare(op);
+        int b = vm_reg(c, lhs);
+        if (vm_is_const(rhs) && vm_fits32(vm_const(rhs))) {
+            vm_emit_jump(c, vm_k_form(vm_branch_op(cond)), b, 0, (int32_t)vm_const(rhs), next->dest->data.label);
+        } else {
+            vm_emit_jump(c, vm_branch_op(cond), b, vm_reg(c, rhs), 0, next->dest->data.label);
+        }
+        *skip_next = true;
+        return;
+    }
+
+    VMOpcode vop = vm_binary_op(op);
+    int b = vm_reg(c, lhs);
+    if (vm_is_const(rhs)) {
+        int64_t k = vm_const(rhs);
+        vm_emit(c, vm_k_form(vop), vm_dest(c, instr, skip_next), b, 0, k);
+    } else {
+        int r = vm_reg(c, rhs);
+        vm_emit(c, vop, vm_dest(c, instr, skip_next), b, r, 0);
+    }
+}
+
+static const char *const vm_native_labels[VM_NATIVE_COUNT] = {
+#define VM_NATIVE_LABEL(name, label) label,
+    VM_NATIVES(VM_NATIVE_LABEL)
+#undef VM_NATIVE_LABEL
+};
+
+/* Copy of `text` after its length, kept by the program; returns its index */
+static int vm_program_string(VMProgram *program, const char *text) {
+    size_t length = strlen(text);
+    int64_t *block = malloc(sizeof(int64_t) + length + 1);
+    block[0] = (int64_t)length;
+    memcpy(block + 1, text, length + 1);
+    program->strings = realloc(program->strings, sizeof(char*) * (program->string_count + 1));
+    program->strings[program->string_count] = (char *)(block + 1);
+    return program->string_count++;
+}
+
+static void vm_compile_call(VMCompiler *c, IRInstruction *instr, bool *skip_next) {
+    const char *name = instr->src1 ? instr->src1->data.label : NULL;
+    int index = 0;
+    IRFunction *callee = c->module->functions;
+    while (callee && (!name || strcmp(callee->name, name) != 0)) {
+        callee = callee->next;
+        index++;
+    }
+    int native = 0;
+    while (!callee && name && native < VM_NATIVE_COUNT && strcmp(vm_native_labels[native], name) != 0) native++;
+    if (!callee && (!name || native == VM_NATIVE_COUNT)) {
+        vm_compile_error(c, "call to undefined function", name ? name : "?");
+        return;
+    }
+
+    // Argument registers first: constants take scratch registers
+    VMFunction *f = c->func;
+    int offset = f->arg_count;
+    if (f->arg_count + instr->arg_count > c->args_capacity) {
+        while (f->arg_count + instr->arg_count > c->args_capacity) {
+            c->args_capacity = c->args_capacity ? c->args_capacity * 2 : 16;
+        }
+        f->args = realloc(f->args, sizeof(uint16_t) * c->args_capacity);
+    }
+    for (int i = 0; i < instr->arg_count; i++) {
+        f->args[f->arg_count++] = (uint16_t)vm_reg(c, instr->args[i]);
+    }
+    if (instr->arg_count > c->program->max_call_args) c->program->max_call_args = instr->arg_count;
+
+    if (!callee) {
+        // Runtime routines return here; a tail call returns their result
+        int dest = instr->opcode == IR_TAIL_CALL ? vm_junk(c) : vm_dest(c, instr, skip_next);
+        vm_emit(c, VM_NATIVE, dest, native, instr->arg_count, offset);
+        if (instr->opcode == IR_TAIL_CALL) vm_emit(c, VM_RET, 0, dest, 0, 0);
+    } else if (instr->opcode == IR_TAIL_CALL) {
+        vm_emit(c, VM_TCALL, 0, index, instr->arg_count, offset);
+    } else {
+        vm_emit(c, VM_CALL, vm_dest(c, instr, skip_next), index, instr->arg_count, offset);
+    }
+}
+
+static void vm_compile_instruction(VMCompiler *c, IRInstruction *instr, bool *skip_next) {
+    switch (instr->opcode) {
+        case IR_ALLOC:
+            break;
+
+        case IR_LOAD:
+            if (vm_load_foldable(c, instr)) {
+                c->alias[instr->dest->data.reg_num] = instr->src1->data.reg_num;
+            } else {
+                vm_emit(c, VM_MOV, vm_reg(c, instr->dest), instr->src1->data.reg_num, 0, 0);
+            }
+            break;
+
+        case IR_STORE:
+        case IR_CONST_INT:
+        case IR_MOVE:
+            if (!instr->dest) break;
+            if (vm_is_const(instr->src1)) {
+                int dest = instr->opcode == IR_STORE ? instr->dest->data.reg_num : vm_dest(c, instr, skip_next);
+                vm_emit(c, VM_LOADK, dest, 0, 0, vm_const(instr->src1));
+            } else {
+                int src = vm_reg(c, instr->src1);
+                int dest = instr->opcode == IR_STORE ? instr->dest->data.reg_num : vm_dest(c, instr, skip_next);
+                if (dest != src) vm_emit(c, VM_MOV, dest, src, 0, 0);
+            }
+            break;
+
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_MOD:
+        case IR_AND: case IR_OR: case IR_SHL: case IR_SHR: case IR_SAR: case IR_MULHI:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            vm_compile_binary(c, instr, skip_next);
+            break;
+
+        case IR_NOT: {
+            int b = vm_reg(c, instr->src1);
+            vm_emit(c, VM_NOT, vm_dest(c, instr, skip_next), b, 0, 0);
+            break;
+        }
+
+        case IR_LABEL:
+            c->labels = realloc(c->labels, sizeof(VMLabel) * (c->label_count + 1));
+            c->labels[c->label_count++] = (VMLabel){ instr->dest->data.label, c->func->code_count };
+            break;
+
+        case IR_JUMP:
+            vm_emit_jump(c, VM_JMP, 0, 0, 0, instr->dest->data.label);
+            break;
+
+        case IR_JUMP_IF:
+        case IR_JUMP_IF_NOT: {
+            bool jump_if = instr->opcode == IR_JUMP_IF;
+            if (vm_is_const(instr->src1)) {
+                if ((vm_const(instr->src1) != 0) == jump_if) vm_emit_jump(c, VM_JMP, 0, 0, 0, instr->dest->data.label);
+                break;
+            }
+            vm_emit_jump(c, jump_if ? VM_JNZ : VM_JZ, vm_reg(c, instr->src1), 0, 0, instr->dest->data.label);
+            break;
+        }
+
+        case IR_ALLOC_ARRAY:
+        case IR_ALLOC_FRAME_ARRAY: {
+            int b = vm_reg(c, instr->src1);
+            vm_emit(c, VM_NEWARR, vm_dest(c, instr, skip_next), b, 0, 0);
+            break;
+        }
+
+        case IR_ARRAY_LEN: {
+            int b = vm_reg(c, instr->src1);
+            vm_emit(c, VM_LEN, vm_dest(c, instr, skip_next), b, 0, 0);
+            break;
+        }
+
+        case IR_LOAD_ELEM: {
+            int b = vm_reg(c, instr->src1);
+            int index = vm_reg(c, instr->src2);
+            vm_emit(c, instr->in_bounds ? VM_LDEU : VM_LDE, vm_dest(c, instr, skip_next), b, index, 0);
+            break;
+        }
+
+        case IR_STORE_ELEM: {
+            int b = vm_reg(c, instr->src1);
+            int index = vm_reg(c, instr->src2);
+            int value = vm_reg(c, instr->arg_count > 0 ? instr->args[0] : NULL);
+            vm_emit(c, instr->in_bounds ? VM_STEU : VM_STE, value, b, index, 0);
+            break;
+        }
+
+        case IR_PRINT:
+            if (instr->src1 && instr->src1->kind == IR_VAL_CONST && instr->src1->type == IR_TYPE_STRING) {
+                vm_emit(c, VM_PRINTS, 0, 0, 0, vm_program_string(c->program, instr->src1->data.string_val));
+                break;
+            }
+            vm_emit(c, VM_PRINT, 0, vm_reg(c, instr->src1), 0, 0);
+            break;
+
+        case IR_CONST_STRING: {
+            int string = vm_program_string(c->program, instr->src1->data.string_val);
+            const char *text = c->program->strings[string];
+            vm_emit(c, VM_LOADK, vm_dest(c, instr, skip_next), 0, 0, (int64_t)(intptr_t)text);
+            break;
+        }
+
+        case IR_CALL:
+        case IR_TAIL_CALL:
+            vm_compile_call(c, instr, skip_next);
+            break;
+
+        case IR_RETURN:
+            if (vm_is_const(instr->src1)) vm_emit(c, VM_RETK, 0, 0, 0, vm_const(instr->src1));
+            else vm_emit(c, VM_RET, 0, vm_reg(c, instr->src1), 0, 0);
+            break;
+
+        default:
+            vm_compile_error(c, "bytecode compiler does not support IR", ir_opcode_name(instr->opcode));
+            break;
+    }
+}
+
+static void vm_compile_function(VMCompiler *c, IRFunction *ir, VMFunction *f) {
+    c->ir = ir;
+    c->func = f;
+    c->code_capacity = 0;
+    c->args_capacity = 0;
+    c->scratch_base = ir->local_count + ir->reg_count;
+    c->scratch_max = 0;
+    c->label_count = 0;
+    c->fixup_count = 0;
+    f->name = strdup(ir->name);
+    f->param_count = ir->param_count;
+
+    c->use_count = calloc((size_t)ir->reg_count + 1, sizeof(int));
+    c->alias = malloc(sizeof(int) * ((size_t)ir->reg_count + 1));
+    for (int r = 0; r <= ir->reg_count; r++) c->alias[r] = -1;
+    for (IRInstruction *in = ir->instructions; in; in = in->next) {
+        const IRValue *operands[2] = { in->src1, in->src2 };
+        for (int k = 0; k < 2; k++) {
+            if (operands[k] && operands[k]->kind == IR_VAL_REG && operands[k]->data.reg_num < ir->reg_count) {
+                c->use_count[operands[k]->data.reg_num]++;
+            }
+        }
+        for (int i = 0; i < in->arg_count; i++) {
+            if (in->args[i] && in->args[i]->kind == IR_VAL_REG && in->args[i]->data.reg_num < ir->reg_count) {
+                c->use_count[in->args[i]->data.reg_num]++;
+            }
+        }
+    }
+
+    for (IRInstruction *in = ir->instructions; in && !c->failed; in = in->next) {
+        bool skip_next = false;
+        c->scratch_used = 0;
+        vm_compile_instruction(c, in, &skip_next);
+        if (skip_next) in = in->next;
+    }
+    // Falling off the end returns 0
+    vm_emit(c, VM_RETK, 0, 0, 0, 0);
+
+    for (int i = 0; i < c->fixup_count && !c->failed; i++) {
+        int l = 0;
+        while (l < c->label_count && strcmp(c->labels[l].name, c->fixups[i].label) != 0) l++;
+        if (l == c->label_count) vm_compile_error(c, "jump to undefined label", c->fixups[i].label);
+        else f->code[c->fixups[i].insn].j.target = c->labels[l].index;
+    }
+
+    f->register_count = ir->local_count + ir->reg_count + c->scratch_max;
+    if (f->register_count > VM_MAX_REGISTERS) vm_compile_error(c, "too many registers", NULL);
+    free(c->use_count);
+    free(c->alias);
+}
+
+VMProgram* vm_compile(IRModule *module) {
+    VMProgram *program = calloc(1, sizeof(VMProgram));
+    VMCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.module = module;
+    c.program = program;
+    program->main_index = -1;
+
+    for (IRFunction *f = module->functions; f; f = f->next) program->function_count++;
+    program->functions = calloc((size_t)program->function_count + 1, sizeof(VMFunction));
+    const char *entry = module->entry_point ? module->entry_point : "main";
+    int index = 0;
+    for (IRFunction *f = module->functions; f && !c.failed; f = f->next, index++) {
+        if (f->local_count + f->reg_count > VM_MAX_REGISTERS) {
+            c.ir = f;
+            vm_compile_error(&c, "too many registers", NULL);
+            break;
+        }
+        vm_compile_function(&c, f, &program->functions[index]);
+        if (strcmp(f->name, entry) == 0) program->main_index = index;
+    }
+    free(c.labels);
+    free(c.fixups);
+
+    if (!c.failed && program->main_index < 0) {
+        fprintf(stderr, "Error: program has no %s function\n", entry);
+        c.failed = true;
+    }
+    if (c.failed) {
+        vm_program_free(program);
+        return NULL;
+    }
+    return program;
+}
+
+void vm_program_free(VMProgram *program) {
+    if (!program) return;
+    for (int i = 0; i < program->function_count; i++) {
+        free(program->functions[i].name);
+        free(program->functions[i].code);
+        free(program->functions[i].args);
+    }
+    free(program->functions);
+    for (int i = 0; i < program->string_count; i++) free(program->strings[i] - sizeof(int64_t));
+    free(program->strings);
+    free(program);
+}
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Run every test program that has an expected output in tests/expected:
+# native code and the bytecode runner, each at -O0 and -O2, must print
+# exactly tests/expected/NAME.out (and NAME.err on stderr, with exit
+# status 1, when that file exists).
+#
+# A test lists the levels it runs at on a line of its own, e.g.
+#   // Levels: -O2
+# and native-only compiler flags with
+#   // Native flags: --static-runtime
+import subprocess
+import os
+import re
+import sys
+import tempfile
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+ROOT_DIR = os.path.dirname(SCRIPT_DIR)
+EXPECTED_DIR = os.path.join(SCRIPT_DIR, "expected")
+
+NATIVE_COMPILER = os.path.join(ROOT_DIR, "subc-native")
+VM_RUNNER = os.path.join(ROOT_DIR, "sub")
+
+LEVELS = ["-O0", "-O2"]
+TIMEOUT = 60
+
+def directive(source, name):
+    match = re.search(r"^// " + name + r": *(.*)$", source, re.MULTILINE)
+    return match.group(1).split() if match else None
+
+def read(path):
+    if not os.path.exists(path):
+        return None
+    with open(path) as f:
+        return f.read()
+
+def run(cmd):
+    try:
+        result = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True, timeout=TIMEOUT)
+        return result.returncode, result.stdout, result.stderr
+    except subprocess.TimeoutExpired:
+        return None, "", "timed out"
+
+def check(label, result, expected_out, expected_err):
+    status, out, err = result
+    want_status = 1 if expected_err is not None else 0
+    if status == want_status and out == expected_out and err == (expected_err or ""):
+        return True
+    print(f"❌ {label}")
+    if status != want_status:
+        print(f"   exit status {status} (want {want_status})")
+    if out != expected_out:
+        print(f"   stdout differs:\n{out}")
+    if err != (expected_err or ""):
+        print(f"   stderr: {err.strip()}")
+    return False
+
+def main():
+    for tool in (NATIVE_COMPILER, VM_RUNNER):
+        if not os.path.exists(tool):
+            print(f"Error: {tool} not found. Run 'make' first.")
+            sys.exit(1)
+
+    names = sorted(f[:-4] for f in os.listdir(EXPECTED_DIR) if f.endswith(".out"))
+    passed = failed = 0
+    with tempfile.TemporaryDirectory() as scratch:
+        binary = os.path.join(scratch, "program")
+        for name in names:
+            test = os.path.join(SCRIPT_DIR, name + ".sb")
+            source = read(test)
+            expected_out = read(os.path.join(EXPECTED_DIR, name + ".out"))
+            expected_err = read(os.path.join(EXPECTED_DIR, name + ".err"))
+            levels = directive(source, "Levels") or LEVELS
+            flags = directive(source, "Native flags") or []
+            ok = True
+            for level in levels:
+                compiled = run([NATIVE_COMPILER, level] + flags + [test, binary])
+                if compiled[0] != 0:
+                    print(f"❌ {name} native {level}: compilation failed\n{compiled[2].strip()}")
+                    ok = False
+                else:
+                    ok &= check(f"{name} native {level}", run([binary]), expected_out, expected_err)
+                ok &= check(f"{name} vm {level}", run([VM_RUNNER, "run", level, test]), expected_out, expected_err)
+            if ok:
+                print(f"✅ {name} ({' '.join(levels)})")
+                passed += 1
+            else:
+                failed += 1
+
+    print(f"\nPrograms: {passed}/{passed + failed} passed.")
+    sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+    main()
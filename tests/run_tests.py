@@ -18,6 +18,7 @@ if not os.path.exists(NATIVE_COMPILER):
 
 TEST_FILE = os.path.join(ROOT_DIR, "examples/comprehensive_test.sb")
 UNIVERSAL_TEST = os.path.join(ROOT_DIR, "examples/universal_test.sb")
+STRING_TEST = os.path.join(ROOT_DIR, "tests/test_transpile_strings.sb")
 
 LANGUAGES = [
     ("python", "test_output.py", ["python3", "test_output.py"]),
@@ -90,7 +91,25 @@ def main():
         
         success_count += 1
 
-    # 2. Test Native Compiler
+    # 2. String literals reach every target as double-quoted literals
+    string_targets = [("c", "output.c"), ("cpp", "output.cpp"), ("python", "output.py"),
+                      ("javascript", "output.js"), ("ruby", "output.rb"), ("java", "SubProgram.java"),
+                      ("rust", "output.rs"), ("swift", "output.swift"), ("kotlin", "output.kt")]
+    expected = ['"hi there"', '"it\'s \\"q\\""']
+    print(f"\n[STRINGS] Transpiling {STRING_TEST}...", end=" ", flush=True)
+    failures = []
+    for lang, output_file in string_targets:
+        success, output = run_command([COMPILER, STRING_TEST, lang])
+        text = open(output_file).read() if success and os.path.exists(output_file) else ""
+        if not all(literal in text for literal in expected) or '""hi' in text or "'hi" in text:
+            failures.append(lang)
+    if failures:
+        print(f"❌ Wrong string literals: {', '.join(failures)}")
+    else:
+        print("✅ Double-quoted in every target")
+        success_count += 1
+
+    # 3. Test Native Compiler
     if os.path.exists(NATIVE_COMPILER):
         print(f"\n[NATIVE] Compiling {UNIVERSAL_TEST}...", end=" ", flush=True)
         cmd = [NATIVE_COMPILER, UNIVERSAL_TEST, "uni_test"]
@@ -105,7 +124,7 @@ def main():
         else:
             print(f"❌ Compilation Failed: {output}")
 
-    total_tasks = len(LANGUAGES) + (1 if os.path.exists(NATIVE_COMPILER) else 0)
+    total_tasks = len(LANGUAGES) + 1 + (1 if os.path.exists(NATIVE_COMPILER) else 0)
     print(f"\nSummary: {success_count}/{total_tasks} tasks passed.")
     
     if success_count == total_tasks: